@@ -2,7 +2,7 @@
 
 _cr_compress_type()
 {
-    COMPREPLY=( $( compgen -W "bz2 gz xz" -- "$2" ) )
+    COMPREPLY=( $( compgen -W "bz2 gz xz zstd" -- "$2" ) )
 }
 
 _cr_checksum_type()
@@ -16,11 +16,11 @@ _cr_createrepo()
 
     case $3 in
         -V|--version|-h|--help|-u|--baseurl|--content|--repo|\
-        -x|--excludes|--changelog-limit|\
-        -q|--quiet|-v|--verbose|--skip-stat)
+        -x|--excludes|--changelog-limit|--watch-delay|\
+        -q|--quiet|-v|--verbose|--skip-stat|--watch)
             return 0
             ;;
-        --update-md-path|-o|--outputdir)
+        --update-md-path|-o|--outputdir|-c|--cachedir)
             COMPREPLY=( $( compgen -d -- "$2" ) )
             return 0
             ;;
@@ -28,11 +28,11 @@ _cr_createrepo()
             COMPREPLY=( $( compgen -f -o plusdirs -X '!*.xml' -- "$2" ) )
             return 0
             ;;
-        -s|--checksum)
+        -s|--checksum|--extra-checksum)
             _cr_checksum_type "$1" "$2"
             return 0
             ;;
-        -i|--pkglist|--read-pkgs-list)
+        -i|--pkglist|--read-pkgs-list|--delta-manifest)
             COMPREPLY=( $( compgen -f -o plusdirs -- "$2" ) )
             return 0
             ;;
@@ -58,17 +58,27 @@ _cr_createrepo()
             _cr_compress_type "$1" "$2"
             return 0
             ;;
+        --checksum-cache)
+            COMPREPLY=( $( compgen -W "none xattr" -- "$2" ) )
+            return 0
+            ;;
+        --read-engine)
+            COMPREPLY=( $( compgen -W "none auto pread io_uring" -- "$2" ) )
+            return 0
+            ;;
     esac
 
     if [[ $2 == -* ]] ; then
         COMPREPLY=( $( compgen -W '--help --version --quiet --verbose
             --excludes --basedir --baseurl --groupfile --checksum
-            --pretty --database --no-database --update --update-md-path
+            --extra-checksum --pretty --database --no-database --sqlite-in-memory
+            --update --update-md-path
             --skip-stat --pkglist --includepkg --outputdir
             --skip-symlinks --changelog-limit --unique-md-filenames
             --simple-md-filenames --retain-old-md --distro --content --repo
             --revision --read-pkgs-list --update --workers --xz
-            --compress-type --keep-all-metadata' -- "$2" ) )
+            --compress-type --keep-all-metadata --cachedir --checksum-cache
+            --read-engine --prefetch --drop-pkgs-cache --delta-manifest --watch --watch-delay' -- "$2" ) )
     else
         COMPREPLY=( $( compgen -d -- "$2" ) )
     fi
@@ -138,6 +148,34 @@ _cr_modifyrepo()
 } &&
 complete -F _cr_modifyrepo -o filenames modifyrepo_c
 
+_cr_sqliterepo()
+{
+    COMPREPLY=()
+
+    case $3 in
+        --version|-h|--help|--xz|--unique-md-filenames|--simple-md-filenames|--sqlite-in-memory|--verbose)
+            return 0
+            ;;
+        --compress-type)
+            _cr_compress_type "" "$2"
+            return 0
+            ;;
+        -s|--checksum)
+            _cr_checksum_type "$1" "$2"
+            return 0
+            ;;
+    esac
+
+    if [[ $2 == -* ]] ; then
+        COMPREPLY=( $( compgen -W '--version --help --compress-type --xz
+            --checksum --unique-md-filenames --simple-md-filenames
+            --sqlite-in-memory --verbose' -- "$2" ) )
+    else
+        COMPREPLY=( $( compgen -d -- "$2" ) )
+    fi
+} &&
+complete -F _cr_sqliterepo -o filenames sqliterepo_c
+
 # Local variables:
 # mode: shell-script
 # sh-basic-offset: 4
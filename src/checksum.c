@@ -30,11 +30,17 @@
 #define MAX_CHECKSUM_NAME_LEN   7
 #define BUFFER_SIZE             2048
 
+#define MULTI_BUFFER_SIZE       (64 * 1024)
+
 struct _cr_ChecksumCtx {
     EVP_MD_CTX      *ctx;
     cr_ChecksumType type;
 };
 
+struct _cr_ChecksumMultiCtx {
+    cr_ChecksumCtx  **ctxs;     // NULL terminated
+};
+
 cr_ChecksumType
 cr_checksum_type(const char *name)
 {
@@ -272,3 +278,144 @@ cr_checksum_final(cr_ChecksumCtx *ctx, GError **err)
 
     return checksum;
 }
+
+cr_ChecksumMultiCtx *
+cr_checksum_multi_new(const cr_ChecksumType *types, GError **err)
+{
+    int count = 0;
+    cr_ChecksumMultiCtx *multi;
+
+    assert(types);
+    assert(!err || *err == NULL);
+
+    while (types[count] != CR_CHECKSUM_UNKNOWN)
+        count++;
+
+    if (!count) {
+        g_set_error(err, CR_CHECKSUM_ERROR, CRE_BADARG,
+                    "No checksum type specified");
+        return NULL;
+    }
+
+    multi = g_malloc0(sizeof(cr_ChecksumMultiCtx));
+    multi->ctxs = g_new0(cr_ChecksumCtx *, count + 1);
+
+    for (int x = 0; x < count; x++) {
+        multi->ctxs[x] = cr_checksum_new(types[x], err);
+        if (!multi->ctxs[x]) {
+            for (int y = 0; y < x; y++)
+                g_free(cr_checksum_final(multi->ctxs[y], NULL));
+            g_free(multi->ctxs);
+            g_free(multi);
+            return NULL;
+        }
+    }
+
+    return multi;
+}
+
+int
+cr_checksum_multi_update(cr_ChecksumMultiCtx *multi,
+                         const void *buf,
+                         size_t len,
+                         GError **err)
+{
+    int rc;
+
+    assert(multi);
+    assert(!err || *err == NULL);
+
+    for (int x = 0; multi->ctxs[x]; x++) {
+        rc = cr_checksum_update(multi->ctxs[x], buf, len, err);
+        if (rc != CRE_OK)
+            return rc;
+    }
+
+    return CRE_OK;
+}
+
+char **
+cr_checksum_multi_final(cr_ChecksumMultiCtx *multi, GError **err)
+{
+    int count = 0;
+    char **checksums;
+    GError *tmp_err = NULL;
+
+    assert(multi);
+    assert(!err || *err == NULL);
+
+    while (multi->ctxs[count])
+        count++;
+
+    checksums = g_new0(char *, count + 1);
+
+    // All contexts have to be finalized (freed) even after an error
+    for (int x = 0; x < count; x++) {
+        if (!tmp_err) {
+            checksums[x] = cr_checksum_final(multi->ctxs[x], &tmp_err);
+        } else {
+            g_free(cr_checksum_final(multi->ctxs[x], NULL));
+        }
+    }
+
+    g_free(multi->ctxs);
+    g_free(multi);
+
+    if (tmp_err) {
+        g_propagate_error(err, tmp_err);
+        g_strfreev(checksums);
+        return NULL;
+    }
+
+    return checksums;
+}
+
+char **
+cr_checksum_file_multi(const char *filename,
+                       const cr_ChecksumType *types,
+                       GError **err)
+{
+    FILE *f;
+    size_t readed;
+    unsigned char *buf;
+    cr_ChecksumMultiCtx *multi;
+    GError *tmp_err = NULL;
+
+    assert(filename);
+    assert(types);
+    assert(!err || *err == NULL);
+
+    multi = cr_checksum_multi_new(types, err);
+    if (!multi)
+        return NULL;
+
+    f = fopen(filename, "rb");
+    if (!f) {
+        g_set_error(err, CR_CHECKSUM_ERROR, CRE_IO,
+                    "Cannot open a file: %s", strerror(errno));
+        g_strfreev(cr_checksum_multi_final(multi, NULL));
+        return NULL;
+    }
+
+    buf = g_malloc(MULTI_BUFFER_SIZE);
+
+    do {
+        readed = fread(buf, 1, MULTI_BUFFER_SIZE, f);
+        cr_checksum_multi_update(multi, buf, readed, &tmp_err);
+    } while (readed == MULTI_BUFFER_SIZE && !tmp_err);
+
+    if (!tmp_err && ferror(f))
+        g_set_error(&tmp_err, CR_CHECKSUM_ERROR, CRE_IO,
+                    "Error while reading a file: %s", strerror(errno));
+
+    g_free(buf);
+    fclose(f);
+
+    if (tmp_err) {
+        g_propagate_error(err, tmp_err);
+        g_strfreev(cr_checksum_multi_final(multi, NULL));
+        return NULL;
+    }
+
+    return cr_checksum_multi_final(multi, err);
+}
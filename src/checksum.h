@@ -33,6 +33,10 @@ extern "C" {
  */
 typedef struct _cr_ChecksumCtx cr_ChecksumCtx;
 
+/** Context computing several checksums over the same data at once.
+ */
+typedef struct _cr_ChecksumMultiCtx cr_ChecksumMultiCtx;
+
 /**
  * Enum of supported checksum types.
  * Note: SHA is just a "nickname" for the SHA1. This
@@ -51,6 +55,24 @@ typedef enum {
     CR_CHECKSUM_SENTINEL,   /*!< sentinel of the list */
 } cr_ChecksumType;
 
+/** Cache of checksums of package files.
+ */
+typedef enum {
+    CR_CHECKSUM_CACHE_NONE,     /*!< checksums are always computed */
+    CR_CHECKSUM_CACHE_XATTR,    /*!< checksums are stored in an extended
+                                     attribute of the package file (e.g.
+                                     "user.createrepo.sha256") together
+                                     with mtime, size and inode of the
+                                     file; only on Linux */
+} cr_ChecksumCacheType;
+
+/** Checksum with its type.
+ */
+typedef struct {
+    char *type;                 /*!< checksum type ("sha512", "md5", ..) */
+    char *checksum;             /*!< checksum */
+} cr_ChecksumValue;
+
 /** Return checksum name.
  * @param type          checksum type
  * @return              constant null terminated string with checksum name
@@ -102,10 +124,53 @@ int cr_checksum_update(cr_ChecksumCtx *ctx,
  */
 char *cr_checksum_final(cr_ChecksumCtx *ctx, GError **err);
 
+/** Compute several checksums of the file in a single read pass.
+ * @param filename      filename
+ * @param types         array of checksum types terminated by
+ *                      CR_CHECKSUM_UNKNOWN
+ * @param err           GError **
+ * @return              NULL terminated array of checksums (in the same
+ *                      order as the types, free it by g_strfreev())
+ *                      or NULL on error
+ */
+char **cr_checksum_file_multi(const char *filename,
+                              const cr_ChecksumType *types,
+                              GError **err);
+
+/** Create new context for several checksums.
+ * @param types     Array of checksum types terminated by
+ *                  CR_CHECKSUM_UNKNOWN (at least one type).
+ * @param err       GError **
+ * @return          cr_ChecksumMultiCtx or NULL on error
+ */
+cr_ChecksumMultiCtx *cr_checksum_multi_new(const cr_ChecksumType *types,
+                                           GError **err);
+
+/** Feeds data into all checksums of the context.
+ * @param ctx       Checksum context.
+ * @param buf       Pointer to the data.
+ * @param len       Length of the data.
+ * @param err       GError **
+ * @return          cr_Error code.
+ */
+int cr_checksum_multi_update(cr_ChecksumMultiCtx *ctx,
+                             const void *buf,
+                             size_t len,
+                             GError **err);
+
+/** Finalize calculation of all checksums and free the context.
+ * @param ctx       Checksum context.
+ * @param err       GError **
+ * @return          NULL terminated array of checksums (in the same order
+ *                  as the types, free it by g_strfreev()) or NULL on
+ *                  error.
+ */
+char **cr_checksum_multi_final(cr_ChecksumMultiCtx *ctx, GError **err);
+
 /** @} */
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif /* __C_CREATEREPOLIB_XML_PARSER_H__ */
+#endif /* __C_CREATEREPOLIB_CHECKSUM_H__ */
@@ -18,10 +18,12 @@
  */
 
 #include <string.h>
+#include <errno.h>
 #include <assert.h>
 #include "cmd_parser.h"
 #include "error.h"
 #include "compression_wrapper.h"
+#include "delta_manifest.h"
 #include "misc.h"
 
 
@@ -29,6 +31,7 @@
 #define DEFAULT_CHECKSUM                "sha256"
 #define DEFAULT_WORKERS                 5
 #define DEFAULT_UNIQUE_MD_FILENAMES     TRUE
+#define DEFAULT_WATCH_DELAY             5
 
 
 struct CmdOptions _cmd_options = {
@@ -37,7 +40,8 @@ struct CmdOptions _cmd_options = {
         .workers             = DEFAULT_WORKERS,
         .unique_md_filenames = DEFAULT_UNIQUE_MD_FILENAMES,
         .checksum_type       = CR_CHECKSUM_SHA256,
-        .compression_type    = CR_CW_UNKNOWN_COMPRESSION
+        .compression_type    = CR_CW_UNKNOWN_COMPRESSION,
+        .watch_delay         = DEFAULT_WATCH_DELAY
     };
 
 
@@ -64,12 +68,25 @@ static GOptionEntry cmd_entries[] =
     { "checksum", 's', 0, G_OPTION_ARG_STRING, &(_cmd_options.checksum),
       "Choose the checksum type used in repomd.xml and for packages in the "
       "metadata. The default is now \"sha256\".", "<checksum_type>" },
+    { "extra-checksum", 0, 0, G_OPTION_ARG_STRING_ARRAY, &(_cmd_options.extra_checksum),
+      "Compute an additional checksum type of packages in the same read as "
+      "the main checksum and publish it in a <checksum_type>sums file "
+      "(in the format of sha256sum and similar tools) listed in the "
+      "repomd.xml. Can be specified multiple times. Packages from the old "
+      "metadata and from the package cache are read again.",
+      "<checksum_type>" },
     { "pretty", 'p', 0, G_OPTION_ARG_NONE, &(_cmd_options.pretty),
       "Make sure all xml generated is formatted (default)", NULL },
     { "database", 'd', 0, G_OPTION_ARG_NONE, &(_cmd_options.database),
       "Generate sqlite databases for use with yum.", NULL },
     { "no-database", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.no_database),
       "Do not generate sqlite databases in the repository.", NULL },
+    { "sqlite-in-memory", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.sqlite_in_memory),
+      "Build the sqlite databases in memory and write them directly into "
+      "the compressed files, so they are not written to the disk and read "
+      "back again. Needs enough memory for all the databases (filelists "
+      "of a large repo could take hundreds of MiB). A database cannot "
+      "grow over 2 GiB in memory.", NULL },
     { "update", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.update),
       "If metadata already exists in the outputdir and an rpm is unchanged "
       "(based on file size and mtime) since the metadata was generated, reuse "
@@ -81,7 +98,7 @@ static GOptionEntry cmd_entries[] =
     { "skip-stat", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.skip_stat),
       "Skip the stat() call on a --update, assumes if the filename is the same "
       "then the file is still the same (only use this if you're fairly "
-      "trusting or gullible).", NULL },
+      "trusting or gullible). The package cache is not used.", NULL },
     { "pkglist", 'i', 0, G_OPTION_ARG_FILENAME, &(_cmd_options.pkglist),
       "Specify a text file which contains the complete list of files to "
       "include in the repository from the set found in the directory. File "
@@ -122,6 +139,46 @@ static GOptionEntry cmd_entries[] =
       "Which compression type to use.", "<compress_type>" },
     { "keep-all-metadata", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.keep_all_metadata),
       "Keep groupfile and updateinfo from source repo during update.", NULL },
+    { "cachedir", 'c', 0, G_OPTION_ARG_FILENAME, &(_cmd_options.cachedir),
+      "Directory for the cache of package metadata. Packages which are "
+      "unchanged since the last run (based on file size, mtime and inode) "
+      "are not read again. Without this option the cache is kept in "
+      "the repodata directory when --update is used.", "CACHEDIR" },
+    { "checksum-cache", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.checksum_cache),
+      "Cache checksums of packages. \"xattr\" - store checksums in extended "
+      "attributes (user.createrepo.<checksum_type>) of the package files "
+      "together with their size, mtime and inode, so unchanged packages "
+      "shared by several repos are hashed only once (Linux only).",
+      "<cache_type>" },
+    { "read-engine", 0, 0, G_OPTION_ARG_STRING, &(_cmd_options.read_engine),
+      "Read packages ahead of the workers with many large reads in flight "
+      "(useful on high-latency storage). \"io_uring\" (if supported), "
+      "\"pread\" (a few reader threads), \"auto\" (io_uring if available, "
+      "pread otherwise) or \"none\" (default). Packages which are found "
+      "in the old metadata or in the cache are read needlessly.",
+      "<engine>" },
+    { "prefetch", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.prefetch),
+      "Ask the kernel to read up to N packages (max 256 MiB) ahead of "
+      "the workers into the page cache (default 0 - no prefetching).",
+      "<N>" },
+    { "drop-pkgs-cache", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.drop_pkgs_cache),
+      "Drop packages from the page cache when they are processed, so "
+      "processing of a huge repo doesn't evict everything else from "
+      "the page cache.", NULL },
+    { "delta-manifest", 0, 0, G_OPTION_ARG_FILENAME, &(_cmd_options.delta_manifest),
+      "Use with --update. Text file with packages changed since the last "
+      "run, one \"A <path>\" (added), \"M <path>\" (modified) or "
+      "\"R <path>\" (removed) per line, paths are relative to the repo "
+      "directory. The directory is not searched and only the added and "
+      "modified packages are read, the others are taken from the old "
+      "metadata as they are.", "<filename>" },
+    { "watch", 0, 0, G_OPTION_ARG_NONE, &(_cmd_options.watch),
+      "Keep running and update the repodata when packages in the directory "
+      "are added, modified or removed. Metadata of the packages are kept "
+      "in memory, only the changed packages are read (Linux only).", NULL },
+    { "watch-delay", 0, 0, G_OPTION_ARG_INT, &(_cmd_options.watch_delay),
+      "Update the repodata when there was no change for this number of "
+      "seconds (default: 5).", "<seconds>" },
     { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
 };
 
@@ -195,6 +252,65 @@ check_arguments(struct CmdOptions *options,
         options->checksum_type = type;
     }
 
+    // Check and set extra checksum types
+    if (options->extra_checksum && options->extra_checksum[0]) {
+        guint len = g_strv_length(options->extra_checksum);
+        options->extra_checksum_types = g_new0(cr_ChecksumType, len + 1);
+        for (guint x = 0; x < len; x++) {
+            cr_ChecksumType type;
+            type = cr_checksum_type(options->extra_checksum[x]);
+            if (type == CR_CHECKSUM_UNKNOWN) {
+                g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                            "Unknown/Unsupported checksum type \"%s\"",
+                            options->extra_checksum[x]);
+                return FALSE;
+            }
+            for (guint y = 0; y < x; y++) {
+                if (options->extra_checksum_types[y] == type) {
+                    g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                                "Extra checksum type \"%s\" is used twice",
+                                options->extra_checksum[x]);
+                    return FALSE;
+                }
+            }
+            options->extra_checksum_types[x] = type;
+        }
+        options->extra_checksum_types[len] = CR_CHECKSUM_UNKNOWN;
+    }
+
+    // Check and set checksum cache type
+    if (options->checksum_cache) {
+        if (!strcmp(options->checksum_cache, "xattr")) {
+            options->checksum_cache_type = CR_CHECKSUM_CACHE_XATTR;
+        } else if (!strcmp(options->checksum_cache, "none")) {
+            options->checksum_cache_type = CR_CHECKSUM_CACHE_NONE;
+        } else {
+            g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                        "Unknown/Unsupported checksum cache type \"%s\"",
+                        options->checksum_cache);
+            return FALSE;
+        }
+    }
+
+    // Check and set read engine backend
+    if (options->read_engine) {
+        options->read_engine_enabled = TRUE;
+        if (!strcmp(options->read_engine, "auto")) {
+            options->read_engine_backend = CR_READENGINE_AUTO;
+        } else if (!strcmp(options->read_engine, "pread")) {
+            options->read_engine_backend = CR_READENGINE_PREAD;
+        } else if (!strcmp(options->read_engine, "io_uring")) {
+            options->read_engine_backend = CR_READENGINE_IO_URING;
+        } else if (!strcmp(options->read_engine, "none")) {
+            options->read_engine_enabled = FALSE;
+        } else {
+            g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                        "Unknown/Unsupported read engine \"%s\"",
+                        options->read_engine);
+            return FALSE;
+        }
+    }
+
     // Check and set compression type
     if (options->compress_type) {
         GString *compress_str = g_string_ascii_down(g_string_new(options->compress_type));
@@ -204,6 +320,15 @@ check_arguments(struct CmdOptions *options,
             options->compression_type = CR_CW_BZ2_COMPRESSION;
         } else if (!strcmp(compress_str->str, "xz")) {
             options->compression_type = CR_CW_XZ_COMPRESSION;
+        } else if (!strcmp(compress_str->str, "zstd")) {
+#ifdef CR_WITH_ZSTD
+            options->compression_type = CR_CW_ZSTD_COMPRESSION;
+#else
+            g_string_free(compress_str, TRUE);
+            g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                        "zstd not supported (built without libzstd)");
+            return FALSE;
+#endif
         } else {
             g_string_free(compress_str, TRUE);
             g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
@@ -217,12 +342,14 @@ check_arguments(struct CmdOptions *options,
     int x;
 
     // Process exclude glob masks
-    x = 0;
-    while (options->excludes && options->excludes[x] != NULL) {
-        GPatternSpec *pattern = g_pattern_spec_new(options->excludes[x]);
-        options->exclude_masks = g_slist_prepend(options->exclude_masks,
-                                                 (gpointer) pattern);
-        x++;
+    if (options->excludes && options->excludes[0] != NULL) {
+        GError *tmp_err = NULL;
+        options->exclude_matcher = cr_exclude_matcher_new(options->excludes,
+                                                          &tmp_err);
+        if (!options->exclude_matcher) {
+            g_propagate_error(err, tmp_err);
+            return FALSE;
+        }
     }
 
     // Process includepkgs
@@ -300,11 +427,78 @@ check_arguments(struct CmdOptions *options,
         x++;
     }
 
+    // Process delta manifest
+    if (options->delta_manifest) {
+        GError *tmp_err = NULL;
+
+        if (!options->update) {
+            g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                        "--delta-manifest can be used only with --update");
+            return FALSE;
+        }
+
+        if (options->include_pkgs || options->l_update_md_paths) {
+            g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                        "--delta-manifest cannot be combined with --pkglist, "
+                        "--includepkg or --update-md-path");
+            return FALSE;
+        }
+
+        if (!cr_delta_manifest_parse(options->delta_manifest,
+                                     &options->changed_pkgs,
+                                     &options->removed_pkgs,
+                                     &tmp_err))
+        {
+            g_propagate_error(err, tmp_err);
+            return FALSE;
+        }
+    }
+
+    // Check watch
+    if (options->watch && options->include_pkgs) {
+        g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                    "--watch cannot be combined with --pkglist "
+                    "or --includepkg");
+        return FALSE;
+    }
+
+    if (options->watch && options->delta_manifest) {
+        g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                    "--watch cannot be combined with --delta-manifest");
+        return FALSE;
+    }
+
+    if (options->watch_delay < 0) {
+        g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                    "Wrong --watch-delay \"%d\"", options->watch_delay);
+        return FALSE;
+    }
+
+    if (options->prefetch < 0) {
+        g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                    "Wrong --prefetch \"%d\"", options->prefetch);
+        return FALSE;
+    }
+
     // Check keep-all-metadata
     if (options->keep_all_metadata && !options->update) {
         g_warning("--keep-all-metadata has no effect (--update is not used)");
     }
 
+    // Check cachedir
+    if (options->cachedir) {
+        gchar *cachedir = cr_normalize_dir_path(options->cachedir);
+        g_free(options->cachedir);
+        options->cachedir = cachedir;
+
+        if (g_mkdir_with_parents(options->cachedir, 0775)) {
+            g_set_error(err, CR_CMD_ERROR, CRE_BADARG,
+                        "Cannot create cachedir \"%s\": %s",
+                        options->cachedir, strerror(errno));
+            return FALSE;
+        }
+    }
+
     // Process --distro tags
     x = 0;
     while (options->distro_tags && options->distro_tags[x]) {
@@ -352,17 +546,24 @@ free_options(struct CmdOptions *options)
     g_free(options->groupfile);
     g_free(options->groupfile_fullpath);
     g_free(options->revision);
+    g_free(options->cachedir);
+    g_free(options->delta_manifest);
+    g_free(options->checksum_cache);
+    g_free(options->read_engine);
 
     g_strfreev(options->excludes);
     g_strfreev(options->includepkg);
     g_strfreev(options->distro_tags);
     g_strfreev(options->content_tags);
     g_strfreev(options->repo_tags);
+    g_strfreev(options->extra_checksum);
 
     cr_slist_free_full(options->include_pkgs, g_free);
-    cr_slist_free_full(options->exclude_masks,
-                      (GDestroyNotify) g_pattern_spec_free);
+    cr_exclude_matcher_free(options->exclude_matcher);
     cr_slist_free_full(options->l_update_md_paths, g_free);
+    cr_slist_free_full(options->changed_pkgs, g_free);
+    cr_slist_free_full(options->removed_pkgs, g_free);
     cr_slist_free_full(options->distro_cpeids, g_free);
     cr_slist_free_full(options->distro_values, g_free);
+    g_free(options->extra_checksum_types);
 }
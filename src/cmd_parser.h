@@ -23,6 +23,8 @@
 #include <glib.h>
 #include "checksum.h"
 #include "compression_wrapper.h"
+#include "dirwalk.h"
+#include "readengine.h"
 
 
 /**
@@ -49,7 +51,9 @@ struct CmdOptions {
     gboolean version;           /*!< print program version */
     gboolean database;          /*!< create sqlite database metadata */
     gboolean no_database;       /*!< do not create database */
+    gboolean sqlite_in_memory;  /*!< build the databases in memory */
     char *checksum;             /*!< type of checksum */
+    char **extra_checksum;      /*!< types of additional checksums */
     char *compress_type;        /*!< which compression type to use */
     gboolean skip_symlinks;     /*!< ignore symlinks of packages */
     int changelog_limit;        /*!< number of changelog messages in
@@ -68,19 +72,43 @@ struct CmdOptions {
     gboolean xz_compression;    /*!< use xz for repodata compression */
     gboolean keep_all_metadata; /*!< keep groupfile and updateinfo from source
                                      repo during update */
+    char *cachedir;             /*!< directory for the package cache */
+    char *checksum_cache;       /*!< type of checksum cache */
+    char *read_engine;          /*!< backend of the read engine */
+    int prefetch;               /*!< number of packages prefetched
+                                     ahead of the workers */
+    gboolean drop_pkgs_cache;   /*!< drop processed packages from
+                                     the page cache */
+    char *delta_manifest;       /*!< file with packages added, modified
+                                     and removed since the last run */
+    gboolean watch;             /*!< keep running and update the repo
+                                     on changes */
+    int watch_delay;            /*!< seconds without changes before
+                                     the repo is updated */
 
     /* Items filled by check_arguments() */
 
     char *groupfile_fullpath;   /*!< full path to groupfile */
-    GSList *exclude_masks;      /*!< list of exclude masks
-                                     (list of GPatternSpec pointers) */
+    cr_ExcludeMatcher *exclude_matcher; /*!< compiled exclude masks
+                                             (NULL if there are none) */
     GSList *include_pkgs;       /*!< list of packages to include (build from
                                      includepkg options and pkglist file) */
     GSList *l_update_md_paths;  /*!< list of repo from update_md_paths
                                      (remote repo are downloaded) */
+    GSList *changed_pkgs;       /*!< added and modified packages from
+                                     the delta manifest */
+    GSList *removed_pkgs;       /*!< removed packages from the delta
+                                     manifest */
     GSList *distro_cpeids;      /*!< CPEIDs from --distro params */
     GSList *distro_values;      /*!< values from --distro params */
     cr_ChecksumType checksum_type;          /*!< checksum type */
+    cr_ChecksumCacheType checksum_cache_type;   /*!< checksum cache type */
+    cr_ChecksumType *extra_checksum_types;  /*!< additional checksum types
+                                                 (terminated by
+                                                 CR_CHECKSUM_UNKNOWN) or
+                                                 NULL */
+    gboolean read_engine_enabled;               /*!< use the read engine */
+    cr_ReadEngineBackend read_engine_backend;   /*!< read engine backend */
     cr_CompressionType compression_type;    /*!< compression type */
 
 };
@@ -17,6 +17,9 @@
  * USA.
  */
 
+#ifdef CR_HAVE_FOPENCOOKIE
+#define _GNU_SOURCE     // fopencookie()
+#endif
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <stdio.h>
@@ -26,12 +29,19 @@
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <zlib.h>
 #include <bzlib.h>
 #include <lzma.h>
+#ifdef CR_WITH_ZSTD
+#include <zstd.h>
+#endif
 #include "logging.h"
 #include "error.h"
 #include "compression_wrapper.h"
+#include "misc.h"
 
 /*
 #define Z_CR_CW_NO_COMPRESSION         0
@@ -51,6 +61,13 @@
 #define GZ_STRATEGY             Z_DEFAULT_STRATEGY
 #define GZ_BUFFER_SIZE          (1024*128)
 
+// Multithreaded gzip compression (pigz-like)
+#define GZ_MT_BLOCK_SIZE        (1024*128)  // Size of independently
+                                            // compressed block
+#define GZ_MT_DICT_SIZE         (1024*32)   // Deflate window size
+#define GZ_MT_JOBS_PER_THREAD   2           // Max blocks in flight
+#define GZ_MT_OS_CODE           0x03        // Unix (the same as zlib uses)
+
 #define BZ2_VERBOSITY           0
 #define BZ2_BLOCKSIZE100K       5  // Higher gives better compression but takes
                                    // more memory
@@ -80,6 +97,18 @@ LZMA_CHECK_SHA256
 #define XZ_DECODER_FLAGS        0
 #define XZ_BUFFER_SIZE          (1024*32)
 
+#ifdef CR_WITH_ZSTD
+/*
+1 (fastest) .. ZSTD_maxCLevel() (19, or 22 with ultra settings)
+Level 10 is still several times faster than xz while giving
+a compression ratio close to it for XML and sqlite metadata.
+*/
+#define CR_CW_ZSTD_COMPRESSION_LEVEL  10
+#endif
+
+// Magic number of a Zstandard frame (little endian)
+#define ZSTD_MAGIC              "\x28\xb5\x2f\xfd"
+
 #if ZLIB_VERNUM < 0x1240
 // XXX: Zlib has gzbuffer since 1.2.4
 #define gzbuffer(a,b) 0
@@ -107,15 +136,617 @@ cr_contentstat_free(cr_ContentStat *cstat, GError **err)
         return;
 
     g_free(cstat->checksum);
+    g_free(cstat->compressed_checksum);
     g_free(cstat);
 }
 
+#ifdef CR_HAVE_FOPENCOOKIE
+/** Output file which checksums the compressed content while it is
+ * written (see output_fopen()).
+ */
+typedef struct {
+    int fd;
+    cr_ChecksumCtx *checksum_ctx;
+    cr_ContentStat *stat;       // Gets the stats when the file is closed
+    gint64 size;                // Number of written bytes
+    gboolean failed;            // Checksum update failed
+} OutputFile;
+#endif
+
+/** Single threaded gzip compression (write mode).
+ * The same what gzwrite() does (a deflate stream with a gzip wrapper),
+ * but the compressed data are written by stdio, so they could go
+ * through an OutputFile.
+ */
+typedef struct {
+    z_stream stream;
+    FILE *file;
+    unsigned char buffer[GZ_BUFFER_SIZE];
+} GzFile;
+
+typedef struct {
+    BZFILE *bzfile;
+    FILE *file;
+} Bz2File;
+
 typedef struct {
     lzma_stream stream;
     FILE *file;
     unsigned char buffer[XZ_BUFFER_SIZE];
 } XzFile;
 
+#ifdef CR_WITH_ZSTD
+typedef struct {
+    FILE *file;
+    ZSTD_CCtx *cctx;            // Compression context (write mode)
+    ZSTD_DCtx *dctx;            // Decompression context (read mode)
+    ZSTD_inBuffer in;           // Compressed input (read mode)
+    gboolean eof;               // End of the input file reached
+    gboolean frame_done;        // The last frame is completely decoded
+    size_t buffer_size;
+    unsigned char *buffer;      // Compressed data
+} ZstdFile;
+#endif
+
+/** Multithreaded gzip compression.
+ * Input is split into blocks of GZ_MT_BLOCK_SIZE which are compressed
+ * by a thread pool as raw deflate streams. Every block is primed with
+ * the last GZ_MT_DICT_SIZE bytes of the previous input (as pigz does),
+ * so the compression ratio is almost the same as with a single thread.
+ * Blocks (except the last one) end with a sync flush, so they are byte
+ * aligned and their concatenation is one valid deflate stream.
+ * The result is a standard single member gzip file.
+ */
+typedef struct {
+    long seq;                   // Sequence number of the block
+    unsigned char *in;          // Uncompressed data
+    size_t in_len;              // Length of uncompressed data
+    unsigned char *dict;        // Dictionary (tail of the previous input)
+    size_t dict_len;            // Length of the dictionary
+    int last;                   // Is this the last block of the stream
+    unsigned char *out;         // Compressed data
+    size_t out_len;             // Length of compressed data
+    uLong crc;                  // CRC32 of the uncompressed data
+    int zerr;                   // zlib error code
+    volatile gint done;         // Is the compression of the block done
+    GMutex *mutex;              // Mutex of the GzMtFile
+    GCond *cond;                // Cond of the GzMtFile
+    int level;                  // Compression level
+} GzMtJob;
+
+typedef struct {
+    FILE *file;                 // Output file
+    GThreadPool *pool;          // Pool of compression threads
+    GMutex *mutex;              // Protects nothing but waiting on the cond
+    GCond *cond;                // Signalized when a job is done
+    GQueue *jobs;               // Jobs in flight (in the order of seq)
+    guint max_jobs;             // Max number of jobs in flight
+    long seq;                   // Sequence number of the next block
+    unsigned char *buf;         // Block being filled by cr_write()
+    size_t buf_len;             // Number of bytes in the buf
+    unsigned char dict[GZ_MT_DICT_SIZE];    // Tail of the input
+    size_t dict_len;            // Number of bytes in the dict
+    uLong crc;                  // CRC32 of all already written data
+    uLong isize;                // Size of the input modulo 2^32
+} GzMtFile;
+
+#ifdef CR_HAVE_FOPENCOOKIE
+static ssize_t
+output_write(void *cookie, const char *buf, size_t size)
+{
+    OutputFile *out = cookie;
+    size_t written = 0;
+    GError *tmp_err = NULL;
+
+    while (written < size) {
+        ssize_t rc = write(out->fd, buf + written, size - written);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc <= 0)
+            break;
+        written += rc;
+    }
+
+    if (written < size)
+        // The file will be incomplete, don't publish its checksum
+        out->failed = TRUE;
+
+    if (cr_checksum_update(out->checksum_ctx, buf, written, &tmp_err)) {
+        g_warning("%s: Cannot checksum compressed content: %s",
+                  __func__, tmp_err->message);
+        g_clear_error(&tmp_err);
+        out->failed = TRUE;
+        errno = EIO;
+        return -1;
+    }
+    out->size += written;
+
+    return written;
+}
+
+static int
+output_close(void *cookie)
+{
+    OutputFile *out = cookie;
+    int ret = close(out->fd);
+    char *checksum = cr_checksum_final(out->checksum_ctx, NULL);
+
+    g_free(out->stat->compressed_checksum);
+    out->stat->compressed_checksum = NULL;
+    if (out->failed || !checksum) {
+        // The checksum doesn't cover the whole content
+        g_free(checksum);
+        errno = EIO;
+        ret = EOF;
+    } else {
+        out->stat->compressed_checksum = checksum;
+        out->stat->compressed_size = out->size;
+    }
+    g_free(out);
+
+    return ret;
+}
+
+/** Open the file for writting. If the stat requests a checksum of
+ * compressed content, all data written to the returned FILE are
+ * checksummed and the stat is filled when the FILE is closed.
+ * Returns NULL and sets errno on error.
+ */
+static FILE *
+output_fopen(const char *filename, cr_ContentStat *stat)
+{
+    cookie_io_functions_t io_funcs = { NULL, output_write,
+                                       NULL, output_close };
+    OutputFile *out;
+    FILE *f;
+    int errsv;
+
+    if (!stat || stat->compressed_checksum_type == CR_CHECKSUM_UNKNOWN)
+        return fopen(filename, "wb");
+
+    out = g_malloc0(sizeof(OutputFile));
+    out->stat = stat;
+    out->checksum_ctx = cr_checksum_new(stat->compressed_checksum_type, NULL);
+    if (!out->checksum_ctx) {
+        g_free(out);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    out->fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (out->fd != -1) {
+        f = fopencookie(out, "wb", io_funcs);
+        if (f)
+            return f;
+    }
+
+    errsv = errno;
+    if (out->fd != -1)
+        close(out->fd);
+    g_free(cr_checksum_final(out->checksum_ctx, NULL));
+    g_free(out);
+    errno = errsv;
+    return NULL;
+}
+#else
+/** Open the file for writting. Without fopencookie() the stats of
+ * compressed content are computed by cr_close() which reads the written
+ * file again (see compressed_stat_fill()).
+ * Returns NULL and sets errno on error.
+ */
+static FILE *
+output_fopen(const char *filename, cr_ContentStat *stat)
+{
+    CR_UNUSED(stat);
+    return fopen(filename, "wb");
+}
+
+/** Fill the stats of compressed content from the closed file.
+ */
+static int
+compressed_stat_fill(const char *filename,
+                     cr_ContentStat *stat,
+                     GError **err)
+{
+    struct stat st;
+    char *checksum;
+
+    if (g_stat(filename, &st) == -1) {
+        g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_IO,
+                    "Cannot stat %s: %s", filename, g_strerror(errno));
+        return CRE_IO;
+    }
+
+    checksum = cr_checksum_file(filename, stat->compressed_checksum_type, err);
+    if (!checksum)
+        return CRE_IO;
+
+    g_free(stat->compressed_checksum);
+    stat->compressed_checksum = checksum;
+    stat->compressed_size = st.st_size;
+
+    return CRE_OK;
+}
+#endif
+
+static GzFile *
+gz_wopen(const char *filename, cr_ContentStat *stat, GError **err)
+{
+    GzFile *gz_file;
+    FILE *f;
+
+    f = output_fopen(filename, stat);
+    if (!f) {
+        g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_GZ,
+                    "fopen(): %s", strerror(errno));
+        return NULL;
+    }
+
+    gz_file = g_malloc0(sizeof(GzFile));
+    if (deflateInit2(&(gz_file->stream), CR_CW_GZ_COMPRESSION_LEVEL,
+                     Z_DEFLATED, MAX_WBITS + 16, 8, GZ_STRATEGY) != Z_OK)
+    {
+        g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_GZ,
+                    "deflateInit2(): %s", gz_file->stream.msg
+                    ? gz_file->stream.msg : "Cannot allocate memory");
+        fclose(f);
+        g_free(gz_file);
+        return NULL;
+    }
+
+    gz_file->file = f;
+    return gz_file;
+}
+
+/** Compress the input of the stream and write out the compressed data.
+ * With Z_FINISH the stream is ended.
+ */
+static int
+gz_deflate(GzFile *gz_file, int flush, GError **err)
+{
+    z_stream *stream = &(gz_file->stream);
+    int rc;
+
+    do {
+        size_t out_len;
+
+        stream->next_out = gz_file->buffer;
+        stream->avail_out = GZ_BUFFER_SIZE;
+
+        rc = deflate(stream, flush);
+        if (rc == Z_STREAM_ERROR) {
+            g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_GZ,
+                        "deflate(): %s", stream->msg
+                        ? stream->msg : "stream error");
+            return CRE_GZ;
+        }
+
+        out_len = GZ_BUFFER_SIZE - stream->avail_out;
+        if (fwrite(gz_file->buffer, 1, out_len, gz_file->file) != out_len) {
+            g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_GZ,
+                        "fwrite(): %s", strerror(errno));
+            return CRE_GZ;
+        }
+    } while (stream->avail_out == 0
+             || (flush == Z_FINISH && rc != Z_STREAM_END));
+
+    return CRE_OK;
+}
+
+static int
+gz_wclose(GzFile *gz_file, GError **err)
+{
+    GError *tmp_err = NULL;
+    int ret;
+
+    ret = gz_deflate(gz_file, Z_FINISH, &tmp_err);
+
+    if (fclose(gz_file->file) != 0 && ret == CRE_OK) {
+        ret = CRE_GZ;
+        g_set_error(&tmp_err, CR_COMPRESSION_WRAPPER_ERROR, CRE_GZ,
+                    "fclose(): %s", strerror(errno));
+    }
+
+    deflateEnd(&(gz_file->stream));
+    g_free(gz_file);
+
+    if (tmp_err)
+        g_propagate_error(err, tmp_err);
+
+    return ret;
+}
+
+static void
+gzmt_compress_block(gpointer data, gpointer user_data)
+{
+    GzMtJob *job = data;
+    z_stream strm;
+    size_t out_size;
+    int rc;
+
+    (void) user_data;
+
+    memset(&strm, 0, sizeof(z_stream));
+    rc = deflateInit2(&strm, job->level, Z_DEFLATED, -MAX_WBITS,
+                      8, GZ_STRATEGY);
+    if (rc != Z_OK)
+        goto done;
+
+    if (job->dict_len) {
+        rc = deflateSetDictionary(&strm, job->dict, job->dict_len);
+        if (rc != Z_OK) {
+            deflateEnd(&strm);
+            goto done;
+        }
+    }
+
+    // deflateBound() doesn't count the sync flush marker
+    out_size = deflateBound(&strm, job->in_len) + 16;
+    job->out = g_malloc(out_size);
+
+    strm.next_in   = job->in;
+    strm.avail_in  = job->in_len;
+    strm.next_out  = job->out;
+    strm.avail_out = out_size;
+
+    while (1) {
+        rc = deflate(&strm, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (rc == Z_STREAM_ERROR)
+            break;
+        if (job->last && rc == Z_STREAM_END) {
+            rc = Z_OK;
+            break;
+        }
+        if (!job->last && strm.avail_in == 0 && strm.avail_out != 0) {
+            rc = Z_OK;
+            break;
+        }
+        if (strm.avail_out == 0) {
+            // Grow the output buffer
+            job->out = g_realloc(job->out, out_size * 2);
+            strm.next_out  = job->out + out_size;
+            strm.avail_out = out_size;
+            out_size *= 2;
+        }
+    }
+
+    job->out_len = out_size - strm.avail_out;
+    job->crc = crc32(crc32(0L, Z_NULL, 0), job->in, job->in_len);
+    deflateEnd(&strm);
+
+done:
+    job->zerr = rc;
+    g_mutex_lock(job->mutex);
+    g_atomic_int_set(&job->done, 1);
+    g_cond_broadcast(job->cond);
+    g_mutex_unlock(job->mutex);
+}
+
+static void
+gzmt_job_free(GzMtJob *job)
+{
+    if (!job)
+        return;
+    g_free(job->in);
+    g_free(job->dict);
+    g_free(job->out);
+    g_free(job);
+}
+
+static GzMtFile *
+gzmt_open(const char *filename,
+          int threads,
+          cr_ContentStat *stat,
+          GError **err)
+{
+    // Gzip header: magic, deflate, no flags, no mtime, no extra flags, OS
+    const unsigned char header[10] = { 0x1f, 0x8b, Z_DEFLATED, 0,
+                                       0, 0, 0, 0, 0, GZ_MT_OS_CODE };
+    GzMtFile *gzmt;
+    FILE *f;
+
+    f = output_fopen(filename, stat);
+    if (!f) {
+        g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_IO,
+                    "fopen(): %s", strerror(errno));
+        return NULL;
+    }
+
+    if (fwrite(header, 1, sizeof(header), f) != sizeof(header)) {
+        g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_IO,
+                    "fwrite(): %s", strerror(errno));
+        fclose(f);
+        return NULL;
+    }
+
+    gzmt = g_malloc0(sizeof(GzMtFile));
+    gzmt->file     = f;
+    gzmt->pool     = g_thread_pool_new(gzmt_compress_block, NULL, threads,
+                                       FALSE, NULL);
+    gzmt->mutex    = g_mutex_new();
+    gzmt->cond     = g_cond_new();
+    gzmt->jobs     = g_queue_new();
+    gzmt->max_jobs = threads * GZ_MT_JOBS_PER_THREAD;
+    gzmt->buf      = g_malloc(GZ_MT_BLOCK_SIZE);
+    gzmt->crc      = crc32(0L, Z_NULL, 0);
+
+    return gzmt;
+}
+
+/** Write compressed blocks which are done (in the proper order).
+ * If wait_all is TRUE, wait for all jobs, otherwise wait only if there
+ * are too many jobs in flight.
+ */
+static int
+gzmt_write_done(GzMtFile *gzmt, gboolean wait_all, GError **err)
+{
+    GzMtJob *job;
+    int ret = CRE_OK;
+
+    while ((job = g_queue_peek_head(gzmt->jobs))) {
+        if (!g_atomic_int_get(&job->done)) {
+            if (!wait_all && g_queue_get_length(gzmt->jobs) < gzmt->max_jobs)
+                break;
+            g_mutex_lock(gzmt->mutex);
+            while (!g_atomic_int_get(&job->done))
+                g_cond_wait(gzmt->cond, gzmt->mutex);
+            g_mutex_unlock(gzmt->mutex);
+        }
+
+        g_queue_pop_head(gzmt->jobs);
+
+        if (ret == CRE_OK && job->zerr != Z_OK) {
+            ret = CRE_GZ;
+            g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_GZ,
+                        "deflate() error (%d)", job->zerr);
+        }
+
+        if (ret == CRE_OK && job->out_len
+            && fwrite(job->out, 1, job->out_len, gzmt->file) != job->out_len)
+        {
+            ret = CRE_IO;
+            g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_IO,
+                        "fwrite(): %s", strerror(errno));
+        }
+
+        gzmt->crc = crc32_combine(gzmt->crc, job->crc, job->in_len);
+        gzmt->isize += job->in_len;
+        gzmt_job_free(job);
+
+        if (ret != CRE_OK && !wait_all)
+            break;
+    }
+
+    return ret;
+}
+
+/** Pass the currently filled block to the compression threads.
+ */
+static int
+gzmt_submit(GzMtFile *gzmt, int last, GError **err)
+{
+    GzMtJob *job = g_malloc0(sizeof(GzMtJob));
+
+    job->seq      = gzmt->seq++;
+    job->in       = gzmt->buf;
+    job->in_len   = gzmt->buf_len;
+    job->last     = last;
+    job->mutex    = gzmt->mutex;
+    job->cond     = gzmt->cond;
+    job->level    = CR_CW_GZ_COMPRESSION_LEVEL;
+    if (gzmt->dict_len) {
+        job->dict     = g_memdup(gzmt->dict, gzmt->dict_len);
+        job->dict_len = gzmt->dict_len;
+    }
+
+    // Update the dictionary for the next block
+    if (job->in_len >= GZ_MT_DICT_SIZE) {
+        memcpy(gzmt->dict, job->in + job->in_len - GZ_MT_DICT_SIZE,
+               GZ_MT_DICT_SIZE);
+        gzmt->dict_len = GZ_MT_DICT_SIZE;
+    } else if (job->in_len) {
+        size_t keep = MIN(gzmt->dict_len, GZ_MT_DICT_SIZE - job->in_len);
+        memmove(gzmt->dict, gzmt->dict + gzmt->dict_len - keep, keep);
+        memcpy(gzmt->dict + keep, job->in, job->in_len);
+        gzmt->dict_len = keep + job->in_len;
+    }
+
+    gzmt->buf     = last ? NULL : g_malloc(GZ_MT_BLOCK_SIZE);
+    gzmt->buf_len = 0;
+
+    g_queue_push_tail(gzmt->jobs, job);
+    g_thread_pool_push(gzmt->pool, job, NULL);
+
+    return gzmt_write_done(gzmt, FALSE, err);
+}
+
+static int
+gzmt_write(GzMtFile *gzmt, const void *buffer, unsigned int len, GError **err)
+{
+    const unsigned char *in = buffer;
+
+    while (len) {
+        size_t chunk = MIN(len, GZ_MT_BLOCK_SIZE - gzmt->buf_len);
+        memcpy(gzmt->buf + gzmt->buf_len, in, chunk);
+        gzmt->buf_len += chunk;
+        in  += chunk;
+        len -= chunk;
+
+        if (gzmt->buf_len == GZ_MT_BLOCK_SIZE) {
+            int rc = gzmt_submit(gzmt, 0, err);
+            if (rc != CRE_OK)
+                return rc;
+        }
+    }
+
+    return CRE_OK;
+}
+
+static int
+gzmt_close(GzMtFile *gzmt, GError **err)
+{
+    unsigned char trailer[8];
+    GError *tmp_err = NULL;
+    int ret;
+
+    // Compress the rest of data as the last block and wait for all jobs
+    ret = gzmt_submit(gzmt, 1, &tmp_err);
+    if (ret == CRE_OK)
+        ret = gzmt_write_done(gzmt, TRUE, &tmp_err);
+    else
+        gzmt_write_done(gzmt, TRUE, NULL);
+
+    if (ret == CRE_OK) {
+        // Gzip trailer: CRC32 and input size, both little endian
+        for (int x = 0; x < 4; x++) {
+            trailer[x]   = (gzmt->crc >> (8 * x)) & 0xff;
+            trailer[x+4] = (gzmt->isize >> (8 * x)) & 0xff;
+        }
+        if (fwrite(trailer, 1, sizeof(trailer), gzmt->file) != sizeof(trailer)) {
+            ret = CRE_IO;
+            g_set_error(&tmp_err, CR_COMPRESSION_WRAPPER_ERROR, CRE_IO,
+                        "fwrite(): %s", strerror(errno));
+        }
+    }
+
+    if (fclose(gzmt->file) != 0 && ret == CRE_OK) {
+        ret = CRE_IO;
+        g_set_error(&tmp_err, CR_COMPRESSION_WRAPPER_ERROR, CRE_IO,
+                    "fclose(): %s", strerror(errno));
+    }
+
+    g_thread_pool_free(gzmt->pool, FALSE, TRUE);
+    g_queue_free(gzmt->jobs);
+    g_cond_free(gzmt->cond);
+    g_mutex_free(gzmt->mutex);
+    g_free(gzmt->buf);
+    g_free(gzmt);
+
+    if (tmp_err)
+        g_propagate_error(err, tmp_err);
+
+    return ret;
+}
+
+/** Check if the file starts with a magic number of a Zstandard frame.
+ */
+static gboolean
+has_zstd_magic(const char *filename)
+{
+    char magic[4];
+    gboolean ret = FALSE;
+    FILE *f = fopen(filename, "rb");
+
+    if (!f)
+        return FALSE;
+
+    if (fread(magic, 1, sizeof(magic), f) == sizeof(magic))
+        ret = !memcmp(magic, ZSTD_MAGIC, sizeof(magic));
+
+    fclose(f);
+    return ret;
+}
+
 cr_CompressionType
 cr_detect_compression(const char *filename, GError **err)
 {
@@ -146,6 +777,10 @@ cr_detect_compression(const char *filename, GError **err)
     } else if (g_str_has_suffix(filename, ".xz"))
     {
         return CR_CW_XZ_COMPRESSION;
+    } else if (g_str_has_suffix(filename, ".zst") ||
+               g_str_has_suffix(filename, ".zstd"))
+    {
+        return CR_CW_ZSTD_COMPRESSION;
     } else if (g_str_has_suffix(filename, ".xml"))
     {
         return CR_CW_NO_COMPRESSION;
@@ -199,6 +834,12 @@ cr_detect_compression(const char *filename, GError **err)
             type = CR_CW_XZ_COMPRESSION;
         }
 
+        else if (g_str_has_prefix(mime_type, "application/zstd") ||
+                 g_str_has_prefix(mime_type, "application/x-zstd"))
+        {
+            type = CR_CW_ZSTD_COMPRESSION;
+        }
+
         else if (g_str_has_prefix(mime_type, "text/plain") ||
                  g_str_has_prefix(mime_type, "text/xml") ||
                  g_str_has_prefix(mime_type, "application/xml") ||
@@ -218,6 +859,12 @@ cr_detect_compression(const char *filename, GError **err)
     }
 
 
+    // Zstd detection (older libmagic doesn't know zstd)
+
+    if (type == CR_CW_UNKNOWN_COMPRESSION && has_zstd_magic(filename))
+        type = CR_CW_ZSTD_COMPRESSION;
+
+
     // Xml detection
 
     if (type == CR_CW_UNKNOWN_COMPRESSION && g_str_has_suffix(filename, ".xml"))
@@ -246,6 +893,8 @@ cr_compression_type(const char *name)
         type = CR_CW_BZ2_COMPRESSION;
     if (!g_strcmp0(name_lower, "xz"))
         type = CR_CW_XZ_COMPRESSION;
+    if (!g_strcmp0(name_lower, "zstd") || !g_strcmp0(name_lower, "zst"))
+        type = CR_CW_ZSTD_COMPRESSION;
 
     g_free(name_lower);
 
@@ -262,6 +911,8 @@ cr_compression_suffix(cr_CompressionType comtype)
             return ".bz2";
         case CR_CW_XZ_COMPRESSION:
             return ".xz";
+        case CR_CW_ZSTD_COMPRESSION:
+            return ".zst";
         default:
             return NULL;
     }
@@ -285,6 +936,18 @@ cr_sopen(const char *filename,
          cr_CompressionType comtype,
          cr_ContentStat *stat,
          GError **err)
+{
+    return cr_sopen_mt(filename, mode, comtype, stat, 1, err);
+}
+
+
+CR_FILE *
+cr_sopen_mt(const char *filename,
+            cr_OpenMode mode,
+            cr_CompressionType comtype,
+            cr_ContentStat *stat,
+            int threads,
+            GError **err)
 {
     CR_FILE *file = NULL;
     cr_CompressionType type = comtype;
@@ -342,21 +1005,38 @@ cr_sopen(const char *filename,
 
     const char *mode_str = (mode == CR_CW_MODE_WRITE) ? "wb" : "rb";
 
+    if (mode != CR_CW_MODE_WRITE || threads < 1)
+        threads = 1;
+
     file = g_malloc0(sizeof(CR_FILE));
     file->mode = mode;
     file->type = type;
+    file->threads = threads;
 
     switch (type) {
 
         case (CR_CW_NO_COMPRESSION): // ---------------------------------------
-            mode_str = (mode == CR_CW_MODE_WRITE) ? "w" : "r";
-            file->FILE = (void *) fopen(filename, mode_str);
+            if (mode == CR_CW_MODE_WRITE)
+                file->FILE = (void *) output_fopen(filename, stat);
+            else
+                file->FILE = (void *) fopen(filename, "r");
             if (!file->FILE)
                 g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_IO,
                             "fopen(): %s", strerror(errno));
             break;
 
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+            if (file->threads > 1) {
+                file->FILE = (void *) gzmt_open(filename, file->threads,
+                                                stat, err);
+                break;
+            }
+
+            if (mode == CR_CW_MODE_WRITE) {
+                file->FILE = (void *) gz_wopen(filename, stat, err);
+                break;
+            }
+
             file->FILE = (void *) gzopen(filename, mode_str);
             if (!file->FILE) {
                 g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_GZ,
@@ -364,11 +1044,6 @@ cr_sopen(const char *filename,
                 break;
             }
 
-            if (mode == CR_CW_MODE_WRITE)
-                gzsetparams((gzFile) file->FILE,
-                            CR_CW_GZ_COMPRESSION_LEVEL,
-                            GZ_STRATEGY);
-
             if (gzbuffer((gzFile) file->FILE, GZ_BUFFER_SIZE) == -1) {
                 g_debug("%s: gzbuffer() call failed", __func__);
                 g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_GZ,
@@ -377,9 +1052,15 @@ cr_sopen(const char *filename,
             break;
 
         case (CR_CW_BZ2_COMPRESSION): { // ------------------------------------
-            FILE *f = fopen(filename, mode_str);
+            FILE *f;
+            BZFILE *bzfile;
             int bzerror;
 
+            if (mode == CR_CW_MODE_WRITE)
+                f = output_fopen(filename, stat);
+            else
+                f = fopen(filename, mode_str);
+
             if (!f) {
                 g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_IO,
                             "fopen(): %s", strerror(errno));
@@ -387,17 +1068,26 @@ cr_sopen(const char *filename,
             }
 
             if (mode == CR_CW_MODE_WRITE) {
-                file->FILE = (void *) BZ2_bzWriteOpen(&bzerror,
-                                                      f,
-                                                      BZ2_BLOCKSIZE100K,
-                                                      BZ2_VERBOSITY,
-                                                      BZ2_WORK_FACTOR);
+                bzfile = BZ2_bzWriteOpen(&bzerror,
+                                         f,
+                                         BZ2_BLOCKSIZE100K,
+                                         BZ2_VERBOSITY,
+                                         BZ2_WORK_FACTOR);
             } else {
-                file->FILE = (void *) BZ2_bzReadOpen(&bzerror,
-                                                     f,
-                                                     BZ2_VERBOSITY,
-                                                     BZ2_USE_LESS_MEMORY,
-                                                     NULL, 0);
+                bzfile = BZ2_bzReadOpen(&bzerror,
+                                        f,
+                                        BZ2_VERBOSITY,
+                                        BZ2_USE_LESS_MEMORY,
+                                        NULL, 0);
+            }
+
+            if (bzerror == BZ_OK) {
+                Bz2File *bz2_file = g_malloc(sizeof(Bz2File));
+                bz2_file->bzfile = bzfile;
+                bz2_file->file = f;
+                file->FILE = (void *) bz2_file;
+            } else {
+                fclose(f);
             }
 
             if (bzerror != BZ_OK) {
@@ -441,7 +1131,28 @@ cr_sopen(const char *filename,
 
             // Prepare coder/decoder
 
-            if (mode == CR_CW_MODE_WRITE)
+            if (mode == CR_CW_MODE_WRITE && file->threads > 1) {
+#if LZMA_VERSION >= UINT32_C(50020002)
+                // Multithreaded encoder (since xz 5.2.0)
+                lzma_mt mt_options;
+                memset(&mt_options, 0, sizeof(lzma_mt));
+                mt_options.flags    = 0;
+                mt_options.threads  = file->threads;
+                mt_options.block_size = 0;  // Default (3 * dictionary size)
+                mt_options.timeout  = 0;
+                mt_options.preset   = CR_CW_XZ_COMPRESSION_LEVEL;
+                mt_options.filters  = NULL;
+                mt_options.check    = XZ_CHECK;
+                ret = lzma_stream_encoder_mt(stream, &mt_options);
+#else
+                g_debug("%s: Multithreaded XZ compression is not supported "
+                        "by this liblzma - using single thread", __func__);
+                file->threads = 1;
+                ret = lzma_easy_encoder(stream,
+                                        CR_CW_XZ_COMPRESSION_LEVEL,
+                                        XZ_CHECK);
+#endif
+            } else if (mode == CR_CW_MODE_WRITE)
                 ret = lzma_easy_encoder(stream,
                                         CR_CW_XZ_COMPRESSION_LEVEL,
                                         XZ_CHECK);
@@ -480,7 +1191,11 @@ cr_sopen(const char *filename,
 
             // Open input/output file
 
-            FILE *f = fopen(filename, mode_str);
+            FILE *f;
+            if (mode == CR_CW_MODE_WRITE)
+                f = output_fopen(filename, stat);
+            else
+                f = fopen(filename, mode_str);
             if (!f) {
                 g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_XZ,
                             "fopen(): %s", strerror(errno));
@@ -494,6 +1209,86 @@ cr_sopen(const char *filename,
             break;
         }
 
+#ifdef CR_WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            size_t rc = 0;
+            ZstdFile *zstd_file = g_malloc0(sizeof(ZstdFile));
+
+            // Prepare coder/decoder
+
+            if (mode == CR_CW_MODE_WRITE) {
+                zstd_file->cctx = ZSTD_createCCtx();
+                zstd_file->buffer_size = ZSTD_CStreamOutSize();
+                if (zstd_file->cctx)
+                    rc = ZSTD_CCtx_setParameter(zstd_file->cctx,
+                                                ZSTD_c_compressionLevel,
+                                                CR_CW_ZSTD_COMPRESSION_LEVEL);
+                if (zstd_file->cctx && !ZSTD_isError(rc)) {
+                    // Protect frames by a checksum (as XZ_CHECK does)
+                    rc = ZSTD_CCtx_setParameter(zstd_file->cctx,
+                                                ZSTD_c_checksumFlag, 1);
+                }
+                if (zstd_file->cctx && !ZSTD_isError(rc)
+                    && file->threads > 1)
+                {
+                    // Multithreaded encoder (libzstd built with
+                    // ZSTD_MULTITHREAD)
+                    size_t mt_rc = ZSTD_CCtx_setParameter(zstd_file->cctx,
+                                                          ZSTD_c_nbWorkers,
+                                                          file->threads);
+                    if (ZSTD_isError(mt_rc)) {
+                        g_debug("%s: Multithreaded Zstd compression is not "
+                                "supported by this libzstd - using single "
+                                "thread", __func__);
+                        file->threads = 1;
+                    }
+                }
+            } else {
+                zstd_file->dctx = ZSTD_createDCtx();
+                zstd_file->buffer_size = ZSTD_DStreamInSize();
+                zstd_file->frame_done = TRUE;
+            }
+
+            if ((!zstd_file->cctx && !zstd_file->dctx) || ZSTD_isError(rc)) {
+                g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_ZSTD,
+                            "Zstd error: %s", ZSTD_isError(rc)
+                            ? ZSTD_getErrorName(rc)
+                            : "Cannot allocate memory");
+                ZSTD_freeCCtx(zstd_file->cctx);
+                ZSTD_freeDCtx(zstd_file->dctx);
+                g_free(zstd_file);
+                break;
+            }
+
+            // Open input/output file
+
+            FILE *f;
+            if (mode == CR_CW_MODE_WRITE)
+                f = output_fopen(filename, stat);
+            else
+                f = fopen(filename, mode_str);
+            if (!f) {
+                g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_ZSTD,
+                            "fopen(): %s", strerror(errno));
+                ZSTD_freeCCtx(zstd_file->cctx);
+                ZSTD_freeDCtx(zstd_file->dctx);
+                g_free(zstd_file);
+                break;
+            }
+
+            zstd_file->file = f;
+            zstd_file->buffer = g_malloc(zstd_file->buffer_size);
+            zstd_file->in.src = zstd_file->buffer;
+            file->FILE = (void *) zstd_file;
+            break;
+        }
+#else
+        case (CR_CW_ZSTD_COMPRESSION): // -------------------------------------
+            g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_ZSTD,
+                        "zstd not supported (built without libzstd)");
+            break;
+#endif
+
         default: // -----------------------------------------------------------
             break;
     }
@@ -510,6 +1305,12 @@ cr_sopen(const char *filename,
     if (stat) {
         file->stat = stat;
 
+#ifndef CR_HAVE_FOPENCOOKIE
+        if (mode == CR_CW_MODE_WRITE
+            && stat->compressed_checksum_type != CR_CHECKSUM_UNKNOWN)
+            file->filename = g_strdup(filename);  // compressed_stat_fill()
+#endif
+
         if (stat->checksum_type == CR_CHECKSUM_UNKNOWN) {
             file->checksum_ctx = NULL;
         } else {
@@ -554,6 +1355,16 @@ cr_close(CR_FILE *cr_file, GError **err)
             break;
 
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
+            if (cr_file->threads > 1) {
+                ret = gzmt_close((GzMtFile *) cr_file->FILE, err);
+                break;
+            }
+
+            if (cr_file->mode == CR_CW_MODE_WRITE) {
+                ret = gz_wclose((GzFile *) cr_file->FILE, err);
+                break;
+            }
+
             rc = gzclose((gzFile) cr_file->FILE);
             if (rc == Z_OK)
                 ret = CRE_OK;
@@ -582,13 +1393,19 @@ cr_close(CR_FILE *cr_file, GError **err)
             }
             break;
 
-        case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
+        case (CR_CW_BZ2_COMPRESSION): { // ------------------------------------
+            Bz2File *bz2_file = (Bz2File *) cr_file->FILE;
+
             if (cr_file->mode == CR_CW_MODE_READ)
-                BZ2_bzReadClose(&rc, (BZFILE *) cr_file->FILE);
+                BZ2_bzReadClose(&rc, bz2_file->bzfile);
             else
-                BZ2_bzWriteClose(&rc, (BZFILE *) cr_file->FILE,
+                BZ2_bzWriteClose(&rc, bz2_file->bzfile,
                                  BZ2_SKIP_FFLUSH, NULL, NULL);
 
+            if (fclose(bz2_file->file) != 0 && rc == BZ_OK)
+                rc = BZ_IO_ERROR;
+            g_free(bz2_file);
+
             if (rc == BZ_OK) {
                 ret = CRE_OK;
             } else {
@@ -611,6 +1428,7 @@ cr_close(CR_FILE *cr_file, GError **err)
                             "Bz2 error: %s", err_msg);
             }
             break;
+        }
 
         case (CR_CW_XZ_COMPRESSION): { // -------------------------------------
             XzFile *xz_file = (XzFile *) cr_file->FILE;
@@ -675,16 +1493,74 @@ cr_close(CR_FILE *cr_file, GError **err)
                         break;
                     }
                 }
+                if (fclose(xz_file->file) != 0 && ret == CRE_OK) {
+                    ret = CRE_XZ;
+                    g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_XZ,
+                                "XZ: fclose(): %s", strerror(errno));
+                }
             } else {
                 ret = CRE_OK;
+                fclose(xz_file->file);
             }
 
-            fclose(xz_file->file);
             lzma_end(stream);
             g_free(stream);
             break;
         }
 
+#ifdef CR_WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            ZstdFile *zstd_file = (ZstdFile *) cr_file->FILE;
+
+            ret = CRE_OK;
+
+            if (cr_file->mode == CR_CW_MODE_WRITE) {
+                // Write out the rest of data and end the frame
+                ZSTD_inBuffer in = { NULL, 0, 0 };
+                size_t zrc;
+
+                do {
+                    ZSTD_outBuffer out = { zstd_file->buffer,
+                                           zstd_file->buffer_size, 0 };
+
+                    zrc = ZSTD_compressStream2(zstd_file->cctx, &out, &in,
+                                               ZSTD_e_end);
+                    if (ZSTD_isError(zrc)) {
+                        ret = CRE_ZSTD;
+                        g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR,
+                                    CRE_ZSTD, "Zstd: ZSTD_compressStream2() "
+                                    "error: %s", ZSTD_getErrorName(zrc));
+                        break;
+                    }
+
+                    if (fwrite(zstd_file->buffer, 1, out.pos,
+                               zstd_file->file) != out.pos)
+                    {
+                        ret = CRE_ZSTD;
+                        g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR,
+                                    CRE_ZSTD, "Zstd: fwrite(): %s",
+                                    strerror(errno));
+                        break;
+                    }
+                } while (zrc != 0);
+
+                if (fclose(zstd_file->file) != 0 && ret == CRE_OK) {
+                    ret = CRE_ZSTD;
+                    g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_ZSTD,
+                                "Zstd: fclose(): %s", strerror(errno));
+                }
+            } else {
+                fclose(zstd_file->file);
+            }
+
+            ZSTD_freeCCtx(zstd_file->cctx);
+            ZSTD_freeDCtx(zstd_file->dctx);
+            g_free(zstd_file->buffer);
+            g_free(zstd_file);
+            break;
+        }
+#endif
+
         default: // -----------------------------------------------------------
             ret = CRE_BADARG;
             g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_BADARG,
@@ -701,6 +1577,26 @@ cr_close(CR_FILE *cr_file, GError **err)
             cr_file->stat->checksum = NULL;
     }
 
+#ifndef CR_HAVE_FOPENCOOKIE
+    if (cr_file->filename) {
+        g_free(cr_file->stat->compressed_checksum);
+        cr_file->stat->compressed_checksum = NULL;
+        if (ret == CRE_OK)
+            ret = compressed_stat_fill(cr_file->filename, cr_file->stat, err);
+        g_free(cr_file->filename);
+    }
+#endif
+
+    if (ret == CRE_OK && cr_file->stat
+        && cr_file->mode == CR_CW_MODE_WRITE
+        && cr_file->stat->compressed_checksum_type != CR_CHECKSUM_UNKNOWN
+        && !cr_file->stat->compressed_checksum)
+    {
+        ret = CRE_IO;
+        g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_IO,
+                    "Checksum of the compressed content is not available");
+    }
+
     g_free(cr_file);
 
     assert(!err || (ret != CRE_OK && *err != NULL)
@@ -748,7 +1644,8 @@ cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
             break;
 
         case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
-            ret = BZ2_bzRead(&bzerror, (BZFILE *) cr_file->FILE, buffer, len);
+            ret = BZ2_bzRead(&bzerror, ((Bz2File *) cr_file->FILE)->bzfile,
+                             buffer, len);
             if (!ret && bzerror == BZ_SEQUENCE_ERROR)
                 // Next read after BZ_STREAM_END (EOF)
                 return 0;
@@ -885,6 +1782,62 @@ cr_read(CR_FILE *cr_file, void *buffer, unsigned int len, GError **err)
             break;
         }
 
+#ifdef CR_WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            ZstdFile *zstd_file = (ZstdFile *) cr_file->FILE;
+            ZSTD_inBuffer *in = &(zstd_file->in);
+            ZSTD_outBuffer out = { buffer, len, 0 };
+
+            while (out.pos < out.size) {
+                size_t prev_pos = out.pos;
+                size_t zrc;
+
+                // Fill input buffer
+                if (in->pos == in->size && !zstd_file->eof) {
+                    size_t rlen = fread(zstd_file->buffer, 1,
+                                        zstd_file->buffer_size,
+                                        zstd_file->file);
+                    if (rlen == 0 && ferror(zstd_file->file)) {
+                        g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR,
+                                    CRE_ZSTD, "Zstd: fread(): %s",
+                                    strerror(errno));
+                        return CR_CW_ERR;   // Error while reading input file
+                    }
+                    zstd_file->eof = (rlen == 0);
+                    in->size = rlen;
+                    in->pos = 0;
+                }
+
+                if (in->pos == in->size && zstd_file->eof
+                    && zstd_file->frame_done)
+                    break;  // EOF
+
+                // Decode (the input could contain several frames)
+                zrc = ZSTD_decompressStream(zstd_file->dctx, &out, in);
+                if (ZSTD_isError(zrc)) {
+                    g_debug("%s: Zstd: Error while decoding: %s",
+                            __func__, ZSTD_getErrorName(zrc));
+                    g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_ZSTD,
+                                "Zstd: Error while decoding: %s",
+                                ZSTD_getErrorName(zrc));
+                    return CR_CW_ERR;  // Error while decoding
+                }
+                zstd_file->frame_done = (zrc == 0);
+
+                if (in->pos == in->size && zstd_file->eof
+                    && out.pos == prev_pos && !zstd_file->frame_done)
+                {
+                    g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_ZSTD,
+                                "Zstd: Compressed file is truncated");
+                    return CR_CW_ERR;
+                }
+            }
+
+            ret = out.pos;
+            break;
+        }
+#endif
+
         default: // -----------------------------------------------------------
             ret = CR_CW_ERR;
             g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_BADARG,
@@ -944,15 +1897,26 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
                 break;
             }
 
-            if ((ret = gzwrite((gzFile) cr_file->FILE, buffer, len)) == 0) {
-                ret = CR_CW_ERR;
-                g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_GZ,
-                    "gzwrite(): %s", cr_gz_strerror((gzFile) cr_file->FILE));
+            if (cr_file->threads > 1) {
+                if (gzmt_write((GzMtFile *) cr_file->FILE, buffer, len, err))
+                    ret = CR_CW_ERR;
+                else
+                    ret = len;
+                break;
             }
+
+            GzFile *gz_file = (GzFile *) cr_file->FILE;
+            gz_file->stream.next_in = (Bytef *) buffer;
+            gz_file->stream.avail_in = len;
+            if (gz_deflate(gz_file, Z_NO_FLUSH, err))
+                ret = CR_CW_ERR;
+            else
+                ret = len;
             break;
 
         case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
-            BZ2_bzWrite(&bzerror, (BZFILE *) cr_file->FILE, (void *) buffer, len);
+            BZ2_bzWrite(&bzerror, ((Bz2File *) cr_file->FILE)->bzfile,
+                        (void *) buffer, len);
             if (bzerror == BZ_OK) {
                 ret = len;
             } else {
@@ -1040,6 +2004,40 @@ cr_write(CR_FILE *cr_file, const void *buffer, unsigned int len, GError **err)
             break;
         }
 
+#ifdef CR_WITH_ZSTD
+        case (CR_CW_ZSTD_COMPRESSION): { // -----------------------------------
+            ZstdFile *zstd_file = (ZstdFile *) cr_file->FILE;
+            ZSTD_inBuffer in = { buffer, len, 0 };
+
+            ret = len;
+
+            while (in.pos < in.size) {
+                ZSTD_outBuffer out = { zstd_file->buffer,
+                                       zstd_file->buffer_size, 0 };
+                size_t zrc = ZSTD_compressStream2(zstd_file->cctx, &out, &in,
+                                                  ZSTD_e_continue);
+                if (ZSTD_isError(zrc)) {
+                    ret = CR_CW_ERR;
+                    g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_ZSTD,
+                                "Zstd: ZSTD_compressStream2() error: %s",
+                                ZSTD_getErrorName(zrc));
+                    break;   // Error while coding
+                }
+
+                if (fwrite(zstd_file->buffer, 1, out.pos,
+                           zstd_file->file) != out.pos)
+                {
+                    ret = CR_CW_ERR;
+                    g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_ZSTD,
+                                "Zstd: fwrite(): %s", strerror(errno));
+                    break;   // Error while writing
+                }
+            }
+
+            break;
+        }
+#endif
+
         default: // -----------------------------------------------------------
             g_set_error(err, CR_COMPRESSION_WRAPPER_ERROR, CRE_BADARG,
                         "Bad compressed file type");
@@ -1078,6 +2076,7 @@ cr_puts(CR_FILE *cr_file, const char *str, GError **err)
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
         case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
         case (CR_CW_XZ_COMPRESSION): // ---------------------------------------
+        case (CR_CW_ZSTD_COMPRESSION): // -------------------------------------
             len = strlen(str);
             ret = cr_write(cr_file, str, len, err);
             if (ret != (int) len)
@@ -1139,6 +2138,7 @@ cr_printf(GError **err, CR_FILE *cr_file, const char *format, ...)
         case (CR_CW_GZ_COMPRESSION): // ---------------------------------------
         case (CR_CW_BZ2_COMPRESSION): // --------------------------------------
         case (CR_CW_XZ_COMPRESSION): // ---------------------------------------
+        case (CR_CW_ZSTD_COMPRESSION): // -------------------------------------
             tmp_ret = cr_write(cr_file, buf, ret, err);
             if (tmp_ret != (int) ret)
                 ret = CR_CW_ERR;
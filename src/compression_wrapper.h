@@ -40,6 +40,7 @@ typedef enum {
     CR_CW_GZ_COMPRESSION,             /*!< Gzip compression */
     CR_CW_BZ2_COMPRESSION,            /*!< BZip2 compression */
     CR_CW_XZ_COMPRESSION,             /*!< XZ compression */
+    CR_CW_ZSTD_COMPRESSION,           /*!< Zstandard compression */
     CR_CW_COMPRESSION_SENTINEL,       /*!< Sentinel of the list */
 } cr_CompressionType;
 
@@ -52,11 +53,21 @@ typedef enum {
 } cr_OpenMode;
 
 /** Stat build about open content during compression (writting).
+ * If compressed_checksum_type is set, stats of the compressed content
+ * (the file itself) are computed too, from the data as they are written,
+ * so the file doesn't have to be read again to get its checksum.
  */
 typedef struct {
     gint64          size;           /*!< Size of content */
     cr_ChecksumType checksum_type;  /*!< Checksum type */
     char            *checksum;      /*!< Checksum */
+    gint64          compressed_size; /*!< Size of compressed content */
+    cr_ChecksumType compressed_checksum_type; /*!< Checksum type of
+                                         compressed content
+                                         (CR_CHECKSUM_UNKNOWN - default -
+                                         means no checksum calculation) */
+    char            *compressed_checksum; /*!< Checksum of compressed
+                                         content */
 } cr_ContentStat;
 
 /** Creates new cr_ContentStat object
@@ -81,6 +92,10 @@ typedef struct {
     cr_OpenMode         mode;           /*!< Mode */
     cr_ContentStat      *stat;          /*!< Content stats */
     cr_ChecksumCtx      *checksum_ctx;  /*!< Checksum contenxt */
+    int                 threads;        /*!< Number of compression threads */
+    char                *filename;      /*!< Name of the file, set only if
+                                             the stats of compressed content
+                                             are computed on close */
 } CR_FILE;
 
 #define CR_CW_ERR       -1      /*!< Return value - Error */
@@ -116,7 +131,8 @@ cr_CompressionType cr_compression_type(const char *name);
 
 /** Open/Create the specified file. If opened for writting, you can pass
  * a cr_ContentStat object and after cr_close() get stats of
- * an open content (stats of uncompressed content).
+ * an open content (stats of uncompressed content) and, if requested by
+ * its compressed_checksum_type, stats of compressed content.
  * @param filename      filename
  * @param mode          open mode
  * @param comtype       type of compression
@@ -130,6 +146,30 @@ CR_FILE *cr_sopen(const char *filename,
                   cr_ContentStat *stat,
                   GError **err);
 
+/** Open/Create the specified file as cr_sopen() does, but if the file
+ * is opened for writting, compress it using multiple threads.
+ * Gzip output is a standard single member gzip file compressed
+ * blockwise in parallel (like pigz does), XZ and Zstandard use
+ * the multithreaded encoders of liblzma and libzstd (if available).
+ * Other compression types and the read mode ignore the threads argument.
+ * Stats (cr_ContentStat) of the open content are the same as with
+ * a single thread.
+ * Note: If threads > 1, the GLib thread system must be initialized.
+ * @param filename      filename
+ * @param mode          open mode
+ * @param comtype       type of compression
+ * @param stat          pointer to cr_ContentStat or NULL
+ * @param threads       number of compression threads (1 = no threads)
+ * @param err           GError **
+ * @return              pointer to a CR_FILE or NULL
+ */
+CR_FILE *cr_sopen_mt(const char *filename,
+                     cr_OpenMode mode,
+                     cr_CompressionType comtype,
+                     cr_ContentStat *stat,
+                     int threads,
+                     GError **err);
+
 /** Reads an array of len bytes from the CR_FILE.
  * @param cr_file       CR_FILE pointer
  * @param buffer        target buffer
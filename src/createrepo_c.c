@@ -28,15 +28,21 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include "cmd_parser.h"
 #include "compression_wrapper.h"
 #include "checksum.h"
+#include "delta_manifest.h"
 #include "error.h"
 #include "load_metadata.h"
 #include "locate_metadata.h"
 #include "misc.h"
 #include "parsepkg.h"
+#include "pkgcache.h"
+#include "prefetch.h"
+#include "readengine.h"
 #include "repomd.h"
+#include "repowatch.h"
 #include "sqlite.h"
 #include "threads.h"
 #include "version.h"
@@ -45,7 +51,14 @@
 
 
 #define G_LOG_DOMAIN        ((gchar*) 0)
-#define MAX_TASK_BUFFER_LEN 20
+#define MIN_REORDER_RING_LEN        20
+#define REORDER_RING_LEN_PER_WORKER 4
+#define PKGCACHE_FILENAME           ".pkgcache" // Cache in the repodata dir
+#define PKGCACHE_SUFFIX             ".pkgcache" // Cache in the --cachedir
+#define TASK_SORT_PARALLEL_MIN      16384   // Min tasks for parallel sort
+#define TASK_SORT_MAX_CHUNKS        16      // Max threads for the sort
+#define MAX_EARLY_TASKS             4096    // Max tasks processed during
+                                            // the directory walk
 
 
 struct UserData {
@@ -62,27 +75,32 @@ struct UserData {
                                     //       This part     |<----->|
     const char *checksum_type_str;  // Name of selected checksum
     cr_ChecksumType checksum_type;  // Constant representing selected checksum
+    const cr_ChecksumType *extra_checksums; // Additional checksum types
+                                    // (terminated by CR_CHECKSUM_UNKNOWN)
+                                    // or NULL
     gboolean skip_symlinks;         // Skip symlinks
     long package_count;             // Total number of packages to process
 
     // Update stuff
     gboolean skip_stat;             // Skip stat() while updating
     cr_Metadata *old_metadata;      // Loaded metadata
+    cr_PkgCache *pkgcache;          // Package cache from the previous run
+    cr_PkgCacheWriter *pkgcache_writer; // Package cache for the next run
+
+    // Read engine and prefetcher
+    cr_ReadEngine *read_engine;     // Reads packages ahead of workers or NULL
+    cr_Prefetcher *prefetcher;      // Prefetches packages into the page
+                                    // cache ahead of workers or NULL
 
     // Thread serialization
-    GMutex *mutex_pri;              // Mutex for primary metadata
-    GMutex *mutex_fil;              // Mutex for filelists metadata
-    GMutex *mutex_oth;              // Mutex for other metadata
-    GCond *cond_pri;                // Condition for primary metadata
-    GCond *cond_fil;                // Condition for filelists metadata
-    GCond *cond_oth;                // Condition for other metadata
-    volatile long id_pri;           // ID of task on turn (write primary metadata)
-    volatile long id_fil;           // ID of task on turn (write filelists metadata)
-    volatile long id_oth;           // ID of task on turn (write other metadata)
-
-    // Buffering
-    GQueue *buffer;                 // Buffer for done tasks
-    GMutex *mutex_buffer;           // Mutex for accessing the buffer
+    cr_ReorderRing *ring;           // Done tasks waiting for writers
+    GMutex *early_mutex;            // Protects results of early tasks
+    GCond *early_cond;              // Signalled when an early task is done
+
+    // Watch stuff
+    gboolean keep_packages;         // Keep packages for the next run
+    GMutex *kept_mutex;             // Protects kept_tasks
+    GPtrArray *kept_tasks;          // Written tasks with kept packages
 };
 
 
@@ -91,11 +109,21 @@ struct PoolTask {
     char* full_path;                // Complete path - /foo/bar/packages/foo.rpm
     char* filename;                 // Just filename - foo.rpm
     char* path;                     // Just path     - /foo/bar/packages
+    cr_Package *md;                 // Unchanged package from the old
+                                    // metadata (--delta-manifest) or NULL
+    gboolean early;                 // Pushed into the pool during the walk,
+                                    // before its position was known
+    gboolean done;                  // Early task was processed
+    struct BufferedTask *result;    // Result of the early task
+    gboolean read_ahead;            // Package is read by the read engine
+    long read_id;                   // Index of the package in the engine
+    gboolean prefetch;              // Package is added to the prefetcher
+    long prefetch_id;               // Index of the package in the prefetcher
+    gboolean pkg_read;              // Package file was read by the worker
 };
 
 
 struct BufferedTask {
-    long id;                        // ID of the task
     struct cr_XmlStruct res;        // XML for primary, filelists and other
     cr_Package *pkg;                // Package structure
     char *location_href;            // location_href path
@@ -103,6 +131,21 @@ struct BufferedTask {
                                     // old metadata and must not be freed!
                                     // If false - package is from file and
                                     // it must be freed!
+    int res_from_md;                // If true - XML is the raw XML from
+                                    // old metadata and must not be freed!
+};
+
+
+struct WriterData {
+    struct UserData *udata;         // User data shared with workers
+    const char *name;               // Name of the metadata (for messages)
+    cr_XmlFile *xml_f;              // Opened compressed xml file or NULL
+    cr_SqliteDb *db;                // Database or NULL
+    cr_XmlFileType type;            // Which chunk of cr_XmlStruct to write
+    GThread *thread;                // The writer thread
+    FILE **sums_f;                  // Opened checksum manifests (one per
+                                    // extra checksum type, NULL terminated)
+                                    // or NULL
 };
 
 
@@ -126,117 +169,250 @@ int
 allowed_file(const gchar *filename, struct CmdOptions *options)
 {
     // Check file against exclude glob masks
-    if (options->exclude_masks) {
-        int str_len = strlen(filename);
-        gchar *reversed_filename = g_utf8_strreverse(filename, str_len);
-
-        GSList *element = options->exclude_masks;
-        for (; element; element=g_slist_next(element)) {
-            if (g_pattern_match((GPatternSpec *) element->data,
-                                str_len, filename, reversed_filename))
-            {
-                g_free(reversed_filename);
-                g_debug("Exclude masks hit - skipping: %s", filename);
-                return FALSE;
-            }
-        }
-        g_free(reversed_filename);
+    if (cr_exclude_matcher_match(options->exclude_matcher, filename)) {
+        g_debug("Exclude masks hit - skipping: %s", filename);
+        return FALSE;
     }
     return TRUE;
 }
 
 
-gint
-buf_task_sort_func(gconstpointer a, gconstpointer b, gpointer data)
+void
+buffered_task_free(struct BufferedTask *buf_task)
 {
-    CR_UNUSED(data);
-    const struct BufferedTask *task_a = a;
-    const struct BufferedTask *task_b = b;
-    if (task_a->id < task_b->id)  return -1;
-    if (task_a->id == task_b->id) return 0;
-    return 1;
+    if (!buf_task)
+        return;
+
+    if (!buf_task->pkg_from_md)
+        cr_package_free(buf_task->pkg);
+    if (!buf_task->res_from_md) {
+        g_free(buf_task->res.primary);
+        g_free(buf_task->res.filelists);
+        g_free(buf_task->res.other);
+    }
+    g_free(buf_task->location_href);
+    g_free(buf_task);
 }
 
 
 void
-write_pkg(long id,
-          struct cr_XmlStruct res,
-          cr_Package *pkg,
-          struct UserData *udata)
+pool_task_free(struct PoolTask *task)
 {
-    GError *tmp_err = NULL;
+    g_free(task->full_path);
+    g_free(task->filename);
+    g_free(task->path);
+    g_free(task);
+}
 
-    // Write primary data
-    g_mutex_lock(udata->mutex_pri);
-    while (udata->id_pri != id)
-        g_cond_wait (udata->cond_pri, udata->mutex_pri);
-    ++udata->id_pri;
-    cr_xmlfile_add_chunk(udata->pri_f, (const char *) res.primary, &tmp_err);
-    if (tmp_err) {
-        g_critical("Cannot add primary chunk:\n%s\nError: %s",
-                   res.primary, tmp_err->message);
-        g_clear_error(&tmp_err);
+
+// Pass the result of a task to the writers. Position of an early task
+// in the metadata is not known yet, its result is kept in the task
+// and main thread passes it to the writers later.
+static void
+task_done(struct UserData *udata,
+          struct PoolTask *task,
+          struct BufferedTask *buf_task)
+{
+    // The package was not read from the file (or the reading failed)
+    if (task->read_ahead)
+        cr_readengine_skip(udata->read_engine, task->read_id);
+
+    if (task->prefetch) {
+        if (task->pkg_read)
+            cr_prefetcher_done(udata->prefetcher, task->prefetch_id);
+        else
+            cr_prefetcher_skip(udata->prefetcher, task->prefetch_id);
     }
 
-    if (udata->pri_db) {
-        cr_db_add_pkg(udata->pri_db, pkg, &tmp_err);
-        if (tmp_err) {
-            g_critical("Cannot add record of %s (%s) to primary db: %s",
-                       pkg->name, pkg->pkgId, tmp_err->message);
-            g_clear_error(&tmp_err);
-        }
+    if (task->early) {
+        g_mutex_lock(udata->early_mutex);
+        task->result = buf_task;
+        task->done = TRUE;
+        g_cond_broadcast(udata->early_cond);
+        g_mutex_unlock(udata->early_mutex);
+        return;
     }
 
-    g_cond_broadcast(udata->cond_pri);
-    g_mutex_unlock(udata->mutex_pri);
+    cr_reorderring_push(udata->ring, task->id, buf_task);
+    pool_task_free(task);
+}
 
-    // Write fielists data
-    g_mutex_lock(udata->mutex_fil);
-    while (udata->id_fil != id)
-        g_cond_wait (udata->cond_fil, udata->mutex_fil);
-    ++udata->id_fil;
-    cr_xmlfile_add_chunk(udata->fil_f, (const char *) res.filelists, &tmp_err);
-    if (tmp_err) {
-        g_critical("Cannot add filelists chunk:\n%s\nError: %s",
-                   res.filelists, tmp_err->message);
-        g_clear_error(&tmp_err);
+
+// Called when all writers are done with the task. With --watch,
+// packages are kept in memory for the next run together with their
+// XML (raw XML of the packages is reused by the next run).
+static void
+buffered_task_done(struct UserData *udata, struct BufferedTask *buf_task)
+{
+    cr_Package *pkg;
+
+    if (!buf_task)
+        return;
+
+    if (!udata->keep_packages) {
+        buffered_task_free(buf_task);
+        return;
     }
 
-    if (udata->fil_db) {
-        cr_db_add_pkg(udata->fil_db, pkg, &tmp_err);
-        if (tmp_err) {
-            g_critical("Cannot add record of %s (%s) to filelists db: %s",
-                       pkg->name, pkg->pkgId, tmp_err->message);
-            g_clear_error(&tmp_err);
-        }
+    pkg = buf_task->pkg;
+    if (!buf_task->res_from_md) {
+        pkg->xml_primary = cr_safe_string_chunk_insert(pkg->chunk,
+                                                buf_task->res.primary);
+        pkg->xml_filelists = cr_safe_string_chunk_insert(pkg->chunk,
+                                                buf_task->res.filelists);
+        pkg->xml_other = cr_safe_string_chunk_insert(pkg->chunk,
+                                                buf_task->res.other);
+        g_free(buf_task->res.primary);
+        g_free(buf_task->res.filelists);
+        g_free(buf_task->res.other);
+        buf_task->res_from_md = 1;
     }
 
-    g_cond_broadcast(udata->cond_fil);
-    g_mutex_unlock(udata->mutex_fil);
+    g_mutex_lock(udata->kept_mutex);
+    g_ptr_array_add(udata->kept_tasks, buf_task);
+    g_mutex_unlock(udata->kept_mutex);
+}
 
-    // Write other data
-    g_mutex_lock(udata->mutex_oth);
-    while (udata->id_oth != id)
-        g_cond_wait (udata->cond_oth, udata->mutex_oth);
-    ++udata->id_oth;
-    cr_xmlfile_add_chunk(udata->oth_f, (const char *) res.other, &tmp_err);
-    if (tmp_err) {
-        g_critical("Cannot add other chunk:\n%s\nError: %s",
-                   res.other, tmp_err->message);
-        g_clear_error(&tmp_err);
+
+// Move the kept packages into a new metadata for the next run. Packages
+// reused from the old metadata are taken out of them, the others
+// (e.g. removed packages) are freed together with the old metadata.
+// The new metadata are indexed by location_href (as the watcher reports
+// paths relative to the repo).
+static cr_Metadata *
+metadata_from_kept_tasks(GPtrArray *kept_tasks, cr_Metadata *old_metadata)
+{
+    cr_Metadata *md = cr_metadata_new(CR_HT_KEY_LOCATION_HREF, 1, NULL);
+    GHashTable *ht = cr_metadata_hashtable(md);
+    GHashTable *old_ht = NULL;
+
+    cr_metadata_set_keep_raw_xml(md, TRUE);
+    if (old_metadata)
+        old_ht = cr_metadata_hashtable(old_metadata);
+
+    for (guint x = 0; x < kept_tasks->len; x++) {
+        struct BufferedTask *buf_task = g_ptr_array_index(kept_tasks, x);
+        cr_Package *pkg = buf_task->pkg;
+
+        if (buf_task->pkg_from_md) {
+            gpointer orig_key, value;
+
+            // The old metadata of the first run are indexed by filename
+            const char *key = pkg->location_href;
+            if (old_metadata
+                && cr_metadata_key(old_metadata) == CR_HT_KEY_FILENAME)
+                key = cr_get_filename(pkg->location_href);
+
+            if (old_ht && g_hash_table_lookup_extended(old_ht, key,
+                                                       &orig_key, &value)
+                && value == pkg)
+            {
+                g_hash_table_steal(old_ht, orig_key);
+            } else {
+                pkg = cr_package_copy(pkg);
+            }
+        }
+
+        g_hash_table_replace(ht, pkg->location_href, pkg);
+        g_free(buf_task->location_href);
+        g_free(buf_task);
     }
 
-    if (udata->oth_db) {
-        cr_db_add_pkg(udata->oth_db, pkg, NULL);
-        if (tmp_err) {
-            g_critical("Cannot add record of %s (%s) to other db: %s",
-                       pkg->name, pkg->pkgId, tmp_err->message);
-            g_clear_error(&tmp_err);
+    return md;
+}
+
+
+// Writer thread - writes done tasks in the proper order into a single
+// output (e.g. primary.xml or primary.sqlite). Every output has its own
+// writer, so compression of the xml files and sqlite inserts of all
+// outputs run in parallel with each other and with the workers.
+gpointer
+writer_thread(gpointer data)
+{
+    GError *tmp_err = NULL;
+    struct WriterData *wdata = data;
+    struct UserData *udata = wdata->udata;
+
+    for (long id = 0; id < udata->package_count; id++) {
+        struct BufferedTask *buf_task = cr_reorderring_get(udata->ring, id);
+
+        // NULL means that the task failed
+        if (buf_task) {
+            if (wdata->xml_f) {
+                const char *chunk;
+
+                switch (wdata->type) {
+                    case CR_XMLFILE_PRIMARY:
+                        chunk = buf_task->res.primary;
+                        break;
+                    case CR_XMLFILE_FILELISTS:
+                        chunk = buf_task->res.filelists;
+                        break;
+                    default:
+                        chunk = buf_task->res.other;
+                        break;
+                }
+
+                cr_xmlfile_add_chunk(wdata->xml_f, chunk, &tmp_err);
+                if (tmp_err) {
+                    g_critical("Cannot add %s chunk:\n%s\nError: %s",
+                               wdata->name, chunk, tmp_err->message);
+                    g_clear_error(&tmp_err);
+                }
+            }
+
+            if (wdata->db) {
+                cr_Package *pkg = buf_task->pkg;
+
+                cr_db_add_pkg(wdata->db, pkg, &tmp_err);
+                if (tmp_err) {
+                    g_critical("Cannot add record of %s (%s) to %s db: %s",
+                               pkg->name, pkg->pkgId, wdata->name,
+                               tmp_err->message);
+                    g_clear_error(&tmp_err);
+                }
+            }
+
+            if (wdata->sums_f) {
+                cr_Package *pkg = buf_task->pkg;
+                GSList *elem = pkg->checksums;
+
+                // The checksums are in the order of the manifests
+                for (int x = 0; wdata->sums_f[x]; x++) {
+                    cr_ChecksumValue *value = elem->data;
+                    fprintf(wdata->sums_f[x], "%s  %s\n",
+                            value->checksum, pkg->location_href);
+                    elem = g_slist_next(elem);
+                }
+            }
         }
+
+        if (cr_reorderring_release(udata->ring, id))
+            buffered_task_done(udata, buf_task);
+    }
+
+    return NULL;
+}
+
+
+// Check that the package has all the extra checksums (in the same order)
+static gboolean
+has_extra_checksums(cr_Package *pkg, const cr_ChecksumType *types)
+{
+    GSList *elem = pkg->checksums;
+
+    for (int x = 0; types && types[x] != CR_CHECKSUM_UNKNOWN; x++) {
+        cr_ChecksumValue *value;
+
+        if (!elem)
+            return FALSE;
+        value = elem->data;
+        if (strcmp(value->type, cr_checksum_name_str(types[x])))
+            return FALSE;
+        elem = g_slist_next(elem);
     }
 
-    g_cond_broadcast(udata->cond_oth);
-    g_mutex_unlock(udata->mutex_oth);
+    return TRUE;
 }
 
 
@@ -245,6 +421,7 @@ dumper_thread(gpointer data, gpointer user_data)
 {
     GError *tmp_err = NULL;
     gboolean old_used = FALSE;  // To use old metadata?
+    gboolean raw_used = FALSE;  // To use raw XML from old metadata?
     cr_Package *md  = NULL;     // Package from loaded MetaData
     cr_Package *pkg = NULL;     // Package from file
     struct stat stat_buf;       // Struct with info from stat() on file
@@ -258,25 +435,59 @@ dumper_thread(gpointer data, gpointer user_data)
     const char *location_href = task->full_path + udata->repodir_name_len;
     const char *location_base = udata->location_base;
 
-    // Get stat info about file
-    if (udata->old_metadata && !(udata->skip_stat)) {
+    // Get stat info about file (packages carried over from the old
+    // metadata are not touched at all, with --skip-stat there is no
+    // package cache)
+    gboolean do_stat = !task->md
+                       && ((udata->old_metadata && !(udata->skip_stat))
+                           || udata->pkgcache || udata->pkgcache_writer);
+    if (do_stat) {
         if (stat(task->full_path, &stat_buf) == -1) {
             g_critical("Stat() on %s: %s", task->full_path, strerror(errno));
             goto task_cleanup;
         }
     }
 
+    // Package cache
+    if (udata->pkgcache) {
+        pkg = cr_pkgcache_get(udata->pkgcache, location_href, &stat_buf);
+        if (pkg) {
+            g_debug("PKGCACHE HIT %s", location_href);
+            // location_href of the package points into the cache
+            pkg->location_base = (char *) location_base;
+        }
+    }
+
     // Update stuff
-    if (udata->old_metadata) {
+    if (task->md) {
+        // Package unchanged according to the delta manifest
+        md = task->md;
+        if (strcmp(udata->checksum_type_str, md->checksum_type))
+            g_debug("%s metadata have other checksum type -> generating new",
+                    task->filename);
+        else if (!has_extra_checksums(md, udata->extra_checksums))
+            g_debug("%s metadata miss extra checksums -> generating new",
+                    task->filename);
+        else
+            old_used = TRUE;
+    } else if (!pkg && udata->old_metadata) {
         // We have old metadata
+        // (metadata loaded for --delta-manifest are indexed by
+        // location_href, the others by filename)
+        const char *key = task->filename;
+        if (cr_metadata_key(udata->old_metadata) == CR_HT_KEY_LOCATION_HREF)
+            key = location_href;
         md = (cr_Package *) g_hash_table_lookup(
                                 cr_metadata_hashtable(udata->old_metadata),
-                                task->filename);
+                                key);
 
         if (md) {
             g_debug("CACHE HIT %s", task->filename);
 
-            if (udata->skip_stat) {
+            if (!has_extra_checksums(md, udata->extra_checksums)) {
+                g_debug("%s metadata miss extra checksums -> generating new",
+                        task->filename);
+            } else if (udata->skip_stat) {
                 old_used = TRUE;
             } else if (stat_buf.st_mtime == md->time_file
                        && stat_buf.st_size == md->size_package
@@ -287,23 +498,73 @@ dumper_thread(gpointer data, gpointer user_data)
                 g_debug("%s metadata are obsolete -> generating new",
                         task->filename);
             }
+        }
+    }
 
-            if (old_used) {
-                // We have usable old data, but we have to set proper locations
-                // WARNING! This two lines destructively modifies content of
-                // packages in old metadata.
-                md->location_href = (char *) location_href;
-                md->location_base = (char *) location_base;
-            }
+    if (old_used) {
+        // The raw XML contains the old location, so it is usable
+        // only if the package location is still the same
+        raw_used = md->xml_primary && md->xml_filelists
+                   && md->xml_other
+                   && !g_strcmp0(md->location_href, location_href)
+                   && !g_strcmp0(md->location_base, location_base);
+
+        // We have usable old data, but we have to set proper locations
+        // WARNING! This two lines destructively modifies content of
+        // packages in old metadata.
+        if (!udata->keep_packages) {
+            md->location_href = (char *) location_href;
+        } else if (g_strcmp0(md->location_href, location_href)) {
+            // The package outlives this run, so does its location
+            md->location_href = cr_safe_string_chunk_insert(md->chunk,
+                                                            location_href);
         }
+        md->location_base = (char *) location_base;
     }
 
     // Load package and gen XML metadata
-    if (!old_used) {
-        // Load package from file
-        pkg = cr_package_from_rpm(task->full_path, udata->checksum_type,
-                                   location_href, udata->location_base,
-                                   udata->changelog_limit, NULL, &tmp_err);
+    if (old_used) {
+        // Just use old loaded metadata
+        pkg = md;
+    } else if (!pkg) {
+        // Load package from file (the file is opened and read only once)
+        cr_ReadBuffer *buf = NULL;
+
+        task->pkg_read = TRUE;
+
+        if (task->read_ahead) {
+            buf = cr_readengine_get(udata->read_engine, task->read_id);
+            task->read_ahead = FALSE;
+        }
+
+        if (buf) {
+            // Content of the file was read ahead by the read engine
+            pkg = cr_package_from_rpm_buffer(buf->fd, task->full_path,
+                                             buf->data, &buf->stat,
+                                             udata->checksum_type,
+                                             udata->extra_checksums,
+                                             location_href,
+                                             udata->location_base,
+                                             udata->changelog_limit,
+                                             &tmp_err);
+            cr_readengine_release(udata->read_engine, buf);
+        } else {
+            int fd = open(task->full_path, O_RDONLY);
+            if (fd == -1) {
+                g_warning("Cannot open package: %s: %s",
+                          task->full_path, strerror(errno));
+                goto task_cleanup;
+            }
+
+            pkg = cr_package_from_rpm_fd(fd, task->full_path,
+                                         udata->checksum_type,
+                                         udata->extra_checksums,
+                                         location_href, udata->location_base,
+                                         udata->changelog_limit,
+                                         do_stat ? &stat_buf : NULL,
+                                         &tmp_err);
+            close(fd);
+        }
         assert(pkg || tmp_err);
 
         if (!pkg) {
@@ -312,7 +573,14 @@ dumper_thread(gpointer data, gpointer user_data)
             g_clear_error(&tmp_err);
             goto task_cleanup;
         }
+    }
 
+    if (raw_used) {
+        // Unchanged package - reuse its XML from the old metadata as is
+        res.primary   = md->xml_primary;
+        res.filelists = md->xml_filelists;
+        res.other     = md->xml_other;
+    } else {
         res = cr_xml_dump(pkg, &tmp_err);
         if (tmp_err) {
             g_critical("Cannot dump XML for %s (%s): %s",
@@ -320,124 +588,46 @@ dumper_thread(gpointer data, gpointer user_data)
             g_clear_error(&tmp_err);
             goto task_cleanup;
         }
-    } else {
-        // Just gen XML from old loaded metadata
-        pkg = md;
-        res = cr_xml_dump(md, &tmp_err);
+    }
+
+    // Store the package into the cache for the next run
+    if (udata->pkgcache_writer) {
+        cr_pkgcache_writer_add(udata->pkgcache_writer, pkg, &stat_buf,
+                               &tmp_err);
         if (tmp_err) {
-            g_critical("Cannot dump XML for %s (%s): %s",
-                       md->name, md->pkgId, tmp_err->message);
+            g_warning("Cannot add %s into the package cache: %s",
+                      location_href, tmp_err->message);
             g_clear_error(&tmp_err);
-            goto task_cleanup;
         }
     }
 
-    // Buffering stuff
-    g_mutex_lock(udata->mutex_buffer);
-
-    if (g_queue_get_length(udata->buffer) < MAX_TASK_BUFFER_LEN
-        && udata->id_pri != task->id
-        && udata->package_count > (task->id + 1))
-    {
-        // If:
-        //  * this isn't our turn
-        //  * the buffer isn't full
-        //  * this isn't the last task
-        // Then: save the task to the buffer
-
-        struct BufferedTask *buf_task = malloc(sizeof(struct BufferedTask));
-        buf_task->id  = task->id;
-        buf_task->res = res;
-        buf_task->pkg = pkg;
-        buf_task->location_href = NULL;
-        buf_task->pkg_from_md = (pkg == md) ? 1 : 0;
-
-        if (pkg == md) {
-            // We MUST store location_href for reused packages who goes to the buffer
-            // We don't need to store location_base because it is allocated in
-            // user_data during this function calls.
-
-            buf_task->location_href = g_strdup(location_href);
-            buf_task->pkg->location_href = buf_task->location_href;
-        }
-
-        g_queue_insert_sorted(udata->buffer, buf_task, buf_task_sort_func, NULL);
-        g_mutex_unlock(udata->mutex_buffer);
-
-        g_free(task->full_path);
-        g_free(task->filename);
-        g_free(task->path);
-        g_free(task);
-
-        return;
+    // Pass the result to the writers
+    struct BufferedTask *buf_task = g_malloc(sizeof(struct BufferedTask));
+    buf_task->res = res;
+    buf_task->pkg = pkg;
+    buf_task->location_href = NULL;
+    buf_task->pkg_from_md = (pkg == md) ? 1 : 0;
+    buf_task->res_from_md = raw_used ? 1 : 0;
+
+    if (pkg == md && !udata->keep_packages) {
+        // We MUST store location_href for reused packages, because
+        // task->full_path is freed before the writers use the package.
+        // We don't need to store location_base because it is allocated in
+        // user_data during this function calls.
+
+        buf_task->location_href = g_strdup(location_href);
+        buf_task->pkg->location_href = buf_task->location_href;
     }
 
-    g_mutex_unlock(udata->mutex_buffer);
-
-    // Dump XML and SQLite
-    write_pkg(task->id, res, pkg, udata);
-
-    // Clean up
-    if (pkg != md)
-        cr_package_free(pkg);
-    g_free(res.primary);
-    g_free(res.filelists);
-    g_free(res.other);
+    task_done(udata, task, buf_task);
+    return;
 
 task_cleanup:
-    if (udata->id_pri <= task->id) {
-        // An error was encountered and we have to wait to increment counters
-        g_mutex_lock(udata->mutex_pri);
-        while (udata->id_pri != task->id)
-            g_cond_wait (udata->cond_pri, udata->mutex_pri);
-        ++udata->id_pri;
-        g_cond_broadcast(udata->cond_pri);
-        g_mutex_unlock(udata->mutex_pri);
-
-        g_mutex_lock(udata->mutex_fil);
-        while (udata->id_fil != task->id)
-            g_cond_wait (udata->cond_fil, udata->mutex_fil);
-        ++udata->id_fil;
-        g_cond_broadcast(udata->cond_fil);
-        g_mutex_unlock(udata->mutex_fil);
-
-        g_mutex_lock(udata->mutex_oth);
-        while (udata->id_oth != task->id)
-            g_cond_wait (udata->cond_oth, udata->mutex_oth);
-        ++udata->id_oth;
-        g_cond_broadcast(udata->cond_oth);
-        g_mutex_unlock(udata->mutex_oth);
-    }
-
-    g_free(task->full_path);
-    g_free(task->filename);
-    g_free(task->path);
-    g_free(task);
-
-    // Try to write all results from buffer which was waiting for us
-    while (1) {
-        struct BufferedTask *buf_task;
-        g_mutex_lock(udata->mutex_buffer);
-        buf_task = g_queue_peek_head(udata->buffer);
-        if (buf_task && buf_task->id == udata->id_pri) {
-            buf_task = g_queue_pop_head (udata->buffer);
-            g_mutex_unlock(udata->mutex_buffer);
-            // Dump XML and SQLite
-            write_pkg(buf_task->id, buf_task->res, buf_task->pkg, udata);
-            // Clean up
-            if (!buf_task->pkg_from_md)
-                cr_package_free(buf_task->pkg);
-            g_free(buf_task->res.primary);
-            g_free(buf_task->res.filelists);
-            g_free(buf_task->res.other);
-            g_free(buf_task->location_href);
-            g_free(buf_task);
-        } else {
-            g_mutex_unlock(udata->mutex_buffer);
-            break;
-        }
-    }
-
+    // An error was encountered - let writers know that they should
+    // skip this task
+    if (pkg && pkg != md)
+        cr_package_free(pkg);
+    task_done(udata, task, NULL);
     return;
 }
 
@@ -457,99 +647,199 @@ task_cmp(gconstpointer a_p, gconstpointer b_p, gpointer user_data)
 }
 
 
-long
+// Function used by qsort() - order by task_cmp, tasks which compare
+// equal keep the order which g_queue_insert_sorted() used to give them
+// (the later added first). Before the sort, task id is the index
+// in which the task was found.
+static int
+task_sort_cmp(const void *a_p, const void *b_p)
+{
+    int ret;
+    const struct PoolTask *a = *((struct PoolTask * const *) a_p);
+    const struct PoolTask *b = *((struct PoolTask * const *) b_p);
+    ret = task_cmp(a, b, NULL);
+    if (ret) return ret;
+    return (a->id < b->id) - (a->id > b->id);
+}
+
+
+struct TaskSortChunk {
+    struct PoolTask **tasks;        // First task of the chunk
+    guint len;                      // Number of tasks in the chunk
+};
+
+
+static gpointer
+task_sort_thread(gpointer data)
+{
+    struct TaskSortChunk *chunk = data;
+    qsort(chunk->tasks, chunk->len, sizeof(struct PoolTask *), task_sort_cmp);
+    return NULL;
+}
+
+
+// Sort the tasks and set their ids to their positions in the metadata.
+// Big arrays are split into chunks sorted by separate threads, the chunks
+// are then merged into a new array.
+static GPtrArray *
+sort_tasks(GPtrArray *tasks, int threads)
+{
+    struct TaskSortChunk chunks[TASK_SORT_MAX_CHUNKS];
+    GThread *sort_threads[TASK_SORT_MAX_CHUNKS];
+    struct PoolTask **all = (struct PoolTask **) tasks->pdata;
+    int n_chunks = CLAMP(threads, 1, TASK_SORT_MAX_CHUNKS);
+    GPtrArray *sorted = g_ptr_array_sized_new(tasks->len);
+
+    if (tasks->len < TASK_SORT_PARALLEL_MIN)
+        n_chunks = 1;
+
+    for (int x = 0; x < n_chunks; x++) {
+        guint start = (guint) (((guint64) tasks->len * x) / n_chunks);
+        guint end = (guint) (((guint64) tasks->len * (x+1)) / n_chunks);
+        chunks[x].tasks = all + start;
+        chunks[x].len = end - start;
+        sort_threads[x] = NULL;
+    }
+
+    if (n_chunks == 1) {
+        task_sort_thread(&chunks[0]);
+    } else {
+        for (int x = 0; x < n_chunks; x++) {
+            GError *tmp_err = NULL;
+            sort_threads[x] = g_thread_create(task_sort_thread, &chunks[x],
+                                              TRUE, &tmp_err);
+            if (!sort_threads[x]) {
+                g_debug("Cannot create sort thread: %s", tmp_err->message);
+                g_error_free(tmp_err);
+                task_sort_thread(&chunks[x]);
+            }
+        }
+        for (int x = 0; x < n_chunks; x++)
+            if (sort_threads[x])
+                g_thread_join(sort_threads[x]);
+    }
+
+    // Merge the sorted chunks
+    for (;;) {
+        int min = -1;
+        struct PoolTask *task;
+
+        for (int x = 0; x < n_chunks; x++) {
+            if (!chunks[x].len)
+                continue;
+            if (min == -1 || task_sort_cmp(chunks[x].tasks,
+                                           chunks[min].tasks) < 0)
+                min = x;
+        }
+
+        if (min == -1)
+            break;
+
+        task = *chunks[min].tasks;
+        chunks[min].tasks++;
+        chunks[min].len--;
+
+        task->id = sorted->len;
+        g_ptr_array_add(sorted, task);
+    }
+
+    return sorted;
+}
+
+
+struct FillPoolWalkData {
+    GPtrArray *tasks;               // Found tasks
+    size_t in_dir_len;              // Length of path to the repo (with '/')
+    GSList **current_pkglist;       // Basenames of found packages
+    FILE *output_pkg_list;          // --read-pkgs-list file or NULL
+    GThreadPool *pool;              // Pool for the early tasks
+    cr_Prefetcher *prefetcher;      // Prefetcher for the early tasks or NULL
+    long early_left;                // How many early tasks could be pushed
+};
+
+
+// Called by cr_dirwalk() for every found rpm that is not excluded
+static void
+fill_pool_walk_cb(const char *full_path,
+                  const char *dirname,
+                  const char *filename,
+                  void *cbdata)
+{
+    struct FillPoolWalkData *data = cbdata;
+    struct PoolTask *task;
+    const gchar *repo_relative_path = full_path + data->in_dir_len;
+
+    g_debug("Adding pkg: %s", full_path);
+    task = g_malloc0(sizeof(struct PoolTask));
+    task->full_path = g_strdup(full_path);
+    task->filename = g_strdup(filename);
+    task->path = g_strdup(dirname);
+    if (data->output_pkg_list)
+        fprintf(data->output_pkg_list, "%s\n", repo_relative_path);
+    *data->current_pkglist = g_slist_prepend(*data->current_pkglist,
+                                             task->filename);
+    // TODO: One common path for all tasks with the same path?
+    task->id = data->tasks->len;
+    g_ptr_array_add(data->tasks, task);
+
+    // Start processing of the package while the walk is still running
+    if (data->early_left > 0) {
+        data->early_left--;
+        task->early = TRUE;
+        if (data->prefetcher) {
+            task->prefetch_id = cr_prefetcher_add(data->prefetcher, full_path);
+            task->prefetch = TRUE;
+        }
+        g_thread_pool_push(data->pool, task, NULL);
+    }
+}
+
+
+// Find the packages and return the tasks sorted in the order of
+// the metadata. Up to max_early tasks are pushed into the (running)
+// pool during the directory walk, other tasks are left to the caller.
+GPtrArray *
 fill_pool(GThreadPool *pool,
+          cr_Prefetcher *prefetcher,
           gchar *in_dir,
           struct CmdOptions *cmd_options,
           GSList **current_pkglist,
-          FILE *output_pkg_list)
+          FILE *output_pkg_list,
+          long max_early)
 {
-    GQueue queue = G_QUEUE_INIT;
+    GPtrArray *tasks = g_ptr_array_new();
+    GPtrArray *sorted_tasks;
     struct PoolTask *task;
-    long package_count = 0;
 
     if (!(cmd_options->include_pkgs)) {
         // --pkglist (or --includepkg) is not supplied -> do dir walk
 
         g_message("Directory walk started");
 
-        size_t in_dir_len = strlen(in_dir);
-        GStringChunk *sub_dirs_chunk = g_string_chunk_new(1024);
-        GQueue *sub_dirs = g_queue_new();
+        struct FillPoolWalkData walk_data;
         gchar *input_dir_stripped;
-
-        input_dir_stripped = g_string_chunk_insert_len(sub_dirs_chunk,
-                                                       in_dir,
-                                                       in_dir_len-1);
-        g_queue_push_head(sub_dirs, input_dir_stripped);
-
-        char *dirname;
-        while ((dirname = g_queue_pop_head(sub_dirs))) {
-            // Open dir
-            GDir *dirp;
-            dirp = g_dir_open (dirname, 0, NULL);
-            if (!dirp) {
-                g_warning("Cannot open directory: %s", dirname);
-                continue;
-            }
-
-            const gchar *filename;
-            while ((filename = g_dir_read_name(dirp))) {
-
-                gchar *full_path = g_strconcat(dirname, "/", filename, NULL);
-
-                // Non .rpm files
-                if (!g_str_has_suffix (filename, ".rpm")) {
-                    if (g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
-                        // Directory
-                        gchar *sub_dir_in_chunk;
-                        sub_dir_in_chunk = g_string_chunk_insert(sub_dirs_chunk,
-                                                                 full_path);
-                        g_queue_push_head(sub_dirs, sub_dir_in_chunk);
-                        g_debug("Dir to scan: %s", sub_dir_in_chunk);
-                    }
-                    g_free(full_path);
-                    continue;
-                }
-
-                // Skip symbolic links if --skip-symlinks arg is used
-                if (cmd_options->skip_symlinks
-                    && g_file_test(full_path, G_FILE_TEST_IS_SYMLINK))
-                {
-                    g_debug("Skipped symlink: %s", full_path);
-                    g_free(full_path);
-                    continue;
-                }
-
-                // Check filename against exclude glob masks
-                const gchar *repo_relative_path = filename;
-                if (in_dir_len < strlen(full_path))
-                    // This probably should be always true
-                    repo_relative_path = full_path + in_dir_len;
-
-                if (allowed_file(repo_relative_path, cmd_options)) {
-                    // FINALLY! Add file into pool
-                    g_debug("Adding pkg: %s", full_path);
-                    task = g_malloc(sizeof(struct PoolTask));
-                    task->full_path = full_path;
-                    task->filename = g_strdup(filename);
-                    task->path = g_strdup(dirname);
-                    if (output_pkg_list)
-                        fprintf(output_pkg_list, "%s\n", repo_relative_path);
-                    *current_pkglist = g_slist_prepend(*current_pkglist, task->filename);
-                    // TODO: One common path for all tasks with the same path?
-                    g_queue_insert_sorted(&queue, task, task_cmp, NULL);
-                } else {
-                    g_free(full_path);
-                }
-            }
-
-            // Cleanup
-            g_dir_close (dirp);
-        }
-
-        g_string_chunk_free (sub_dirs_chunk);
-        g_queue_free(sub_dirs);
+        int flags = CR_DIRWALK_DEFAULT;
+
+        if (cmd_options->skip_symlinks)
+            flags |= CR_DIRWALK_SKIP_SYMLINKS;
+
+        walk_data.tasks = tasks;
+        walk_data.in_dir_len = strlen(in_dir);
+        walk_data.current_pkglist = current_pkglist;
+        walk_data.output_pkg_list = output_pkg_list;
+        walk_data.pool = pool;
+        walk_data.prefetcher = prefetcher;
+        walk_data.early_left = max_early;
+
+        input_dir_stripped = g_strndup(in_dir, walk_data.in_dir_len-1);
+        cr_dirwalk(input_dir_stripped,
+                   ".rpm",
+                   cmd_options->exclude_matcher,
+                   flags,
+                   cmd_options->workers,
+                   fill_pool_walk_cb,
+                   &walk_data);
+        g_free(input_dir_stripped);
     } else {
         // pkglist is supplied - use only files in pkglist
 
@@ -576,26 +866,330 @@ fill_pool(GThreadPool *pool,
                 gchar *full_path = g_strconcat(in_dir, relative_path, NULL);
                 //     ^^^ /path/to/in_repo/packages/i386/foobar.rpm
                 g_debug("Adding pkg: %s", full_path);
-                task = g_malloc(sizeof(struct PoolTask));
+                task = g_malloc0(sizeof(struct PoolTask));
                 task->full_path = full_path;
                 task->filename  = g_strdup(filename);         // foobar.rpm
                 task->path      = strndup(relative_path, x);  // packages/i386/
                 if (output_pkg_list)
                     fprintf(output_pkg_list, "%s\n", relative_path);
                 *current_pkglist = g_slist_prepend(*current_pkglist, task->filename);
-                g_queue_insert_sorted(&queue, task, task_cmp, NULL);
+                task->id = tasks->len;
+                g_ptr_array_add(tasks, task);
             }
         }
     }
 
-    // Push sorted tasks into the thread pool
-    while ((task = g_queue_pop_head(&queue)) != NULL) {
-        task->id = package_count;
+    sorted_tasks = sort_tasks(tasks, cmd_options->workers);
+    g_ptr_array_free(tasks, TRUE);
+
+    return sorted_tasks;
+}
+
+
+// Add a task for the package (path is relative to the in_dir)
+static struct PoolTask *
+delta_task_add(GPtrArray *tasks, gchar *in_dir, const char *relative_path)
+{
+    struct PoolTask *task;
+    const char *filename = strrchr(relative_path, '/');
+
+    filename = filename ? filename + 1 : relative_path;
+
+    task = g_malloc0(sizeof(struct PoolTask));
+    task->full_path = g_strconcat(in_dir, relative_path, NULL);
+    task->filename  = g_strdup(filename);
+    task->path      = g_strndup(relative_path, filename - relative_path);
+    task->id        = tasks->len;
+    g_ptr_array_add(tasks, task);
+    return task;
+}
+
+
+// Build the tasks from the delta manifest instead of a directory walk.
+// Packages from the old metadata which are not mentioned in the manifest
+// are carried over as they are, only the added and modified packages
+// are read. Returns the tasks sorted in the order of the metadata.
+GPtrArray *
+fill_pool_from_delta(gchar *in_dir,
+                     struct CmdOptions *cmd_options,
+                     cr_Metadata *old_metadata,
+                     FILE *output_pkg_list)
+{
+    GHashTable *ht = cr_metadata_hashtable(old_metadata);
+    GPtrArray *tasks = g_ptr_array_new();
+    GPtrArray *sorted_tasks;
+    GHashTableIter iter;
+    gpointer value;
+    GSList *to_read;
+
+    // Drop old versions of removed, modified and excluded packages
+    // (the old metadata are indexed by location_href)
+    to_read = cr_delta_manifest_apply(ht,
+                                      cmd_options->changed_pkgs,
+                                      cmd_options->removed_pkgs,
+                                      cmd_options->exclude_matcher);
+
+    // Unchanged packages
+    g_hash_table_iter_init(&iter, ht);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        cr_Package *md = value;
+        struct PoolTask *task;
+
+        task = delta_task_add(tasks, in_dir, md->location_href);
+        task->md = md;
+    }
+
+    g_debug("%u packages carried over from the old metadata", tasks->len);
+
+    // Added and modified packages
+    for (GSList *element = to_read; element; element = g_slist_next(element)) {
+        const char *relative_path = element->data;
+        struct PoolTask *task;
+
+        task = delta_task_add(tasks, in_dir, relative_path);
+        g_debug("Adding pkg: %s", task->full_path);
+        if (output_pkg_list)
+            fprintf(output_pkg_list, "%s\n", relative_path);
+    }
+
+    g_slist_free(to_read);
+
+    sorted_tasks = sort_tasks(tasks, cmd_options->workers);
+    g_ptr_array_free(tasks, TRUE);
+
+    return sorted_tasks;
+}
+
+
+// Push the sorted tasks which were not processed during the directory
+// walk into the pool and pass results of the early tasks to the writers.
+// The pool and the writers must be already running.
+static void
+push_tasks(GThreadPool *pool, struct UserData *udata, GPtrArray *tasks)
+{
+    GPtrArray *early_tasks = g_ptr_array_new();
+
+    // Late tasks are freed by the workers - don't touch them after push
+    // Packages are added into the read engine in the order in which
+    // workers take them from the pool
+    for (guint x = 0; x < tasks->len; x++) {
+        struct PoolTask *task = g_ptr_array_index(tasks, x);
+        if (task->early) {
+            g_ptr_array_add(early_tasks, task);
+            continue;
+        }
+        if (udata->read_engine && !task->md) {
+            task->read_id = cr_readengine_add(udata->read_engine,
+                                              task->full_path);
+            task->read_ahead = TRUE;
+        }
+        if (udata->prefetcher && !task->md) {
+            task->prefetch_id = cr_prefetcher_add(udata->prefetcher,
+                                                  task->full_path);
+            task->prefetch = TRUE;
+        }
         g_thread_pool_push(pool, task, NULL);
-        ++package_count;
     }
 
-    return package_count;
+    if (udata->read_engine)
+        cr_readengine_finish(udata->read_engine);
+    if (udata->prefetcher)
+        cr_prefetcher_finish(udata->prefetcher);
+
+    // Early tasks were pushed first, so none of them waits for a late one
+    for (guint x = 0; x < early_tasks->len; x++) {
+        struct PoolTask *task = g_ptr_array_index(early_tasks, x);
+
+        g_mutex_lock(udata->early_mutex);
+        while (!task->done)
+            g_cond_wait(udata->early_cond, udata->early_mutex);
+        g_mutex_unlock(udata->early_mutex);
+
+        cr_reorderring_push(udata->ring, task->id, task->result);
+        pool_task_free(task);
+    }
+
+    g_ptr_array_free(early_tasks, TRUE);
+}
+
+
+// Finalization of the repodata. Every metadata file has its own chain
+// of tasks (e.g. fill primary.xml record -> close primary.sqlite ->
+// compress it -> fill its record -> rename it) and the chains run
+// in parallel in a cr_TaskDag, so no chain waits for the slowest task
+// of the other ones.
+
+struct RecordTask {
+    cr_RepomdRecord *record;        // Record to be filled
+    cr_RepomdRecord *crecord;       // Record of compressed copy of the file
+                                    // which is created (groupfile) or NULL
+    cr_CompressionType compression; // Compression of the copy
+    cr_ChecksumType checksum_type;  // Checksum type of the records
+};
+
+struct DbTask {
+    cr_SqliteDb *db;                // Database (closed by the task)
+    struct RecordTask *xml;         // Record of the corresponding xml file
+    cr_CompressionTask *compression;// Compression of the database
+    gboolean in_memory;             // The database is in memory, it is
+                                    // written directly into compression->dst
+    struct RecordTask db_record;    // Record of the compressed database
+};
+
+
+static void
+fill_record_task(gpointer data, GError **err)
+{
+    struct RecordTask *task = data;
+    GError *tmp_err = NULL;
+
+    if (task->crecord)
+        cr_repomd_record_compress_and_fill(task->record,
+                                           task->crecord,
+                                           task->checksum_type,
+                                           task->compression,
+                                           &tmp_err);
+    else
+        cr_repomd_record_fill(task->record, task->checksum_type, &tmp_err);
+
+    if (tmp_err)
+        g_propagate_prefixed_error(err, tmp_err, "Cannot process %s: ",
+                                   task->record->location_real);
+}
+
+
+static void
+rename_record_task(gpointer data, GError **err)
+{
+    struct RecordTask *task = data;
+
+    CR_UNUSED(err);
+
+    cr_repomd_record_rename_file(task->record, NULL);
+    if (task->crecord)
+        cr_repomd_record_rename_file(task->crecord, NULL);
+}
+
+
+static void
+close_db_task(gpointer data, GError **err)
+{
+    struct DbTask *task = data;
+    GError *tmp_err = NULL;
+
+    // The database contains checksum of its xml file
+    cr_db_dbinfo_update(task->db, task->xml->record->checksum, &tmp_err);
+    if (tmp_err) {
+        cr_db_close(task->db, NULL);
+    } else if (task->in_memory) {
+        // Stats of the database and of the compressed file are computed
+        // while it is written, so neither of them is read again
+        cr_db_close_compressed(task->db,
+                               task->compression->dst,
+                               task->compression->type,
+                               task->compression->stat,
+                               &tmp_err);
+    } else {
+        cr_db_close(task->db, &tmp_err);
+    }
+    task->db = NULL;
+
+    if (tmp_err) {
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "Cannot close sqlite database %s: ",
+                                   task->compression->src);
+        return;
+    }
+
+    if (task->in_memory)
+        cr_repomd_record_load_contentstat(task->db_record.record,
+                                          task->compression->stat);
+}
+
+
+static void
+compress_db_task(gpointer data, GError **err)
+{
+    struct DbTask *task = data;
+
+    cr_compressing_thread(task->compression, NULL);
+
+    if (task->compression->err) {
+        g_propagate_prefixed_error(err, task->compression->err,
+                                   "Cannot compress %s: ",
+                                   task->compression->src);
+        task->compression->err = NULL;
+        return;
+    }
+
+    cr_repomd_record_load_contentstat(task->db_record.record,
+                                      task->compression->stat);
+}
+
+
+// Add a task named by the record and the step (for debug messages)
+static cr_DagTask *
+add_task(cr_TaskDag *dag,
+         cr_RepomdRecord *record,
+         const char *step,
+         cr_DagTaskFunc func,
+         gpointer data)
+{
+    gchar *name = g_strconcat(record->type, " ", step, NULL);
+    cr_DagTask *task = cr_taskdag_add(dag, name, func, data);
+    g_free(name);
+    return task;
+}
+
+
+// Add tasks which fill the record (after the dependency is done)
+// and rename its file. Returns the fill task.
+static cr_DagTask *
+add_record_tasks(cr_TaskDag *dag,
+                 struct RecordTask *task,
+                 cr_DagTask *dependency,
+                 gboolean rename_files)
+{
+    cr_DagTask *fill_task, *rename_task;
+
+    fill_task = add_task(dag, task->record, "fill", fill_record_task, task);
+    cr_taskdag_depends(fill_task, dependency);
+
+    if (rename_files) {
+        rename_task = add_task(dag, task->record, "rename",
+                               rename_record_task, task);
+        cr_taskdag_depends(rename_task, fill_task);
+    }
+
+    return fill_task;
+}
+
+
+// Add tasks which close the database (after the record of its xml file
+// is filled), compress it (an in-memory database is compressed while it
+// is closed), fill its record and rename it.
+static void
+add_db_tasks(cr_TaskDag *dag,
+             struct DbTask *task,
+             cr_DagTask *xml_fill,
+             gboolean rename_files)
+{
+    cr_DagTask *close_task, *compress_task;
+
+    close_task = add_task(dag, task->db_record.record, "close",
+                          close_db_task, task);
+    cr_taskdag_depends(close_task, xml_fill);
+
+    if (task->in_memory) {
+        add_record_tasks(dag, &task->db_record, close_task, rename_files);
+        return;
+    }
+
+    compress_task = add_task(dag, task->db_record.record, "compress",
+                             compress_db_task, task);
+    cr_taskdag_depends(compress_task, close_task);
+
+    add_record_tasks(dag, &task->db_record, compress_task, rename_files);
 }
 
 
@@ -712,9 +1306,41 @@ main(int argc, char **argv)
         tmp_out_repo = g_strconcat(out_dir, ".repodata/", NULL);
     }
 
-    // Block SIGINT
+    // Init package parser
+
+    cr_package_parser_init();
+    cr_package_parser_set_checksum_cache(cmd_options->checksum_cache_type);
+    // Watched packages can be truncated while they are read, do not mmap
+    // them (the access to the truncated part of a mapping raises SIGBUS)
+    cr_package_parser_set_mmap(!cmd_options->watch);
+    cr_xml_dump_init();
+
+
+    // Start watching before the first run, so no change is missed
+
+    struct RepoWatch *watch = NULL;     // Watcher of the input dir
+    cr_Metadata *watch_metadata = NULL; // Packages from the previous run
+    gboolean watch_rerun = FALSE;       // Run triggered by the watcher
+
+    if (cmd_options->watch) {
+        watch = repowatch_new(in_dir, ".rpm", cmd_options->skip_symlinks,
+                              &tmp_err);
+        if (!watch) {
+            g_critical("Cannot watch %s: %s", in_dir, tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+
+    // Every --watch run starts here
 
     sigset_t intmask;
+
+next_run:
+
+    // Block SIGINT
+
     sigemptyset(&intmask);
     sigaddset(&intmask, SIGINT);
     sigprocmask(SIG_BLOCK, &intmask, NULL);
@@ -768,10 +1394,63 @@ main(int argc, char **argv)
     }
 
 
-    // Init package parser
+    // Open package cache (workers could use it already during the walk)
+
+    cr_PkgCache *pkgcache = NULL;
+    cr_PkgCacheWriter *pkgcache_writer = NULL;
+
+    // With --delta-manifest, unchanged packages are not stat()ed, so they
+    // couldn't be stored into a new cache - the cache is not used at all.
+    // The same for --skip-stat, cached packages are valid only if the
+    // stat() of their files matches. The cache doesn't store extra
+    // checksums, so it isn't used with --extra-checksum either.
+    if ((cmd_options->cachedir || cmd_options->update)
+        && !cmd_options->delta_manifest && !cmd_options->skip_stat
+        && !cmd_options->watch && !cmd_options->extra_checksum_types)
+    {
+        gchar *pkgcache_path;       // Cache from the previous run
+        gchar *new_pkgcache_path;   // Cache for the next run
+
+        if (cmd_options->cachedir) {
+            // Every input directory has its own cache file
+            gchar *key = g_compute_checksum_for_string(G_CHECKSUM_SHA256,
+                                                       in_dir, -1);
+            pkgcache_path = g_strconcat(cmd_options->cachedir, key,
+                                        PKGCACHE_SUFFIX, NULL);
+            new_pkgcache_path = g_strdup(pkgcache_path);
+            g_free(key);
+        } else {
+            pkgcache_path = g_strconcat(out_repo, PKGCACHE_FILENAME, NULL);
+            new_pkgcache_path = g_strconcat(tmp_out_repo, PKGCACHE_FILENAME,
+                                            NULL);
+        }
+
+        pkgcache = cr_pkgcache_open(pkgcache_path,
+                                    cmd_options->checksum_type,
+                                    cmd_options->changelog_limit,
+                                    &tmp_err);
+        if (pkgcache) {
+            g_message("Package cache %s: %d packages", pkgcache_path,
+                      cr_pkgcache_size(pkgcache));
+        } else {
+            g_debug("Package cache %s not used: %s",
+                    pkgcache_path, tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+
+        pkgcache_writer = cr_pkgcache_writer_new(new_pkgcache_path,
+                                                 cmd_options->checksum_type,
+                                                 cmd_options->changelog_limit,
+                                                 &tmp_err);
+        if (!pkgcache_writer) {
+            g_warning("Cannot create package cache: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+
+        g_free(pkgcache_path);
+        g_free(new_pkgcache_path);
+    }
 
-    cr_package_parser_init();
-    cr_xml_dump_init();
 
 
     // Thread pool - Creation
@@ -785,24 +1464,75 @@ main(int argc, char **argv)
                                           NULL);
     g_debug("Thread pool ready");
 
-    long package_count;
+
+    // Thread pool - User data initialization (the part used by workers)
+
+    user_data.changelog_limit   = cmd_options->changelog_limit;
+    user_data.location_base     = cmd_options->location_base;
+    user_data.checksum_type_str = cr_checksum_name_str(cmd_options->checksum_type);
+    user_data.checksum_type     = cmd_options->checksum_type;
+    user_data.extra_checksums   = cmd_options->extra_checksum_types;
+    user_data.skip_symlinks     = cmd_options->skip_symlinks;
+    user_data.skip_stat         = cmd_options->skip_stat;
+    user_data.old_metadata      = NULL;
+    user_data.pkgcache          = pkgcache;
+    user_data.pkgcache_writer   = pkgcache_writer;
+    user_data.read_engine       = NULL;
+    user_data.prefetcher        = NULL;
+    user_data.repodir_name_len  = strlen(in_dir);
+    user_data.ring              = NULL;
+    user_data.early_mutex       = g_mutex_new();
+    user_data.early_cond        = g_cond_new();
+    user_data.keep_packages     = cmd_options->watch;
+    user_data.kept_mutex        = g_mutex_new();
+    user_data.kept_tasks        = g_ptr_array_new();
+
+    long package_count = 0;
+    GPtrArray *tasks = NULL;
     GSList *current_pkglist = NULL;
     /* ^^^ List with basenames of files which will be processed */
 
+    // Without --update, packages are processed already during the walk.
+    // With --update, the old metadata are loaded only for the found
+    // packages and workers need them - so they have to wait for the walk.
+    gboolean early_processing = !cmd_options->update && !watch_rerun;
+    if (early_processing)
+        g_thread_pool_set_max_threads(pool, cmd_options->workers, NULL);
 
-    // Thread pool - Fill with tasks
 
-    package_count = fill_pool(pool,
-                              in_dir,
-                              cmd_options,
-                              &current_pkglist,
-                              output_pkg_list);
+    // Prefetcher (started before the walk, it prefetches also packages
+    // processed during the walk)
 
-    g_debug("Package count: %ld", package_count);
-    g_message("Directory walk done - %ld packages", package_count);
+    if (cmd_options->prefetch || cmd_options->drop_pkgs_cache) {
+        user_data.prefetcher = cr_prefetcher_new(cmd_options->prefetch, 0,
+                                                 cmd_options->drop_pkgs_cache,
+                                                 &tmp_err);
+        if (!user_data.prefetcher) {
+            g_warning("%s", tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
 
-    if (output_pkg_list)
-        fclose(output_pkg_list);
+
+    // Thread pool - Fill with tasks (with --delta-manifest or when
+    // the watcher found changes, the tasks are created from the old
+    // metadata)
+
+    gboolean use_delta = cmd_options->delta_manifest || watch_rerun;
+
+    if (!use_delta) {
+        tasks = fill_pool(pool,
+                          user_data.prefetcher,
+                          in_dir,
+                          cmd_options,
+                          &current_pkglist,
+                          output_pkg_list,
+                          early_processing ? MAX_EARLY_TASKS : 0);
+        package_count = tasks->len;
+
+        g_debug("Package count: %ld", package_count);
+        g_message("Directory walk done - %ld packages", package_count);
+    }
 
 
     // Load old metadata if --update
@@ -810,19 +1540,42 @@ main(int argc, char **argv)
     cr_Metadata *old_metadata = NULL;
     struct cr_MetadataLocation *old_metadata_location = NULL;
 
-    if (!package_count)
+    if (!package_count && !use_delta)
         g_debug("No packages found - skipping metadata loading");
 
-    if (package_count && cmd_options->update) {
+    if (watch_rerun) {
+        // Packages from the previous run are in memory
+        old_metadata = watch_metadata;
+        watch_metadata = NULL;
+
+        if (cmd_options->outputdir)
+            old_metadata_location = cr_locate_metadata(out_dir, 1, NULL);
+        else
+            old_metadata_location = cr_locate_metadata(in_dir, 1, NULL);
+    } else if ((package_count || cmd_options->delta_manifest)
+               && cmd_options->update)
+    {
         int ret;
-        old_metadata = cr_metadata_new(CR_HT_KEY_FILENAME, 1, current_pkglist);
+        // With --delta-manifest, packages are identified by their path
+        // in the repo, filenames don't have to be unique
+        cr_HashTableKey key = CR_HT_KEY_FILENAME;
+        if (cmd_options->delta_manifest)
+            key = CR_HT_KEY_LOCATION_HREF;
+        old_metadata = cr_metadata_new(key, 1, current_pkglist);
+        cr_metadata_set_keep_raw_xml(old_metadata, TRUE);
 
         if (cmd_options->outputdir)
             old_metadata_location = cr_locate_metadata(out_dir, 1, NULL);
         else
             old_metadata_location = cr_locate_metadata(in_dir, 1, NULL);
 
-        if (old_metadata_location) {
+        if (old_metadata_location && pkgcache && !cmd_options->delta_manifest) {
+            // The package cache contains all packages from the previous
+            // run - there is no need to load the old xml files
+            // (the delta manifest needs them for the unchanged packages)
+            g_debug("Old metadata from %s - skipped (package cache is used)",
+                    out_dir);
+        } else if (old_metadata_location) {
             ret = cr_metadata_load_xml(old_metadata,
                                        old_metadata_location,
                                        &tmp_err);
@@ -830,11 +1583,19 @@ main(int argc, char **argv)
 
             if (ret == CRE_OK) {
                 g_debug("Old metadata from: %s - loaded", out_dir);
+            } else if (cmd_options->delta_manifest) {
+                g_critical("Old metadata from %s - loading failed: %s",
+                           out_dir, tmp_err->message);
+                exit(EXIT_FAILURE);
             } else {
                 g_debug("Old metadata from %s - loading failed: %s",
                         out_dir, tmp_err->message);
                 g_clear_error(&tmp_err);
             }
+        } else if (cmd_options->delta_manifest) {
+            g_critical("--delta-manifest: No old metadata found in %s",
+                       out_dir);
+            exit(EXIT_FAILURE);
         }
 
         // Load repodata from --update-md-path
@@ -862,6 +1623,20 @@ main(int argc, char **argv)
     g_slist_free(current_pkglist);
     current_pkglist = NULL;
 
+    if (use_delta) {
+        tasks = fill_pool_from_delta(in_dir,
+                                     cmd_options,
+                                     old_metadata,
+                                     output_pkg_list);
+        package_count = tasks->len;
+
+        g_debug("Package count: %ld", package_count);
+        g_message("Changes processed - %ld packages", package_count);
+    }
+
+    if (output_pkg_list)
+        fclose(output_pkg_list);
+
 
     // Copy groupfile
 
@@ -979,15 +1754,22 @@ main(int argc, char **argv)
     g_message("Temporary output repo path: %s", tmp_out_repo);
     g_debug("Creating .xml.gz files");
 
+    // The three metadata files are compressed at the same time, split
+    // the number of workers among them, so the host is not oversubscribed
+    int compression_threads = MAX(1, cmd_options->workers / 3);
+
     pri_xml_filename = g_strconcat(tmp_out_repo, "/primary.xml.gz", NULL);
     fil_xml_filename = g_strconcat(tmp_out_repo, "/filelists.xml.gz", NULL);
     oth_xml_filename = g_strconcat(tmp_out_repo, "/other.xml.gz", NULL);
 
     pri_stat = cr_contentstat_new(cmd_options->checksum_type, NULL);
-    pri_cr_file = cr_xmlfile_sopen_primary(pri_xml_filename,
-                                           CR_CW_GZ_COMPRESSION,
-                                           pri_stat,
-                                           &tmp_err);
+    pri_stat->compressed_checksum_type = cmd_options->checksum_type;
+    pri_cr_file = cr_xmlfile_sopen_mt(pri_xml_filename,
+                                      CR_XMLFILE_PRIMARY,
+                                      CR_CW_GZ_COMPRESSION,
+                                      pri_stat,
+                                      compression_threads,
+                                      &tmp_err);
     assert(pri_cr_file || tmp_err);
     if (!pri_cr_file) {
         g_critical("Cannot open file %s: %s",
@@ -1001,10 +1783,13 @@ main(int argc, char **argv)
     }
 
     fil_stat = cr_contentstat_new(cmd_options->checksum_type, NULL);
-    fil_cr_file = cr_xmlfile_sopen_filelists(fil_xml_filename,
-                                            CR_CW_GZ_COMPRESSION,
-                                            fil_stat,
-                                            &tmp_err);
+    fil_stat->compressed_checksum_type = cmd_options->checksum_type;
+    fil_cr_file = cr_xmlfile_sopen_mt(fil_xml_filename,
+                                      CR_XMLFILE_FILELISTS,
+                                      CR_CW_GZ_COMPRESSION,
+                                      fil_stat,
+                                      compression_threads,
+                                      &tmp_err);
     assert(fil_cr_file || tmp_err);
     if (!fil_cr_file) {
         g_critical("Cannot open file %s: %s",
@@ -1020,10 +1805,13 @@ main(int argc, char **argv)
     }
 
     oth_stat = cr_contentstat_new(cmd_options->checksum_type, NULL);
-    oth_cr_file = cr_xmlfile_sopen_other(oth_xml_filename,
-                                        CR_CW_GZ_COMPRESSION,
-                                        oth_stat,
-                                        &tmp_err);
+    oth_stat->compressed_checksum_type = cmd_options->checksum_type;
+    oth_cr_file = cr_xmlfile_sopen_mt(oth_xml_filename,
+                                      CR_XMLFILE_OTHER,
+                                      CR_CW_GZ_COMPRESSION,
+                                      oth_stat,
+                                      compression_threads,
+                                      &tmp_err);
     assert(oth_cr_file || tmp_err);
     if (!oth_cr_file) {
         g_critical("Cannot open file %s: %s",
@@ -1065,7 +1853,10 @@ main(int argc, char **argv)
         fil_db_filename = g_strconcat(tmp_out_repo, "/filelists.sqlite", NULL);
         oth_db_filename = g_strconcat(tmp_out_repo, "/other.sqlite", NULL);
 
-        pri_db = cr_db_open_primary(pri_db_filename, &tmp_err);
+        if (cmd_options->sqlite_in_memory)
+            pri_db = cr_db_open_in_memory(CR_DB_PRIMARY, &tmp_err);
+        else
+            pri_db = cr_db_open_primary(pri_db_filename, &tmp_err);
         assert(pri_db || tmp_err);
         if (!pri_db) {
             g_critical("Cannot open %s: %s",
@@ -1074,7 +1865,10 @@ main(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
 
-        fil_db = cr_db_open_filelists(fil_db_filename, &tmp_err);
+        if (cmd_options->sqlite_in_memory)
+            fil_db = cr_db_open_in_memory(CR_DB_FILELISTS, &tmp_err);
+        else
+            fil_db = cr_db_open_filelists(fil_db_filename, &tmp_err);
         assert(fil_db || tmp_err);
         if (!fil_db) {
             g_critical("Cannot open %s: %s",
@@ -1083,7 +1877,10 @@ main(int argc, char **argv)
             exit(EXIT_FAILURE);
         }
 
-        oth_db = cr_db_open_other(oth_db_filename, &tmp_err);
+        if (cmd_options->sqlite_in_memory)
+            oth_db = cr_db_open_in_memory(CR_DB_OTHER, &tmp_err);
+        else
+            oth_db = cr_db_open_other(oth_db_filename, &tmp_err);
         assert(oth_db || tmp_err);
         if (!oth_db) {
             g_critical("Cannot open %s: %s",
@@ -1093,6 +1890,33 @@ main(int argc, char **argv)
         }
     }
 
+    // Open checksum manifests of the extra checksum types
+
+    guint sums_count = 0;
+    FILE **sums_f = NULL;
+    gchar **sums_filenames = NULL;
+
+    if (cmd_options->extra_checksum_types) {
+        const cr_ChecksumType *types = cmd_options->extra_checksum_types;
+
+        while (types[sums_count] != CR_CHECKSUM_UNKNOWN)
+            sums_count++;
+
+        sums_f = g_new0(FILE *, sums_count + 1);
+        sums_filenames = g_new0(gchar *, sums_count + 1);
+        for (guint x = 0; x < sums_count; x++) {
+            sums_filenames[x] = g_strconcat(tmp_out_repo, "/",
+                                            cr_checksum_name_str(types[x]),
+                                            "sums", NULL);
+            sums_f[x] = fopen(sums_filenames[x], "w");
+            if (!sums_f[x]) {
+                g_critical("Cannot open %s: %s",
+                           sums_filenames[x], strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
     // Thread pool - User data initialization
 
     user_data.pri_f             = pri_cr_file;
@@ -1101,55 +1925,110 @@ main(int argc, char **argv)
     user_data.pri_db            = pri_db;
     user_data.fil_db            = fil_db;
     user_data.oth_db            = oth_db;
-    user_data.changelog_limit   = cmd_options->changelog_limit;
-    user_data.location_base     = cmd_options->location_base;
-    user_data.checksum_type_str = cr_checksum_name_str(cmd_options->checksum_type);
-    user_data.checksum_type     = cmd_options->checksum_type;
-    user_data.skip_symlinks     = cmd_options->skip_symlinks;
-    user_data.skip_stat         = cmd_options->skip_stat;
     user_data.old_metadata      = old_metadata;
-    user_data.repodir_name_len  = strlen(in_dir);
     user_data.package_count     = package_count;
-    user_data.buffer            = g_queue_new();
-    user_data.mutex_buffer      = g_mutex_new();
-    user_data.mutex_pri         = g_mutex_new();
-    user_data.mutex_fil         = g_mutex_new();
-    user_data.mutex_oth         = g_mutex_new();
-    user_data.cond_pri          = g_cond_new();
-    user_data.cond_fil          = g_cond_new();
-    user_data.cond_oth          = g_cond_new();
-    user_data.id_pri            = 0;
-    user_data.id_fil            = 0;
-    user_data.id_oth            = 0;
 
     g_debug("Thread pool user data ready");
 
 
+    // Start writers (one per output)
+
+    struct WriterData writers[] = {
+        { &user_data, "primary",   pri_cr_file, NULL,   CR_XMLFILE_PRIMARY,   NULL, NULL },
+        { &user_data, "filelists", fil_cr_file, NULL,   CR_XMLFILE_FILELISTS, NULL, NULL },
+        { &user_data, "other",     oth_cr_file, NULL,   CR_XMLFILE_OTHER,     NULL, NULL },
+        { &user_data, "primary",   NULL,        pri_db, CR_XMLFILE_PRIMARY,   NULL, NULL },
+        { &user_data, "filelists", NULL,        fil_db, CR_XMLFILE_FILELISTS, NULL, NULL },
+        { &user_data, "other",     NULL,        oth_db, CR_XMLFILE_OTHER,     NULL, NULL },
+        { &user_data, "checksums", NULL,        NULL,   CR_XMLFILE_PRIMARY,   NULL, sums_f },
+    };
+    guint writers_count = (cmd_options->no_database) ? 3 : 6;
+    if (sums_f)
+        writers[writers_count++] = writers[6];
+
+    user_data.ring = cr_reorderring_new(
+                    MAX(MIN_REORDER_RING_LEN,
+                        cmd_options->workers * REORDER_RING_LEN_PER_WORKER),
+                    writers_count);
+
+    for (guint x = 0; x < writers_count; x++)
+        writers[x].thread = g_thread_create(writer_thread, &writers[x],
+                                            TRUE, NULL);
+
+
+    // Start read engine
+
+    if (cmd_options->read_engine_enabled) {
+        user_data.read_engine = cr_readengine_new(
+                                        cmd_options->read_engine_backend,
+                                        0, 0, &tmp_err);
+        if (user_data.read_engine) {
+            g_debug("Read engine started (%s)",
+                    cr_readengine_backend_name(user_data.read_engine));
+        } else {
+            g_warning("%s - packages are read by workers",
+                      tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
+
+
     // Start pool
 
     g_thread_pool_set_max_threads(pool, cmd_options->workers, NULL);
     g_message("Pool started (with %d workers)", cmd_options->workers);
 
+    push_tasks(pool, &user_data, tasks);
+    g_ptr_array_free(tasks, TRUE);
 
-    // Wait until pool is finished
+
+    // Wait until pool and writers are finished
 
     g_thread_pool_free(pool, FALSE, TRUE);
     g_message("Pool finished");
 
-    cr_xml_dump_cleanup();
+    cr_readengine_free(user_data.read_engine);
+    user_data.read_engine = NULL;
+    cr_prefetcher_free(user_data.prefetcher);
+    user_data.prefetcher = NULL;
+
+    for (guint x = 0; x < writers_count; x++)
+        g_thread_join(writers[x].thread);
 
     cr_xmlfile_close(pri_cr_file, NULL);
     cr_xmlfile_close(fil_cr_file, NULL);
     cr_xmlfile_close(oth_cr_file, NULL);
 
-    g_queue_free(user_data.buffer);
-    g_mutex_free(user_data.mutex_buffer);
-    g_cond_free(user_data.cond_pri);
-    g_cond_free(user_data.cond_fil);
-    g_cond_free(user_data.cond_oth);
-    g_mutex_free(user_data.mutex_pri);
-    g_mutex_free(user_data.mutex_fil);
-    g_mutex_free(user_data.mutex_oth);
+    for (guint x = 0; x < sums_count; x++) {
+        int failed = ferror(sums_f[x]);
+        if (fclose(sums_f[x]) || failed) {
+            g_critical("Cannot write %s", sums_filenames[x]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    g_free(sums_f);
+
+    cr_reorderring_free(user_data.ring);
+    g_cond_free(user_data.early_cond);
+    g_mutex_free(user_data.early_mutex);
+
+    // Keep the packages in memory for the next run
+    if (cmd_options->watch)
+        watch_metadata = metadata_from_kept_tasks(user_data.kept_tasks,
+                                                  old_metadata);
+    g_ptr_array_free(user_data.kept_tasks, TRUE);
+    g_mutex_free(user_data.kept_mutex);
+
+    // All packages from the cache are freed now
+    cr_pkgcache_close(pkgcache);
+
+    if (pkgcache_writer) {
+        cr_pkgcache_writer_close(pkgcache_writer, &tmp_err);
+        if (tmp_err) {
+            g_warning("Cannot write package cache: %s", tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
 
 
     // Create repomd records for each file
@@ -1167,6 +2046,7 @@ main(int argc, char **argv)
     cr_RepomdRecord *groupfile_rec            = NULL;
     cr_RepomdRecord *compressed_groupfile_rec = NULL;
     cr_RepomdRecord *updateinfo_rec           = NULL;
+    cr_RepomdRecord **sums_recs = g_new0(cr_RepomdRecord *, sums_count + 1);
 
 
     // XML
@@ -1179,44 +2059,35 @@ main(int argc, char **argv)
     cr_contentstat_free(fil_stat, NULL);
     cr_contentstat_free(oth_stat, NULL);
 
-    GThreadPool *fill_pool = g_thread_pool_new(cr_repomd_record_fill_thread,
-                                               NULL, 3, FALSE, NULL);
-
-    cr_RepomdRecordFillTask *pri_fill_task;
-    cr_RepomdRecordFillTask *fil_fill_task;
-    cr_RepomdRecordFillTask *oth_fill_task;
-
-    pri_fill_task = cr_repomdrecordfilltask_new(pri_xml_rec,
-                                                cmd_options->checksum_type,
-                                                NULL);
-    g_thread_pool_push(fill_pool, pri_fill_task, NULL);
-
-    fil_fill_task = cr_repomdrecordfilltask_new(fil_xml_rec,
-                                                cmd_options->checksum_type,
-                                                NULL);
-    g_thread_pool_push(fill_pool, fil_fill_task, NULL);
+    cr_RepomdRecord *xml_recs[3] = { pri_xml_rec, fil_xml_rec, oth_xml_rec };
+    struct RecordTask xml_tasks[3];
+    struct RecordTask groupfile_task, updateinfo_task;
+    struct RecordTask *sums_tasks = g_new0(struct RecordTask, sums_count);
+    struct DbTask db_tasks[3];
+    cr_DagTask *xml_fills[3];
+
+    cr_TaskDag *dag = cr_taskdag_new(cmd_options->workers);
+
+    for (int x = 0; x < 3; x++) {
+        xml_tasks[x].record        = xml_recs[x];
+        xml_tasks[x].crecord       = NULL;
+        xml_tasks[x].checksum_type = cmd_options->checksum_type;
+        xml_fills[x] = add_record_tasks(dag, &xml_tasks[x], NULL,
+                                        cmd_options->unique_md_filenames);
+    }
 
-    oth_fill_task = cr_repomdrecordfilltask_new(oth_xml_rec,
-                                                cmd_options->checksum_type,
-                                                NULL);
-    g_thread_pool_push(fill_pool, oth_fill_task, NULL);
 
     // Groupfile
 
     if (groupfile) {
         groupfile_rec = cr_repomd_record_new("group", groupfile);
         compressed_groupfile_rec = cr_repomd_record_new("group_gz", groupfile);
-        cr_repomd_record_compress_and_fill(groupfile_rec,
-                                          compressed_groupfile_rec,
-                                          cmd_options->checksum_type,
-                                          groupfile_compression,
-                                          &tmp_err);
-        if (tmp_err) {
-            g_critical("Cannot process groupfile %s: %s",
-                       groupfile, tmp_err->message);
-            g_clear_error(&tmp_err);
-            exit(EXIT_FAILURE);
-        }
+        groupfile_task.record        = groupfile_rec;
+        groupfile_task.crecord       = compressed_groupfile_rec;
+        groupfile_task.compression   = groupfile_compression;
+        groupfile_task.checksum_type = cmd_options->checksum_type;
+        add_record_tasks(dag, &groupfile_task, NULL,
+                         cmd_options->unique_md_filenames);
     }
 
 
@@ -1224,138 +2095,83 @@ main(int argc, char **argv)
 
     if (updateinfo) {
         updateinfo_rec = cr_repomd_record_new("updateinfo", updateinfo);
-        cr_repomd_record_fill(updateinfo_rec,
-                              cmd_options->checksum_type,
-                              &tmp_err);
-        if (tmp_err) {
-            g_critical("Cannot process updateinfo %s: %s",
-                       updateinfo, tmp_err->message);
-            g_clear_error(&tmp_err);
-            exit(EXIT_FAILURE);
-        }
+        updateinfo_task.record        = updateinfo_rec;
+        updateinfo_task.crecord       = NULL;
+        updateinfo_task.checksum_type = cmd_options->checksum_type;
+        add_record_tasks(dag, &updateinfo_task, NULL,
+                         cmd_options->unique_md_filenames);
     }
 
 
-    // Wait till repomd record fill task of xml files ends.
+    // Checksum manifests
 
-    g_thread_pool_free(fill_pool, FALSE, TRUE);
+    for (guint x = 0; x < sums_count; x++) {
+        const char *name = cr_checksum_name_str(
+                                    cmd_options->extra_checksum_types[x]);
+        gchar *type = g_strconcat(name, "sums", NULL);
+        sums_recs[x] = cr_repomd_record_new(type, sums_filenames[x]);
+        sums_tasks[x].record        = sums_recs[x];
+        sums_tasks[x].crecord       = NULL;
+        sums_tasks[x].checksum_type = cmd_options->checksum_type;
+        add_record_tasks(dag, &sums_tasks[x], NULL,
+                         cmd_options->unique_md_filenames);
+        g_free(type);
+    }
+    g_strfreev(sums_filenames);
 
-    cr_repomdrecordfilltask_free(pri_fill_task, NULL);
-    cr_repomdrecordfilltask_free(fil_fill_task, NULL);
-    cr_repomdrecordfilltask_free(oth_fill_task, NULL);
 
     // Sqlite db
 
     if (!cmd_options->no_database) {
-
-        gchar *pri_db_name = g_strconcat(pri_db_filename,
-                                         sqlite_compression_suffix, NULL);
-        gchar *fil_db_name = g_strconcat(fil_db_filename,
-                                         sqlite_compression_suffix, NULL);
-        gchar *oth_db_name = g_strconcat(oth_db_filename,
+        cr_SqliteDb *dbs[3] = { pri_db, fil_db, oth_db };
+        const char *db_filenames[3] = { pri_db_filename,
+                                        fil_db_filename,
+                                        oth_db_filename };
+        const char *db_types[3] = { "primary_db",
+                                    "filelists_db",
+                                    "other_db" };
+
+        for (int x = 0; x < 3; x++) {
+            gchar *db_name = g_strconcat(db_filenames[x],
                                          sqlite_compression_suffix, NULL);
 
-        cr_db_dbinfo_update(pri_db, pri_xml_rec->checksum, NULL);
-        cr_db_dbinfo_update(fil_db, fil_xml_rec->checksum, NULL);
-        cr_db_dbinfo_update(oth_db, oth_xml_rec->checksum, NULL);
-
-        cr_db_close(pri_db, NULL);
-        cr_db_close(fil_db, NULL);
-        cr_db_close(oth_db, NULL);
-
-
-        // Compress dbs
-
-        GThreadPool *compress_pool =  g_thread_pool_new(cr_compressing_thread,
-                                                        NULL, 3, FALSE, NULL);
-
-        cr_CompressionTask *pri_db_task;
-        cr_CompressionTask *fil_db_task;
-        cr_CompressionTask *oth_db_task;
-
-        pri_db_task = cr_compressiontask_new(pri_db_filename,
-                                             pri_db_name,
-                                             sqlite_compression,
-                                             cmd_options->checksum_type,
-                                             1, NULL);
-        g_thread_pool_push(compress_pool, pri_db_task, NULL);
-
-        fil_db_task = cr_compressiontask_new(fil_db_filename,
-                                             fil_db_name,
-                                             sqlite_compression,
-                                             cmd_options->checksum_type,
-                                             1, NULL);
-        g_thread_pool_push(compress_pool, fil_db_task, NULL);
-
-        oth_db_task = cr_compressiontask_new(oth_db_filename,
-                                             oth_db_name,
-                                             sqlite_compression,
-                                             cmd_options->checksum_type,
-                                             1, NULL);
-        g_thread_pool_push(compress_pool, oth_db_task, NULL);
-
-        g_thread_pool_free(compress_pool, FALSE, TRUE);
-
-        // Prepare repomd records
-
-        pri_db_rec = cr_repomd_record_new("primary_db", pri_db_name);
-        fil_db_rec = cr_repomd_record_new("filelists_db", fil_db_name);
-        oth_db_rec = cr_repomd_record_new("other_db", oth_db_name);
-
-        g_free(pri_db_name);
-        g_free(fil_db_name);
-        g_free(oth_db_name);
-
-        cr_repomd_record_load_contentstat(pri_db_rec, pri_db_task->stat);
-        cr_repomd_record_load_contentstat(fil_db_rec, fil_db_task->stat);
-        cr_repomd_record_load_contentstat(oth_db_rec, oth_db_task->stat);
-
-        cr_compressiontask_free(pri_db_task, NULL);
-        cr_compressiontask_free(fil_db_task, NULL);
-        cr_compressiontask_free(oth_db_task, NULL);
-
-        fill_pool = g_thread_pool_new(cr_repomd_record_fill_thread,
-                                      NULL, 3, FALSE, NULL);
-
-        cr_RepomdRecordFillTask *pri_db_fill_task;
-        cr_RepomdRecordFillTask *fil_db_fill_task;
-        cr_RepomdRecordFillTask *oth_db_fill_task;
-
-        pri_db_fill_task = cr_repomdrecordfilltask_new(pri_db_rec,
-                                                       cmd_options->checksum_type,
-                                                       NULL);
-        g_thread_pool_push(fill_pool, pri_db_fill_task, NULL);
-
-        fil_db_fill_task = cr_repomdrecordfilltask_new(fil_db_rec,
-                                                       cmd_options->checksum_type,
-                                                       NULL);
-        g_thread_pool_push(fill_pool, fil_db_fill_task, NULL);
+            db_tasks[x].db  = dbs[x];
+            db_tasks[x].xml = &xml_tasks[x];
+            db_tasks[x].in_memory = cmd_options->sqlite_in_memory;
+            db_tasks[x].compression = cr_compressiontask_new(db_filenames[x],
+                                                    db_name,
+                                                    sqlite_compression,
+                                                    cmd_options->checksum_type,
+                                                    1, NULL);
+            db_tasks[x].db_record.record = cr_repomd_record_new(db_types[x],
+                                                                db_name);
+            db_tasks[x].db_record.crecord = NULL;
+            db_tasks[x].db_record.checksum_type = cmd_options->checksum_type;
+            add_db_tasks(dag, &db_tasks[x], xml_fills[x],
+                         cmd_options->unique_md_filenames);
+
+            g_free(db_name);
+        }
 
-        oth_db_fill_task = cr_repomdrecordfilltask_new(oth_db_rec,
-                                                       cmd_options->checksum_type,
-                                                       NULL);
-        g_thread_pool_push(fill_pool, oth_db_fill_task, NULL);
+        pri_db_rec = db_tasks[0].db_record.record;
+        fil_db_rec = db_tasks[1].db_record.record;
+        oth_db_rec = db_tasks[2].db_record.record;
+    }
 
-        g_thread_pool_free(fill_pool, FALSE, TRUE);
 
-        cr_repomdrecordfilltask_free(pri_db_fill_task, NULL);
-        cr_repomdrecordfilltask_free(fil_db_fill_task, NULL);
-        cr_repomdrecordfilltask_free(oth_db_fill_task, NULL);
-    }
+    // Wait till all records are filled and files renamed
 
+    cr_taskdag_run(dag, &tmp_err);
+    cr_taskdag_free(dag);
 
-    // Add checksums into files names
+    if (!cmd_options->no_database)
+        for (int x = 0; x < 3; x++)
+            cr_compressiontask_free(db_tasks[x].compression, NULL);
 
-    if (cmd_options->unique_md_filenames) {
-        cr_repomd_record_rename_file(pri_xml_rec, NULL);
-        cr_repomd_record_rename_file(fil_xml_rec, NULL);
-        cr_repomd_record_rename_file(oth_xml_rec, NULL);
-        cr_repomd_record_rename_file(pri_db_rec, NULL);
-        cr_repomd_record_rename_file(fil_db_rec, NULL);
-        cr_repomd_record_rename_file(oth_db_rec, NULL);
-        cr_repomd_record_rename_file(groupfile_rec, NULL);
-        cr_repomd_record_rename_file(compressed_groupfile_rec, NULL);
-        cr_repomd_record_rename_file(updateinfo_rec, NULL);
+    if (tmp_err) {
+        g_critical("%s", tmp_err->message);
+        g_clear_error(&tmp_err);
+        exit(EXIT_FAILURE);
     }
 
 
@@ -1370,6 +2186,10 @@ main(int argc, char **argv)
     cr_repomd_set_record(repomd_obj, groupfile_rec);
     cr_repomd_set_record(repomd_obj, compressed_groupfile_rec);
     cr_repomd_set_record(repomd_obj, updateinfo_rec);
+    for (guint x = 0; x < sums_count; x++)
+        cr_repomd_set_record(repomd_obj, sums_recs[x]);
+    g_free(sums_recs);
+    g_free(sums_tasks);
 
     int i = 0;
     while (cmd_options->repo_tags && cmd_options->repo_tags[i])
@@ -1484,12 +2304,7 @@ main(int argc, char **argv)
     if (old_metadata)
         cr_metadata_free(old_metadata);
 
-    g_free(in_repo);
-    g_free(out_repo);
     tmp_repodata_path = NULL;
-    g_free(tmp_out_repo);
-    g_free(in_dir);
-    g_free(out_dir);
     g_free(pri_xml_filename);
     g_free(fil_xml_filename);
     g_free(oth_xml_filename);
@@ -1499,7 +2314,41 @@ main(int argc, char **argv)
     g_free(groupfile);
     g_free(updateinfo);
 
+
+    // Wait for changes (--watch)
+
+    if (watch) {
+        GSList *changed = NULL;
+        GSList *removed = NULL;
+
+        g_message("Watching %s for changes", in_dir);
+        if (!repowatch_wait(watch, cmd_options->watch_delay,
+                            &changed, &removed, &tmp_err))
+        {
+            g_critical("Cannot watch %s: %s", in_dir, tmp_err->message);
+            g_clear_error(&tmp_err);
+            exit(EXIT_FAILURE);
+        }
+
+        g_message("%d packages added or modified, %d removed",
+                  g_slist_length(changed), g_slist_length(removed));
+
+        cr_slist_free_full(cmd_options->changed_pkgs, g_free);
+        cr_slist_free_full(cmd_options->removed_pkgs, g_free);
+        cmd_options->changed_pkgs = changed;
+        cmd_options->removed_pkgs = removed;
+        watch_rerun = TRUE;
+        goto next_run;
+    }
+
+    g_free(in_repo);
+    g_free(out_repo);
+    g_free(tmp_out_repo);
+    g_free(in_dir);
+    g_free(out_dir);
+
     free_options(cmd_options);
+    cr_xml_dump_cleanup();
     cr_package_parser_cleanup();
 
     g_debug("All done");
@@ -41,6 +41,8 @@ extern "C" {
 #include <glib.h>
 #include "checksum.h"
 #include "compression_wrapper.h"
+#include "delta_manifest.h"
+#include "dirwalk.h"
 #include "error.h"
 #include "load_metadata.h"
 #include "locate_metadata.h"
@@ -48,6 +50,9 @@ extern "C" {
 #include "package.h"
 #include "parsehdr.h"
 #include "parsepkg.h"
+#include "pkgcache.h"
+#include "prefetch.h"
+#include "readengine.h"
 #include "repomd.h"
 #include "sqlite.h"
 #include "threads.h"
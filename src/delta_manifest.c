@@ -0,0 +1,125 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <string.h>
+#include "delta_manifest.h"
+#include "error.h"
+#include "package.h"
+
+gboolean
+cr_delta_manifest_parse(const char *path,
+                        GSList **changed,
+                        GSList **removed,
+                        GError **err)
+{
+    char *content = NULL;
+    char **lines;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    if (!g_file_get_contents(path, &content, NULL, &tmp_err)) {
+        g_set_error(err, CR_DELTA_MANIFEST_ERROR, CRE_IO,
+                    "Cannot read delta manifest: %s", tmp_err->message);
+        g_error_free(tmp_err);
+        return FALSE;
+    }
+
+    lines = g_strsplit(content, "\n", 0);
+    g_free(content);
+
+    for (int x = 0; lines[x] != NULL; x++) {
+        char *line = g_strstrip(lines[x]);
+        char *relative_path;
+
+        if (!*line || *line == '#')
+            continue;
+
+        relative_path = line + 1;
+        while (g_ascii_isspace(*relative_path))
+            relative_path++;
+        while (*relative_path == '/')
+            relative_path++;
+
+        if (!g_ascii_isspace(line[1]) || !*relative_path
+            || !strchr("AMR", line[0]))
+        {
+            g_set_error(err, CR_DELTA_MANIFEST_ERROR, CRE_BADARG,
+                        "Bad line %d in delta manifest %s: \"%s\"",
+                        x + 1, path, line);
+            g_strfreev(lines);
+            return FALSE;
+        }
+
+        if (line[0] == 'R')
+            *removed = g_slist_prepend(*removed, g_strdup(relative_path));
+        else
+            *changed = g_slist_prepend(*changed, g_strdup(relative_path));
+    }
+
+    g_strfreev(lines);
+    return TRUE;
+}
+
+
+GSList *
+cr_delta_manifest_apply(GHashTable *packages,
+                        GSList *changed,
+                        GSList *removed,
+                        cr_ExcludeMatcher *excludes)
+{
+    GSList *to_read = NULL;
+    GHashTableIter iter;
+    gpointer key, value;
+
+    for (GSList *elem = removed; elem; elem = g_slist_next(elem))
+        if (!g_hash_table_remove(packages, elem->data))
+            g_warning("Removed package %s is not in the old metadata",
+                      (char *) elem->data);
+
+    for (GSList *elem = changed; elem; elem = g_slist_next(elem)) {
+        const char *relative_path = elem->data;
+
+        g_hash_table_remove(packages, relative_path);
+        if (cr_exclude_matcher_match(excludes, relative_path)) {
+            g_debug("Exclude masks hit - skipping: %s", relative_path);
+            continue;
+        }
+        to_read = g_slist_prepend(to_read, (gpointer) relative_path);
+    }
+
+    // Packages which are excluded now (e.g. masks changed since the last
+    // run) don't belong to the new metadata either
+    g_hash_table_iter_init(&iter, packages);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        cr_Package *pkg = value;
+
+        if (!pkg->location_href
+            || cr_exclude_matcher_match(excludes, pkg->location_href))
+        {
+            g_debug("Exclude masks hit - skipping: %s",
+                    pkg->location_href ? pkg->location_href : "(null)");
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+
+    return g_slist_reverse(to_read);
+}
@@ -0,0 +1,89 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_DELTA_MANIFEST_H__
+#define __C_CREATEREPOLIB_DELTA_MANIFEST_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include "dirwalk.h"
+
+/** \defgroup   delta_manifest  List of changed packages.
+ *
+ * A delta manifest lists packages which were added, modified or removed
+ * since the last run. Each line contains a flag and a path relative to
+ * the repository:
+ * \code
+ * # comment
+ * A Packages/new-1.0-1.noarch.rpm
+ * M Packages/rebuilt-2.0-1.x86_64.rpm
+ * R Packages/old-0.9-1.noarch.rpm
+ * \endcode
+ *
+ * Packages are identified by their location_href, so two packages with
+ * the same filename in different directories are different packages.
+ *
+ *  \addtogroup delta_manifest
+ *  @{
+ */
+
+/** Parse the delta manifest.
+ * Empty lines and lines starting with '#' are ignored, leading '/'
+ * characters of paths are stripped.
+ * @param path          path to the manifest
+ * @param changed       list of added and modified packages (newly
+ *                      allocated strings are prepended to the list)
+ * @param removed       list of removed packages (newly allocated strings
+ *                      are prepended to the list)
+ * @param err           GError **
+ * @return              TRUE on success
+ */
+gboolean cr_delta_manifest_parse(const char *path,
+                                 GSList **changed,
+                                 GSList **removed,
+                                 GError **err);
+
+/** Apply the changes to the packages from the old metadata.
+ * Removed and modified packages are removed from the hashtable together
+ * with packages which match the exclude masks. The remaining packages
+ * are the unchanged ones.
+ * @param packages      hashtable of packages with location_href as a key
+ *                      (see CR_HT_KEY_LOCATION_HREF)
+ * @param changed       list of added and modified packages
+ * @param removed       list of removed packages
+ * @param excludes      exclude masks matched against the paths (could
+ *                      be NULL)
+ * @return              list of packages from changed which have to be
+ *                      read (the strings are not copied)
+ */
+GSList *cr_delta_manifest_apply(GHashTable *packages,
+                                GSList *changed,
+                                GSList *removed,
+                                cr_ExcludeMatcher *excludes);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_DELTA_MANIFEST_H__ */
@@ -0,0 +1,417 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#define _GNU_SOURCE
+#include <glib.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#include "dirwalk.h"
+#include "error.h"
+#include "misc.h"
+
+#define DIRWALK_BUF_SIZE    (64*1024)   // Buffer for getdents64()
+
+/* Exclude matcher
+ * ===============
+ * All masks are translated into a single regular expression
+ * "^(?:mask1|mask2|...)\z" which works on raw bytes (the file names
+ * don't have to be valid UTF-8).
+ */
+
+/* One character for the '?' wildcard. The same rule as g_utf8_next_char()
+ * uses (the length of the character is given by its first byte),
+ * so the result is the same as the result of g_pattern_match().
+ */
+#define GLOB_ANY_CHAR_REGEX "(?:[\\x00-\\xBF\\xFE\\xFF]"    \
+                            "|[\\xC0-\\xDF]."               \
+                            "|[\\xE0-\\xEF].{2}"            \
+                            "|[\\xF0-\\xF7].{3}"            \
+                            "|[\\xF8-\\xFB].{4}"            \
+                            "|[\\xFC\\xFD].{5})"
+
+struct _cr_ExcludeMatcher {
+    GRegex *regex;  /*!< compiled masks (NULL if there are no masks) */
+};
+
+static void
+cr_glob_to_regex(GString *regex, const char *glob)
+{
+    const char *run = glob;
+
+    for (const char *cur = glob; ; cur++) {
+        if (*cur != '*' && *cur != '?' && *cur != '\0')
+            continue;
+
+        if (cur > run) {
+            gchar *escaped = g_regex_escape_string(run, cur - run);
+            g_string_append(regex, escaped);
+            g_free(escaped);
+        }
+
+        if (*cur == '\0')
+            break;
+
+        g_string_append(regex, (*cur == '*') ? ".*" : GLOB_ANY_CHAR_REGEX);
+        run = cur + 1;
+    }
+}
+
+cr_ExcludeMatcher *
+cr_exclude_matcher_new(char **globs, GError **err)
+{
+    cr_ExcludeMatcher *matcher;
+    GString *regex;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    matcher = g_new0(cr_ExcludeMatcher, 1);
+
+    if (!globs || !globs[0])
+        return matcher;
+
+    regex = g_string_new("^(?:");
+    for (int x = 0; globs[x]; x++) {
+        if (x)
+            g_string_append_c(regex, '|');
+        cr_glob_to_regex(regex, globs[x]);
+    }
+    g_string_append(regex, ")\\z");
+
+    matcher->regex = g_regex_new(regex->str,
+                                 G_REGEX_RAW | G_REGEX_DOTALL | G_REGEX_OPTIMIZE,
+                                 0,
+                                 &tmp_err);
+    g_string_free(regex, TRUE);
+
+    if (tmp_err) {
+        g_set_error(err, CR_DIRWALK_ERROR, CRE_BADARG,
+                    "Cannot compile exclude masks: %s", tmp_err->message);
+        g_error_free(tmp_err);
+        g_free(matcher);
+        return NULL;
+    }
+
+    return matcher;
+}
+
+gboolean
+cr_exclude_matcher_match(cr_ExcludeMatcher *matcher, const char *str)
+{
+    if (!matcher || !matcher->regex)
+        return FALSE;
+
+    return g_regex_match(matcher->regex, str, 0, NULL);
+}
+
+void
+cr_exclude_matcher_free(cr_ExcludeMatcher *matcher)
+{
+    if (!matcher)
+        return;
+
+    if (matcher->regex)
+        g_regex_unref(matcher->regex);
+    g_free(matcher);
+}
+
+/* Directory walk
+ * ==============
+ * Directories waiting for a scan are kept in a queue shared by all
+ * threads. A thread takes a directory, reads all its entries and
+ * queues the found subdirectories. The walk is done when the queue is
+ * empty and no thread is scanning a directory.
+ */
+
+typedef struct {
+    const char *suffix;
+    size_t root_len;                // Length of the path to the root dir
+    cr_ExcludeMatcher *excludes;
+    int flags;
+    cr_DirWalkFunc func;
+    void *cbdata;
+
+    GMutex *mutex;                  // Protects dirs and pending
+    GCond *cond;                    // Signals new dirs or end of the walk
+    GQueue dirs;                    // Dirs waiting for a scan
+    guint pending;                  // Dirs waiting for a scan or being
+                                    // scanned
+    GMutex *func_mutex;             // Serializes calls of the func
+} cr_DirWalk;
+
+#ifdef __linux__
+struct cr_linux_dirent64 {
+    guint64         d_ino;
+    gint64          d_off;
+    unsigned short  d_reclen;
+    unsigned char   d_type;
+    char            d_name[];
+};
+#endif
+
+/** Check if the entry is a directory (symbolic links are followed,
+ * the same as g_file_test(G_FILE_TEST_IS_DIR) does).
+ */
+static gboolean
+cr_dirwalk_is_dir(int dirfd, const char *name, unsigned char d_type)
+{
+    struct stat st;
+
+    if (d_type == DT_DIR)
+        return TRUE;
+
+    if (d_type != DT_UNKNOWN && d_type != DT_LNK)
+        return FALSE;
+
+    if (fstatat(dirfd, name, &st, 0) == -1)
+        return FALSE;
+
+    return S_ISDIR(st.st_mode);
+}
+
+/** Check if the entry is a symbolic link.
+ */
+static gboolean
+cr_dirwalk_is_symlink(int dirfd, const char *name, unsigned char d_type)
+{
+    struct stat st;
+
+    if (d_type != DT_UNKNOWN)
+        return d_type == DT_LNK;
+
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+        return FALSE;
+
+    return S_ISLNK(st.st_mode);
+}
+
+static void
+cr_dirwalk_entry(cr_DirWalk *walk,
+                 const char *dirname,
+                 int dirfd,
+                 const char *name,
+                 unsigned char d_type,
+                 GSList **subdirs)
+{
+    gchar *full_path;
+    const char *relative_path;
+
+    if (name[0] == '.'
+        && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        return;
+
+    if (!g_str_has_suffix(name, walk->suffix)) {
+        if (cr_dirwalk_is_dir(dirfd, name, d_type)) {
+            gchar *subdir = g_strconcat(dirname, "/", name, NULL);
+            g_debug("Dir to scan: %s", subdir);
+            *subdirs = g_slist_prepend(*subdirs, subdir);
+        }
+        return;
+    }
+
+    if ((walk->flags & CR_DIRWALK_SKIP_SYMLINKS)
+        && cr_dirwalk_is_symlink(dirfd, name, d_type))
+    {
+        g_debug("Skipped symlink: %s/%s", dirname, name);
+        return;
+    }
+
+    full_path = g_strconcat(dirname, "/", name, NULL);
+
+    relative_path = full_path + walk->root_len + 1;
+    if (cr_exclude_matcher_match(walk->excludes, relative_path)) {
+        g_debug("Exclude masks hit - skipping: %s", relative_path);
+        g_free(full_path);
+        return;
+    }
+
+    g_mutex_lock(walk->func_mutex);
+    walk->func(full_path, dirname, name, walk->cbdata);
+    g_mutex_unlock(walk->func_mutex);
+
+    g_free(full_path);
+}
+
+/** Read all entries of the directory.
+ */
+static void
+cr_dirwalk_scan(cr_DirWalk *walk, const char *dirname, char *buf)
+{
+    int fd;
+    GSList *subdirs = NULL;
+
+    fd = open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        g_warning("Cannot open directory: %s", dirname);
+        return;
+    }
+
+#ifdef __linux__
+    for (;;) {
+        long nread = syscall(SYS_getdents64, fd, buf, DIRWALK_BUF_SIZE);
+
+        if (nread == -1) {
+            g_warning("Cannot read directory %s: %s",
+                      dirname, strerror(errno));
+            break;
+        }
+
+        if (nread == 0)
+            break;
+
+        for (long pos = 0; pos < nread;) {
+            struct cr_linux_dirent64 *d = (void *) (buf + pos);
+            cr_dirwalk_entry(walk, dirname, fd, d->d_name, d->d_type,
+                             &subdirs);
+            pos += d->d_reclen;
+        }
+    }
+    close(fd);
+#else
+    CR_UNUSED(buf);
+    DIR *dirp = fdopendir(fd);
+    if (!dirp) {
+        g_warning("Cannot open directory: %s", dirname);
+        close(fd);
+        return;
+    }
+
+    struct dirent *d;
+    while ((d = readdir(dirp))) {
+#ifdef _DIRENT_HAVE_D_TYPE
+        unsigned char d_type = d->d_type;
+#else
+        unsigned char d_type = DT_UNKNOWN;
+#endif
+        cr_dirwalk_entry(walk, dirname, dirfd(dirp), d->d_name, d_type,
+                         &subdirs);
+    }
+    closedir(dirp);
+#endif
+
+    if (!subdirs)
+        return;
+
+    // Queue the subdirectories
+    g_mutex_lock(walk->mutex);
+    for (GSList *elem = subdirs; elem; elem = g_slist_next(elem)) {
+        g_queue_push_tail(&walk->dirs, elem->data);
+        walk->pending++;
+    }
+    g_cond_broadcast(walk->cond);
+    g_mutex_unlock(walk->mutex);
+    g_slist_free(subdirs);
+}
+
+static gpointer
+cr_dirwalk_thread(gpointer data)
+{
+    cr_DirWalk *walk = data;
+    char *buf = g_malloc(DIRWALK_BUF_SIZE);
+
+    for (;;) {
+        gchar *dirname;
+
+        g_mutex_lock(walk->mutex);
+        while (g_queue_is_empty(&walk->dirs) && walk->pending)
+            g_cond_wait(walk->cond, walk->mutex);
+        dirname = g_queue_pop_head(&walk->dirs);
+        g_mutex_unlock(walk->mutex);
+
+        if (!dirname)
+            break;  // Nothing left
+
+        cr_dirwalk_scan(walk, dirname, buf);
+        g_free(dirname);
+
+        g_mutex_lock(walk->mutex);
+        walk->pending--;
+        if (!walk->pending)
+            g_cond_broadcast(walk->cond);
+        g_mutex_unlock(walk->mutex);
+    }
+
+    g_free(buf);
+    return NULL;
+}
+
+void
+cr_dirwalk(const char *dir,
+           const char *suffix,
+           cr_ExcludeMatcher *excludes,
+           int flags,
+           int threads,
+           cr_DirWalkFunc func,
+           void *cbdata)
+{
+    cr_DirWalk walk;
+    GThread **thread_list;
+
+    assert(dir);
+    assert(suffix);
+    assert(func);
+
+    walk.suffix     = suffix;
+    walk.root_len   = strlen(dir);
+    walk.excludes   = excludes;
+    walk.flags      = flags;
+    walk.func       = func;
+    walk.cbdata     = cbdata;
+    walk.mutex      = g_mutex_new();
+    walk.cond       = g_cond_new();
+    walk.func_mutex = g_mutex_new();
+    g_queue_init(&walk.dirs);
+    g_queue_push_tail(&walk.dirs, g_strdup(dir));
+    walk.pending    = 1;
+
+    threads = MAX(1, threads);
+    thread_list = g_new0(GThread *, threads);
+
+    // The current thread is one of the walkers
+    for (int x = 1; x < threads; x++) {
+        GError *tmp_err = NULL;
+        thread_list[x] = g_thread_create(cr_dirwalk_thread, &walk,
+                                         TRUE, &tmp_err);
+        if (!thread_list[x]) {
+            g_debug("Cannot create dirwalk thread: %s", tmp_err->message);
+            g_error_free(tmp_err);
+            break;
+        }
+    }
+
+    cr_dirwalk_thread(&walk);
+
+    for (int x = 1; x < threads; x++)
+        if (thread_list[x])
+            g_thread_join(thread_list[x]);
+
+    g_free(thread_list);
+    g_mutex_free(walk.mutex);
+    g_cond_free(walk.cond);
+    g_mutex_free(walk.func_mutex);
+}
@@ -0,0 +1,129 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_DIRWALK_H__
+#define __C_CREATEREPOLIB_DIRWALK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/** \defgroup   dirwalk     Parallel directory walk.
+ *
+ * Recursive search for files with a given suffix. Directories are
+ * read by several threads at once, the entry type reported by the
+ * kernel is used to distinguish files from directories, so the walk
+ * doesn't need a stat() call per entry.
+ *
+ * Example:
+ * \code
+ * static void
+ * found(const char *full_path, const char *dirname,
+ *       const char *filename, void *cbdata)
+ * {
+ *     printf("%s\n", full_path);
+ * }
+ *
+ * char *globs[] = { "*debuginfo*", NULL };
+ * cr_ExcludeMatcher *excludes = cr_exclude_matcher_new(globs, NULL);
+ * cr_dirwalk("/foo/repo", ".rpm", excludes, CR_DIRWALK_DEFAULT, 4,
+ *            found, NULL);
+ * cr_exclude_matcher_free(excludes);
+ * \endcode
+ *
+ *  \addtogroup dirwalk
+ *  @{
+ */
+
+/** Compiled set of exclude glob masks.
+ */
+typedef struct _cr_ExcludeMatcher cr_ExcludeMatcher;
+
+/** Compile a list of glob masks into a single matcher. The masks
+ * have the same syntax and meaning as GPatternSpec masks ('*' matches
+ * any string, '?' a single character).
+ * @param globs         NULL terminated array of glob masks
+ * @param err           GError **
+ * @return              new cr_ExcludeMatcher or NULL on error
+ */
+cr_ExcludeMatcher *cr_exclude_matcher_new(char **globs, GError **err);
+
+/** Check if the string matches any of the masks. This function is
+ * thread safe.
+ * @param matcher       cr_ExcludeMatcher
+ * @param str           string
+ * @return              TRUE if any mask matches the whole string
+ */
+gboolean cr_exclude_matcher_match(cr_ExcludeMatcher *matcher,
+                                  const char *str);
+
+/** Free the matcher.
+ * @param matcher       cr_ExcludeMatcher
+ */
+void cr_exclude_matcher_free(cr_ExcludeMatcher *matcher);
+
+/** Flags of cr_dirwalk().
+ */
+typedef enum {
+    CR_DIRWALK_DEFAULT          = 0,        /*!< no flags */
+    CR_DIRWALK_SKIP_SYMLINKS    = 1 << 0,   /*!< skip files which are
+                                                 symbolic links */
+} cr_DirWalkFlags;
+
+/** Callback called for every found file. Calls are serialized.
+ * @param full_path     path to the file (dirname + "/" + filename)
+ * @param dirname       path to the directory of the file
+ * @param filename      name of the file
+ * @param cbdata        user data
+ */
+typedef void (*cr_DirWalkFunc)(const char *full_path,
+                               const char *dirname,
+                               const char *filename,
+                               void *cbdata);
+
+/** Recursively search the directory for files with the suffix.
+ * Entries which don't have the suffix and are directories (or symbolic
+ * links to directories) are searched. Directories which cannot be
+ * opened are reported by a warning and skipped.
+ * @param dir           path to the directory (without trailing '/')
+ * @param suffix        suffix of the wanted files (e.g. ".rpm")
+ * @param excludes      files which path relative to the dir matches
+ *                      are skipped (could be NULL)
+ * @param flags         cr_DirWalkFlags
+ * @param threads       number of threads used for the walk
+ * @param func          callback called for every found file
+ * @param cbdata        user data for the callback
+ */
+void cr_dirwalk(const char *dir,
+                const char *suffix,
+                cr_ExcludeMatcher *excludes,
+                int flags,
+                int threads,
+                cr_DirWalkFunc func,
+                void *cbdata);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_DIRWALK_H__ */
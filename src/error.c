@@ -75,6 +75,8 @@ cr_strerror(cr_Error rc)
             return "Assert error";
         case CRE_BADCMDARG:
             return "Bad command line argument(s)";
+        case CRE_ZSTD:
+            return "Zstandard library related error";
         default:
             return "Unknown error";
     }
@@ -104,6 +106,18 @@ cr_db_error_quark(void)
     return g_quark_from_static_string("cr_db_error");
 }
 
+GQuark
+cr_delta_manifest_error_quark(void)
+{
+    return g_quark_from_static_string("cr_delta_manifest_error");
+}
+
+GQuark
+cr_dirwalk_error_quark(void)
+{
+    return g_quark_from_static_string("cr_dirwalk_error");
+}
+
 GQuark
 cr_load_metadata_error_quark(void)
 {
@@ -122,6 +136,12 @@ cr_parsepkg_error_quark(void)
     return g_quark_from_static_string("cr_parsepkg_error");
 }
 
+GQuark
+cr_pkgcache_error_quark(void)
+{
+    return g_quark_from_static_string("cr_pkgcache_error");
+}
+
 GQuark
 cr_misc_error_quark(void)
 {
@@ -145,12 +165,24 @@ cr_repomd_record_error_quark(void)
     return g_quark_from_static_string("cr_repomd_record_error");
 }
 
+GQuark
+cr_sqliterepo_error_quark(void)
+{
+    return g_quark_from_static_string("cr_sqliterepo_error");
+}
+
 GQuark
 cr_threads_error_quark(void)
 {
     return g_quark_from_static_string("cr_threads_error");
 }
 
+GQuark
+cr_watch_error_quark(void)
+{
+    return g_quark_from_static_string("cr_watch_error");
+}
+
 GQuark
 cr_xml_dump_filelists_error_quark(void)
 {
@@ -80,6 +80,8 @@ typedef enum {
         object was changed (by you - a programmer) in a bad way */
     CRE_BADCMDARG, /*!<
         Bad command line argument(s) */
+    CRE_ZSTD, /*!<
+        Zstandard library related error */
 } cr_Error;
 
 /** Converts cr_Error return code to error string.
@@ -93,14 +95,19 @@ const char *cr_strerror(cr_Error rc);
 #define CR_CMD_ERROR                    cr_cmd_error_quark()
 #define CR_COMPRESSION_WRAPPER_ERROR    cr_compression_wrapper_error_quark()
 #define CR_DB_ERROR                     cr_db_error_quark()
+#define CR_DELTA_MANIFEST_ERROR         cr_delta_manifest_error_quark()
+#define CR_DIRWALK_ERROR                cr_dirwalk_error_quark()
 #define CR_LOAD_METADATA_ERROR          cr_load_metadata_error_quark()
 #define CR_LOCATE_METADATA_ERROR        cr_locate_metadata_error_quark()
 #define CR_MISC_ERROR                   cr_misc_error_quark()
 #define CR_MODIFYREPO_ERROR             cr_modifyrepo_error_quark()
 #define CR_PARSEPKG_ERROR               cr_parsepkg_error_quark()
+#define CR_PKGCACHE_ERROR               cr_pkgcache_error_quark()
 #define CR_REPOMD_ERROR                 cr_repomd_error_quark()
 #define CR_REPOMD_RECORD_ERROR          cr_repomd_record_error_quark()
+#define CR_SQLITEREPO_ERROR             cr_sqliterepo_error_quark()
 #define CR_THREADS_ERROR                cr_threads_error_quark()
+#define CR_WATCH_ERROR                  cr_watch_error_quark()
 #define CR_XML_DUMP_FILELISTS_ERROR     cr_xml_dump_filelists_error_quark()
 #define CR_XML_DUMP_OTHER_ERROR         cr_xml_dump_other_error_quark()
 #define CR_XML_DUMP_PRIMARY_ERROR       cr_xml_dump_primary_error_quark()
@@ -116,14 +123,19 @@ GQuark cr_checksum_error_quark(void);
 GQuark cr_cmd_error_quark(void);
 GQuark cr_compression_wrapper_error_quark(void);
 GQuark cr_db_error_quark(void);
+GQuark cr_delta_manifest_error_quark(void);
+GQuark cr_dirwalk_error_quark(void);
 GQuark cr_load_metadata_error_quark(void);
 GQuark cr_locate_metadata_error_quark(void);
 GQuark cr_misc_error_quark(void);
 GQuark cr_modifyrepo_error_quark(void);
 GQuark cr_parsepkg_error_quark(void);
+GQuark cr_pkgcache_error_quark(void);
 GQuark cr_repomd_error_quark(void);
 GQuark cr_repomd_record_error_quark(void);
+GQuark cr_sqliterepo_error_quark(void);
 GQuark cr_threads_error_quark(void);
+GQuark cr_watch_error_quark(void);
 GQuark cr_xml_dump_filelists_error_quark(void);
 GQuark cr_xml_dump_other_error_quark(void);
 GQuark cr_xml_dump_primary_error_quark(void);
@@ -39,7 +39,11 @@ struct _cr_Metadata {
     cr_HashTableKey key;    /*!< key used in hashtable */
     GHashTable *ht;         /*!< hashtable with packages */
     GStringChunk *chunk;    /*!< NULL or string chunk with strings from htn */
+    GSList *chunks;         /*!< Other string chunks with strings from htn
+                                 (filled by filelists and other parsers
+                                 if a single chunk is used) */
     GHashTable *pkglist_ht; /*!< list of allowed package basenames to load */
+    gboolean keep_raw_xml;  /*!< keep raw xml of the loaded packages */
 };
 
 cr_HashTableKey
@@ -111,6 +115,13 @@ cr_metadata_new(cr_HashTableKey key, int use_single_chunk, GSList *pkglist)
     return md;
 }
 
+void
+cr_metadata_set_keep_raw_xml(cr_Metadata *md, gboolean keep_raw_xml)
+{
+    assert(md);
+    md->keep_raw_xml = keep_raw_xml;
+}
+
 void
 cr_metadata_free(cr_Metadata *md)
 {
@@ -120,19 +131,63 @@ cr_metadata_free(cr_Metadata *md)
     cr_destroy_metadata_hashtable(md->ht);
     if (md->chunk)
         g_string_chunk_free(md->chunk);
+    for (GSList *elem = md->chunks; elem; elem = g_slist_next(elem))
+        g_string_chunk_free(elem->data);
+    g_slist_free(md->chunks);
     if (md->pkglist_ht)
         g_hash_table_destroy(md->pkglist_ht);
     g_free(md);
 }
 
 // Callbacks for XML parsers
+//
+// Primary, filelists and other xml files are parsed concurrently.
+// Primary parser (running in the calling thread) publishes packages into
+// the hashtable. Filelists and other parsers (running in their own threads)
+// parse data of each package into a temporary package (with its own
+// string chunk) and when the package is complete, its files/changelogs
+// are moved into the package published by the primary parser.
+// If the package is not published yet, filelists/other parser waits
+// until it is published or until the primary parser is done.
+
+typedef struct {
+    GMutex          *mutex;         /*!< Protects ht and package chunks
+                                         (NULL if loading is sequential) */
+    GCond           *cond;          /*!< Signalized when primary parser
+                                         publishes a package or ends */
+    gint            waiting;        /*!< Number of threads waiting on cond */
+    GHashTable      *skipped;       /*!< pkgIds of packages which primary
+                                         parser didn't store (NULL if
+                                         all packages are stored) */
+    gboolean        primary_done;   /*!< Primary parser has finished */
+    gboolean        primary_failed; /*!< Primary parser has failed */
+} cr_LoadSync;
 
 typedef struct {
     GHashTable      *ht;
     GStringChunk    *chunk;
     GHashTable      *pkglist_ht;
+    cr_LoadSync     *sync;
+    GStringChunk    *own_chunk;     /*!< String chunk of filelists/other
+                                         parser */
+    cr_Package      *current;       /*!< Temporary package being parsed
+                                         by filelists/other parser */
 } cr_CbData;
 
+static inline void
+load_sync_lock(cr_LoadSync *sync)
+{
+    if (sync->mutex)
+        g_mutex_lock(sync->mutex);
+}
+
+static inline void
+load_sync_unlock(cr_LoadSync *sync)
+{
+    if (sync->mutex)
+        g_mutex_unlock(sync->mutex);
+}
+
 static int
 primary_newpkgcb(cr_Package **pkg,
          const char *pkgId,
@@ -164,6 +219,7 @@ primary_pkgcb(cr_Package *pkg, void *cbdata, GError **err)
 {
     gboolean store_pkg = TRUE;
     cr_CbData *cb_data = cbdata;
+    cr_LoadSync *sync = cb_data->sync;
 
     CR_UNUSED(err);
 
@@ -183,13 +239,22 @@ primary_pkgcb(cr_Package *pkg, void *cbdata, GError **err)
         pkg->chunk = NULL;
     }
 
+    load_sync_lock(sync);
+
     if (!store_pkg) {
+        // Let filelists and other parsers know that they don't need
+        // to wait for this package
+        if (sync->skipped)
+            g_hash_table_insert(sync->skipped, g_strdup(pkg->pkgId), NULL);
         cr_package_free(pkg);
-        return CR_CB_RET_OK;
+    } else {
+        // Store package into the hashtable
+        g_hash_table_replace(cb_data->ht, pkg->pkgId, pkg);
     }
 
-    // Store package into the hashtable
-    g_hash_table_replace(cb_data->ht, pkg->pkgId, pkg);
+    if (sync->waiting)
+        g_cond_broadcast(sync->cond);
+    load_sync_unlock(sync);
 
     return CR_CB_RET_OK;
 }
@@ -202,110 +267,321 @@ newpkgcb(cr_Package **pkg,
          void *cbdata,
          GError **err)
 {
+    cr_Package *target;
     cr_CbData *cb_data = cbdata;
+    cr_LoadSync *sync = cb_data->sync;
 
     CR_UNUSED(name);
     CR_UNUSED(arch);
-    CR_UNUSED(err);
 
     assert(*pkg == NULL);
     assert(pkgId);
 
-    *pkg = g_hash_table_lookup(cb_data->ht, pkgId);
+    // Wait until the package is published by the primary parser
+    load_sync_lock(sync);
+    while (!(target = g_hash_table_lookup(cb_data->ht, pkgId))
+           && !sync->primary_done
+           && !(sync->skipped && g_hash_table_lookup_extended(sync->skipped,
+                                                              pkgId,
+                                                              NULL, NULL)))
+    {
+        sync->waiting++;
+        g_cond_wait(sync->cond, sync->mutex);
+        sync->waiting--;
+    }
 
-    if (*pkg && cb_data->chunk) {
-        assert(!(*pkg)->chunk);
-        (*pkg)->chunk = cb_data->chunk;
+    if (sync->primary_failed) {
+        load_sync_unlock(sync);
+        g_set_error(err, CR_LOAD_METADATA_ERROR, CRE_CBINTERRUPTED,
+                    "Primary parser failed");
+        return CR_CB_RET_ERR;
     }
+    load_sync_unlock(sync);
+
+    if (!target)
+        return CR_CB_RET_OK;  // Package is not wanted
+
+    // Parse into a temporary package
+    *pkg = cr_package_new_without_chunk();
+    (*pkg)->chunk = cb_data->own_chunk;
+    cb_data->current = *pkg;
 
     return CR_CB_RET_OK;
 }
 
+/** Copy strings of the files/changelogs (and their raw xml) into the chunk.
+ */
+static void
+rechunk_strings(cr_Package *pkg, GStringChunk *chunk)
+{
+    for (GSList *elem = pkg->files; elem; elem = g_slist_next(elem)) {
+        cr_PackageFile *file = elem->data;
+        file->path = cr_safe_string_chunk_insert_const(chunk, file->path);
+        file->name = cr_safe_string_chunk_insert(chunk, file->name);
+    }
+
+    for (GSList *elem = pkg->changelogs; elem; elem = g_slist_next(elem)) {
+        cr_ChangelogEntry *entry = elem->data;
+        entry->author = cr_safe_string_chunk_insert(chunk, entry->author);
+        entry->changelog = cr_safe_string_chunk_insert(chunk,
+                                                       entry->changelog);
+    }
+
+    pkg->xml_filelists = cr_safe_string_chunk_insert(chunk,
+                                                     pkg->xml_filelists);
+    pkg->xml_other = cr_safe_string_chunk_insert(chunk, pkg->xml_other);
+}
+
 static int
 pkgcb(cr_Package *pkg, void *cbdata, GError **err)
 {
+    cr_Package *target;
     cr_CbData *cb_data = cbdata;
+    cr_LoadSync *sync = cb_data->sync;
 
     CR_UNUSED(err);
 
-    if (cb_data->chunk) {
-        assert(pkg->chunk == cb_data->chunk);
-        pkg->chunk = NULL;
+    assert(pkg == cb_data->current);
+    assert(pkg->chunk == cb_data->own_chunk);
+    pkg->chunk = NULL;
+    cb_data->current = NULL;
+
+    load_sync_lock(sync);
+
+    target = g_hash_table_lookup(cb_data->ht, pkg->pkgId);
+    if (target) {
+        // Per package chunks are not shared between the packages, strings
+        // have to be copied. (The single chunk mode keeps the own_chunk.)
+        if (!cb_data->chunk)
+            rechunk_strings(pkg, target->chunk);
+
+        target->files = g_slist_concat(target->files, pkg->files);
+        pkg->files = NULL;
+        target->changelogs = g_slist_concat(target->changelogs,
+                                            pkg->changelogs);
+        pkg->changelogs = NULL;
+        if (pkg->xml_filelists)
+            target->xml_filelists = pkg->xml_filelists;
+        if (pkg->xml_other)
+            target->xml_other = pkg->xml_other;
     }
 
+    load_sync_unlock(sync);
+
+    cr_package_free(pkg);
+
+    // The own_chunk is just a temporary storage in per package chunk mode
+    if (!cb_data->chunk)
+        g_string_chunk_clear(cb_data->own_chunk);
+
     return CR_CB_RET_OK;
 }
 
+typedef enum {
+    LOAD_FILELISTS,
+    LOAD_OTHER,
+} cr_LoadFileType;
+
+/** Filelists or other xml parser function.
+ */
+typedef int (*cr_XmlParseFunc)(const char *path,
+                               cr_XmlParserNewPkgCb newpkgcb,
+                               void *newpkgcb_data,
+                               cr_XmlParserPkgCb pkgcb,
+                               void *pkgcb_data,
+                               cr_XmlParserWarningCb warningcb,
+                               void *warningcb_data,
+                               GError **err);
+
+/** Parser of filelists or other xml file.
+ */
+typedef struct {
+    cr_LoadFileType type;
+    const char      *path;
+    gboolean        keep_raw;
+    cr_CbData       cb_data;
+    GThread         *thread;
+    GError          *err;
+} cr_LoadJob;
+
+static gpointer
+load_job_run(gpointer data)
+{
+    cr_LoadJob *job = data;
+    cr_XmlParseFunc parse;
+    const char *name;
+
+    if (job->type == LOAD_FILELISTS) {
+        parse = job->keep_raw ? cr_xml_parse_filelists_raw
+                              : cr_xml_parse_filelists;
+        name  = "Filelists XML parser";
+    } else {
+        parse = job->keep_raw ? cr_xml_parse_other_raw
+                              : cr_xml_parse_other;
+        name  = "Other XML parser";
+    }
+
+    parse(job->path,
+          newpkgcb,
+          &job->cb_data,
+          pkgcb,
+          &job->cb_data,
+          cr_warning_cb,
+          (void *) name,
+          &job->err);
+
+    if (job->cb_data.current) {
+        // Parsing was interrupted - free the unfinished package
+        job->cb_data.current->chunk = NULL;
+        cr_package_free(job->cb_data.current);
+        job->cb_data.current = NULL;
+    }
+
+    return NULL;
+}
+
 static int
 cr_load_xml_files(GHashTable *hashtable,
                   const char *primary_xml_path,
                   const char *filelists_xml_path,
                   const char *other_xml_path,
                   GStringChunk *chunk,
+                  GSList **chunks,
                   GHashTable *pkglist_ht,
+                  gboolean keep_raw,
                   GError **err)
 {
     cr_CbData cb_data;
+    cr_LoadSync sync;
+    cr_LoadJob jobs[2];
+    int jobs_count = 0;
+    int ret = CRE_OK;
+    gboolean threaded = g_thread_supported();
     GError *tmp_err = NULL;
 
     assert(hashtable);
 
+    memset(&sync, 0, sizeof(sync));
+    if (threaded) {
+        sync.mutex = g_mutex_new();
+        sync.cond  = g_cond_new();
+        if (pkglist_ht)
+            sync.skipped = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                 g_free, NULL);
+    }
+
     // Prepare cb data
     cb_data.ht          = hashtable;
     cb_data.chunk       = chunk;
     cb_data.pkglist_ht  = pkglist_ht;
+    cb_data.sync        = &sync;
+    cb_data.own_chunk   = NULL;
+    cb_data.current     = NULL;
+
+    // Prepare filelists and other parsers
+    if (filelists_xml_path) {
+        jobs[jobs_count].type = LOAD_FILELISTS;
+        jobs[jobs_count].path = filelists_xml_path;
+        jobs_count++;
+    }
+
+    if (other_xml_path) {
+        jobs[jobs_count].type = LOAD_OTHER;
+        jobs[jobs_count].path = other_xml_path;
+        jobs_count++;
+    }
+
+    for (int x = 0; x < jobs_count; x++) {
+        cr_LoadJob *job = &jobs[x];
+        job->cb_data = cb_data;
+        job->keep_raw = keep_raw;
+        job->cb_data.own_chunk = g_string_chunk_new(STRINGCHUNK_SIZE);
+        job->thread = NULL;
+        job->err = NULL;
+
+        if (!threaded)
+            continue;
+
+        job->thread = g_thread_create(load_job_run, job, TRUE, &tmp_err);
+        if (!job->thread) {
+            // Parse it later in this thread
+            g_debug("%s: Cannot create thread: %s", __func__,
+                    tmp_err->message);
+            g_clear_error(&tmp_err);
+        }
+    }
+
+    // Parse primary in this thread
+    if (keep_raw)
+        cr_xml_parse_primary_raw(primary_xml_path,
+                                 primary_newpkgcb,
+                                 &cb_data,
+                                 primary_pkgcb,
+                                 &cb_data,
+                                 cr_warning_cb,
+                                 "Primary XML parser",
+                                 (filelists_xml_path) ? 0 : 1,
+                                 &tmp_err);
+    else
+        cr_xml_parse_primary(primary_xml_path,
+                             primary_newpkgcb,
+                             &cb_data,
+                             primary_pkgcb,
+                             &cb_data,
+                             cr_warning_cb,
+                             "Primary XML parser",
+                             (filelists_xml_path) ? 0 : 1,
+                             &tmp_err);
+
+    load_sync_lock(&sync);
+    sync.primary_done = TRUE;
+    sync.primary_failed = (tmp_err != NULL);
+    if (sync.waiting)
+        g_cond_broadcast(sync.cond);
+    load_sync_unlock(&sync);
+
+    // Wait for the filelists and other parsers
+    for (int x = 0; x < jobs_count; x++) {
+        if (jobs[x].thread)
+            g_thread_join(jobs[x].thread);
+        else if (!tmp_err)
+            load_job_run(&jobs[x]);
+    }
 
-    cr_xml_parse_primary(primary_xml_path,
-                         primary_newpkgcb,
-                         &cb_data,
-                         primary_pkgcb,
-                         &cb_data,
-                         cr_warning_cb,
-                         "Primary XML parser",
-                         (filelists_xml_path) ? 0 : 1,
-                         &tmp_err);
     if (tmp_err) {
-        int code = tmp_err->code;
+        ret = tmp_err->code;
         g_debug("primary.xml parsing error: %s", tmp_err->message);
         g_propagate_prefixed_error(err, tmp_err, "primary.xml parsing: ");
-        return code;
     }
 
-    if (filelists_xml_path) {
-        cr_xml_parse_filelists(filelists_xml_path,
-                               newpkgcb,
-                               &cb_data,
-                               pkgcb,
-                               &cb_data,
-                               cr_warning_cb,
-                               "Filelists XML parser",
-                               &tmp_err);
-        if (tmp_err) {
-            int code = tmp_err->code;
-            g_debug("filelists.xml parsing error: %s", tmp_err->message);
-            g_propagate_prefixed_error(err, tmp_err, "filelists.xml parsing: ");
-            return code;
+    for (int x = 0; x < jobs_count; x++) {
+        cr_LoadJob *job = &jobs[x];
+        const char *name = (job->type == LOAD_FILELISTS) ? "filelists.xml"
+                                                         : "other.xml";
+
+        if (job->err && ret == CRE_OK) {
+            ret = job->err->code;
+            g_debug("%s parsing error: %s", name, job->err->message);
+            g_propagate_prefixed_error(err, job->err, "%s parsing: ", name);
+        } else if (job->err) {
+            g_clear_error(&job->err);
         }
+
+        // In single chunk mode the strings of packages are in the own_chunk
+        if (chunk)
+            *chunks = g_slist_prepend(*chunks, job->cb_data.own_chunk);
+        else
+            g_string_chunk_free(job->cb_data.own_chunk);
     }
 
-    if (other_xml_path) {
-        cr_xml_parse_other(other_xml_path,
-                           newpkgcb,
-                           &cb_data,
-                           pkgcb,
-                           &cb_data,
-                           cr_warning_cb,
-                           "Other XML parser",
-                           &tmp_err);
-        if (tmp_err) {
-            int code = tmp_err->code;
-            g_debug("other.xml parsing error: %s", tmp_err->message);
-            g_propagate_prefixed_error(err, tmp_err, "other.xml parsing: ");
-            return code;
-        }
+    if (threaded) {
+        if (sync.skipped)
+            g_hash_table_destroy(sync.skipped);
+        g_cond_free(sync.cond);
+        g_mutex_free(sync.mutex);
     }
 
-    return CRE_OK;
+    return ret;
 }
 
 int
@@ -334,7 +610,9 @@ cr_metadata_load_xml(cr_Metadata *md,
                                ml->fil_xml_href,
                                ml->oth_xml_href,
                                md->chunk,
+                               &md->chunks,
                                md->pkglist_ht,
+                               md->keep_raw_xml,
                                &tmp_err);
 
     if (result != CRE_OK) {
@@ -362,6 +640,9 @@ cr_metadata_load_xml(cr_Metadata *md,
             case CR_HT_KEY_FILENAME:
                 new_key = cr_get_filename(pkg->location_href);
                 break;
+            case CR_HT_KEY_LOCATION_HREF:
+                new_key = pkg->location_href;
+                break;
             case CR_HT_KEY_HASH:
                 new_key = pkg->pkgId;
                 break;
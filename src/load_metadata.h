@@ -62,6 +62,8 @@ typedef enum {
     CR_HT_KEY_NAME,                     /*!< pkg name (cr_Package ->name) */
     CR_HT_KEY_FILENAME,                 /*!< pkg filename (cr_Package
                                              ->location_href) */
+    CR_HT_KEY_LOCATION_HREF,            /*!< path of the pkg in the repo
+                                             (cr_Package ->location_href) */
     CR_HT_KEY_SENTINEL,                 /*!< last element, terminator, .. */
 } cr_HashTableKey;
 
@@ -99,6 +101,15 @@ cr_Metadata *cr_metadata_new(cr_HashTableKey key,
                              int use_single_chunk,
                              GSList *pkglist);
 
+/** Keep raw xml of the loaded packages. If enabled, the following loads
+ * store the original xml of every package into its xml_primary,
+ * xml_filelists and xml_other members. This needs more memory, but
+ * the xml of unchanged packages could be reused without dumping.
+ * @param md            cr_Metadata object
+ * @param keep_raw_xml  keep raw xml of the packages
+ */
+void cr_metadata_set_keep_raw_xml(cr_Metadata *md, gboolean keep_raw_xml);
+
 /** Destroy metadata.
  * @param md            cr_Metadata object
  */
@@ -472,6 +472,9 @@ cr_remove_metadata(const char *repopath, GError **err)
             g_str_has_suffix(file, "primary.xml.xz") ||
             g_str_has_suffix(file, "filelists.xml.xz") ||
             g_str_has_suffix(file, "other.xml.xz") ||
+            g_str_has_suffix(file, "primary.xml.zst") ||
+            g_str_has_suffix(file, "filelists.xml.zst") ||
+            g_str_has_suffix(file, "other.xml.zst") ||
             g_str_has_suffix(file, "primary.xml") ||
             g_str_has_suffix(file, "filelists.xml") ||
             g_str_has_suffix(file, "other.xml") ||
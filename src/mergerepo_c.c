@@ -325,8 +325,14 @@ check_arguments(struct CmdOptions *options)
 
         if (type == CR_CW_UNKNOWN_COMPRESSION) {
             g_critical("Compression %s not available: Please choose from: "
-                       "gz or bz2 or xz", options->compress_type);
+                       "gz or bz2 or xz or zstd", options->compress_type);
             ret = FALSE;
+#ifndef CR_WITH_ZSTD
+        } else if (type == CR_CW_ZSTD_COMPRESSION) {
+            g_critical("Compression %s not available: zstd not supported "
+                       "(built without libzstd)", options->compress_type);
+            ret = FALSE;
+#endif
         } else {
             options->db_compression_type = type;
             options->groupfile_compression_type = type;
@@ -1009,6 +1015,9 @@ dump_merged_metadata(GHashTable *merged_hashtable,
     cr_ContentStat *pri_stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
     cr_ContentStat *fil_stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
     cr_ContentStat *oth_stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+    pri_stat->compressed_checksum_type = CR_CHECKSUM_SHA256;
+    fil_stat->compressed_checksum_type = CR_CHECKSUM_SHA256;
+    oth_stat->compressed_checksum_type = CR_CHECKSUM_SHA256;
 
     cr_XmlFile *pri_f;
     cr_XmlFile *fil_f;
@@ -1514,6 +1523,11 @@ main(int argc, char **argv)
     }
 
 
+    // Threads are used while loading metadata
+
+    g_thread_init(NULL);
+
+
     // Set logging
 
     g_log_set_default_handler (cr_log_fn, NULL);
@@ -326,6 +326,78 @@ cr_get_header_byte_range(const char *filename, GError **err)
     return results;
 }
 
+static inline unsigned int
+read_be32(const unsigned char *buf)
+{
+    return ((unsigned int) buf[0] << 24) | ((unsigned int) buf[1] << 16)
+           | ((unsigned int) buf[2] << 8) | (unsigned int) buf[3];
+}
+
+struct cr_HeaderRangeStruct
+cr_get_header_byte_range_from_buffer(const unsigned char *buf,
+                                     gsize len,
+                                     GError **err)
+{
+    // Same computation as in cr_get_header_byte_range() but over
+    // bytes which are already in the memory
+
+    struct cr_HeaderRangeStruct results;
+
+    assert(buf || len == 0);
+    assert(!err || *err == NULL);
+
+    results.start = 0;
+    results.end   = 0;
+
+    if (len < 112) {
+        g_set_error(err, CR_MISC_ERROR, CRE_IO,
+                    "Buffer is too short (%"G_GSIZE_FORMAT" bytes) "
+                    "to contain a signature header", len);
+        return results;
+    }
+
+    unsigned int sigindex = read_be32(buf + 104);
+    unsigned int sigdata  = read_be32(buf + 108);
+
+    unsigned int sigindexsize = sigindex * 16;
+    unsigned int sigsize = sigdata + sigindexsize;
+    unsigned int disttoboundary = sigsize % 8;
+    if (disttoboundary) {
+        disttoboundary = 8 - disttoboundary;
+    }
+    unsigned int hdrstart = 112 + sigsize + disttoboundary;
+
+    if (hdrstart < 112 || (gsize) hdrstart + 16 > len) {
+        g_set_error(err, CR_MISC_ERROR, CRE_IO,
+                    "Buffer is too short (%"G_GSIZE_FORMAT" bytes) "
+                    "to contain a header starting at %u", len, hdrstart);
+        return results;
+    }
+
+    unsigned int hdrindex = read_be32(buf + hdrstart + 8);
+    unsigned int hdrdata  = read_be32(buf + hdrstart + 12);
+    unsigned int hdrindexsize = hdrindex * 16;
+    unsigned int hdrsize = hdrdata + hdrindexsize + 16;
+    unsigned int hdrend = hdrstart + hdrsize;
+
+
+    // Check sanity
+
+    if (hdrend < hdrstart) {
+        g_debug("%s: sanity check fail (%d > %d))", __func__,
+                hdrstart, hdrend);
+        g_set_error(err, CR_MISC_ERROR, CRE_ERROR,
+                    "sanity check error (hdrstart: %d > hdrend: %d)",
+                    hdrstart, hdrend);
+        return results;
+    }
+
+    results.start = hdrstart;
+    results.end   = hdrend;
+
+    return results;
+}
+
 char *
 cr_get_filename(const char *filepath)
 {
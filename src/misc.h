@@ -118,6 +118,19 @@ struct cr_HeaderRangeStruct {
 struct cr_HeaderRangeStruct cr_get_header_byte_range(const char *filename,
                                                      GError **err);
 
+/** Return header byte range of a package which content (or at least
+ * the leading part with lead, signature and start of the header)
+ * is already in the memory.
+ * @param buf           buffer with the beginning of the rpm file
+ * @param len           number of valid bytes in the buffer
+ * @param err           GError **
+ * @return              header range (start = end = 0 on error)
+ */
+struct cr_HeaderRangeStruct cr_get_header_byte_range_from_buffer(
+                                                const unsigned char *buf,
+                                                gsize len,
+                                                GError **err);
+
 /** Return pointer to the rest of string after last '/'.
  * (e.g. for "/foo/bar" returns "bar")
  * @param filepath      path
@@ -116,6 +116,11 @@ cr_package_free(cr_Package *package)
         g_slist_free (package->changelogs);
     }
 
+    if (package->checksums) {
+        g_slist_foreach (package->checksums, (GFunc) g_free, NULL);
+        g_slist_free (package->checksums);
+    }
+
     g_free (package);
 }
 
@@ -191,6 +196,9 @@ cr_package_copy(cr_Package *orig)
     pkg->location_href    = cr_safe_string_chunk_insert(pkg->chunk, orig->location_href);
     pkg->location_base    = cr_safe_string_chunk_insert(pkg->chunk, orig->location_base);
     pkg->checksum_type    = cr_safe_string_chunk_insert(pkg->chunk, orig->checksum_type);
+    pkg->xml_primary      = cr_safe_string_chunk_insert(pkg->chunk, orig->xml_primary);
+    pkg->xml_filelists    = cr_safe_string_chunk_insert(pkg->chunk, orig->xml_filelists);
+    pkg->xml_other        = cr_safe_string_chunk_insert(pkg->chunk, orig->xml_other);
 
     pkg->requires  = cr_dependency_dup(pkg->chunk, orig->requires);
     pkg->provides  = cr_dependency_dup(pkg->chunk, orig->provides);
@@ -215,5 +223,14 @@ cr_package_copy(cr_Package *orig)
         pkg->changelogs = g_slist_prepend(pkg->changelogs, log);
     }
 
+    for (GSList *elem = orig->checksums; elem; elem = g_slist_next(elem)) {
+        cr_ChecksumValue *orig_checksum = elem->data;
+        cr_ChecksumValue *checksum = g_new0(cr_ChecksumValue, 1);
+        checksum->type     = cr_safe_string_chunk_insert(pkg->chunk, orig_checksum->type);
+        checksum->checksum = cr_safe_string_chunk_insert(pkg->chunk, orig_checksum->checksum);
+        pkg->checksums = g_slist_prepend(pkg->checksums, checksum);
+    }
+    pkg->checksums = g_slist_reverse(pkg->checksums);
+
     return pkg;
 }
@@ -27,6 +27,7 @@ extern "C" {
 #endif
 
 #include <glib.h>
+#include "checksum.h"
 
 /** \defgroup   package         Package representation.
  *  \addtogroup package
@@ -108,6 +109,16 @@ typedef struct {
 
     GStringChunk *chunk;        /*!< string chunk for store all package strings
                                      on the single place */
+
+    char *xml_primary;          /*!< raw xml of the package element as it was
+                                     loaded from a primary.xml (or NULL) */
+    char *xml_filelists;        /*!< raw xml of the package element as it was
+                                     loaded from a filelists.xml (or NULL) */
+    char *xml_other;            /*!< raw xml of the package element as it was
+                                     loaded from an other.xml (or NULL) */
+
+    GSList *checksums;          /*!< additional checksums of the package file
+                                     (list of cr_ChecksumValue structs) */
 } cr_Package;
 
 /** Create new (empty) dependency structure.
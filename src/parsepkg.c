@@ -20,10 +20,13 @@
 #include <glib.h>
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <rpm/rpmio.h>
 #include <rpm/rpmts.h>
 #include <rpm/rpmfi.h>
 #include <rpm/rpmlib.h>
@@ -35,8 +38,25 @@
 #include "misc.h"
 #include "checksum.h"
 
+#ifdef __linux__
+#include <sys/xattr.h>
+#define CR_CHECKSUM_XATTR
+#endif
+
+#define READ_BUFFER_SIZE        (1024*1024)
+
+// Checksum cache in extended attributes of the packages
+// Name: prefix + checksum name (e.g. "user.createrepo.sha256")
+// Value: "<version> <mtime>.<mtime_ns> <size> <inode> <header start>
+//         <header end> <checksum>"
+#define CHECKSUM_XATTR_PREFIX   "user.createrepo."
+#define CHECKSUM_XATTR_VERSION  "1"
+#define CHECKSUM_XATTR_MAX_LEN  256
+
 volatile short cr_initialized = 0;
 rpmts cr_ts = NULL;
+static cr_ChecksumCacheType cr_checksum_cache = CR_CHECKSUM_CACHE_NONE;
+static gboolean cr_use_mmap = TRUE;
 
 
 void
@@ -69,114 +89,668 @@ cr_package_parser_cleanup()
 }
 
 
+// Lead of the package: magic (4 bytes), major (1), minor (1), type (2), ..
+#define RPM_LEAD_SIZE           96
+#define RPM_LEAD_TYPE_OFFSET    6
+#define RPM_LEAD_TYPE_SOURCE    1
+// Header structure: magic (8 bytes), index length (4), data length (4), ..
+#define RPM_HEADER_MAGIC_SIZE   8
+
+
+static guint32
+read_be32(const unsigned char *buf)
+{
+    guint32 val;
+    memcpy(&val, buf, sizeof(val));
+    return GUINT32_FROM_BE(val);
+}
+
+
+/** Import the header of the package from its content which is already
+ * in the memory (buf contains at least the first hdr_r->end bytes of the
+ * file), so the header is not read and parsed again via rpmio.
+ * Like rpmReadPackageFile() does, the payload size from the signature
+ * header is added to the header (RPMTAG_ARCHIVESIZE, the only signature
+ * tag used by the parser) and legacy headers are retrofitted.
+ * Digests and signatures are not checked (the same as with the
+ * verify flags set by cr_package_parser_init()).
+ */
 static int
-read_header(const char *filename, Header *hdr, GError **err)
+header_from_buffer(const unsigned char *buf,
+                   const char *filename,
+                   struct cr_HeaderRangeStruct *hdr_r,
+                   Header *hdr,
+                   GError **err)
 {
-    assert(filename);
+    Header h, sigh;
+    guint32 sig_il, sig_dl, archive_size;
+    gsize sig_size;
+    unsigned char *blob;
+
     assert(!err || *err == NULL);
 
-    FD_t fd = Fopen(filename, "r.ufdio");
-    if (!fd) {
-        g_warning("%s: Fopen of %s failed %s",
-                  __func__, filename, strerror(errno));
+    // Signature header (the range of the main header is known, so it is
+    // at least 112 bytes long and the signature header is before it)
+
+    sig_il = read_be32(buf + RPM_LEAD_SIZE + RPM_HEADER_MAGIC_SIZE);
+    sig_dl = read_be32(buf + RPM_LEAD_SIZE + RPM_HEADER_MAGIC_SIZE + 4);
+    sig_size = 8 + (gsize) sig_il * 16 + sig_dl;
+    if (RPM_LEAD_SIZE + RPM_HEADER_MAGIC_SIZE + sig_size
+            > (gsize) hdr_r->start)
+    {
+        g_set_error(err, CR_PARSEPKG_ERROR, CRE_ERROR,
+                    "Bad signature header of %s", filename);
+        return CRE_ERROR;
+    }
+
+    blob = (unsigned char *) buf + RPM_LEAD_SIZE + RPM_HEADER_MAGIC_SIZE;
+    sigh = headerImport(blob, sig_size, HEADERIMPORT_COPY);
+    if (!sigh) {
+        g_set_error(err, CR_PARSEPKG_ERROR, CRE_ERROR,
+                    "Cannot import signature header of %s", filename);
+        return CRE_ERROR;
+    }
+    archive_size = headerGetNumber(sigh, RPMSIGTAG_PAYLOADSIZE);
+    headerFree(sigh);
+
+    // Main header
+
+    blob = (unsigned char *) buf + hdr_r->start + RPM_HEADER_MAGIC_SIZE;
+    h = headerImport(blob, hdr_r->end - hdr_r->start - RPM_HEADER_MAGIC_SIZE,
+                     HEADERIMPORT_COPY);
+    if (!h) {
+        g_set_error(err, CR_PARSEPKG_ERROR, CRE_ERROR,
+                    "Cannot import header of %s", filename);
+        return CRE_ERROR;
+    }
+
+    if (archive_size && !headerIsEntry(h, RPMTAG_ARCHIVESIZE))
+        headerPutUint32(h, RPMTAG_ARCHIVESIZE, &archive_size, 1);
+
+    // Retrofits of legacy headers
+
+    if (!headerIsEntry(h, RPMTAG_SOURCERPM)
+        && !headerIsEntry(h, RPMTAG_SOURCEPACKAGE)
+        && (buf[RPM_LEAD_TYPE_OFFSET] << 8 | buf[RPM_LEAD_TYPE_OFFSET+1])
+            == RPM_LEAD_TYPE_SOURCE)
+    {
+        guint32 one = 1;
+        headerPutUint32(h, RPMTAG_SOURCEPACKAGE, &one, 1);
+    }
+
+    if (headerIsEntry(h, RPMTAG_OLDFILENAMES))
+        headerConvert(h, HEADERCONV_COMPRESSFILELIST);
+
+    *hdr = h;
+    return CRE_OK;
+}
+
+
+/** Read the beginning of the file up to the end of the header with
+ * the known range and import the header.
+ */
+static int
+read_header_fd(int fd,
+               const char *filename,
+               struct cr_HeaderRangeStruct *hdr_r,
+               Header *hdr,
+               GError **err)
+{
+    int ret;
+    gsize filled = 0;
+    gsize len = (gsize) hdr_r->end;
+    unsigned char *buf;
+
+    assert(fd >= 0);
+    assert(!err || *err == NULL);
+
+    buf = g_malloc(len);
+    while (filled < len) {
+        ssize_t readed = pread(fd, buf + filled, len - filled, filled);
+        if (readed == -1 && errno == EINTR)
+            continue;
+        if (readed <= 0) {
+            g_set_error(err, CR_PARSEPKG_ERROR, CRE_IO,
+                        "Cannot read header of %s: %s", filename,
+                        readed ? strerror(errno) : "Unexpected end of file");
+            g_free(buf);
+            return CRE_IO;
+        }
+        filled += readed;
+    }
+
+    ret = header_from_buffer(buf, filename, hdr_r, hdr, err);
+    g_free(buf);
+    return ret;
+}
+
+
+/** Read up to len bytes from the current position of the fd. Less bytes
+ * are read only at the end of the file.
+ * @return              number of read bytes or -1 on error
+ */
+static gssize
+read_block(int fd, const char *filename, unsigned char *buf, gsize len,
+           GError **err)
+{
+    gsize filled = 0;
+
+    while (filled < len) {
+        ssize_t readed = read(fd, buf + filled, len - filled);
+        if (readed == -1) {
+            if (errno == EINTR)
+                continue;
+            g_set_error(err, CR_PARSEPKG_ERROR, CRE_IO,
+                        "read() error on %s: %s", filename, strerror(errno));
+            return -1;
+        }
+        if (readed == 0)
+            break;  // EOF
+        filled += readed;
+    }
+
+    return filled;
+}
+
+
+/** Compute checksums of the whole file, header byte range and import
+ * the header in a single pass over the file content. If the content is
+ * not passed in data, the file is mmaped (unless disabled by
+ * cr_package_parser_set_mmap()), if it is not possible, it is
+ * sequentially read via a large buffer.
+ */
+static int
+checksum_and_header_range_fd(int fd,
+                             const char *filename,
+                             const unsigned char *data,
+                             gint64 size,
+                             const cr_ChecksumType *checksum_types,
+                             char ***checksums,
+                             struct cr_HeaderRangeStruct *hdr_r,
+                             Header *hdr,
+                             GError **err)
+{
+    cr_ChecksumMultiCtx *ctx;
+    GError *tmp_err = NULL;
+
+    assert(fd >= 0);
+    assert(checksums);
+    assert(hdr_r);
+    assert(hdr);
+    assert(!err || *err == NULL);
+
+    *checksums = NULL;
+    *hdr = NULL;
+
+    ctx = cr_checksum_multi_new(checksum_types, &tmp_err);
+    if (!ctx) {
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "Error while checksum calculation: ");
+        return CRE_ERROR;
+    }
+
+    // Use the already read content or try mmap
+
+    void *map = MAP_FAILED;
+    if (!data && cr_use_mmap && size > 0
+        && (guint64) size <= (guint64) G_MAXSIZE)
+    {
+        map = mmap(NULL, (size_t) size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            posix_madvise(map, (size_t) size, POSIX_MADV_SEQUENTIAL);
+            data = map;
+        }
+    }
+
+    if (data) {
+        *hdr_r = cr_get_header_byte_range_from_buffer(data, (gsize) size,
+                                                      &tmp_err);
+        if (!tmp_err && hdr_r->end > size)
+            g_set_error(&tmp_err, CR_PARSEPKG_ERROR, CRE_ERROR,
+                        "Header ends (%u) after the end of the file "
+                        "(%"G_GINT64_FORMAT")", hdr_r->end, size);
+        if (tmp_err) {
+            g_propagate_prefixed_error(err, tmp_err,
+                                   "Error while determinig header range: ");
+            if (map != MAP_FAILED)
+                munmap(map, (size_t) size);
+            g_strfreev(cr_checksum_multi_final(ctx, NULL));
+            return CRE_ERROR;
+        }
+
+        header_from_buffer(data, filename, hdr_r, hdr, &tmp_err);
+        if (!tmp_err)
+            cr_checksum_multi_update(ctx, data, (size_t) size, &tmp_err);
+        if (map != MAP_FAILED)
+            munmap(map, (size_t) size);
+        if (tmp_err) {
+            g_propagate_prefixed_error(err, tmp_err,
+                                   "Error while reading %s: ", filename);
+            g_strfreev(cr_checksum_multi_final(ctx, NULL));
+            if (*hdr)
+                *hdr = headerFree(*hdr);
+            return CRE_ERROR;
+        }
+
+        *checksums = cr_checksum_multi_final(ctx, &tmp_err);
+        if (tmp_err) {
+            g_propagate_prefixed_error(err, tmp_err,
+                                   "Error while checksum calculation: ");
+            *hdr = headerFree(*hdr);
+            return CRE_ERROR;
+        }
+
+        return CRE_OK;
+    }
+
+    if (cr_use_mmap && size > 0)
+        g_debug("%s: mmap of %s failed (%s) - using read()",
+                __func__, filename, strerror(errno));
+
+    // Fallback - read the file via a large buffer
+    // The first block is extended until it contains the whole header
+
+    if (lseek(fd, 0, SEEK_SET) == (off_t) -1) {
         g_set_error(err, CR_PARSEPKG_ERROR, CRE_IO,
-                    "Fopen failed: %s", strerror(errno));
+                    "lseek failed on %s: %s", filename, strerror(errno));
+        g_strfreev(cr_checksum_multi_final(ctx, NULL));
         return CRE_IO;
     }
 
-    int rc = rpmReadPackageFile(cr_ts, fd, NULL, hdr);
-    if (rc != RPMRC_OK) {
-        switch (rc) {
-            case RPMRC_NOKEY:
-                g_debug("%s: %s: Public key is unavailable.",
-                        __func__, filename);
-                break;
-            case RPMRC_NOTTRUSTED:
-                g_debug("%s:  %s: Signature is OK, but key is not trusted.",
-                        __func__, filename);
-                break;
-            default:
-                g_warning("%s: rpmReadPackageFile() error (%s)",
-                          __func__, strerror(errno));
-                g_set_error(err, CR_PARSEPKG_ERROR, CRE_IO,
-                            "rpmReadPackageFile() error: %s", strerror(errno));
-                Fclose(fd);
-                return CRE_IO;
+    gsize buf_size = READ_BUFFER_SIZE;
+    unsigned char *buf = g_malloc(buf_size);
+    gsize filled = 0;
+    gboolean eof = FALSE;
+
+    while (1) {
+        gssize readed = read_block(fd, filename, buf + filled,
+                                   buf_size - filled, &tmp_err);
+        if (readed == -1)
+            break;
+        filled += readed;
+        eof = (filled < buf_size);
+
+        // A too short buffer is reported as CRE_IO
+        *hdr_r = cr_get_header_byte_range_from_buffer(buf, filled, &tmp_err);
+        if (!tmp_err && (gsize) hdr_r->end <= filled)
+            break;
+        if (eof || (tmp_err && tmp_err->code != CRE_IO)) {
+            if (!tmp_err)
+                g_set_error(&tmp_err, CR_PARSEPKG_ERROR, CRE_ERROR,
+                            "Header ends (%u) after the end of the "
+                            "file", hdr_r->end);
+            g_prefix_error(&tmp_err, "Error while determinig header range: ");
+            break;
         }
+
+        if (tmp_err)
+            buf_size *= 2;
+        else
+            buf_size = MAX(buf_size, (gsize) hdr_r->end);
+        g_clear_error(&tmp_err);
+        buf = g_realloc(buf, buf_size);
+    }
+
+    if (!tmp_err)
+        header_from_buffer(buf, filename, hdr_r, hdr, &tmp_err);
+
+    while (!tmp_err) {
+        cr_checksum_multi_update(ctx, buf, filled, &tmp_err);
+        if (tmp_err) {
+            g_prefix_error(&tmp_err, "Error while checksum calculation: ");
+            break;
+        }
+
+        if (eof)
+            break;
+
+        gssize readed = read_block(fd, filename, buf, buf_size, &tmp_err);
+        if (readed == -1)
+            break;
+        filled = readed;
+        eof = (filled < buf_size);
+    }
+
+    g_free(buf);
+
+    if (tmp_err) {
+        g_propagate_error(err, tmp_err);
+        g_strfreev(cr_checksum_multi_final(ctx, NULL));
+        if (*hdr)
+            *hdr = headerFree(*hdr);
+        return CRE_IO;
+    }
+
+    *checksums = cr_checksum_multi_final(ctx, &tmp_err);
+    if (tmp_err) {
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "Error while checksum calculation: ");
+        *hdr = headerFree(*hdr);
+        return CRE_ERROR;
     }
 
-    Fclose(fd);
     return CRE_OK;
 }
 
-cr_Package *
-cr_package_from_rpm(const char *filename,
-                    cr_ChecksumType checksum_type,
-                    const char *location_href,
-                    const char *location_base,
-                    int changelog_limit,
-                    struct stat *stat_buf,
-                    GError **err)
+
+void
+cr_package_parser_set_checksum_cache(cr_ChecksumCacheType type)
 {
-    cr_Package *pkg = NULL;
-    const char *checksum_type_str;
+    cr_checksum_cache = type;
+}
+
+
+void
+cr_package_parser_set_mmap(gboolean use_mmap)
+{
+    cr_use_mmap = use_mmap;
+}
+
+
+#ifdef CR_CHECKSUM_XATTR
+/** Length of the hexadecimal checksum of the type (0 if unknown).
+ */
+static size_t
+checksum_hex_len(cr_ChecksumType type)
+{
+    switch (type) {
+        case CR_CHECKSUM_MD5:       return 32;
+        case CR_CHECKSUM_SHA:
+        case CR_CHECKSUM_SHA1:      return 40;
+        case CR_CHECKSUM_SHA224:    return 56;
+        case CR_CHECKSUM_SHA256:    return 64;
+        case CR_CHECKSUM_SHA384:    return 96;
+        case CR_CHECKSUM_SHA512:    return 128;
+        default:                    return 0;
+    }
+}
+#endif
+
+
+/** Load checksum and header range of the package from the extended
+ * attribute. The cached values are used only if the mtime, size and inode
+ * of the file are the same as they were when the checksum was computed
+ * and if they are sane (the header range lies within the file and the
+ * checksum has the length of the checksum type). Otherwise the checksum
+ * is computed again.
+ * @return              TRUE if a valid cached checksum was found
+ */
+static gboolean
+checksum_cache_get(int fd,
+                   const struct stat *stat_buf,
+                   cr_ChecksumType checksum_type,
+                   char **checksum,
+                   struct cr_HeaderRangeStruct *hdr_r)
+{
+#ifdef CR_CHECKSUM_XATTR
+    char name[64];
+    char value[CHECKSUM_XATTR_MAX_LEN + 1];
+    char cached[CHECKSUM_XATTR_MAX_LEN + 1];
+    long long mtime, size, start, end;
+    long mtime_ns;
+    unsigned long long ino;
+    ssize_t len;
+
+    g_snprintf(name, sizeof(name), CHECKSUM_XATTR_PREFIX "%s",
+               cr_checksum_name_str(checksum_type));
+
+    len = fgetxattr(fd, name, value, CHECKSUM_XATTR_MAX_LEN);
+    if (len <= 0)
+        return FALSE;
+    value[len] = '\0';
+
+    if (sscanf(value, CHECKSUM_XATTR_VERSION " %lld.%ld %lld %llu %lld %lld %256s",
+               &mtime, &mtime_ns, &size, &ino, &start, &end, cached) != 7)
+        return FALSE;
+
+    if (mtime != (long long) stat_buf->st_mtim.tv_sec
+        || mtime_ns != stat_buf->st_mtim.tv_nsec
+        || size != (long long) stat_buf->st_size
+        || ino != (unsigned long long) stat_buf->st_ino)
+        return FALSE;   // The file has been changed
+
+    if (start < 0 || end <= start || end > size) {
+        g_debug("%s: Bad cached header range %lld-%lld (file size %lld)",
+                __func__, start, end, size);
+        return FALSE;
+    }
+
+    if (strlen(cached) != checksum_hex_len(checksum_type)) {
+        g_debug("%s: Bad length of the cached %s checksum", __func__,
+                cr_checksum_name_str(checksum_type));
+        return FALSE;
+    }
+
+    for (char *c = cached; *c; c++)
+        if (!g_ascii_isxdigit(*c))
+            return FALSE;
+
+    *checksum = g_strdup(cached);
+    hdr_r->start = start;
+    hdr_r->end = end;
+    return TRUE;
+#else
+    CR_UNUSED(fd);
+    CR_UNUSED(stat_buf);
+    CR_UNUSED(checksum_type);
+    CR_UNUSED(checksum);
+    CR_UNUSED(hdr_r);
+    return FALSE;
+#endif
+}
+
+
+/** Store checksum and header range of the package to the extended
+ * attribute. Failures (e.g. a read-only file or a filesystem without
+ * extended attributes) are ignored.
+ */
+static void
+checksum_cache_set(int fd,
+                   const char *filename,
+                   const struct stat *stat_buf,
+                   cr_ChecksumType checksum_type,
+                   const char *checksum,
+                   struct cr_HeaderRangeStruct *hdr_r)
+{
+#ifdef CR_CHECKSUM_XATTR
+    char name[64];
+    char *value;
+
+    g_snprintf(name, sizeof(name), CHECKSUM_XATTR_PREFIX "%s",
+               cr_checksum_name_str(checksum_type));
+
+    value = g_strdup_printf(CHECKSUM_XATTR_VERSION " %lld.%09ld %lld %llu %lld %lld %s",
+                            (long long) stat_buf->st_mtim.tv_sec,
+                            (long) stat_buf->st_mtim.tv_nsec,
+                            (long long) stat_buf->st_size,
+                            (unsigned long long) stat_buf->st_ino,
+                            (long long) hdr_r->start,
+                            (long long) hdr_r->end,
+                            checksum);
+
+    if (fsetxattr(fd, name, value, strlen(value), 0) == -1)
+        g_debug("%s: Cannot store checksum of %s to %s: %s",
+                __func__, filename, name, strerror(errno));
+
+    g_free(value);
+#else
+    CR_UNUSED(fd);
+    CR_UNUSED(filename);
+    CR_UNUSED(stat_buf);
+    CR_UNUSED(checksum_type);
+    CR_UNUSED(checksum);
+    CR_UNUSED(hdr_r);
+#endif
+}
+
+
+/** Read everything what is needed for cr_package_from_header() or
+ * cr_xml_from_header() from an already opened package file.
+ */
+static int
+read_package_fd(int fd,
+                const char *filename,
+                const unsigned char *data,
+                cr_ChecksumType checksum_type,
+                const cr_ChecksumType *extra_checksums,
+                struct stat *stat_buf,
+                Header *hdr,
+                gint64 *mtime,
+                gint64 *size,
+                char **checksum,
+                char ***extra,
+                struct cr_HeaderRangeStruct *hdr_r,
+                GError **err)
+{
+    int extra_count = 0;
+    cr_ChecksumType *types;
+    char **checksums;
+    struct stat stat_buf_own;
+    gboolean use_cache;
     GError *tmp_err = NULL;
 
-    assert(filename);
     assert(!err || *err == NULL);
 
-    checksum_type_str = cr_checksum_name_str(checksum_type);
+    while (extra_checksums && extra_checksums[extra_count] != CR_CHECKSUM_UNKNOWN)
+        extra_count++;
 
+    // Only the main checksum is cached
+    use_cache = (cr_checksum_cache != CR_CHECKSUM_CACHE_NONE && !extra_count);
 
-    // Read header
 
-    Header hdr;
-    read_header(filename, &hdr, &tmp_err);
+    // Get file stat (the cache needs the inode and the exact mtime of
+    // the opened file)
+
+    if (!stat_buf || use_cache) {
+        if (fstat(fd, &stat_buf_own) == -1) {
+            g_warning("%s: fstat() error (%s)", __func__, strerror(errno));
+            g_set_error(err,  CR_PARSEPKG_ERROR, CRE_IO, "fstat() failed");
+            return CRE_IO;
+        }
+        stat_buf = &stat_buf_own;
+    }
+
+    *mtime  = stat_buf->st_mtime;
+    *size   = stat_buf->st_size;
+
+
+    // Load checksum and header range from the cache
+
+    if (use_cache) {
+        checksums = g_new0(char *, 2);
+        if (checksum_cache_get(fd, stat_buf, checksum_type,
+                               &checksums[0], hdr_r))
+            goto read_header;
+        g_free(checksums);
+    }
+
+
+    // Compute checksums and get header range
+
+    types = g_new(cr_ChecksumType, extra_count + 2);
+    types[0] = checksum_type;
+    for (int x = 0; x < extra_count; x++)
+        types[x+1] = extra_checksums[x];
+    types[extra_count+1] = CR_CHECKSUM_UNKNOWN;
+
+    checksum_and_header_range_fd(fd, filename, data, *size, types,
+                                 &checksums, hdr_r, hdr, &tmp_err);
+    g_free(types);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
-        return NULL;
+        return CRE_ERROR;
     }
 
+    if (use_cache)
+        checksum_cache_set(fd, filename, stat_buf, checksum_type,
+                           checksums[0], hdr_r);
 
-    // Get file stat
+    goto done;
 
-    gint64 mtime;
-    gint64 size;
 
-    if (!stat_buf) {
-        struct stat stat_buf_own;
-        if (stat(filename, &stat_buf_own) == -1) {
-            g_warning("%s: stat() error (%s)", __func__, strerror(errno));
-            g_set_error(err,  CR_PARSEPKG_ERROR, CRE_IO, "stat() failed");
-            headerFree(hdr);
-            return NULL;
-        }
-        mtime  = stat_buf_own.st_mtime;
-        size   = stat_buf_own.st_size;
+read_header:
+
+
+    // The checksum was cached, read just the header
+
+    read_header_fd(fd, filename, hdr_r, hdr, &tmp_err);
+    if (tmp_err) {
+        g_propagate_error(err, tmp_err);
+        g_strfreev(checksums);
+        return CRE_IO;
+    }
+
+
+done:
+
+    // The first checksum is the main one, the rest are the extra ones
+
+    *checksum = checksums[0];
+    if (extra) {
+        *extra = g_new0(char *, extra_count + 1);
+        for (int x = 0; x < extra_count; x++)
+            (*extra)[x] = checksums[x+1];
     } else {
-        mtime  = stat_buf->st_mtime;
-        size   = stat_buf->st_size;
+        for (int x = 0; x < extra_count; x++)
+            g_free(checksums[x+1]);
     }
+    g_free(checksums);
 
+    return CRE_OK;
+}
 
-    // Compute checksum
 
-    char *checksum = cr_checksum_file(filename, checksum_type, &tmp_err);
-    if (tmp_err) {
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while checksum calculation: ");
-        headerFree(hdr);
-        return NULL;
+static int
+open_package(const char *filename, GError **err)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        g_warning("%s: open of %s failed %s",
+                  __func__, filename, strerror(errno));
+        g_set_error(err, CR_PARSEPKG_ERROR, CRE_IO,
+                    "Cannot open %s: %s", filename, strerror(errno));
     }
+    return fd;
+}
 
 
-    // Get header range
+static cr_Package *
+package_from_rpm_fd(int fd,
+                    const char *filename,
+                    const unsigned char *data,
+                    cr_ChecksumType checksum_type,
+                    const cr_ChecksumType *extra_checksums,
+                    const char *location_href,
+                    const char *location_base,
+                    int changelog_limit,
+                    struct stat *stat_buf,
+                    GError **err)
+{
+    cr_Package *pkg = NULL;
+    const char *checksum_type_str;
+    GError *tmp_err = NULL;
 
-    struct cr_HeaderRangeStruct hdr_r = cr_get_header_byte_range(filename,
-                                                                 &tmp_err);
+    assert(fd >= 0);
+    assert(filename);
+    assert(!err || *err == NULL);
+
+    checksum_type_str = cr_checksum_name_str(checksum_type);
+
+
+    // Read all needed info in a single pass
+
+    Header hdr;
+    gint64 mtime;
+    gint64 size;
+    char *checksum;
+    char **extra;
+    struct cr_HeaderRangeStruct hdr_r;
+
+    read_package_fd(fd, filename, data, checksum_type, extra_checksums,
+                    stat_buf, &hdr, &mtime, &size, &checksum, &extra, &hdr_r,
+                    &tmp_err);
     if (tmp_err) {
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while determinig header range: ");
+        g_propagate_error(err, tmp_err);
         return NULL;
     }
 
@@ -190,11 +764,90 @@ cr_package_from_rpm(const char *filename,
     headerFree(hdr);
 
     if (tmp_err) {
+        g_strfreev(extra);
         g_propagate_prefixed_error(err, tmp_err,
                                    "Error while checksum calculation:");
         return NULL;
     }
 
+
+    // Store the extra checksums
+
+    for (int x = 0; extra[x]; x++) {
+        cr_ChecksumValue *value = g_new0(cr_ChecksumValue, 1);
+        value->type = g_string_chunk_insert(pkg->chunk,
+                            cr_checksum_name_str(extra_checksums[x]));
+        value->checksum = g_string_chunk_insert(pkg->chunk, extra[x]);
+        pkg->checksums = g_slist_prepend(pkg->checksums, value);
+    }
+    pkg->checksums = g_slist_reverse(pkg->checksums);
+    g_strfreev(extra);
+
+    return pkg;
+}
+
+
+cr_Package *
+cr_package_from_rpm_fd(int fd,
+                       const char *filename,
+                       cr_ChecksumType checksum_type,
+                       const cr_ChecksumType *extra_checksums,
+                       const char *location_href,
+                       const char *location_base,
+                       int changelog_limit,
+                       struct stat *stat_buf,
+                       GError **err)
+{
+    return package_from_rpm_fd(fd, filename, NULL, checksum_type,
+                               extra_checksums, location_href, location_base,
+                               changelog_limit, stat_buf, err);
+}
+
+
+cr_Package *
+cr_package_from_rpm_buffer(int fd,
+                           const char *filename,
+                           const unsigned char *data,
+                           struct stat *stat_buf,
+                           cr_ChecksumType checksum_type,
+                           const cr_ChecksumType *extra_checksums,
+                           const char *location_href,
+                           const char *location_base,
+                           int changelog_limit,
+                           GError **err)
+{
+    assert(data);
+    assert(stat_buf);
+
+    return package_from_rpm_fd(fd, filename, data, checksum_type,
+                               extra_checksums, location_href, location_base,
+                               changelog_limit, stat_buf, err);
+}
+
+
+cr_Package *
+cr_package_from_rpm(const char *filename,
+                    cr_ChecksumType checksum_type,
+                    const char *location_href,
+                    const char *location_base,
+                    int changelog_limit,
+                    struct stat *stat_buf,
+                    GError **err)
+{
+    cr_Package *pkg;
+
+    assert(filename);
+    assert(!err || *err == NULL);
+
+    int fd = open_package(filename, err);
+    if (fd == -1)
+        return NULL;
+
+    pkg = cr_package_from_rpm_fd(fd, filename, checksum_type, NULL,
+                                 location_href, location_base,
+                                 changelog_limit, stat_buf, err);
+    close(fd);
+
     return pkg;
 }
 
@@ -222,56 +875,24 @@ cr_xml_from_rpm(const char *filename,
 
     checksum_type_str = cr_checksum_name_str(checksum_type);
 
-
-    // Read header
-
-    Header hdr;
-    read_header(filename, &hdr, &tmp_err);
-    if (tmp_err) {
-        g_propagate_error(err, tmp_err);
+    int fd = open_package(filename, err);
+    if (fd == -1)
         return result;
-    }
 
 
-    // Get file stat
+    // Read all needed info in a single pass
 
+    Header hdr;
     gint64 mtime;
     gint64 size;
+    char *checksum;
+    struct cr_HeaderRangeStruct hdr_r;
 
-    if (!stat_buf) {
-        struct stat stat_buf_own;
-        if (stat(filename, &stat_buf_own) == -1) {
-            g_warning("%s: stat() error (%s)", __func__, strerror(errno));
-            g_set_error(err,  CR_PARSEPKG_ERROR, CRE_IO, "stat() failed");
-            headerFree(hdr);
-            return result;
-        }
-        mtime  = stat_buf_own.st_mtime;
-        size   = stat_buf_own.st_size;
-    } else {
-        mtime  = stat_buf->st_mtime;
-        size   = stat_buf->st_size;
-    }
-
-
-    // Compute checksum
-
-    char *checksum = cr_checksum_file(filename, checksum_type, &tmp_err);
-    if (tmp_err) {
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while checksum calculation: ");
-        headerFree(hdr);
-        return result;
-    }
-
-
-    // Get header range
-
-    struct cr_HeaderRangeStruct hdr_r = cr_get_header_byte_range(filename,
-                                                                 &tmp_err);
+    read_package_fd(fd, filename, NULL, checksum_type, NULL, stat_buf,
+                    &hdr, &mtime, &size, &checksum, NULL, &hdr_r, &tmp_err);
+    close(fd);
     if (tmp_err) {
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while determinig header range: ");
+        g_propagate_error(err, tmp_err);
         return result;
     }
 
@@ -47,6 +47,27 @@ void cr_package_parser_init();
  */
 void cr_package_parser_cleanup();
 
+/** Set the checksum cache used by cr_package_from_rpm(),
+ * cr_package_from_rpm_fd() and cr_xml_from_rpm(). A cached checksum is
+ * used only if the file has the same mtime, size and inode as when the
+ * checksum was stored and if the cached values are sane, otherwise the
+ * checksum is computed again. A cache which cannot be written (read-only file,
+ * filesystem without extended attributes) is silently ignored.
+ * Extra checksums are not cached, they are always computed.
+ * This function is not thread safe! Call it before parsing.
+ * @param type                  cr_ChecksumCacheType
+ */
+void cr_package_parser_set_checksum_cache(cr_ChecksumCacheType type);
+
+/** Set whether packages may be mmaped while they are read. A mmaped file
+ * which is truncated by somebody else while it is read kills the process
+ * by SIGBUS, so disable mmap if the files can change during the parsing
+ * (then they are read by read() into a buffer). Enabled by default.
+ * This function is not thread safe! Call it before parsing.
+ * @param use_mmap              TRUE to use mmap, FALSE to use read()
+ */
+void cr_package_parser_set_mmap(gboolean use_mmap);
+
 /** Generate package object from package file.
  * @param filename              filename
  * @param checksum_type         type of checksum to be used
@@ -66,6 +87,71 @@ cr_Package *cr_package_from_rpm(const char *filename,
                                 struct stat *stat_buf,
                                 GError **err);
 
+/** Generate package object from an already opened package file.
+ * The file content is read only once (it is mmaped or read via a large
+ * buffer) and checksums, header byte range and header itself are all
+ * obtained from this single pass.
+ * The descriptor is not closed by this function and its file offset
+ * is not preserved.
+ * @param fd                    file descriptor opened for reading
+ * @param filename              filename (used for messages)
+ * @param checksum_type         type of checksum to be used
+ * @param extra_checksums       types of additional checksums which are
+ *                              stored in the checksums list of the
+ *                              package (array terminated by
+ *                              CR_CHECKSUM_UNKNOWN or NULL), they are
+ *                              for the caller only, the xml dump
+ *                              functions don't write them
+ * @param location_href         package location inside repository
+ * @param location_base         location (url) of repository
+ * @param changelog_limit       number of changelog entries
+ * @param stat_buf              struct stat of the file
+ *                              (optional - could be NULL, then fstat()
+ *                              is used)
+ * @param err                   GError **
+ * @return                      cr_Package
+ */
+cr_Package *cr_package_from_rpm_fd(int fd,
+                                   const char *filename,
+                                   cr_ChecksumType checksum_type,
+                                   const cr_ChecksumType *extra_checksums,
+                                   const char *location_href,
+                                   const char *location_base,
+                                   int changelog_limit,
+                                   struct stat *stat_buf,
+                                   GError **err);
+
+/** Generate package object from a package file which content is already
+ * in the memory (e.g. read by cr_ReadEngine). Checksums and header byte
+ * range are computed from the data, the header itself is read via
+ * the descriptor (its bytes are in the page cache already).
+ * The descriptor is not closed by this function and its file offset
+ * is not preserved.
+ * @param fd                    file descriptor opened for reading
+ * @param filename              filename (used for messages)
+ * @param data                  whole content of the file
+ * @param stat_buf              struct stat of the file (its st_size
+ *                              must be the size of the data)
+ * @param checksum_type         type of checksum to be used
+ * @param extra_checksums       types of additional checksums (array
+ *                              terminated by CR_CHECKSUM_UNKNOWN or NULL)
+ * @param location_href         package location inside repository
+ * @param location_base         location (url) of repository
+ * @param changelog_limit       number of changelog entries
+ * @param err                   GError **
+ * @return                      cr_Package
+ */
+cr_Package *cr_package_from_rpm_buffer(int fd,
+                                       const char *filename,
+                                       const unsigned char *data,
+                                       struct stat *stat_buf,
+                                       cr_ChecksumType checksum_type,
+                                       const cr_ChecksumType *extra_checksums,
+                                       const char *location_href,
+                                       const char *location_base,
+                                       int changelog_limit,
+                                       GError **err);
+
 /** Generate XML for the specified package.
  * @param filename              rpm filename
  * @param checksum_type         type of checksum to be used
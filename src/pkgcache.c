@@ -0,0 +1,689 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "error.h"
+#include "misc.h"
+#include "pkgcache.h"
+
+/* File format:
+ *
+ * +--------------------+
+ * | Header             |  PkgCacheHeader
+ * +--------------------+
+ * | Record 1           |  guint32 length of the record data + record data
+ * | ...                |
+ * | Record N           |
+ * +--------------------+
+ * | Index              |  N * guint64 offsets of the records
+ * +--------------------+
+ *
+ * Record data: key (size, mtime, inode and location_href of the rpm)
+ * followed by the serialized cr_Package.
+ * Integers are stored in the host byte order (the cache is not meant to be
+ * shared between different machines), strings are stored as guint32 length
+ * followed by the string including the terminating '\0' byte.
+ */
+
+#define PKGCACHE_MAGIC          "CRPKGC"
+#define PKGCACHE_VERSION        1
+#define PKGCACHE_BYTEORDER      0x01020304
+#define PKGCACHE_NULL_STRING    G_MAXUINT32
+
+typedef struct {
+    char    magic[8];           // PKGCACHE_MAGIC
+    guint32 version;            // PKGCACHE_VERSION
+    guint32 byteorder;          // PKGCACHE_BYTEORDER
+    guint32 checksum_type;      // cr_ChecksumType of the packages
+    gint32  changelog_limit;    // Changelog limit of the packages
+    guint64 count;              // Number of records
+    guint64 index_offset;       // Offset of the index
+} PkgCacheHeader;
+
+struct _cr_PkgCache {
+    unsigned char   *map;       // Mapped file
+    gsize           size;       // Size of the mapped file
+    GHashTable      *index;     // location_href -> record
+};
+
+struct _cr_PkgCacheWriter {
+    GMutex          *mutex;     // Protects all items bellow
+    FILE            *f;         // Temporary file
+    char            *path;      // Final path of the cache
+    char            *tmp_path;  // Path of the temporary file
+    GArray          *offsets;   // Offsets of written records (guint64)
+    guint64         offset;     // Current offset in the file
+    PkgCacheHeader  header;     // Header of the file
+    gboolean        failed;     // Write failed
+};
+
+
+// Reading
+
+typedef struct {
+    const unsigned char *p;     // Current position
+    const unsigned char *end;   // End of the data
+    gboolean err;               // Data are corrupted
+} PkgCacheCursor;
+
+static gint64
+cursor_int64(PkgCacheCursor *c)
+{
+    gint64 val = 0;
+
+    if (c->err || c->end - c->p < (gssize) sizeof(val)) {
+        c->err = TRUE;
+        return 0;
+    }
+
+    memcpy(&val, c->p, sizeof(val));
+    c->p += sizeof(val);
+    return val;
+}
+
+static guint32
+cursor_uint32(PkgCacheCursor *c)
+{
+    guint32 val = 0;
+
+    if (c->err || c->end - c->p < (gssize) sizeof(val)) {
+        c->err = TRUE;
+        return 0;
+    }
+
+    memcpy(&val, c->p, sizeof(val));
+    c->p += sizeof(val);
+    return val;
+}
+
+static char *
+cursor_string(PkgCacheCursor *c)
+{
+    char *str;
+    guint32 len = cursor_uint32(c);
+
+    if (c->err || len == PKGCACHE_NULL_STRING)
+        return NULL;
+
+    if ((guint64) (c->end - c->p) < (guint64) len + 1 || c->p[len] != '\0') {
+        c->err = TRUE;
+        return NULL;
+    }
+
+    str = (char *) c->p;
+    c->p += len + 1;
+    return str;
+}
+
+static GSList *
+cursor_dependencies(PkgCacheCursor *c)
+{
+    GSList *list = NULL;
+    guint32 count = cursor_uint32(c);
+
+    for (guint32 x = 0; x < count && !c->err; x++) {
+        cr_Dependency *dep = cr_dependency_new();
+        dep->name    = cursor_string(c);
+        dep->flags   = cursor_string(c);
+        dep->epoch   = cursor_string(c);
+        dep->version = cursor_string(c);
+        dep->release = cursor_string(c);
+        dep->pre     = cursor_uint32(c);
+        list = g_slist_prepend(list, dep);
+    }
+
+    return g_slist_reverse(list);
+}
+
+static GSList *
+cursor_files(PkgCacheCursor *c)
+{
+    GSList *list = NULL;
+    guint32 count = cursor_uint32(c);
+
+    for (guint32 x = 0; x < count && !c->err; x++) {
+        cr_PackageFile *file = cr_package_file_new();
+        file->type = cursor_string(c);
+        file->path = cursor_string(c);
+        file->name = cursor_string(c);
+        list = g_slist_prepend(list, file);
+    }
+
+    return g_slist_reverse(list);
+}
+
+static GSList *
+cursor_changelogs(PkgCacheCursor *c)
+{
+    GSList *list = NULL;
+    guint32 count = cursor_uint32(c);
+
+    for (guint32 x = 0; x < count && !c->err; x++) {
+        cr_ChangelogEntry *entry = cr_changelog_entry_new();
+        entry->author    = cursor_string(c);
+        entry->date      = cursor_int64(c);
+        entry->changelog = cursor_string(c);
+        list = g_slist_prepend(list, entry);
+    }
+
+    return g_slist_reverse(list);
+}
+
+/** Set the cursor to the data of the record.
+ */
+static void
+cursor_init(PkgCacheCursor *c, cr_PkgCache *cache, const unsigned char *record)
+{
+    guint32 len;
+
+    c->p   = record;
+    c->end = cache->map + cache->size;
+    c->err = FALSE;
+
+    len = cursor_uint32(c);
+    if (!c->err && (guint64) (c->end - c->p) >= len)
+        c->end = c->p + len;
+    else
+        c->err = TRUE;
+}
+
+cr_PkgCache *
+cr_pkgcache_open(const char *path,
+                 cr_ChecksumType checksum_type,
+                 int changelog_limit,
+                 GError **err)
+{
+    int fd;
+    struct stat st;
+    unsigned char *map;
+    PkgCacheHeader header;
+    cr_PkgCache *cache;
+
+    assert(path);
+    assert(!err || *err == NULL);
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        g_set_error(err, CR_PKGCACHE_ERROR,
+                    (errno == ENOENT) ? CRE_NOFILE : CRE_IO,
+                    "Cannot open %s: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_STAT,
+                    "fstat(%s) error: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    if ((guint64) st.st_size < sizeof(PkgCacheHeader)) {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_BADARG,
+                    "%s is not a package cache (too short)", path);
+        close(fd);
+        return NULL;
+    }
+
+    // Private writable mapping - nobody can accidentally modify the file
+    // via strings of packages
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_IO,
+                    "mmap(%s) error: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    // Check the header
+    memcpy(&header, map, sizeof(header));
+
+    if (memcmp(header.magic, PKGCACHE_MAGIC, sizeof(PKGCACHE_MAGIC))
+        || header.version != PKGCACHE_VERSION
+        || header.byteorder != PKGCACHE_BYTEORDER)
+    {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_BADARG,
+                    "%s is not a package cache (or an unsupported version)",
+                    path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    if (header.checksum_type != (guint32) checksum_type
+        || header.changelog_limit != changelog_limit)
+    {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_BADARG,
+                    "%s was created with another checksum type or "
+                    "changelog limit", path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    if (header.index_offset > (guint64) st.st_size
+        || header.count > ((guint64) st.st_size - header.index_offset)
+                          / sizeof(guint64))
+    {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_BADARG,
+                    "%s is corrupted (bad index)", path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    cache = g_malloc0(sizeof(*cache));
+    cache->map   = map;
+    cache->size  = st.st_size;
+    cache->index = g_hash_table_new(g_str_hash, g_str_equal);
+
+    // Load the index
+    for (guint64 x = 0; x < header.count; x++) {
+        guint64 offset;
+        PkgCacheCursor c;
+        char *location_href;
+
+        memcpy(&offset, map + header.index_offset + x * sizeof(offset),
+               sizeof(offset));
+        if (offset < sizeof(PkgCacheHeader) || offset >= header.index_offset)
+            continue;
+
+        cursor_init(&c, cache, map + offset);
+        cursor_int64(&c);   // size
+        cursor_int64(&c);   // mtime
+        cursor_int64(&c);   // inode
+        location_href = cursor_string(&c);
+        if (c.err || !location_href)
+            continue;
+
+        g_hash_table_replace(cache->index, location_href, map + offset);
+    }
+
+    return cache;
+}
+
+guint
+cr_pkgcache_size(cr_PkgCache *cache)
+{
+    assert(cache);
+    return g_hash_table_size(cache->index);
+}
+
+cr_Package *
+cr_pkgcache_get(cr_PkgCache *cache,
+                const char *location_href,
+                struct stat *stat_buf)
+{
+    PkgCacheCursor c;
+    cr_Package *pkg;
+    const unsigned char *record;
+
+    assert(cache);
+    assert(location_href);
+    assert(stat_buf);
+
+    record = g_hash_table_lookup(cache->index, location_href);
+    if (!record)
+        return NULL;
+
+    cursor_init(&c, cache, record);
+
+    // Check the key
+    if (cursor_int64(&c) != (gint64) stat_buf->st_size
+        || cursor_int64(&c) != (gint64) stat_buf->st_mtime
+        || cursor_int64(&c) != (gint64) stat_buf->st_ino
+        || c.err)
+        return NULL;
+
+    pkg = cr_package_new_without_chunk();
+
+    pkg->location_href    = cursor_string(&c);
+    pkg->time_file        = cursor_int64(&c);
+    pkg->time_build       = cursor_int64(&c);
+    pkg->rpm_header_start = cursor_int64(&c);
+    pkg->rpm_header_end   = cursor_int64(&c);
+    pkg->size_package     = cursor_int64(&c);
+    pkg->size_installed   = cursor_int64(&c);
+    pkg->size_archive     = cursor_int64(&c);
+    pkg->pkgId            = cursor_string(&c);
+    pkg->name             = cursor_string(&c);
+    pkg->arch             = cursor_string(&c);
+    pkg->version          = cursor_string(&c);
+    pkg->epoch            = cursor_string(&c);
+    pkg->release          = cursor_string(&c);
+    pkg->vcs              = cursor_string(&c);
+    pkg->summary          = cursor_string(&c);
+    pkg->description      = cursor_string(&c);
+    pkg->url              = cursor_string(&c);
+    pkg->rpm_license      = cursor_string(&c);
+    pkg->rpm_vendor       = cursor_string(&c);
+    pkg->rpm_group        = cursor_string(&c);
+    pkg->rpm_buildhost    = cursor_string(&c);
+    pkg->rpm_sourcerpm    = cursor_string(&c);
+    pkg->rpm_packager     = cursor_string(&c);
+    pkg->checksum_type    = cursor_string(&c);
+    pkg->requires         = cursor_dependencies(&c);
+    pkg->provides         = cursor_dependencies(&c);
+    pkg->conflicts        = cursor_dependencies(&c);
+    pkg->obsoletes        = cursor_dependencies(&c);
+    pkg->files            = cursor_files(&c);
+    pkg->changelogs       = cursor_changelogs(&c);
+
+    if (c.err || !pkg->pkgId) {
+        g_debug("%s: Corrupted record of %s", __func__, location_href);
+        cr_package_free(pkg);
+        return NULL;
+    }
+
+    return pkg;
+}
+
+void
+cr_pkgcache_close(cr_PkgCache *cache)
+{
+    if (!cache)
+        return;
+
+    g_hash_table_destroy(cache->index);
+    munmap(cache->map, cache->size);
+    g_free(cache);
+}
+
+
+// Writing
+
+static void
+put_int64(GByteArray *buf, gint64 val)
+{
+    g_byte_array_append(buf, (guint8 *) &val, sizeof(val));
+}
+
+static void
+put_uint32(GByteArray *buf, guint32 val)
+{
+    g_byte_array_append(buf, (guint8 *) &val, sizeof(val));
+}
+
+static void
+put_string(GByteArray *buf, const char *str)
+{
+    if (!str) {
+        put_uint32(buf, PKGCACHE_NULL_STRING);
+        return;
+    }
+
+    guint32 len = strlen(str);
+    put_uint32(buf, len);
+    g_byte_array_append(buf, (const guint8 *) str, len + 1);
+}
+
+static void
+put_dependencies(GByteArray *buf, GSList *list)
+{
+    put_uint32(buf, g_slist_length(list));
+    for (GSList *elem = list; elem; elem = g_slist_next(elem)) {
+        cr_Dependency *dep = elem->data;
+        put_string(buf, dep->name);
+        put_string(buf, dep->flags);
+        put_string(buf, dep->epoch);
+        put_string(buf, dep->version);
+        put_string(buf, dep->release);
+        put_uint32(buf, dep->pre ? 1 : 0);
+    }
+}
+
+static void
+put_files(GByteArray *buf, GSList *list)
+{
+    put_uint32(buf, g_slist_length(list));
+    for (GSList *elem = list; elem; elem = g_slist_next(elem)) {
+        cr_PackageFile *file = elem->data;
+        put_string(buf, file->type);
+        put_string(buf, file->path);
+        put_string(buf, file->name);
+    }
+}
+
+static void
+put_changelogs(GByteArray *buf, GSList *list)
+{
+    put_uint32(buf, g_slist_length(list));
+    for (GSList *elem = list; elem; elem = g_slist_next(elem)) {
+        cr_ChangelogEntry *entry = elem->data;
+        put_string(buf, entry->author);
+        put_int64(buf, entry->date);
+        put_string(buf, entry->changelog);
+    }
+}
+
+static void pkgcache_writer_free(cr_PkgCacheWriter *writer);
+
+cr_PkgCacheWriter *
+cr_pkgcache_writer_new(const char *path,
+                       cr_ChecksumType checksum_type,
+                       int changelog_limit,
+                       GError **err)
+{
+    int fd;
+    FILE *f;
+    char *tmp_path;
+    cr_PkgCacheWriter *writer;
+
+    assert(path);
+    assert(!err || *err == NULL);
+
+    tmp_path = g_strconcat(path, ".XXXXXX", NULL);
+    fd = g_mkstemp(tmp_path);
+    if (fd == -1) {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_IO,
+                    "Cannot create %s: %s", tmp_path, strerror(errno));
+        g_free(tmp_path);
+        return NULL;
+    }
+
+    f = fdopen(fd, "w");
+    if (!f) {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_IO,
+                    "fdopen(): %s", strerror(errno));
+        close(fd);
+        g_remove(tmp_path);
+        g_free(tmp_path);
+        return NULL;
+    }
+
+    writer = g_malloc0(sizeof(*writer));
+    writer->mutex    = g_mutex_new();
+    writer->f        = f;
+    writer->path     = g_strdup(path);
+    writer->tmp_path = tmp_path;
+    writer->offsets  = g_array_new(FALSE, FALSE, sizeof(guint64));
+    writer->offset   = sizeof(PkgCacheHeader);
+
+    memcpy(writer->header.magic, PKGCACHE_MAGIC, sizeof(PKGCACHE_MAGIC));
+    writer->header.version          = PKGCACHE_VERSION;
+    writer->header.byteorder        = PKGCACHE_BYTEORDER;
+    writer->header.checksum_type    = checksum_type;
+    writer->header.changelog_limit  = changelog_limit;
+
+    // Placeholder of the header (the final one is written by close)
+    if (fwrite(&writer->header, sizeof(PkgCacheHeader), 1, f) != 1) {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_IO,
+                    "Cannot write %s: %s", tmp_path, strerror(errno));
+        cr_pkgcache_writer_abort(writer);
+        return NULL;
+    }
+
+    return writer;
+}
+
+int
+cr_pkgcache_writer_add(cr_PkgCacheWriter *writer,
+                       cr_Package *pkg,
+                       struct stat *stat_buf,
+                       GError **err)
+{
+    int ret = CRE_OK;
+    GByteArray *buf;
+    guint32 len;
+
+    assert(writer);
+    assert(pkg);
+    assert(pkg->location_href);
+    assert(stat_buf);
+    assert(!err || *err == NULL);
+
+    // Serialize the package (without the lock)
+    buf = g_byte_array_sized_new(4096);
+    put_uint32(buf, 0);  // Placeholder for the length
+    put_int64(buf, stat_buf->st_size);
+    put_int64(buf, stat_buf->st_mtime);
+    put_int64(buf, stat_buf->st_ino);
+    put_string(buf, pkg->location_href);
+    put_int64(buf, pkg->time_file);
+    put_int64(buf, pkg->time_build);
+    put_int64(buf, pkg->rpm_header_start);
+    put_int64(buf, pkg->rpm_header_end);
+    put_int64(buf, pkg->size_package);
+    put_int64(buf, pkg->size_installed);
+    put_int64(buf, pkg->size_archive);
+    put_string(buf, pkg->pkgId);
+    put_string(buf, pkg->name);
+    put_string(buf, pkg->arch);
+    put_string(buf, pkg->version);
+    put_string(buf, pkg->epoch);
+    put_string(buf, pkg->release);
+    put_string(buf, pkg->vcs);
+    put_string(buf, pkg->summary);
+    put_string(buf, pkg->description);
+    put_string(buf, pkg->url);
+    put_string(buf, pkg->rpm_license);
+    put_string(buf, pkg->rpm_vendor);
+    put_string(buf, pkg->rpm_group);
+    put_string(buf, pkg->rpm_buildhost);
+    put_string(buf, pkg->rpm_sourcerpm);
+    put_string(buf, pkg->rpm_packager);
+    put_string(buf, pkg->checksum_type);
+    put_dependencies(buf, pkg->requires);
+    put_dependencies(buf, pkg->provides);
+    put_dependencies(buf, pkg->conflicts);
+    put_dependencies(buf, pkg->obsoletes);
+    put_files(buf, pkg->files);
+    put_changelogs(buf, pkg->changelogs);
+
+    len = buf->len - sizeof(guint32);
+    memcpy(buf->data, &len, sizeof(len));
+
+    // Write it
+    g_mutex_lock(writer->mutex);
+
+    if (writer->failed) {
+        ret = CRE_IO;
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_IO,
+                    "Previous write to %s failed", writer->tmp_path);
+    } else if (fwrite(buf->data, buf->len, 1, writer->f) != 1) {
+        ret = CRE_IO;
+        writer->failed = TRUE;
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_IO,
+                    "Cannot write %s: %s", writer->tmp_path, strerror(errno));
+    } else {
+        g_array_append_val(writer->offsets, writer->offset);
+        writer->offset += buf->len;
+    }
+
+    g_mutex_unlock(writer->mutex);
+
+    g_byte_array_free(buf, TRUE);
+
+    return ret;
+}
+
+int
+cr_pkgcache_writer_close(cr_PkgCacheWriter *writer, GError **err)
+{
+    assert(writer);
+    assert(!err || *err == NULL);
+
+    if (writer->failed) {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_IO,
+                    "Write to %s failed", writer->tmp_path);
+        cr_pkgcache_writer_abort(writer);
+        return CRE_IO;
+    }
+
+    writer->header.count        = writer->offsets->len;
+    writer->header.index_offset = writer->offset;
+
+    if (fwrite(writer->offsets->data, sizeof(guint64),
+               writer->offsets->len, writer->f) != writer->offsets->len
+        || fseek(writer->f, 0, SEEK_SET) != 0
+        || fwrite(&writer->header, sizeof(PkgCacheHeader), 1, writer->f) != 1
+        || fflush(writer->f) != 0)
+    {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_IO,
+                    "Cannot write %s: %s", writer->tmp_path, strerror(errno));
+        cr_pkgcache_writer_abort(writer);
+        return CRE_IO;
+    }
+
+    fclose(writer->f);
+    writer->f = NULL;
+
+    if (g_rename(writer->tmp_path, writer->path) == -1) {
+        g_set_error(err, CR_PKGCACHE_ERROR, CRE_IO,
+                    "Cannot rename %s -> %s: %s", writer->tmp_path,
+                    writer->path, strerror(errno));
+        cr_pkgcache_writer_abort(writer);
+        return CRE_IO;
+    }
+
+    pkgcache_writer_free(writer);
+
+    return CRE_OK;
+}
+
+void
+cr_pkgcache_writer_abort(cr_PkgCacheWriter *writer)
+{
+    if (!writer)
+        return;
+
+    if (writer->f)
+        fclose(writer->f);
+    writer->f = NULL;
+    g_remove(writer->tmp_path);
+
+    pkgcache_writer_free(writer);
+}
+
+static void
+pkgcache_writer_free(cr_PkgCacheWriter *writer)
+{
+    assert(!writer->f);
+
+    g_mutex_free(writer->mutex);
+    g_array_free(writer->offsets, TRUE);
+    g_free(writer->path);
+    g_free(writer->tmp_path);
+    g_free(writer);
+}
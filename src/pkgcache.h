@@ -0,0 +1,157 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_PKGCACHE_H__
+#define __C_CREATEREPOLIB_PKGCACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include <sys/stat.h>
+#include "checksum.h"
+#include "package.h"
+
+/** \defgroup   pkgcache    Persistent cache of package metadata.
+ *
+ * The cache is a single file which contains serialized cr_Package
+ * objects. Every package is keyed by its location (path relative to
+ * the repository) and by size, mtime and inode number of the rpm file.
+ * The whole cache is valid only for the checksum type and the changelog
+ * limit which were used when it was created.
+ *
+ * The cache is memory mapped for reading and strings of the packages
+ * obtained from the cache point directly into the mapped file, so
+ * the packages must not be used after the cache is closed.
+ *
+ * Example:
+ * \code
+ * cr_PkgCache *cache;
+ * cr_PkgCacheWriter *writer;
+ *
+ * cache = cr_pkgcache_open("old.cache", CR_CHECKSUM_SHA256, 10, NULL);
+ * writer = cr_pkgcache_writer_new("new.cache", CR_CHECKSUM_SHA256, 10, NULL);
+ *
+ * // For every package (could be called from multiple threads)
+ * pkg = cr_pkgcache_get(cache, location_href, &stat_buf);
+ * if (!pkg)
+ *     pkg = cr_package_from_rpm(...);
+ * cr_pkgcache_writer_add(writer, pkg, &stat_buf, NULL);
+ *
+ * cr_pkgcache_writer_close(writer, NULL);
+ * // Free packages from the cache
+ * cr_pkgcache_close(cache);
+ * \endcode
+ *
+ *  \addtogroup pkgcache
+ *  @{
+ */
+
+/** Opened (memory mapped) package cache.
+ */
+typedef struct _cr_PkgCache cr_PkgCache;
+
+/** Package cache being written.
+ */
+typedef struct _cr_PkgCacheWriter cr_PkgCacheWriter;
+
+/** Open a package cache.
+ * @param path              path to the cache file
+ * @param checksum_type     checksum type of the packages
+ * @param changelog_limit   changelog limit used for the packages
+ * @param err               GError **
+ * @return                  opened cache or NULL if the cache doesn't
+ *                          exist, it is corrupted or it was created
+ *                          with another checksum type or changelog limit
+ */
+cr_PkgCache *cr_pkgcache_open(const char *path,
+                              cr_ChecksumType checksum_type,
+                              int changelog_limit,
+                              GError **err);
+
+/** Number of packages in the cache.
+ * @param cache             cr_PkgCache
+ * @return                  number of packages
+ */
+guint cr_pkgcache_size(cr_PkgCache *cache);
+
+/** Get a package from the cache. This function is thread safe.
+ * Strings of the returned package point into the cache, the package
+ * has to be freed by cr_package_free() before the cache is closed.
+ * @param cache             cr_PkgCache
+ * @param location_href     location of the package inside repository
+ * @param stat_buf          struct stat of the rpm file
+ * @return                  new cr_Package or NULL if the package is not
+ *                          cached or the file was changed
+ */
+cr_Package *cr_pkgcache_get(cr_PkgCache *cache,
+                            const char *location_href,
+                            struct stat *stat_buf);
+
+/** Close (unmap) the cache.
+ * @param cache             cr_PkgCache
+ */
+void cr_pkgcache_close(cr_PkgCache *cache);
+
+/** Create a new cache file. The file is written into a temporary file
+ * which is renamed to the path by cr_pkgcache_writer_close().
+ * @param path              path to the cache file
+ * @param checksum_type     checksum type of the packages
+ * @param changelog_limit   changelog limit used for the packages
+ * @param err               GError **
+ * @return                  cr_PkgCacheWriter or NULL
+ */
+cr_PkgCacheWriter *cr_pkgcache_writer_new(const char *path,
+                                          cr_ChecksumType checksum_type,
+                                          int changelog_limit,
+                                          GError **err);
+
+/** Add a package into the cache. This function is thread safe.
+ * The package is keyed by its location_href.
+ * @param writer            cr_PkgCacheWriter
+ * @param pkg               package
+ * @param stat_buf          struct stat of the rpm file
+ * @param err               GError **
+ * @return                  cr_Error code
+ */
+int cr_pkgcache_writer_add(cr_PkgCacheWriter *writer,
+                           cr_Package *pkg,
+                           struct stat *stat_buf,
+                           GError **err);
+
+/** Finish the cache file and rename it to its final path.
+ * @param writer            cr_PkgCacheWriter
+ * @param err               GError **
+ * @return                  cr_Error code
+ */
+int cr_pkgcache_writer_close(cr_PkgCacheWriter *writer, GError **err);
+
+/** Remove the temporary file and free the writer.
+ * @param writer            cr_PkgCacheWriter
+ */
+void cr_pkgcache_writer_abort(cr_PkgCacheWriter *writer);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_PKGCACHE_H__ */
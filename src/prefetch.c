@@ -0,0 +1,314 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "logging.h"
+#include "prefetch.h"
+
+
+typedef enum {
+    FILE_QUEUED,        // Waiting for the prefetcher
+    FILE_OPENING,       // Being opened by the prefetcher
+    FILE_PREFETCHED,    // Prefetched, waiting for its consumer
+    FILE_DONE,          // Done (or skipped) by its consumer
+} PrefetchFileState;
+
+typedef struct {
+    char *filename;
+    PrefetchFileState state;
+    int fd;                 // Kept open while the file is prefetched
+    gsize size;             // Size of the prefetched file
+    gboolean done;          // Done while it was opened
+    gboolean skipped;       // Skipped while it was opened
+} PrefetchFile;
+
+struct _cr_Prefetcher {
+    guint window;           // Max number of prefetched files
+    gsize memory_limit;     // Max size of prefetched files
+    gboolean drop;          // Drop done files from the page cache
+
+    GMutex *mutex;
+    GCond *cond;            // The prefetcher thread sleeps here
+    GPtrArray *files;       // PrefetchFile *
+    long next;              // Index of the next file to prefetch
+    guint prefetched;       // Number of prefetched files
+    gsize memory_used;      // Size of prefetched files
+    gboolean finished;      // No more files will be added
+    gboolean stopping;      // The prefetcher is being freed
+
+    GThread *thread;
+};
+
+
+/** Drop the file from the page cache (if requested) and close it.
+ * The fd could be -1, then the file is opened by its name.
+ */
+static void
+drop_file(cr_Prefetcher *prefetcher, const char *filename, int fd)
+{
+    if (prefetcher->drop) {
+        if (fd == -1)
+            fd = open(filename, O_RDONLY);
+        if (fd != -1)
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+
+    if (fd != -1)
+        close(fd);
+}
+
+/** Wait until the file fits into the window. Called with the mutex locked.
+ * Returns FALSE if its consumer was faster or if the prefetcher stops.
+ */
+static gboolean
+wait_for_window(cr_Prefetcher *prefetcher, PrefetchFile *file)
+{
+    while (prefetcher->prefetched > 0
+           && (prefetcher->prefetched >= prefetcher->window
+               || prefetcher->memory_used + file->size
+                  > prefetcher->memory_limit))
+    {
+        if (file->done || file->skipped || prefetcher->stopping)
+            return FALSE;
+        g_cond_wait(prefetcher->cond, prefetcher->mutex);
+    }
+
+    return !(file->done || file->skipped || prefetcher->stopping);
+}
+
+static gpointer
+prefetcher_thread(gpointer data)
+{
+    cr_Prefetcher *prefetcher = data;
+
+    g_mutex_lock(prefetcher->mutex);
+    while (!prefetcher->stopping) {
+        PrefetchFile *file;
+        struct stat stat_buf;
+        int fd;
+
+        if (prefetcher->next >= (long) prefetcher->files->len) {
+            if (prefetcher->finished)
+                break;
+            g_cond_wait(prefetcher->cond, prefetcher->mutex);
+            continue;
+        }
+
+        file = g_ptr_array_index(prefetcher->files, prefetcher->next++);
+        if (file->state != FILE_QUEUED)
+            continue;   // Its consumer was faster
+        file->state = FILE_OPENING;
+        g_mutex_unlock(prefetcher->mutex);
+
+        fd = open(file->filename, O_RDONLY);
+        if (fd != -1 && fstat(fd, &stat_buf) == -1) {
+            close(fd);
+            fd = -1;
+        }
+        if (fd == -1)
+            g_debug("%s: Cannot prefetch %s: %s",
+                    __func__, file->filename, strerror(errno));
+
+        g_mutex_lock(prefetcher->mutex);
+        if (fd != -1) {
+            file->size = (gsize) stat_buf.st_size;
+            if (wait_for_window(prefetcher, file)) {
+                // Asynchronous - the kernel starts to read the file
+                // in the background
+                posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                file->fd = fd;
+                file->state = FILE_PREFETCHED;
+                prefetcher->prefetched++;
+                prefetcher->memory_used += file->size;
+                continue;
+            }
+        }
+
+        // Not prefetched - its consumer reads it without help
+        file->state = FILE_DONE;
+        if (file->done) {
+            g_mutex_unlock(prefetcher->mutex);
+            drop_file(prefetcher, file->filename, fd);
+            g_mutex_lock(prefetcher->mutex);
+        } else if (fd != -1) {
+            close(fd);
+        }
+    }
+    g_mutex_unlock(prefetcher->mutex);
+
+    return NULL;
+}
+
+
+cr_Prefetcher *
+cr_prefetcher_new(guint window, gsize memory, gboolean drop, GError **err)
+{
+    cr_Prefetcher *prefetcher;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    prefetcher = g_malloc0(sizeof(cr_Prefetcher));
+    prefetcher->window = window;
+    prefetcher->memory_limit = memory ? memory : CR_PREFETCH_DEFAULT_MEMORY;
+    prefetcher->drop = drop;
+    prefetcher->mutex = g_mutex_new();
+    prefetcher->cond = g_cond_new();
+    prefetcher->files = g_ptr_array_new();
+
+    if (window > 0) {
+        prefetcher->thread = g_thread_create(prefetcher_thread, prefetcher,
+                                             TRUE, &tmp_err);
+        if (tmp_err) {
+            g_propagate_prefixed_error(err, tmp_err,
+                                       "Cannot start the prefetcher: ");
+            cr_prefetcher_free(prefetcher);
+            return NULL;
+        }
+    }
+
+    return prefetcher;
+}
+
+long
+cr_prefetcher_add(cr_Prefetcher *prefetcher, const char *filename)
+{
+    PrefetchFile *file;
+    long id;
+
+    assert(prefetcher);
+    assert(filename);
+
+    file = g_malloc0(sizeof(PrefetchFile));
+    file->filename = g_strdup(filename);
+    file->state = FILE_QUEUED;
+    file->fd = -1;
+
+    g_mutex_lock(prefetcher->mutex);
+    assert(!prefetcher->finished);
+    id = prefetcher->files->len;
+    g_ptr_array_add(prefetcher->files, file);
+    g_cond_broadcast(prefetcher->cond);
+    g_mutex_unlock(prefetcher->mutex);
+
+    return id;
+}
+
+void
+cr_prefetcher_finish(cr_Prefetcher *prefetcher)
+{
+    assert(prefetcher);
+
+    g_mutex_lock(prefetcher->mutex);
+    prefetcher->finished = TRUE;
+    g_cond_broadcast(prefetcher->cond);
+    g_mutex_unlock(prefetcher->mutex);
+}
+
+static void
+prefetcher_release(cr_Prefetcher *prefetcher, long id, gboolean read)
+{
+    PrefetchFile *file;
+    int fd = -1;
+    gboolean drop = FALSE;
+
+    assert(prefetcher);
+
+    g_mutex_lock(prefetcher->mutex);
+    assert(id >= 0 && id < (long) prefetcher->files->len);
+    file = g_ptr_array_index(prefetcher->files, id);
+
+    switch (file->state) {
+        case FILE_QUEUED:
+            file->state = FILE_DONE;
+            drop = read;
+            break;
+        case FILE_OPENING:
+            // The prefetcher finishes it
+            if (read)
+                file->done = TRUE;
+            else
+                file->skipped = TRUE;
+            g_cond_broadcast(prefetcher->cond);
+            break;
+        case FILE_PREFETCHED:
+            fd = file->fd;
+            file->fd = -1;
+            file->state = FILE_DONE;
+            prefetcher->prefetched--;
+            prefetcher->memory_used -= file->size;
+            g_cond_broadcast(prefetcher->cond);
+            drop = TRUE;
+            break;
+        case FILE_DONE:
+            break;
+    }
+    g_mutex_unlock(prefetcher->mutex);
+
+    if (drop)
+        drop_file(prefetcher, file->filename, fd);
+}
+
+void
+cr_prefetcher_done(cr_Prefetcher *prefetcher, long id)
+{
+    prefetcher_release(prefetcher, id, TRUE);
+}
+
+void
+cr_prefetcher_skip(cr_Prefetcher *prefetcher, long id)
+{
+    prefetcher_release(prefetcher, id, FALSE);
+}
+
+void
+cr_prefetcher_free(cr_Prefetcher *prefetcher)
+{
+    if (!prefetcher)
+        return;
+
+    g_mutex_lock(prefetcher->mutex);
+    prefetcher->finished = TRUE;
+    prefetcher->stopping = TRUE;
+    g_cond_broadcast(prefetcher->cond);
+    g_mutex_unlock(prefetcher->mutex);
+
+    if (prefetcher->thread)
+        g_thread_join(prefetcher->thread);
+
+    for (guint x = 0; x < prefetcher->files->len; x++) {
+        PrefetchFile *file = g_ptr_array_index(prefetcher->files, x);
+        if (file->fd != -1)
+            close(file->fd);
+        g_free(file->filename);
+        g_free(file);
+    }
+
+    g_ptr_array_free(prefetcher->files, TRUE);
+    g_cond_free(prefetcher->cond);
+    g_mutex_free(prefetcher->mutex);
+    g_free(prefetcher);
+}
@@ -0,0 +1,119 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_PREFETCH_H__
+#define __C_CREATEREPOLIB_PREFETCH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/** \defgroup   prefetch    Page cache prefetcher.
+ *
+ * A thread which asks the kernel (posix_fadvise(POSIX_FADV_WILLNEED))
+ * to read files into the page cache a window ahead of their consumers.
+ * The prefetcher itself doesn't read anything, the kernel reads the
+ * files in the background, so the consumers find them in the page cache.
+ * Optionally, files are dropped from the page cache
+ * (POSIX_FADV_DONTNEED) when their consumer is done with them, so
+ * processing of a huge number of files doesn't evict everything else
+ * from the page cache.
+ *
+ * Example:
+ * \code
+ * cr_Prefetcher *prefetcher = cr_prefetcher_new(32, 0, TRUE, NULL);
+ * long id = cr_prefetcher_add(prefetcher, "/foo/bar.rpm");
+ * cr_prefetcher_finish(prefetcher);
+ *
+ * // Read the /foo/bar.rpm
+ * cr_prefetcher_done(prefetcher, id);
+ *
+ * cr_prefetcher_free(prefetcher);
+ * \endcode
+ *
+ *  \addtogroup prefetch
+ *  @{
+ */
+
+/** Default max size of the files which are prefetched and not done yet.
+ */
+#define CR_PREFETCH_DEFAULT_MEMORY      (256*1024*1024)
+
+/** Prefetcher.
+ */
+typedef struct _cr_Prefetcher cr_Prefetcher;
+
+/** Create a new prefetcher and start its thread.
+ * @param window        max number of files which are prefetched and
+ *                      not done yet (0 = no prefetching, files are only
+ *                      dropped from the page cache if drop is TRUE)
+ * @param memory        max size of the files which are prefetched and
+ *                      not done yet (0 = default)
+ * @param drop          drop files from the page cache when they are done
+ * @param err           GError **
+ * @return              new cr_Prefetcher or NULL on error
+ */
+cr_Prefetcher *cr_prefetcher_new(guint window,
+                                 gsize memory,
+                                 gboolean drop,
+                                 GError **err);
+
+/** Add a file to the end of the queue. Files should be added in
+ * the order in which they are going to be consumed.
+ * This function is thread safe.
+ * @param prefetcher    cr_Prefetcher
+ * @param filename      path to the file (the string is copied)
+ * @return              index of the file (indexes start from 0)
+ */
+long cr_prefetcher_add(cr_Prefetcher *prefetcher, const char *filename);
+
+/** Signal that no more files will be added.
+ * @param prefetcher    cr_Prefetcher
+ */
+void cr_prefetcher_finish(cr_Prefetcher *prefetcher);
+
+/** Signal that the consumer has read the file. A file which was not
+ * prefetched yet is not prefetched anymore. This function is thread safe.
+ * @param prefetcher    cr_Prefetcher
+ * @param id            index of the file
+ */
+void cr_prefetcher_done(cr_Prefetcher *prefetcher, long id);
+
+/** Signal that the file is not needed at all (e.g. it was found in
+ * a cache). Unlike cr_prefetcher_done(), the file is dropped from the
+ * page cache only if it was prefetched. This function is thread safe.
+ * @param prefetcher    cr_Prefetcher
+ * @param id            index of the file
+ */
+void cr_prefetcher_skip(cr_Prefetcher *prefetcher, long id);
+
+/** Stop the prefetcher and free it.
+ * @param prefetcher    cr_Prefetcher
+ */
+void cr_prefetcher_free(cr_Prefetcher *prefetcher);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_PREFETCH_H__ */
@@ -51,10 +51,18 @@ BZ2                     = _createrepo_c.BZ2_COMPRESSION
 #: XZ compression alias
 XZ                      = _createrepo_c.XZ_COMPRESSION
 
+if hasattr(_createrepo_c, "ZSTD_COMPRESSION"):
+    #: Zstandard compression (only if built with libzstd)
+    ZSTD_COMPRESSION    = _createrepo_c.ZSTD_COMPRESSION
+
+    #: Zstandard compression alias
+    ZSTD                = _createrepo_c.ZSTD_COMPRESSION
+
 HT_KEY_DEFAULT  = _createrepo_c.HT_KEY_DEFAULT  #: Default key (hash)
 HT_KEY_HASH     = _createrepo_c.HT_KEY_HASH     #: Package hash as a key
 HT_KEY_NAME     = _createrepo_c.HT_KEY_NAME     #: Package name as a key
 HT_KEY_FILENAME = _createrepo_c.HT_KEY_FILENAME #: Package filename as a key
+HT_KEY_LOCATION_HREF = _createrepo_c.HT_KEY_LOCATION_HREF #: Package location_href as a key
 
 DB_PRIMARY      = _createrepo_c.DB_PRIMARY   #: Primary database
 DB_FILELISTS    = _createrepo_c.DB_FILELISTS #: Filelists database
@@ -114,7 +122,7 @@ class CrFile(_createrepo_c.CrFile):
                  comtype=NO_COMPRESSION, stat=None):
         """:arg filename: Filename
         :arg mode: MODE_READ or MODE_WRITE
-        :arg comtype: Compression type (GZ, BZ, XZ or NO_COMPRESSION)
+        :arg comtype: Compression type (GZ, BZ, XZ, ZSTD or NO_COMPRESSION)
         :arg stat: ContentStat object or None"""
         _createrepo_c.CrFile.__init__(self, filename, mode, comtype, stat)
 
@@ -206,6 +206,14 @@ static PyGetSetDef contentstat_getsetters[] = {
         "Type of used checksum", OFFSET(checksum_type)},
     {"checksum",        (getter)get_str, (setter)set_str,
         "Calculated checksum", OFFSET(checksum)},
+    {"compressed_size", (getter)get_num, (setter)set_num,
+        "Number of compressed bytes written", OFFSET(compressed_size)},
+    {"compressed_checksum_type", (getter)get_int, (setter)set_int,
+        "Type of checksum of compressed content (UNKNOWN_CHECKSUM "
+        "means no checksum)", OFFSET(compressed_checksum_type)},
+    {"compressed_checksum", (getter)get_str, (setter)set_str,
+        "Calculated checksum of compressed content",
+        OFFSET(compressed_checksum)},
     {NULL, NULL, NULL, NULL, NULL} /* sentinel */
 };
 
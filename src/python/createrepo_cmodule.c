@@ -175,12 +175,16 @@ init_createrepo_c(void)
     PyModule_AddIntConstant(m, "GZ_COMPRESSION", CR_CW_GZ_COMPRESSION);
     PyModule_AddIntConstant(m, "BZ2_COMPRESSION", CR_CW_BZ2_COMPRESSION);
     PyModule_AddIntConstant(m, "XZ_COMPRESSION", CR_CW_XZ_COMPRESSION);
+#ifdef CR_WITH_ZSTD
+    PyModule_AddIntConstant(m, "ZSTD_COMPRESSION", CR_CW_ZSTD_COMPRESSION);
+#endif
 
     /* Load Metadata key values */
     PyModule_AddIntConstant(m, "HT_KEY_DEFAULT", CR_HT_KEY_DEFAULT);
     PyModule_AddIntConstant(m, "HT_KEY_HASH", CR_HT_KEY_HASH);
     PyModule_AddIntConstant(m, "HT_KEY_NAME", CR_HT_KEY_NAME);
     PyModule_AddIntConstant(m, "HT_KEY_FILENAME", CR_HT_KEY_FILENAME);
+    PyModule_AddIntConstant(m, "HT_KEY_LOCATION_HREF", CR_HT_KEY_LOCATION_HREF);
 
     /* Sqlite DB types */
     PyModule_AddIntConstant(m, "DB_PRIMARY", CR_DB_PRIMARY);
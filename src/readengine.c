@@ -0,0 +1,763 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "logging.h"
+#include "readengine.h"
+
+#ifdef CR_WITH_LIBURING
+#include <liburing.h>
+#endif
+
+#define READ_CHUNK_SIZE         (1024*1024) // Size of a single read
+#define PREAD_MAX_THREADS       8           // Threads of the pread backend
+#define MAX_FILES_PER_READ      4           // Max files read ahead
+                                            // per read in flight
+
+
+typedef enum {
+    FILE_QUEUED,    // Waiting for the engine
+    FILE_OPENING,   // Being opened by the engine
+    FILE_READING,   // Being read by the engine
+    FILE_READY,     // Read, waiting for the consumer
+    FILE_LEFT,      // Not read by the engine, left to the consumer
+    FILE_DONE,      // Taken or skipped by the consumer
+} ReadFileState;
+
+typedef struct {
+    cr_ReadBuffer buf;      // Must be the first member
+    char *filename;
+    ReadFileState state;
+    gboolean reserved;      // Counted in the memory of the engine
+    gboolean skipped;       // Skipped (or taken) by its consumer
+                            // while the engine was working on it
+    gboolean waiting;       // Opened, waiting for free memory
+    // Used only by the io_uring backend
+    gsize submitted;        // Bytes submitted for reading
+    gsize completed;        // Bytes already read
+    int inflight;           // Reads in flight
+    gboolean failed;        // A read failed
+} ReadFile;
+
+struct _cr_ReadEngine {
+    int depth;              // Max number of reads in flight
+    gsize memory_limit;     // Max memory of reserved files
+    gsize max_file_size;    // Larger files are left to consumers
+    guint max_files;        // Max number of reserved files
+
+    GMutex *mutex;
+    GCond *cond_engine;     // Engine threads sleep here
+    GCond *cond_ready;      // Consumers sleep here
+    GPtrArray *files;       // ReadFile *
+    long next;              // Index of the next file for the engine
+    gsize memory_used;      // Memory of reserved files
+    guint files_reserved;   // Number of reserved files
+    gboolean finished;      // No more files will be added
+    gboolean stopping;      // The engine is being freed
+
+    GThread *threads[PREAD_MAX_THREADS];
+    int threads_count;
+    gboolean uring;         // io_uring backend is used
+#ifdef CR_WITH_LIBURING
+    struct io_uring ring;
+#endif
+};
+
+
+/** Close the file and free its content.
+ * Called with the mutex locked.
+ */
+static void
+readfile_clear(cr_ReadEngine *engine, ReadFile *file)
+{
+    g_free(file->buf.data);
+    file->buf.data = NULL;
+    if (file->buf.fd != -1) {
+        close(file->buf.fd);
+        file->buf.fd = -1;
+    }
+
+    if (file->reserved) {
+        file->reserved = FALSE;
+        engine->memory_used -= file->buf.size;
+        engine->files_reserved--;
+        g_cond_broadcast(engine->cond_engine);
+    }
+}
+
+/** Called by the engine when it is done with the file.
+ * Called with the mutex locked.
+ */
+static void
+readfile_finish(cr_ReadEngine *engine, ReadFile *file, gboolean ok)
+{
+    if (file->skipped) {
+        readfile_clear(engine, file);
+        file->state = FILE_DONE;
+    } else if (ok) {
+        file->state = FILE_READY;
+    } else {
+        readfile_clear(engine, file);
+        file->state = FILE_LEFT;
+    }
+
+    g_cond_broadcast(engine->cond_ready);
+}
+
+/** Open the file and get its size. Returns FALSE if the file
+ * should be left to its consumer.
+ */
+static gboolean
+readfile_open(cr_ReadEngine *engine, ReadFile *file)
+{
+    file->buf.fd = open(file->filename, O_RDONLY);
+    if (file->buf.fd == -1) {
+        g_debug("%s: Cannot open %s: %s",
+                __func__, file->filename, strerror(errno));
+        return FALSE;
+    }
+
+    if (fstat(file->buf.fd, &file->buf.stat) == -1) {
+        g_debug("%s: fstat() of %s failed: %s",
+                __func__, file->filename, strerror(errno));
+        return FALSE;
+    }
+
+    if (!S_ISREG(file->buf.stat.st_mode)
+        || file->buf.stat.st_size <= 0
+        || (guint64) file->buf.stat.st_size > engine->max_file_size)
+        return FALSE;
+
+    file->buf.size = (gsize) file->buf.stat.st_size;
+    return TRUE;
+}
+
+/** Take the next file which wasn't taken by its consumer yet and open it.
+ * If wait is TRUE, wait for new files. Returns NULL if there are no
+ * more files (or no files at the moment if wait is FALSE).
+ */
+static ReadFile *
+open_next_file(cr_ReadEngine *engine, gboolean wait)
+{
+    ReadFile *file = NULL;
+
+    g_mutex_lock(engine->mutex);
+    while (!file && !engine->stopping) {
+        if (engine->next >= (long) engine->files->len) {
+            if (!wait || engine->finished)
+                break;
+            g_cond_wait(engine->cond_engine, engine->mutex);
+            continue;
+        }
+
+        file = g_ptr_array_index(engine->files, engine->next++);
+        if (file->state != FILE_QUEUED) {
+            file = NULL;    // Taken by its consumer
+            continue;
+        }
+        file->state = FILE_OPENING;
+        g_mutex_unlock(engine->mutex);
+
+        gboolean ok = readfile_open(engine, file);
+
+        g_mutex_lock(engine->mutex);
+        if (!ok) {
+            readfile_finish(engine, file, FALSE);
+            file = NULL;
+        }
+    }
+    g_mutex_unlock(engine->mutex);
+
+    return file;
+}
+
+typedef enum {
+    RESERVE_OK,         // Memory is reserved and the buffer allocated
+    RESERVE_LATER,      // Not enough memory now (only if wait is FALSE)
+    RESERVE_FAILED,     // The file was taken by its consumer meanwhile
+                        // or the engine is stopping
+} ReserveResult;
+
+/** Reserve memory for the opened file and allocate its buffer.
+ * If wait is TRUE, wait until other files are released.
+ * While the file waits for memory, its consumer can take it, otherwise
+ * a consumer could wait for a file which waits for memory of files
+ * which are going to be consumed by the same consumer.
+ */
+static ReserveResult
+readfile_reserve(cr_ReadEngine *engine, ReadFile *file, gboolean wait)
+{
+    ReserveResult ret = RESERVE_OK;
+
+    g_mutex_lock(engine->mutex);
+    while (engine->files_reserved > 0
+           && (engine->memory_used + file->buf.size > engine->memory_limit
+               || engine->files_reserved >= engine->max_files))
+    {
+        if (file->skipped || engine->stopping) {
+            ret = RESERVE_FAILED;
+            break;
+        }
+        if (!file->waiting) {
+            // Let its consumer know that it could take the file
+            file->waiting = TRUE;
+            g_cond_broadcast(engine->cond_ready);
+        }
+        if (!wait) {
+            ret = RESERVE_LATER;
+            break;
+        }
+        g_cond_wait(engine->cond_engine, engine->mutex);
+    }
+
+    if (ret == RESERVE_OK && file->skipped)
+        ret = RESERVE_FAILED;
+
+    if (ret == RESERVE_OK) {
+        file->waiting = FALSE;
+        file->reserved = TRUE;
+        engine->memory_used += file->buf.size;
+        engine->files_reserved++;
+        file->state = FILE_READING;
+    }
+    g_mutex_unlock(engine->mutex);
+
+    if (ret == RESERVE_OK)
+        file->buf.data = g_malloc(file->buf.size);
+    return ret;
+}
+
+
+// pread backend
+
+static gboolean
+pread_file(ReadFile *file)
+{
+    gsize offset = 0;
+
+    while (offset < file->buf.size) {
+        gsize len = MIN(READ_CHUNK_SIZE, file->buf.size - offset);
+        ssize_t readed = pread(file->buf.fd, file->buf.data + offset,
+                               len, (off_t) offset);
+        if (readed == -1) {
+            if (errno == EINTR)
+                continue;
+            g_debug("%s: pread() of %s failed: %s",
+                    __func__, file->filename, strerror(errno));
+            return FALSE;
+        }
+        if (readed == 0) {
+            g_debug("%s: %s was truncated while it was read",
+                    __func__, file->filename);
+            return FALSE;
+        }
+        offset += readed;
+    }
+
+    return TRUE;
+}
+
+static gpointer
+pread_thread(gpointer data)
+{
+    cr_ReadEngine *engine = data;
+    ReadFile *file;
+
+    while ((file = open_next_file(engine, TRUE))) {
+        gboolean ok = readfile_reserve(engine, file, TRUE) == RESERVE_OK
+                      && pread_file(file);
+
+        g_mutex_lock(engine->mutex);
+        readfile_finish(engine, file, ok);
+        g_mutex_unlock(engine->mutex);
+    }
+
+    return NULL;
+}
+
+
+// io_uring backend
+
+#ifdef CR_WITH_LIBURING
+
+typedef struct {
+    ReadFile *file;
+    gsize offset;
+    gsize len;
+} UringRead;
+
+static gboolean
+uring_submit_read(cr_ReadEngine *engine, UringRead *req)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&engine->ring);
+    if (!sqe)
+        return FALSE;
+
+    io_uring_prep_read(sqe, req->file->buf.fd,
+                       req->file->buf.data + req->offset,
+                       (unsigned) req->len, (off_t) req->offset);
+    io_uring_sqe_set_data(sqe, req);
+    return TRUE;
+}
+
+/** Process a completed read. Returns number of reads which are
+ * finished (0 if the rest of the read was submitted again).
+ */
+static int
+uring_complete_read(cr_ReadEngine *engine,
+                    GQueue *submitting,
+                    GHashTable *reqs,
+                    UringRead *req,
+                    int res)
+{
+    ReadFile *file = req->file;
+    gboolean resubmit = FALSE;
+
+    if (res == -EINTR || res == -EAGAIN) {
+        resubmit = TRUE;
+    } else if (res > 0) {
+        file->completed += res;
+        if ((gsize) res < req->len) {
+            // Short read - read the rest
+            req->offset += res;
+            req->len -= res;
+            resubmit = TRUE;
+        }
+    } else {
+        g_debug("%s: Read of %s failed: %s", __func__, file->filename,
+                res ? strerror(-res) : "file was truncated");
+        file->failed = TRUE;
+    }
+
+    if (resubmit && !file->failed) {
+        if (uring_submit_read(engine, req))
+            return 0;
+        file->failed = TRUE;    // No free sqe for the rest
+    }
+
+    g_hash_table_remove(reqs, req);
+    g_free(req);
+    file->inflight--;
+
+    if (file->failed)
+        g_queue_remove(submitting, file);
+
+    if (file->inflight == 0
+        && (file->failed || file->completed == file->buf.size))
+    {
+        g_mutex_lock(engine->mutex);
+        readfile_finish(engine, file, !file->failed);
+        g_mutex_unlock(engine->mutex);
+    }
+
+    return 1;
+}
+
+/** Leave all files which are being read to their consumers.
+ * Used when io_uring itself fails. The reads which were submitted to
+ * the kernel are waited for (the kernel writes into their buffers),
+ * the reads which are still in the submission queue are never submitted.
+ * All the reads (UringRead) are freed.
+ */
+static void
+uring_abort(cr_ReadEngine *engine, GHashTable *reqs, ReadFile *waiting)
+{
+    GHashTableIter iter;
+    gpointer key;
+    unsigned submitted = g_hash_table_size(reqs)
+                         - io_uring_sq_ready(&engine->ring);
+    gboolean drained = TRUE;
+
+    while (submitted > 0) {
+        struct io_uring_cqe *cqe;
+        int ret = io_uring_wait_cqe(&engine->ring, &cqe);
+        if (ret == -EINTR || ret == -EAGAIN)
+            continue;
+        if (ret < 0) {
+            g_warning("%s: Cannot wait for the reads in flight: %s",
+                      __func__, strerror(-ret));
+            drained = FALSE;
+            break;
+        }
+
+        UringRead *req = io_uring_cqe_get_data(cqe);
+        io_uring_cqe_seen(&engine->ring, cqe);
+        g_hash_table_remove(reqs, req);
+        g_free(req);
+        submitted--;
+    }
+
+    g_mutex_lock(engine->mutex);
+    g_hash_table_iter_init(&iter, reqs);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        UringRead *req = key;
+        // The kernel could still write into the buffer - leak it
+        if (!drained)
+            req->file->buf.data = NULL;
+        g_free(req);
+    }
+    g_hash_table_remove_all(reqs);
+
+    if (waiting)
+        readfile_finish(engine, waiting, FALSE);
+    for (long x = 0; x < engine->next; x++) {
+        ReadFile *file = g_ptr_array_index(engine->files, x);
+        if (file->state == FILE_READING)
+            readfile_finish(engine, file, FALSE);
+    }
+    // The rest is left to the consumers
+    engine->next = engine->files->len;
+    engine->stopping = TRUE;
+    g_mutex_unlock(engine->mutex);
+}
+
+static gpointer
+uring_thread(gpointer data)
+{
+    cr_ReadEngine *engine = data;
+    GQueue *submitting = g_queue_new(); // Files with unsubmitted reads
+    GHashTable *reqs = g_hash_table_new(g_direct_hash, g_direct_equal);
+                                        // Reads in flight (UringRead *)
+    ReadFile *waiting = NULL;           // Opened file waiting for memory
+    int inflight = 0;
+
+    while (1) {
+
+        // Queue new reads
+
+        while (inflight < engine->depth) {
+            ReadFile *file = g_queue_peek_head(submitting);
+
+            if (!file) {
+                // Wait for new files only if there is nothing to do
+                file = waiting ? waiting : open_next_file(engine,
+                                                          inflight == 0);
+                waiting = NULL;
+                if (!file)
+                    break;
+                ReserveResult res = readfile_reserve(engine, file,
+                                                     inflight == 0);
+                if (res == RESERVE_LATER) {
+                    waiting = file;
+                    break;
+                }
+                if (res == RESERVE_FAILED) {
+                    g_mutex_lock(engine->mutex);
+                    readfile_finish(engine, file, FALSE);
+                    g_mutex_unlock(engine->mutex);
+                    continue;
+                }
+                g_queue_push_tail(submitting, file);
+            }
+
+            UringRead *req = g_new(UringRead, 1);
+            req->file = file;
+            req->offset = file->submitted;
+            req->len = MIN(READ_CHUNK_SIZE, file->buf.size - file->submitted);
+            if (!uring_submit_read(engine, req)) {
+                g_free(req);
+                break;
+            }
+
+            g_hash_table_insert(reqs, req, req);
+            file->submitted += req->len;
+            file->inflight++;
+            inflight++;
+            if (file->submitted == file->buf.size)
+                g_queue_pop_head(submitting);
+        }
+
+        if (inflight == 0)
+            break;  // No more files
+
+
+        // Submit them and wait for completions
+
+        int ret = io_uring_submit_and_wait(&engine->ring, 1);
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            g_warning("%s: io_uring_submit_and_wait() failed: %s",
+                      __func__, strerror(-ret));
+            uring_abort(engine, reqs, waiting);
+            io_uring_queue_exit(&engine->ring);
+            engine->uring = FALSE;
+            g_hash_table_destroy(reqs);
+            g_queue_free(submitting);
+            return NULL;
+        }
+
+        struct io_uring_cqe *cqe;
+        unsigned head;
+        unsigned seen = 0;
+        io_uring_for_each_cqe(&engine->ring, head, cqe) {
+            inflight -= uring_complete_read(engine, submitting, reqs,
+                                            io_uring_cqe_get_data(cqe),
+                                            cqe->res);
+            seen++;
+        }
+        io_uring_cq_advance(&engine->ring, seen);
+    }
+
+    g_hash_table_destroy(reqs);
+    g_queue_free(submitting);
+    return NULL;
+}
+
+/** Initialize the io_uring. Returns FALSE if it is not supported
+ * by the kernel.
+ */
+static gboolean
+uring_init(cr_ReadEngine *engine)
+{
+    int ret = io_uring_queue_init(engine->depth, &engine->ring, 0);
+    if (ret < 0) {
+        g_debug("%s: io_uring is not available: %s",
+                __func__, strerror(-ret));
+        return FALSE;
+    }
+
+    struct io_uring_probe *probe = io_uring_get_probe_ring(&engine->ring);
+    if (!probe || !io_uring_opcode_supported(probe, IORING_OP_READ)) {
+        g_debug("%s: io_uring doesn't support IORING_OP_READ", __func__);
+        if (probe)
+            io_uring_free_probe(probe);
+        io_uring_queue_exit(&engine->ring);
+        return FALSE;
+    }
+    io_uring_free_probe(probe);
+
+    return TRUE;
+}
+
+#endif  // CR_WITH_LIBURING
+
+
+cr_ReadEngine *
+cr_readengine_new(cr_ReadEngineBackend backend,
+                  int depth,
+                  gsize memory,
+                  GError **err)
+{
+    cr_ReadEngine *engine;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    engine = g_malloc0(sizeof(cr_ReadEngine));
+    engine->depth = (depth > 0) ? depth : CR_READENGINE_DEFAULT_DEPTH;
+    engine->memory_limit = memory ? memory : CR_READENGINE_DEFAULT_MEMORY;
+    engine->max_file_size = engine->memory_limit / 4;
+    engine->max_files = engine->depth * MAX_FILES_PER_READ;
+    engine->mutex = g_mutex_new();
+    engine->cond_engine = g_cond_new();
+    engine->cond_ready = g_cond_new();
+    engine->files = g_ptr_array_new();
+
+#ifdef CR_WITH_LIBURING
+    if (backend != CR_READENGINE_PREAD)
+        engine->uring = uring_init(engine);
+#else
+    if (backend == CR_READENGINE_IO_URING)
+        g_debug("%s: Built without io_uring support - using pread",
+                __func__);
+#endif
+
+    if (engine->uring) {
+#ifdef CR_WITH_LIBURING
+        engine->threads[0] = g_thread_create(uring_thread, engine,
+                                             TRUE, &tmp_err);
+        engine->threads_count = engine->threads[0] ? 1 : 0;
+#endif
+    } else {
+        int threads = MIN(engine->depth, PREAD_MAX_THREADS);
+        for (int x = 0; x < threads && !tmp_err; x++) {
+            engine->threads[x] = g_thread_create(pread_thread, engine,
+                                                 TRUE, &tmp_err);
+            if (engine->threads[x])
+                engine->threads_count++;
+        }
+    }
+
+    if (tmp_err) {
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "Cannot start the read engine: ");
+        cr_readengine_free(engine);
+        return NULL;
+    }
+
+    return engine;
+}
+
+const char *
+cr_readengine_backend_name(cr_ReadEngine *engine)
+{
+    assert(engine);
+    return engine->uring ? "io_uring" : "pread";
+}
+
+long
+cr_readengine_add(cr_ReadEngine *engine, const char *filename)
+{
+    ReadFile *file;
+    long id;
+
+    assert(engine);
+    assert(filename);
+
+    file = g_malloc0(sizeof(ReadFile));
+    file->filename = g_strdup(filename);
+    file->state = FILE_QUEUED;
+    file->buf.filename = file->filename;
+    file->buf.fd = -1;
+
+    g_mutex_lock(engine->mutex);
+    assert(!engine->finished);
+    id = engine->files->len;
+    file->buf.id = id;
+    g_ptr_array_add(engine->files, file);
+    g_cond_broadcast(engine->cond_engine);
+    g_mutex_unlock(engine->mutex);
+
+    return id;
+}
+
+void
+cr_readengine_finish(cr_ReadEngine *engine)
+{
+    assert(engine);
+
+    g_mutex_lock(engine->mutex);
+    engine->finished = TRUE;
+    g_cond_broadcast(engine->cond_engine);
+    g_mutex_unlock(engine->mutex);
+}
+
+cr_ReadBuffer *
+cr_readengine_get(cr_ReadEngine *engine, long id)
+{
+    ReadFile *file;
+    cr_ReadBuffer *buf = NULL;
+
+    assert(engine);
+
+    g_mutex_lock(engine->mutex);
+    assert(id >= 0 && id < (long) engine->files->len);
+    file = g_ptr_array_index(engine->files, id);
+    assert(file->state != FILE_DONE);
+
+    while (file->state == FILE_OPENING || file->state == FILE_READING) {
+        if (file->waiting) {
+            // Don't wait for memory, read the file by yourself
+            file->skipped = TRUE;
+            g_cond_broadcast(engine->cond_engine);
+            g_mutex_unlock(engine->mutex);
+            return NULL;
+        }
+        g_cond_wait(engine->cond_ready, engine->mutex);
+    }
+
+    if (file->state == FILE_READY)
+        buf = &file->buf;
+    file->state = FILE_DONE;
+    g_mutex_unlock(engine->mutex);
+
+    return buf;
+}
+
+void
+cr_readengine_release(cr_ReadEngine *engine, cr_ReadBuffer *buf)
+{
+    assert(engine);
+
+    if (!buf)
+        return;
+
+    g_mutex_lock(engine->mutex);
+    readfile_clear(engine, (ReadFile *) buf);
+    g_mutex_unlock(engine->mutex);
+}
+
+void
+cr_readengine_skip(cr_ReadEngine *engine, long id)
+{
+    ReadFile *file;
+
+    assert(engine);
+
+    g_mutex_lock(engine->mutex);
+    assert(id >= 0 && id < (long) engine->files->len);
+    file = g_ptr_array_index(engine->files, id);
+
+    switch (file->state) {
+        case FILE_OPENING:
+        case FILE_READING:
+            // Freed by the engine when the read is done
+            file->skipped = TRUE;
+            g_cond_broadcast(engine->cond_engine);
+            break;
+        case FILE_READY:
+            readfile_clear(engine, file);
+            file->state = FILE_DONE;
+            break;
+        default:
+            file->state = FILE_DONE;
+            break;
+    }
+    g_mutex_unlock(engine->mutex);
+}
+
+void
+cr_readengine_free(cr_ReadEngine *engine)
+{
+    if (!engine)
+        return;
+
+    g_mutex_lock(engine->mutex);
+    engine->finished = TRUE;
+    engine->stopping = TRUE;
+    g_cond_broadcast(engine->cond_engine);
+    g_mutex_unlock(engine->mutex);
+
+    for (int x = 0; x < engine->threads_count; x++)
+        g_thread_join(engine->threads[x]);
+
+#ifdef CR_WITH_LIBURING
+    if (engine->uring)
+        io_uring_queue_exit(&engine->ring);
+#endif
+
+    for (guint x = 0; x < engine->files->len; x++) {
+        ReadFile *file = g_ptr_array_index(engine->files, x);
+        readfile_clear(engine, file);
+        g_free(file->filename);
+        g_free(file);
+    }
+
+    g_ptr_array_free(engine->files, TRUE);
+    g_cond_free(engine->cond_engine);
+    g_cond_free(engine->cond_ready);
+    g_mutex_free(engine->mutex);
+    g_free(engine);
+}
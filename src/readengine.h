@@ -0,0 +1,175 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_READENGINE_H__
+#define __C_CREATEREPOLIB_READENGINE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+#include <sys/stat.h>
+
+/** \defgroup   readengine  Asynchronous read-ahead of whole files.
+ *
+ * The engine reads files in the order in which they were added,
+ * a window of them ahead of their consumers, and keeps many large
+ * reads in flight at once. With io_uring (if createrepo_c was built
+ * with liburing and the kernel supports it) a single thread keeps
+ * the whole queue in flight, otherwise a few threads use pread().
+ *
+ * A consumer asks for a file by its index. If the file is read already
+ * (or it is being read) the consumer gets its content, if the engine
+ * didn't start to read it yet, the file is left to the consumer, so
+ * a slow engine never delays the consumers. Files which are too large
+ * for the read-ahead window are always left to the consumers.
+ *
+ * Example:
+ * \code
+ * cr_ReadEngine *engine = cr_readengine_new(CR_READENGINE_AUTO,
+ *                                           0, 0, NULL);
+ * long id = cr_readengine_add(engine, "/foo/bar.rpm");
+ * cr_readengine_finish(engine);
+ *
+ * cr_ReadBuffer *buf = cr_readengine_get(engine, id);
+ * if (buf) {
+ *     // Use buf->data, buf->size, buf->fd and buf->stat
+ *     cr_readengine_release(engine, buf);
+ * } else {
+ *     // Read the file by yourself
+ * }
+ *
+ * cr_readengine_free(engine);
+ * \endcode
+ *
+ *  \addtogroup readengine
+ *  @{
+ */
+
+/** Backend of the read engine.
+ */
+typedef enum {
+    CR_READENGINE_AUTO,     /*!< io_uring if available, pread otherwise */
+    CR_READENGINE_PREAD,    /*!< pread() from several threads */
+    CR_READENGINE_IO_URING, /*!< io_uring (falls back to pread if
+                                 it is not available) */
+} cr_ReadEngineBackend;
+
+/** Default number of reads in flight.
+ */
+#define CR_READENGINE_DEFAULT_DEPTH         64
+
+/** Default max amount of memory used by files which were read
+ * ahead and are not released yet.
+ */
+#define CR_READENGINE_DEFAULT_MEMORY        (256*1024*1024)
+
+/** Content of a file read by the engine.
+ */
+typedef struct {
+    long id;            /*!< index of the file */
+    const char *filename; /*!< path to the file */
+    int fd;             /*!< opened file (read only, offset 0), it is
+                             closed by cr_readengine_release() */
+    struct stat stat;   /*!< fstat() of the fd */
+    unsigned char *data; /*!< whole content of the file */
+    gsize size;         /*!< size of the data */
+} cr_ReadBuffer;
+
+/** Read engine.
+ */
+typedef struct _cr_ReadEngine cr_ReadEngine;
+
+/** Create a new read engine and start its threads.
+ * @param backend       cr_ReadEngineBackend
+ * @param depth         max number of reads in flight (0 = default)
+ * @param memory        max memory used by read files which are not
+ *                      released yet (0 = default), files larger than
+ *                      a quarter of this limit are not read ahead
+ * @param err           GError **
+ * @return              new cr_ReadEngine or NULL on error
+ */
+cr_ReadEngine *cr_readengine_new(cr_ReadEngineBackend backend,
+                                 int depth,
+                                 gsize memory,
+                                 GError **err);
+
+/** Name of the backend really used by the engine ("io_uring" or "pread").
+ * @param engine        cr_ReadEngine
+ * @return              name of the backend
+ */
+const char *cr_readengine_backend_name(cr_ReadEngine *engine);
+
+/** Add a file to the end of the read queue. This function is thread
+ * safe, but files should be added in the order in which they are going
+ * to be consumed.
+ * @param engine        cr_ReadEngine
+ * @param filename      path to the file (the string is copied)
+ * @return              index of the file (indexes start from 0)
+ */
+long cr_readengine_add(cr_ReadEngine *engine, const char *filename);
+
+/** Signal that no more files will be added. Threads of the engine
+ * terminate when all added files are read.
+ * @param engine        cr_ReadEngine
+ */
+void cr_readengine_finish(cr_ReadEngine *engine);
+
+/** Get content of the file. If the file is being read, the function
+ * waits for it. If the engine didn't start to read the file yet,
+ * couldn't read it or if the file is too large, the file is taken away
+ * from the engine and NULL is returned. Every file must be passed to
+ * exactly one of cr_readengine_get() and cr_readengine_skip().
+ * @param engine        cr_ReadEngine
+ * @param id            index of the file
+ * @return              cr_ReadBuffer which must be released by
+ *                      cr_readengine_release() or NULL if the caller
+ *                      has to read the file by itself
+ */
+cr_ReadBuffer *cr_readengine_get(cr_ReadEngine *engine, long id);
+
+/** Release the buffer returned by cr_readengine_get(). Its memory is
+ * freed and its fd is closed.
+ * @param engine        cr_ReadEngine
+ * @param buf           cr_ReadBuffer
+ */
+void cr_readengine_release(cr_ReadEngine *engine, cr_ReadBuffer *buf);
+
+/** Signal that content of the file is not needed (e.g. the package
+ * was found in a cache). If the file is already read, its memory is
+ * freed.
+ * @param engine        cr_ReadEngine
+ * @param id            index of the file
+ */
+void cr_readengine_skip(cr_ReadEngine *engine, long id);
+
+/** Stop the engine and free it. Reads in flight are completed and
+ * files which were not consumed are freed.
+ * @param engine        cr_ReadEngine
+ */
+void cr_readengine_free(cr_ReadEngine *engine);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_READENGINE_H__ */
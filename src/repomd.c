@@ -71,6 +71,7 @@ cr_repomd_record_free(cr_RepomdRecord *md)
     if (!md)
         return;
 
+    cr_slist_free_full(md->checksums, g_free);
     g_string_chunk_free(md->chunk);
     g_free(md);
 }
@@ -97,6 +98,16 @@ cr_repomd_record_copy(const cr_RepomdRecord *orig)
                                                 orig->checksum_open);
     rec->checksum_open_type = cr_safe_string_chunk_insert(rec->chunk,
                                                 orig->checksum_open_type);
+    for (GSList *elem = orig->checksums; elem; elem = g_slist_next(elem)) {
+        cr_ChecksumValue *orig_value = elem->data;
+        cr_ChecksumValue *value = g_new0(cr_ChecksumValue, 1);
+        value->type     = cr_safe_string_chunk_insert(rec->chunk,
+                                                orig_value->type);
+        value->checksum = cr_safe_string_chunk_insert(rec->chunk,
+                                                orig_value->checksum);
+        rec->checksums = g_slist_prepend(rec->checksums, value);
+    }
+    rec->checksums = g_slist_reverse(rec->checksums);
     rec->timestamp = orig->timestamp;
     rec->size      = orig->size;
     rec->size_open = orig->size_open;
@@ -186,6 +197,15 @@ int
 cr_repomd_record_fill(cr_RepomdRecord *md,
                       cr_ChecksumType checksum_type,
                       GError **err)
+{
+    return cr_repomd_record_fill_extra(md, checksum_type, NULL, err);
+}
+
+int
+cr_repomd_record_fill_extra(cr_RepomdRecord *md,
+                            cr_ChecksumType checksum_type,
+                            const cr_ChecksumType *extra_checksums,
+                            GError **err)
 {
     const char *checksum_str;
     cr_ChecksumType checksum_t;
@@ -215,12 +235,28 @@ cr_repomd_record_fill(cr_RepomdRecord *md,
     }
 
 
-    // Compute checksum of compressed file
+    // Compute checksum (and the extra checksums) of compressed file
+    // in a single read
+
+    gboolean need_checksum = !md->checksum_type || !md->checksum;
+    int extra_count = 0;
+
+    while (extra_checksums && extra_checksums[extra_count] != CR_CHECKSUM_UNKNOWN)
+        extra_count++;
 
-    if (!md->checksum_type || !md->checksum) {
-        gchar *chksum;
+    if (need_checksum || extra_count) {
+        cr_ChecksumType *types = g_new(cr_ChecksumType, extra_count + 2);
+        int x = 0;
+        gchar **chksums;
 
-        chksum = cr_checksum_file(path, checksum_t, &tmp_err);
+        if (need_checksum)
+            types[x++] = checksum_t;
+        for (int y = 0; y < extra_count; y++)
+            types[x++] = extra_checksums[y];
+        types[x] = CR_CHECKSUM_UNKNOWN;
+
+        chksums = cr_checksum_file_multi(path, types, &tmp_err);
+        g_free(types);
         if (tmp_err) {
             int code = tmp_err->code;
             g_propagate_prefixed_error(err, tmp_err,
@@ -228,9 +264,21 @@ cr_repomd_record_fill(cr_RepomdRecord *md,
             return code;
         }
 
-        md->checksum_type = g_string_chunk_insert(md->chunk, checksum_str);
-        md->checksum = g_string_chunk_insert(md->chunk, chksum);
-        g_free(chksum);
+        x = 0;
+        if (need_checksum) {
+            md->checksum_type = g_string_chunk_insert(md->chunk, checksum_str);
+            md->checksum = g_string_chunk_insert(md->chunk, chksums[x++]);
+        }
+
+        for (int y = 0; y < extra_count; y++) {
+            cr_ChecksumValue *value = g_new0(cr_ChecksumValue, 1);
+            value->type = g_string_chunk_insert(md->chunk,
+                                cr_checksum_name_str(extra_checksums[y]));
+            value->checksum = g_string_chunk_insert(md->chunk, chksums[x++]);
+            md->checksums = g_slist_append(md->checksums, value);
+        }
+
+        g_strfreev(chksums);
     }
 
 
@@ -322,6 +370,7 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
     char buf[BUFFER_SIZE];
     CR_FILE *cw_plain;
     CR_FILE *cw_compressed;
+    cr_ContentStat *cstat;
     gint64 gf_size = -1, cgf_size = -1;
     gint64 gf_time = -1, cgf_time = -1;
     struct stat gf_stat, cgf_stat;
@@ -376,12 +425,19 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
         return code;
     }
 
-    cw_compressed = cr_open(cpath,
-                            CR_CW_MODE_WRITE,
-                            record_compression,
-                            &tmp_err);
+    // Checksums of both files are computed during the compression
+    cstat = cr_contentstat_new(checksum_type, NULL);
+    cstat->compressed_checksum_type = checksum_type;
+
+    cw_compressed = cr_sopen(cpath,
+                             CR_CW_MODE_WRITE,
+                             record_compression,
+                             cstat,
+                             &tmp_err);
     if (!cw_compressed) {
         int code = tmp_err->code;
+        cr_close(cw_plain, NULL);
+        cr_contentstat_free(cstat, NULL);
         g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ", cpath);
         return code;
     }
@@ -397,6 +453,7 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
     if (tmp_err) {
         int code = tmp_err->code;
         cr_close(cw_compressed, NULL);
+        cr_contentstat_free(cstat, NULL);
         g_debug("%s: Error while repomd record compression: %s", __func__,
                 tmp_err->message);
         g_propagate_prefixed_error(err, tmp_err,
@@ -407,29 +464,18 @@ cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
     cr_close(cw_compressed, &tmp_err);
     if (tmp_err) {
         int code = tmp_err->code;
+        cr_contentstat_free(cstat, NULL);
         g_propagate_prefixed_error(err, tmp_err,
                 "Error while closing %s: ", path);
         return code;
     }
 
 
-    // Compute checksums
+    // Checksums
 
-    checksum  = cr_checksum_file(path, checksum_type, &tmp_err);
-    if (tmp_err) {
-        int code = tmp_err->code;
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while checksum calculation:");
-        return code;
-    }
-
-    cchecksum = cr_checksum_file(cpath, checksum_type, &tmp_err);
-    if (tmp_err) {
-        int code = tmp_err->code;
-        g_propagate_prefixed_error(err, tmp_err,
-                                   "Error while checksum calculation:");
-        return code;
-    }
+    checksum  = g_strdup(cstat->checksum);
+    cchecksum = g_strdup(cstat->compressed_checksum);
+    cr_contentstat_free(cstat, NULL);
 
 
     // Get stats
@@ -609,6 +655,16 @@ cr_repomd_record_load_contentstat(cr_RepomdRecord *record,
     record->checksum_open_type = cr_safe_string_chunk_insert(record->chunk,
                                 cr_checksum_name_str(stats->checksum_type));
     record->size_open = stats->size;
+
+    if (stats->compressed_checksum) {
+        // Stats of the compressed file computed while it was written,
+        // cr_repomd_record_fill() doesn't have to read it again
+        record->checksum = cr_safe_string_chunk_insert(record->chunk,
+                                                stats->compressed_checksum);
+        record->checksum_type = cr_safe_string_chunk_insert(record->chunk,
+                    cr_checksum_name_str(stats->compressed_checksum_type));
+        record->size = stats->compressed_size;
+    }
 }
 
 cr_Repomd *
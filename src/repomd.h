@@ -85,6 +85,9 @@ typedef struct {
     int db_ver;                 /*!< version of database */
 
     GStringChunk *chunk;        /*!< String chunk */
+    GSList *checksums;          /*!< additional checksums of file
+                                     (list of cr_ChecksumValue), they are
+                                     not written to the repomd.xml */
 } cr_RepomdRecord;
 
 /** Distro tag structure
@@ -145,6 +148,23 @@ int cr_repomd_record_fill(cr_RepomdRecord *record,
                           cr_ChecksumType checksum_type,
                           GError **err);
 
+/** Same as cr_repomd_record_fill() but additional checksums of the file
+ * are computed too and appended to the checksums list of the record.
+ * The checksum and all the additional checksums are computed in a single
+ * read of the file. The additional checksums are for the caller only,
+ * cr_xml_dump_repomd() doesn't write them.
+ * @param record                cr_RepomdRecord object
+ * @param checksum_type         type of checksum to use
+ * @param extra_checksums       types of additional checksums (array
+ *                              terminated by CR_CHECKSUM_UNKNOWN or NULL)
+ * @param err                   GError **
+ * @return                      cr_Error code
+ */
+int cr_repomd_record_fill_extra(cr_RepomdRecord *record,
+                                cr_ChecksumType checksum_type,
+                                const cr_ChecksumType *extra_checksums,
+                                GError **err);
+
 /** Almost analogous to cr_repomd_record_fill but suitable for groupfile.
  * Record must be set with the path to existing non compressed groupfile.
  * Compressed file will be created and compressed_record updated.
@@ -170,7 +190,10 @@ int cr_repomd_record_compress_and_fill(cr_RepomdRecord *record,
 int cr_repomd_record_rename_file(cr_RepomdRecord *record, GError **err);
 
 /** Load the open stats (checksum_open, checksum_open_type and size_open)
- * from the cr_ContentStat object.
+ * from the cr_ContentStat object. If the stats of compressed content
+ * were computed (see compressed_checksum_type of cr_ContentStat),
+ * checksum, checksum_type and size are loaded too, so
+ * cr_repomd_record_fill() doesn't need to read the file again.
  * @param record                cr_RepomdRecord
  * @param stats                 cr_ContentStat
  */
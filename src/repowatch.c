@@ -0,0 +1,433 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "repowatch.h"
+#include "error.h"
+#include "misc.h"
+
+#define WATCH_BUF_SIZE      (64*1024)   // Buffer for inotify events
+
+#ifdef __linux__
+#define WATCH_MASK          (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO \
+                             | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR)
+#endif
+
+
+struct RepoWatch {
+    int fd;                 // inotify descriptor
+    char *dir;              // watched directory (with trailing '/')
+    char *suffix;           // suffix of watched files
+    gboolean skip_symlinks; // ignore files which are symlinks
+    GHashTable *wds;        // watch descriptor -> relative path of the dir
+                            // ("" for the top dir, "foo/" for subdirs)
+    GHashTable *files;      // files known at the last repowatch_wait()
+    GHashTable *changed;    // files added or modified since then
+    GHashTable *removed;    // known files removed since then
+    GTimer *last_change;    // started by the last change
+};
+
+
+#ifdef __linux__
+
+static void
+mark_changed(struct RepoWatch *watch, const char *path)
+{
+    g_hash_table_remove(watch->removed, path);
+    g_hash_table_insert(watch->changed, g_strdup(path), NULL);
+    g_timer_start(watch->last_change);
+}
+
+
+static void
+mark_removed(struct RepoWatch *watch, const char *path)
+{
+    g_hash_table_remove(watch->changed, path);
+    if (g_hash_table_lookup_extended(watch->files, path, NULL, NULL))
+        g_hash_table_insert(watch->removed, g_strdup(path), NULL);
+    g_timer_start(watch->last_change);
+}
+
+
+static gboolean
+is_output_dir(const char *reldir, const char *name)
+{
+    return !*reldir && (!strcmp(name, "repodata")
+                        || !strcmp(name, ".repodata"));
+}
+
+
+// Watch the directory and its subdirectories. The found files are
+// added into the known files or, if report is TRUE, marked as changed.
+static void
+watch_dir(struct RepoWatch *watch, const char *reldir, gboolean report)
+{
+    int wd;
+    DIR *dirp;
+    struct dirent *entry;
+    gchar *full_path = g_strconcat(watch->dir, reldir, NULL);
+
+    wd = inotify_add_watch(watch->fd, full_path, WATCH_MASK);
+    if (wd == -1) {
+        g_warning("Cannot watch %s: %s", full_path, strerror(errno));
+        g_free(full_path);
+        return;
+    }
+
+    // The same directory could be reachable via a symlink
+    if (g_hash_table_lookup(watch->wds, GINT_TO_POINTER(wd))) {
+        g_free(full_path);
+        return;
+    }
+    g_hash_table_insert(watch->wds, GINT_TO_POINTER(wd), g_strdup(reldir));
+
+    // Watch is set before the read, so no new file could be missed
+    dirp = opendir(full_path);
+    if (!dirp) {
+        g_warning("Cannot open directory %s: %s", full_path, strerror(errno));
+        g_free(full_path);
+        return;
+    }
+
+    while ((entry = readdir(dirp))) {
+        struct stat st;
+        gboolean is_link;
+        gchar *path, *entry_full_path;
+
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")
+            || is_output_dir(reldir, entry->d_name))
+            continue;
+
+        // Symlinks to directories are followed, symlinks to files are
+        // skipped with skip_symlinks (the same as in the directory walk)
+        entry_full_path = g_strconcat(full_path, entry->d_name, NULL);
+        if (lstat(entry_full_path, &st) == -1) {
+            g_free(entry_full_path);
+            continue;
+        }
+        is_link = S_ISLNK(st.st_mode);
+        if (is_link && stat(entry_full_path, &st) == -1) {
+            g_free(entry_full_path);
+            continue;
+        }
+        g_free(entry_full_path);
+
+        if (S_ISDIR(st.st_mode)) {
+            path = g_strconcat(reldir, entry->d_name, "/", NULL);
+            watch_dir(watch, path, report);
+        } else if (S_ISREG(st.st_mode)
+                   && !(is_link && watch->skip_symlinks)
+                   && g_str_has_suffix(entry->d_name, watch->suffix)) {
+            path = g_strconcat(reldir, entry->d_name, NULL);
+            if (report)
+                mark_changed(watch, path);
+            else
+                g_hash_table_insert(watch->files, g_strdup(path), NULL);
+        } else {
+            continue;
+        }
+        g_free(path);
+    }
+
+    closedir(dirp);
+    g_free(full_path);
+}
+
+
+// Collect keys of the table which start with the prefix
+static GSList *
+keys_with_prefix(GHashTable *table, const char *prefix)
+{
+    GHashTableIter iter;
+    gpointer key;
+    GSList *keys = NULL;
+
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+        if (g_str_has_prefix(key, prefix))
+            keys = g_slist_prepend(keys, g_strdup(key));
+
+    return keys;
+}
+
+
+// Stop watching of the directory (and its subdirectories) and mark
+// all files in it as removed
+static void
+unwatch_dir(struct RepoWatch *watch, const char *reldir)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    GSList *paths, *elem;
+
+    g_hash_table_iter_init(&iter, watch->wds);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        if (g_str_has_prefix(value, reldir)) {
+            inotify_rm_watch(watch->fd, GPOINTER_TO_INT(key));
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+
+    paths = g_slist_concat(keys_with_prefix(watch->files, reldir),
+                           keys_with_prefix(watch->changed, reldir));
+    for (elem = paths; elem; elem = g_slist_next(elem))
+        mark_removed(watch, elem->data);
+    cr_slist_free_full(paths, g_free);
+}
+
+
+// Events were lost - watch the whole tree again. Every file is marked
+// as removed and files which still exist are marked as changed again.
+static void
+resync(struct RepoWatch *watch)
+{
+    g_warning("Inotify queue overflow - rescanning %s", watch->dir);
+    unwatch_dir(watch, "");
+    watch_dir(watch, "", TRUE);
+}
+
+
+static void
+process_event(struct RepoWatch *watch, struct inotify_event *event)
+{
+    const char *reldir;
+    gchar *path;
+
+    if (event->mask & IN_Q_OVERFLOW) {
+        resync(watch);
+        return;
+    }
+
+    if (event->mask & IN_IGNORED) {
+        g_hash_table_remove(watch->wds, GINT_TO_POINTER(event->wd));
+        return;
+    }
+
+    reldir = g_hash_table_lookup(watch->wds, GINT_TO_POINTER(event->wd));
+    if (!reldir || !event->len || is_output_dir(reldir, event->name))
+        return;
+
+    if (event->mask & IN_ISDIR) {
+        path = g_strconcat(reldir, event->name, "/", NULL);
+        if (event->mask & (IN_CREATE | IN_MOVED_TO))
+            watch_dir(watch, path, TRUE);
+        else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+            unwatch_dir(watch, path);
+        g_free(path);
+        return;
+    }
+
+    if (!g_str_has_suffix(event->name, watch->suffix))
+        return;
+
+    path = g_strconcat(reldir, event->name, NULL);
+    if (event->mask & IN_CLOSE_WRITE) {
+        mark_changed(watch, path);
+    } else if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        // Regular files are reported when they are closed (or moved in),
+        // symlinks are complete right after their creation
+        struct stat st;
+        gboolean is_link = FALSE;
+        gchar *full_path = g_strconcat(watch->dir, path, NULL);
+        if (lstat(full_path, &st) == 0)
+            is_link = S_ISLNK(st.st_mode);
+        g_free(full_path);
+
+        if (is_link && !watch->skip_symlinks)
+            mark_changed(watch, path);
+        else if (!is_link && (event->mask & IN_MOVED_TO))
+            mark_changed(watch, path);
+    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        mark_removed(watch, path);
+    }
+    g_free(path);
+}
+
+#endif /* __linux__ */
+
+
+struct RepoWatch *
+repowatch_new(const char *dir,
+              const char *suffix,
+              gboolean skip_symlinks,
+              GError **err)
+{
+#ifdef __linux__
+    struct RepoWatch *watch;
+    int fd;
+
+    fd = inotify_init();
+    if (fd == -1) {
+        g_set_error(err, CR_WATCH_ERROR, CRE_IO,
+                    "inotify_init(): %s", strerror(errno));
+        return NULL;
+    }
+
+    watch = g_malloc0(sizeof(struct RepoWatch));
+    watch->fd = fd;
+    watch->dir = g_strdup(dir);
+    watch->suffix = g_strdup(suffix);
+    watch->skip_symlinks = skip_symlinks;
+    watch->wds = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                       NULL, g_free);
+    watch->files = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, NULL);
+    watch->changed = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, NULL);
+    watch->removed = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, NULL);
+    watch->last_change = g_timer_new();
+
+    watch_dir(watch, "", FALSE);
+    if (!g_hash_table_size(watch->wds)) {
+        g_set_error(err, CR_WATCH_ERROR, CRE_IO,
+                    "Cannot watch directory %s", dir);
+        repowatch_free(watch);
+        return NULL;
+    }
+
+    return watch;
+#else
+    CR_UNUSED(dir);
+    CR_UNUSED(suffix);
+    CR_UNUSED(skip_symlinks);
+    g_set_error(err, CR_WATCH_ERROR, CRE_ERROR,
+                "Watching of directories is supported only on Linux");
+    return NULL;
+#endif
+}
+
+
+gboolean
+repowatch_wait(struct RepoWatch *watch,
+               int delay,
+               GSList **changed,
+               GSList **removed,
+               GError **err)
+{
+#ifdef __linux__
+    char *buf = g_malloc(WATCH_BUF_SIZE);
+    GHashTableIter iter;
+    gpointer key;
+
+    *changed = NULL;
+    *removed = NULL;
+
+    for (;;) {
+        struct pollfd pfd = { watch->fd, POLLIN, 0 };
+        int timeout = -1;
+        int ret;
+        ssize_t len;
+
+        if (g_hash_table_size(watch->changed)
+            || g_hash_table_size(watch->removed))
+        {
+            gdouble wait = delay - g_timer_elapsed(watch->last_change, NULL);
+            if (wait <= 0)
+                break;
+            timeout = (int) (wait * 1000) + 1;
+        }
+
+        ret = poll(&pfd, 1, timeout);
+        if (ret == -1 && errno == EINTR)
+            continue;
+        if (ret == -1) {
+            g_set_error(err, CR_WATCH_ERROR, CRE_IO,
+                        "poll(): %s", strerror(errno));
+            g_free(buf);
+            return FALSE;
+        }
+        if (ret == 0)
+            continue;
+
+        len = read(watch->fd, buf, WATCH_BUF_SIZE);
+        if (len == -1 && errno == EINTR)
+            continue;
+        if (len <= 0) {
+            g_set_error(err, CR_WATCH_ERROR, CRE_IO,
+                        "Cannot read inotify events: %s",
+                        len ? strerror(errno) : "EOF");
+            g_free(buf);
+            return FALSE;
+        }
+
+        for (char *ptr = buf; ptr < buf + len; ) {
+            struct inotify_event *event = (struct inotify_event *) ptr;
+            process_event(watch, event);
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    g_free(buf);
+
+    // Report the changes and take them as known
+    g_hash_table_iter_init(&iter, watch->changed);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        *changed = g_slist_prepend(*changed, g_strdup(key));
+        g_hash_table_insert(watch->files, g_strdup(key), NULL);
+    }
+
+    g_hash_table_iter_init(&iter, watch->removed);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        *removed = g_slist_prepend(*removed, g_strdup(key));
+        g_hash_table_remove(watch->files, key);
+    }
+
+    g_hash_table_remove_all(watch->changed);
+    g_hash_table_remove_all(watch->removed);
+
+    return TRUE;
+#else
+    CR_UNUSED(watch);
+    CR_UNUSED(delay);
+    *changed = NULL;
+    *removed = NULL;
+    g_set_error(err, CR_WATCH_ERROR, CRE_ERROR,
+                "Watching of directories is supported only on Linux");
+    return FALSE;
+#endif
+}
+
+
+void
+repowatch_free(struct RepoWatch *watch)
+{
+    if (!watch)
+        return;
+
+    close(watch->fd);
+    g_free(watch->dir);
+    g_free(watch->suffix);
+    g_hash_table_destroy(watch->wds);
+    g_hash_table_destroy(watch->files);
+    g_hash_table_destroy(watch->changed);
+    g_hash_table_destroy(watch->removed);
+    g_timer_destroy(watch->last_change);
+    g_free(watch);
+}
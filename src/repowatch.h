@@ -0,0 +1,77 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_REPOWATCH_H__
+#define __C_CREATEREPOLIB_REPOWATCH_H__
+
+#include <glib.h>
+
+
+/**
+ * Watcher of packages in a directory tree (used by --watch).
+ * Only Linux (inotify) is supported.
+ */
+struct RepoWatch;
+
+/**
+ * Start watching of the directory tree. The "repodata" and ".repodata"
+ * subdirectories of the top directory are not watched.
+ * @param dir           path to the directory (with trailing '/')
+ * @param suffix        suffix of the watched files (e.g. ".rpm")
+ * @param skip_symlinks ignore files which are symbolic links (symbolic
+ *                      links to directories are followed, as in
+ *                      cr_dirwalk())
+ * @param err           GError **
+ * @return              new RepoWatch or NULL on error
+ */
+struct RepoWatch *
+repowatch_new(const char *dir,
+              const char *suffix,
+              gboolean skip_symlinks,
+              GError **err);
+
+/**
+ * Wait for changes of the watched files. After the first change, the
+ * function waits until there is no other change for delay seconds,
+ * so a batch of packages copied into the repo is returned at once.
+ * A file changed several times is reported only once.
+ * @param watch         RepoWatch
+ * @param delay         debounce delay in seconds
+ * @param changed       list of added and modified files (paths relative
+ *                      to the watched directory, caller frees them)
+ * @param removed       list of removed files (paths relative to the
+ *                      watched directory, caller frees them)
+ * @param err           GError **
+ * @return              TRUE on success, FALSE on error
+ */
+gboolean
+repowatch_wait(struct RepoWatch *watch,
+               int delay,
+               GSList **changed,
+               GSList **removed,
+               GError **err);
+
+/**
+ * Stop watching and free the RepoWatch.
+ * @param watch         RepoWatch
+ */
+void
+repowatch_free(struct RepoWatch *watch);
+
+#endif /* __C_CREATEREPOLIB_REPOWATCH_H__ */
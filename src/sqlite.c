@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include "logging.h"
 #include "misc.h"
 #include "sqlite.h"
@@ -34,26 +35,43 @@
 #define ENCODED_PACKAGE_FILE_FILES 2048
 #define ENCODED_PACKAGE_FILE_TYPES 60
 
+// sqlite3_serialize() is always available since SQLite 3.36,
+// older versions need to be built with SQLITE_ENABLE_DESERIALIZE
+#if SQLITE_VERSION_NUMBER >= 3036000 || defined(SQLITE_ENABLE_DESERIALIZE)
+#define CR_DB_SERIALIZE
+#endif
+
+// Size of the chunks of the db image passed to cr_write()
+#define DB_IMAGE_CHUNK  (1024*1024)
+
+// Max size of the in-memory db (the default of the memdb is only
+// SQLITE_MEMDB_DEFAULT_MAXSIZE - 1 GiB). The memdb keeps the db in a single
+// buffer and SQLite doesn't allocate 2 GiB or more at once, so this is
+// the real limit of the in-memory db.
+#define DB_MEMDB_MAX_SIZE   0x7fffff00
+
+typedef struct _DbBatch DbBatch;   // Multi-row insertion
+
 struct _DbPrimaryStatements {
     sqlite3 *db;
     sqlite3_stmt *pkg_handle;
-    sqlite3_stmt *provides_handle;
-    sqlite3_stmt *conflicts_handle;
-    sqlite3_stmt *obsoletes_handle;
-    sqlite3_stmt *requires_handle;
-    sqlite3_stmt *files_handle;
+    DbBatch *provides_handle;
+    DbBatch *conflicts_handle;
+    DbBatch *obsoletes_handle;
+    DbBatch *requires_handle;
+    DbBatch *files_handle;
 };
 
 struct _DbFilelistsStatements {
     sqlite3 *db;
     sqlite3_stmt *package_id_handle;
-    sqlite3_stmt *filelists_handle;
+    DbBatch *filelists_handle;
 };
 
 struct _DbOtherStatements {
     sqlite3 *db;
     sqlite3_stmt *package_id_handle;
-    sqlite3_stmt *changelog_handle;
+    DbBatch *changelog_handle;
 };
 
 /*
@@ -66,6 +84,8 @@ struct _DbOtherStatements {
  *  - Close db
  */
 
+/** Open the db file or, if the path is NULL, a new in-memory db.
+ */
 static sqlite3 *
 open_sqlite_db(const char *path, GError **err)
 {
@@ -74,14 +94,32 @@ open_sqlite_db(const char *path, GError **err)
 
     assert(!err || *err == NULL);
 
-    rc = sqlite3_open(path, &db);
+    rc = sqlite3_open(path ? path : ":memory:", &db);
     if (rc != SQLITE_OK) {
         g_set_error(err, CR_DB_ERROR, CRE_DB,
                     "Can not open SQL database: %s", sqlite3_errmsg(db));
         sqlite3_close(db);
-        db = NULL;
+        return NULL;
     }
 
+#ifdef CR_DB_SERIALIZE
+    if (!path) {
+        // Keep the in-memory db in a single growing buffer, so
+        // sqlite3_serialize() returns the image without copying it
+        rc = sqlite3_deserialize(db, "main", NULL, 0, 0,
+                                 SQLITE_DESERIALIZE_FREEONCLOSE
+                                 | SQLITE_DESERIALIZE_RESIZEABLE);
+        if (rc != SQLITE_OK) {
+            g_debug("%s: Cannot use memdb: %s", __func__, sqlite3_errmsg(db));
+        } else {
+#ifdef SQLITE_FCNTL_SIZE_LIMIT
+            sqlite3_int64 limit = DB_MEMDB_MAX_SIZE;
+            sqlite3_file_control(db, "main", SQLITE_FCNTL_SIZE_LIMIT, &limit);
+#endif
+        }
+    }
+#endif
+
     return db;
 }
 
@@ -330,6 +368,17 @@ db_tweak(sqlite3 *db, GError **err)
     sqlite3_exec (db, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
 
     sqlite3_exec (db, "PRAGMA temp_store = MEMORY", NULL, NULL, NULL);
+
+    // Only a new (empty) db is affected, old SQLite used 1 KiB pages
+    sqlite3_exec (db, "PRAGMA page_size = 4096", NULL, NULL, NULL);
+
+    // Bigger page cache (64 MiB), indexes are created at the end,
+    // when all the tables are filled
+    sqlite3_exec (db, "PRAGMA cache_size = -65536", NULL, NULL, NULL);
+
+    // Nobody else uses the db while it is written,
+    // the file lock is acquired only once
+    sqlite3_exec (db, "PRAGMA locking_mode = EXCLUSIVE", NULL, NULL, NULL);
 }
 
 
@@ -540,6 +589,201 @@ cr_db_dbinfo_update(cr_SqliteDb *sqlitedb, const char *checksum, GError **err)
 }
 
 
+/*
+ * Multi-row insertion
+ *
+ * Rows of a package are collected and, when the package is done,
+ * inserted by as few multi-row INSERT statements (with 2^N rows) as
+ * possible. Every sqlite3_step() has a considerable overhead, this is
+ * about twice as fast as a statement per row. Strings are not copied,
+ * so the rows must be flushed before the package is freed.
+ */
+
+#define DB_BATCH_LEVELS     6   // Statements for 1, 2, 4, ... 32 rows
+
+typedef enum {
+    DB_VALUE_NULL,          // SQL NULL (e.g. a NULL string)
+    DB_VALUE_TEXT,
+    DB_VALUE_INT,
+} DbValueKind;
+
+typedef struct {
+    DbValueKind kind;
+    const char *text;       // Text
+    int len;                // Length of the text (-1 = null terminated)
+    gint64 num;             // Number
+} DbValue;
+
+struct _DbBatch {
+    sqlite3 *db;
+    const char *name;       // Name of the table (for messages)
+    gchar *head;            // "INSERT INTO table (columns) VALUES "
+    int columns;            // Number of columns
+    sqlite3_stmt *handles[DB_BATCH_LEVELS]; // Prepared when needed
+    GArray *values;         // DbValue of the collected rows
+    GStringChunk *chunk;    // Copies of transient strings
+};
+
+
+static sqlite3_stmt *
+db_batch_handle(DbBatch *batch, int level, GError **err)
+{
+    int rc;
+    GString *query;
+
+    assert(!err || *err == NULL);
+
+    if (batch->handles[level])
+        return batch->handles[level];
+
+    query = g_string_new(batch->head);
+    for (int row = 0; row < (1 << level); row++) {
+        g_string_append(query, row ? ", (?" : "(?");
+        for (int col = 1; col < batch->columns; col++)
+            g_string_append(query, ", ?");
+        g_string_append_c(query, ')');
+    }
+
+    rc = sqlite3_prepare_v2(batch->db, query->str, -1,
+                            &batch->handles[level], NULL);
+    g_string_free(query, TRUE);
+
+    if (rc != SQLITE_OK) {
+        g_set_error(err, CR_DB_ERROR, CRE_DB,
+                    "Cannot prepare %s insertion: %s",
+                    batch->name, sqlite3_errmsg(batch->db));
+        sqlite3_finalize(batch->handles[level]);
+        batch->handles[level] = NULL;
+    }
+
+    return batch->handles[level];
+}
+
+static void
+db_batch_free(DbBatch *batch)
+{
+    if (!batch)
+        return;
+
+    for (int x = 0; x < DB_BATCH_LEVELS; x++)
+        if (batch->handles[x])
+            sqlite3_finalize(batch->handles[x]);
+    g_array_free(batch->values, TRUE);
+    g_string_chunk_free(batch->chunk);
+    g_free(batch->head);
+    g_free(batch);
+}
+
+/** Prepare a multi-row insertion into the table.
+ * The columns are comma separated names of the columns.
+ */
+static DbBatch *
+db_batch_new(sqlite3 *db,
+             const char *table,
+             const char *columns,
+             GError **err)
+{
+    DbBatch *batch = g_new0(DbBatch, 1);
+
+    assert(!err || *err == NULL);
+
+    batch->db      = db;
+    batch->name    = table;
+    batch->head    = g_strdup_printf("INSERT INTO %s (%s) VALUES ",
+                                     table, columns);
+    batch->columns = 1;
+    for (const char *c = columns; *c; c++)
+        if (*c == ',')
+            batch->columns++;
+    batch->values  = g_array_new(FALSE, FALSE, sizeof(DbValue));
+    batch->chunk   = g_string_chunk_new(1024);
+
+    // The single row statement is always needed
+    if (!db_batch_handle(batch, 0, err)) {
+        db_batch_free(batch);
+        return NULL;
+    }
+
+    return batch;
+}
+
+static inline void
+db_batch_text_len(DbBatch *batch, const char *text, int len)
+{
+    DbValue value = { text ? DB_VALUE_TEXT : DB_VALUE_NULL, text, len, 0 };
+    g_array_append_val(batch->values, value);
+}
+
+static inline void
+db_batch_text(DbBatch *batch, const char *text)
+{
+    db_batch_text_len(batch, text, -1);
+}
+
+static inline void
+db_batch_int(DbBatch *batch, gint64 num)
+{
+    DbValue value = { DB_VALUE_INT, NULL, 0, num };
+    g_array_append_val(batch->values, value);
+}
+
+/** Insert all collected rows.
+ */
+static void
+db_batch_flush(DbBatch *batch, GError **err)
+{
+    int rc = SQLITE_DONE;
+    int rows, row = 0;
+    DbValue *values = (DbValue *) batch->values->data;
+
+    assert(!err || *err == NULL);
+    assert(batch->values->len % batch->columns == 0);
+
+    rows = batch->values->len / batch->columns;
+
+    for (int level = DB_BATCH_LEVELS - 1; level >= 0; level--) {
+        int count = 1 << level;
+
+        while (rc == SQLITE_DONE && rows - row >= count) {
+            sqlite3_stmt *handle = db_batch_handle(batch, level, NULL);
+            if (!handle)
+                break;  // Smaller statements are used
+
+            for (int x = 0; x < count * batch->columns; x++) {
+                DbValue *value = &values[row * batch->columns + x];
+                switch (value->kind) {
+                    case DB_VALUE_TEXT:
+                        sqlite3_bind_text(handle, x + 1, value->text,
+                                          value->len, SQLITE_STATIC);
+                        break;
+                    case DB_VALUE_INT:
+                        sqlite3_bind_int64(handle, x + 1, value->num);
+                        break;
+                    default:
+                        sqlite3_bind_null(handle, x + 1);
+                        break;
+                }
+            }
+
+            rc = sqlite3_step(handle);
+            sqlite3_reset(handle);
+            row += count;
+        }
+    }
+
+    g_array_set_size(batch->values, 0);
+    g_string_chunk_clear(batch->chunk);
+
+    if (rc != SQLITE_DONE) {
+        g_critical("Error adding %s records to db: %s",
+                   batch->name, sqlite3_errmsg(batch->db));
+        g_set_error(err, CR_DB_ERROR, CRE_DB,
+                    "Error adding %s records to db: %s",
+                    batch->name, sqlite3_errmsg(batch->db));
+    }
+}
+
+
 /*
  * primary.sqlite
  */
@@ -647,114 +891,47 @@ db_package_write (sqlite3 *db,
 }
 
 
-static sqlite3_stmt *
+static DbBatch *
 db_dependency_prepare (sqlite3 *db, const char *table, GError **err)
 {
-    int rc;
-    sqlite3_stmt *handle = NULL;
-    char *query;
-
-    const char *pre_name = "";
-    const char *pre_value = "";
+    const char *columns = "name, flags, epoch, version, release, pkgKey";
 
     assert(!err || *err == NULL);
 
-    if (!strcmp (table, "requires")) {
-        pre_name = ", pre";
-        pre_value = ", ?";
-    }
-
-    query = g_strdup_printf
-        ("INSERT INTO %s (name, flags, epoch, version, release, pkgKey%s) "
-         "VALUES (?, ?, ?, ?, ?, ?%s)", table, pre_name, pre_value);
-
-    rc = sqlite3_prepare_v2 (db, query, -1, &handle, NULL);
-    g_free (query);
-
-    if (rc != SQLITE_OK) {
-        g_set_error(err, CR_DB_ERROR, CRE_DB,
-                     "Cannot prepare dependency insertion: %s",
-                     sqlite3_errmsg (db));
-        sqlite3_finalize (handle);
-        handle = NULL;
-    }
+    if (!strcmp (table, "requires"))
+        columns = "name, flags, epoch, version, release, pkgKey, pre";
 
-    return handle;
+    return db_batch_new(db, table, columns, err);
 }
 
 static void
-db_dependency_write (sqlite3 *db,
-                     sqlite3_stmt *handle,
+db_dependency_write (DbBatch *batch,
                      gint64 pkgKey,
                      cr_Dependency *dep,
-                     gboolean isRequirement,
-                     GError **err)
+                     gboolean isRequirement)
 {
-    int rc;
-
-    assert(!err || *err == NULL);
-
-    sqlite3_bind_text (handle, 1, dep->name,    -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 2, dep->flags,   -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 3, dep->epoch,   -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 4, dep->version, -1, SQLITE_STATIC);
-    sqlite3_bind_text (handle, 5, dep->release, -1, SQLITE_STATIC);
-    sqlite3_bind_int  (handle, 6, pkgKey);
-
-    if (isRequirement) {
-        if (dep->pre)
-            sqlite3_bind_text (handle, 7, "TRUE", -1, SQLITE_TRANSIENT);
-        else
-            sqlite3_bind_text (handle, 7, "FALSE", -1, SQLITE_TRANSIENT);
-    }
-
-    rc = sqlite3_step (handle);
-    sqlite3_reset (handle);
-
-    if (rc != SQLITE_DONE) {
-        g_critical ("Error adding package dependency to db: %s",
-                    sqlite3_errmsg (db));
-        g_set_error(err, CR_DB_ERROR, CRE_DB,
-                    "Error adding package dependency to db: %s",
-                    sqlite3_errmsg(db));
-    }
+    db_batch_text(batch, dep->name);
+    db_batch_text(batch, dep->flags);
+    db_batch_text(batch, dep->epoch);
+    db_batch_text(batch, dep->version);
+    db_batch_text(batch, dep->release);
+    db_batch_int (batch, pkgKey);
+
+    if (isRequirement)
+        db_batch_text(batch, dep->pre ? "TRUE" : "FALSE");
 }
 
-static sqlite3_stmt *
+static DbBatch *
 db_file_prepare (sqlite3 *db, GError **err)
 {
-    int rc;
-    sqlite3_stmt *handle = NULL;
-    const char *query;
-
-    assert(!err || *err == NULL);
-
-    query = "INSERT INTO files (name, type, pkgKey) VALUES (?, ?, ?)";
-
-    rc = sqlite3_prepare_v2 (db, query, -1, &handle, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error(err, CR_DB_ERROR, CRE_DB,
-                     "Can not prepare file insertion: %s",
-                     sqlite3_errmsg (db));
-        sqlite3_finalize (handle);
-        handle = NULL;
-    }
-
-    return handle;
-
+    return db_batch_new(db, "files", "name, type, pkgKey", err);
 }
 
 static void
-db_file_write (sqlite3 *db,
-               sqlite3_stmt *handle,
+db_file_write (DbBatch *batch,
                gint64 pkgKey,
-               cr_PackageFile *file,
-               GError **err)
+               cr_PackageFile *file)
 {
-    int rc;
-
-    assert(!err || *err == NULL);
-
     gchar *fullpath = g_strconcat(file->path, file->name, NULL);
     if (!fullpath)
         return; // Nothing to do
@@ -769,21 +946,10 @@ db_file_write (sqlite3 *db,
         file_type = "file";
     }
 
-    sqlite3_bind_text (handle, 1, fullpath, -1, SQLITE_TRANSIENT);
+    db_batch_text(batch, g_string_chunk_insert(batch->chunk, fullpath));
     g_free(fullpath);
-    sqlite3_bind_text (handle, 2, file_type, -1, SQLITE_STATIC);
-    sqlite3_bind_int  (handle, 3, pkgKey);
-
-    rc = sqlite3_step (handle);
-    sqlite3_reset (handle);
-
-    if (rc != SQLITE_DONE) {
-        g_critical ("Error adding package file to db: %s",
-                    sqlite3_errmsg (db));
-        g_set_error(err, CR_DB_ERROR, CRE_DB,
-                    "Error adding package file to db: %s",
-                    sqlite3_errmsg(db));
-    }
+    db_batch_text(batch, file_type);
+    db_batch_int (batch, pkgKey);
 }
 
 
@@ -792,29 +958,11 @@ db_file_write (sqlite3 *db,
  */
 
 
-static sqlite3_stmt *
+static DbBatch *
 db_filelists_prepare (sqlite3 *db, GError **err)
 {
-    int rc;
-    sqlite3_stmt *handle = NULL;
-    const char *query;
-
-    assert(!err || *err == NULL);
-
-    query =
-        "INSERT INTO filelist (pkgKey, dirname, filenames, filetypes) "
-        " VALUES (?, ?, ?, ?)";
-
-    rc = sqlite3_prepare_v2 (db, query, -1, &handle, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error(err, CR_DB_ERROR, CRE_DB,
-                     "Can not prepare filelist insertion: %s",
-                     sqlite3_errmsg (db));
-        sqlite3_finalize (handle);
-        handle = NULL;
-    }
-
-    return handle;
+    return db_batch_new(db, "filelist",
+                        "pkgKey, dirname, filenames, filetypes", err);
 }
 
 
@@ -896,22 +1044,17 @@ package_files_to_hash (GSList *files)
 
 
 static void
-cr_db_write_file (sqlite3 *db,
-                  sqlite3_stmt *handle,
+cr_db_write_file (DbBatch *batch,
                   gint64 pkgKey,
                   gpointer key,
-                  gpointer value,
-                  GError **err)
+                  gpointer value)
 {
     // key is a path to directory eg. "/etc/X11/xinit/xinitrc.d"
     // value is a struct eg. { .files="foo/bar/dir", .types="ffd"}
 
-    int rc;
     size_t key_len;
     EncodedPackageFile *file = (EncodedPackageFile *) value;
 
-    assert(!err || *err == NULL);
-
     key_len = strlen((const char *) key);
     while (key_len > 1 && ((char *) key)[key_len-1] == '/') {
         // Remove trailing '/' char(s)
@@ -925,21 +1068,10 @@ cr_db_write_file (sqlite3 *db,
         key_len = 1;
     }
 
-    sqlite3_bind_int (handle, 1, pkgKey);
-    sqlite3_bind_text(handle, 2, (const char *) key, (int) key_len, SQLITE_STATIC);
-    sqlite3_bind_text(handle, 3, file->files->str, -1, SQLITE_STATIC);
-    sqlite3_bind_text(handle, 4, file->types->str, -1, SQLITE_STATIC);
-
-    rc = sqlite3_step (handle);
-    sqlite3_reset (handle);
-
-    if (rc != SQLITE_DONE) {
-        g_critical ("Error adding file records to db: %s",
-                    sqlite3_errmsg (db));
-        g_set_error(err, CR_DB_ERROR, CRE_DB,
-                    "Error adding file records to db : %s",
-                     sqlite3_errmsg(db));
-    }
+    db_batch_int     (batch, pkgKey);
+    db_batch_text_len(batch, (const char *) key, (int) key_len);
+    db_batch_text    (batch, file->files->str);
+    db_batch_text    (batch, file->types->str);
 }
 
 
@@ -948,29 +1080,11 @@ cr_db_write_file (sqlite3 *db,
  */
 
 
-static sqlite3_stmt *
+static DbBatch *
 db_changelog_prepare (sqlite3 *db, GError **err)
 {
-    int rc;
-    sqlite3_stmt *handle = NULL;
-    const char *query;
-
-    assert(!err || *err == NULL);
-
-    query =
-        "INSERT INTO changelog (pkgKey, author, date, changelog) "
-        " VALUES (?, ?, ?, ?)";
-
-    rc = sqlite3_prepare_v2 (db, query, -1, &handle, NULL);
-    if (rc != SQLITE_OK) {
-        g_set_error(err, CR_DB_ERROR, CRE_DB,
-                     "Can not prepare changelog insertion: %s",
-                     sqlite3_errmsg (db));
-        sqlite3_finalize (handle);
-        handle = NULL;
-    }
-
-    return handle;
+    return db_batch_new(db, "changelog",
+                        "pkgKey, author, date, changelog", err);
 }
 
 
@@ -999,13 +1113,19 @@ db_package_ids_prepare(sqlite3 *db, GError **err)
 }
 
 
-static void
+/** Insert pkgId into the packages table.
+ * The pkgKey is returned instead of being stored into the cr_Package,
+ * so the same package could be written into the filelists and other
+ * databases from different threads at the same time.
+ */
+static gint64
 db_package_ids_write(sqlite3 *db,
                      sqlite3_stmt *handle,
                      cr_Package *pkg,
                      GError **err)
 {
     int rc;
+    gint64 pkgKey = 0;
 
     assert(!err || *err == NULL);
 
@@ -1014,7 +1134,7 @@ db_package_ids_write(sqlite3 *db,
     sqlite3_reset (handle);
 
     if (rc == SQLITE_DONE) {
-        pkg->pkgKey = sqlite3_last_insert_rowid (db);
+        pkgKey = sqlite3_last_insert_rowid (db);
     } else {
         g_critical("Error adding package to db: %s",
                    sqlite3_errmsg(db));
@@ -1022,6 +1142,8 @@ db_package_ids_write(sqlite3 *db,
                     "Error adding package to db: %s",
                     sqlite3_errmsg(db));
     }
+
+    return pkgKey;
 }
 
 /*
@@ -1095,16 +1217,11 @@ cr_db_destroy_primary_statements(cr_DbPrimaryStatements stmts)
 
     if (stmts->pkg_handle)
         sqlite3_finalize(stmts->pkg_handle);
-    if (stmts->provides_handle)
-        sqlite3_finalize(stmts->provides_handle);
-    if (stmts->conflicts_handle)
-        sqlite3_finalize(stmts->conflicts_handle);
-    if (stmts->obsoletes_handle)
-        sqlite3_finalize(stmts->obsoletes_handle);
-    if (stmts->requires_handle)
-        sqlite3_finalize(stmts->requires_handle);
-    if (stmts->files_handle)
-        sqlite3_finalize(stmts->files_handle);
+    db_batch_free(stmts->provides_handle);
+    db_batch_free(stmts->conflicts_handle);
+    db_batch_free(stmts->obsoletes_handle);
+    db_batch_free(stmts->requires_handle);
+    db_batch_free(stmts->files_handle);
     free(stmts);
 }
 
@@ -1125,61 +1242,35 @@ cr_db_add_primary_pkg(cr_DbPrimaryStatements stmts,
         return;
     }
 
-    for (iter = pkg->provides; iter; iter = iter->next) {
-        db_dependency_write(stmts->db,
-                            stmts->provides_handle,
-                            pkg->pkgKey,
-                            (cr_Dependency *) iter->data,
-                            FALSE,
-                            &tmp_err);
-        if (tmp_err) {
-            g_propagate_error(err, tmp_err);
-            return;
-        }
-    }
+    for (iter = pkg->provides; iter; iter = iter->next)
+        db_dependency_write(stmts->provides_handle, pkg->pkgKey,
+                            (cr_Dependency *) iter->data, FALSE);
 
-    for (iter = pkg->conflicts; iter; iter = iter->next) {
-        db_dependency_write(stmts->db,
-                            stmts->conflicts_handle,
-                            pkg->pkgKey,
-                            (cr_Dependency *) iter->data,
-                            FALSE,
-                            &tmp_err);
-        if (tmp_err) {
-            g_propagate_error(err, tmp_err);
-            return;
-        }
-    }
+    for (iter = pkg->conflicts; iter; iter = iter->next)
+        db_dependency_write(stmts->conflicts_handle, pkg->pkgKey,
+                            (cr_Dependency *) iter->data, FALSE);
 
-    for (iter = pkg->obsoletes; iter; iter = iter->next) {
-        db_dependency_write(stmts->db,
-                            stmts->obsoletes_handle,
-                            pkg->pkgKey,
-                            (cr_Dependency *) iter->data,
-                            FALSE,
-                            &tmp_err);
-        if (tmp_err) {
-            g_propagate_error(err, tmp_err);
-            return;
-        }
-    }
+    for (iter = pkg->obsoletes; iter; iter = iter->next)
+        db_dependency_write(stmts->obsoletes_handle, pkg->pkgKey,
+                            (cr_Dependency *) iter->data, FALSE);
 
-    for (iter = pkg->requires; iter; iter = iter->next) {
-        db_dependency_write(stmts->db,
-                            stmts->requires_handle,
-                            pkg->pkgKey,
-                            (cr_Dependency *) iter->data,
-                            TRUE,
-                            &tmp_err);
-        if (tmp_err) {
-            g_propagate_error(err, tmp_err);
-            return;
-        }
-    }
+    for (iter = pkg->requires; iter; iter = iter->next)
+        db_dependency_write(stmts->requires_handle, pkg->pkgKey,
+                            (cr_Dependency *) iter->data, TRUE);
+
+    for (iter = pkg->files; iter; iter = iter->next)
+        db_file_write(stmts->files_handle, pkg->pkgKey,
+                      (cr_PackageFile *) iter->data);
 
-    for (iter = pkg->files; iter; iter = iter->next) {
-        db_file_write(stmts->db, stmts->files_handle, pkg->pkgKey,
-                      (cr_PackageFile *) iter->data, &tmp_err);
+    // Insert the collected rows
+    DbBatch *batches[] = { stmts->provides_handle,
+                           stmts->conflicts_handle,
+                           stmts->obsoletes_handle,
+                           stmts->requires_handle,
+                           stmts->files_handle };
+
+    for (int x = 0; x < 5; x++) {
+        db_batch_flush(batches[x], &tmp_err);
         if (tmp_err) {
             g_propagate_error(err, tmp_err);
             return;
@@ -1227,8 +1318,7 @@ cr_db_destroy_filelists_statements(cr_DbFilelistsStatements stmts)
 
     if (stmts->package_id_handle)
         sqlite3_finalize(stmts->package_id_handle);
-    if (stmts->filelists_handle)
-        sqlite3_finalize(stmts->filelists_handle);
+    db_batch_free(stmts->filelists_handle);
     free(stmts);
 }
 
@@ -1238,12 +1328,14 @@ cr_db_add_filelists_pkg(cr_DbFilelistsStatements stmts,
                         cr_Package *pkg,
                         GError **err)
 {
+    gint64 pkgKey;
     GError *tmp_err = NULL;
 
     assert(!err || *err == NULL);
 
     // Add record into the package table
-    db_package_ids_write(stmts->db, stmts->package_id_handle, pkg, &tmp_err);
+    pkgKey = db_package_ids_write(stmts->db, stmts->package_id_handle, pkg,
+                                  &tmp_err);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
         return;
@@ -1259,13 +1351,13 @@ cr_db_add_filelists_pkg(cr_DbFilelistsStatements stmts,
     // value is a struct eg. { .files="foo/bar/dir", .types="ffd"}
     hash = package_files_to_hash(pkg->files);
     g_hash_table_iter_init(&iter, hash);
-    while (g_hash_table_iter_next (&iter, &key, &value)) {
-        cr_db_write_file(stmts->db, stmts->filelists_handle, pkg->pkgKey, key, value, &tmp_err);
-        if (tmp_err) {
-            g_propagate_error(err, tmp_err);
-            break;
-        }
-    }
+    while (g_hash_table_iter_next (&iter, &key, &value))
+        cr_db_write_file(stmts->filelists_handle, pkgKey, key, value);
+
+    // Rows refer to the strings from the hashtable
+    db_batch_flush(stmts->filelists_handle, &tmp_err);
+    if (tmp_err)
+        g_propagate_error(err, tmp_err);
 
     g_hash_table_destroy(hash);
 }
@@ -1310,8 +1402,7 @@ cr_db_destroy_other_statements(cr_DbOtherStatements stmts)
 
     if (stmts->package_id_handle)
         sqlite3_finalize(stmts->package_id_handle);
-    if (stmts->changelog_handle)
-        sqlite3_finalize(stmts->changelog_handle);
+    db_batch_free(stmts->changelog_handle);
     free(stmts);
 }
 
@@ -1319,17 +1410,18 @@ cr_db_destroy_other_statements(cr_DbOtherStatements stmts)
 void
 cr_db_add_other_pkg(cr_DbOtherStatements stmts, cr_Package *pkg, GError **err)
 {
-    int rc;
     GSList *iter;
     cr_ChangelogEntry *entry;
+    gint64 pkgKey;
     GError *tmp_err = NULL;
 
     assert(!err || *err == NULL);
 
-    sqlite3_stmt *handle = stmts->changelog_handle;
+    DbBatch *batch = stmts->changelog_handle;
 
     // Add package record into the packages table
-    db_package_ids_write(stmts->db, stmts->package_id_handle, pkg, &tmp_err);
+    pkgKey = db_package_ids_write(stmts->db, stmts->package_id_handle, pkg,
+                                  &tmp_err);
     if (tmp_err) {
         g_propagate_error(err, tmp_err);
         return;
@@ -1339,31 +1431,22 @@ cr_db_add_other_pkg(cr_DbOtherStatements stmts, cr_Package *pkg, GError **err)
     for (iter = pkg->changelogs; iter; iter = iter->next) {
         entry = (cr_ChangelogEntry *) iter->data;
 
-        sqlite3_bind_int  (handle, 1, pkg->pkgKey);
-        sqlite3_bind_text (handle, 2, entry->author, -1, SQLITE_STATIC);
-        sqlite3_bind_int  (handle, 3, entry->date);
-        sqlite3_bind_text (handle, 4, entry->changelog, -1, SQLITE_STATIC);
-
-        rc = sqlite3_step (handle);
-        sqlite3_reset (handle);
-
-        if (rc != SQLITE_DONE) {
-            g_critical ("Error adding changelog to db: %s",
-                        sqlite3_errmsg (stmts->db));
-            g_set_error(err, CR_DB_ERROR, CRE_DB,
-                        "Error adding changelog to db : %s",
-                        sqlite3_errmsg(stmts->db));
-            return;
-        }
+        db_batch_int (batch, pkgKey);
+        db_batch_text(batch, entry->author);
+        db_batch_int (batch, entry->date);
+        db_batch_text(batch, entry->changelog);
     }
-}
-
 
-// Function from header file (Public interface of the module)
+    db_batch_flush(batch, &tmp_err);
+    if (tmp_err)
+        g_propagate_error(err, tmp_err);
+}
 
 
-cr_SqliteDb *
-cr_db_open(const char *path, cr_DatabaseType db_type, GError **err)
+/** Open the db file or, if the path is NULL, a new in-memory db.
+ */
+static cr_SqliteDb *
+db_open(const char *path, cr_DatabaseType db_type, GError **err)
 {
     cr_SqliteDb *sqlitedb = NULL;
     int exists;
@@ -1371,16 +1454,10 @@ cr_db_open(const char *path, cr_DatabaseType db_type, GError **err)
     GError *tmp_err = NULL;
     void *statements;
 
-    assert(path);
     assert(db_type < CR_DB_SENTINEL);
     assert(!err || *err == NULL);
 
-    if (path[0] == '\0') {
-        g_set_error(err, CR_DB_ERROR, CRE_BADARG, "Bad path: \"%s\"", path);
-        return NULL;
-    }
-
-    exists = g_file_test(path, G_FILE_TEST_IS_REGULAR);
+    exists = path && g_file_test(path, G_FILE_TEST_IS_REGULAR);
 
     sqlite3_enable_shared_cache(1);
 
@@ -1481,16 +1558,16 @@ cr_db_open(const char *path, cr_DatabaseType db_type, GError **err)
 }
 
 
-int
-cr_db_close(cr_SqliteDb *sqlitedb, GError **err)
+/** Create indexes, destroy the compiled statements and commit
+ * the transaction. The db stays open.
+ */
+static int
+db_finish(cr_SqliteDb *sqlitedb, GError **err)
 {
     GError *tmp_err = NULL;
 
     assert(!err || *err == NULL);
 
-    if (!sqlitedb)
-        return CRE_OK;
-
     switch (sqlitedb->type) {
         case CR_DB_PRIMARY:
             db_index_primary_tables(sqlitedb->db, &tmp_err);
@@ -1518,14 +1595,207 @@ cr_db_close(cr_SqliteDb *sqlitedb, GError **err)
     }
 
     sqlite3_exec (sqlitedb->db, "COMMIT", NULL, NULL, NULL);
-    sqlite3_close(sqlitedb->db);
 
+    return CRE_OK;
+}
+
+
+/** Write the image of the db into the file by cr_write().
+ */
+static int
+db_write_image(const unsigned char *image,
+               sqlite3_int64 size,
+               const char *path,
+               cr_CompressionType comtype,
+               cr_ContentStat *stat,
+               GError **err)
+{
+    CR_FILE *cr_file;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    cr_file = cr_sopen(path, CR_CW_MODE_WRITE, comtype, stat, &tmp_err);
+    if (!cr_file) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ", path);
+        return code;
+    }
+
+    for (sqlite3_int64 off = 0; off < size && !tmp_err; off += DB_IMAGE_CHUNK) {
+        unsigned int len = (unsigned int) MIN(DB_IMAGE_CHUNK, size - off);
+        cr_write(cr_file, image + off, len, &tmp_err);
+    }
+
+    if (tmp_err) {
+        int code = tmp_err->code;
+        cr_close(cr_file, NULL);
+        g_propagate_prefixed_error(err, tmp_err, "Cannot write %s: ", path);
+        return code;
+    }
+
+    cr_close(cr_file, &tmp_err);
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_prefixed_error(err, tmp_err, "Cannot close %s: ", path);
+        return code;
+    }
+
+    return CRE_OK;
+}
+
+
+/** Copy the db into a temporary file by the sqlite backup API and
+ * compress the file. Used if the db image cannot be serialized.
+ */
+static int
+db_backup_and_compress(sqlite3 *db,
+                       const char *path,
+                       cr_CompressionType comtype,
+                       cr_ContentStat *stat,
+                       GError **err)
+{
+    int rc;
+    sqlite3 *dst = NULL;
+    sqlite3_backup *backup;
+    gchar *tmp_path;
+    GError *tmp_err = NULL;
+
+    assert(!err || *err == NULL);
+
+    tmp_path = g_strconcat(path, ".tmp.sqlite", NULL);
+    remove(tmp_path);
+
+    rc = sqlite3_open(tmp_path, &dst);
+    if (rc == SQLITE_OK) {
+        backup = sqlite3_backup_init(dst, "main", db, "main");
+        if (backup) {
+            sqlite3_backup_step(backup, -1);
+            sqlite3_backup_finish(backup);
+        }
+        rc = sqlite3_errcode(dst);
+    }
+
+    if (rc != SQLITE_OK) {
+        g_set_error(err, CR_DB_ERROR, CRE_DB,
+                    "Cannot copy the database into %s: %s",
+                    tmp_path, sqlite3_errmsg(dst));
+        sqlite3_close(dst);
+        remove(tmp_path);
+        g_free(tmp_path);
+        return CRE_DB;
+    }
+
+    sqlite3_close(dst);
+
+    cr_compress_file_with_stat(tmp_path, path, comtype, stat, &tmp_err);
+    remove(tmp_path);
+    g_free(tmp_path);
+
+    if (tmp_err) {
+        int code = tmp_err->code;
+        g_propagate_error(err, tmp_err);
+        return code;
+    }
+
+    return CRE_OK;
+}
+
+
+// Function from header file (Public interface of the module)
+
+
+cr_SqliteDb *
+cr_db_open(const char *path, cr_DatabaseType db_type, GError **err)
+{
+    assert(path);
+    assert(!err || *err == NULL);
+
+    if (path[0] == '\0') {
+        g_set_error(err, CR_DB_ERROR, CRE_BADARG, "Bad path: \"%s\"", path);
+        return NULL;
+    }
+
+    return db_open(path, db_type, err);
+}
+
+
+cr_SqliteDb *
+cr_db_open_in_memory(cr_DatabaseType db_type, GError **err)
+{
+    return db_open(NULL, db_type, err);
+}
+
+
+int
+cr_db_close(cr_SqliteDb *sqlitedb, GError **err)
+{
+    int rc;
+
+    assert(!err || *err == NULL);
+
+    if (!sqlitedb)
+        return CRE_OK;
+
+    rc = db_finish(sqlitedb, err);
+    if (rc != CRE_OK)
+        return rc;
+
+    sqlite3_close(sqlitedb->db);
     g_free(sqlitedb);
 
     return CRE_OK;
 }
 
 
+int
+cr_db_close_compressed(cr_SqliteDb *sqlitedb,
+                       const char *path,
+                       cr_CompressionType comtype,
+                       cr_ContentStat *stat,
+                       GError **err)
+{
+    int rc;
+    unsigned char *image = NULL;
+    sqlite3_int64 size = 0;
+    gboolean copied = FALSE;
+
+    assert(sqlitedb);
+    assert(path);
+    assert(!err || *err == NULL);
+
+    rc = db_finish(sqlitedb, err);
+    if (rc != CRE_OK) {
+        sqlite3_close(sqlitedb->db);
+        g_free(sqlitedb);
+        return rc;
+    }
+
+#ifdef CR_DB_SERIALIZE
+    // Without a copy if the db lives in a single buffer (memdb)
+    image = sqlite3_serialize(sqlitedb->db, "main", &size,
+                              SQLITE_SERIALIZE_NOCOPY);
+    if (!image) {
+        image = sqlite3_serialize(sqlitedb->db, "main", &size, 0);
+        copied = TRUE;
+    }
+#endif
+
+    if (image)
+        rc = db_write_image(image, size, path, comtype, stat, err);
+    else
+        rc = db_backup_and_compress(sqlitedb->db, path, comtype, stat, err);
+
+    if (copied)
+        sqlite3_free(image);
+
+    sqlite3_close(sqlitedb->db);
+    g_free(sqlitedb);
+
+    return rc;
+}
+
+
 int
 cr_db_add_pkg(cr_SqliteDb *sqlitedb, cr_Package *pkg, GError **err)
 {
@@ -22,6 +22,7 @@
 
 #include <glib.h>
 #include <sqlite3.h>
+#include "compression_wrapper.h"
 #include "package.h"
 
 #ifdef __cplusplus
@@ -52,6 +53,18 @@ extern "C" {
  * cr_db_close(primary_db, NULL);
  * \endcode
  *
+ * A database could be also built in memory and written directly into
+ * a compressed file (the stats of its content are computed during
+ * the write, so the database is never read back from the disk):
+ * \code
+ * primary_db = cr_db_open_in_memory(CR_DB_PRIMARY, NULL);
+ * cr_db_add_pkg(primary_db, pkg, NULL);
+ * cr_db_dbinfo_update(primary_db, "foochecksum", NULL);
+ * cr_db_close_compressed(primary_db,
+ *                        "/foo/bar/repodata/primary.sqlite.bz2",
+ *                        CR_CW_BZ2_COMPRESSION, NULL, NULL);
+ * \endcode
+ *
  *  \addtogroup sqlite
  *  @{
  */
@@ -142,6 +155,21 @@ cr_SqliteDb *cr_db_open(const char *path,
                         cr_DatabaseType db_type,
                         GError **err);
 
+/** Open (create new) sqlite db in memory.
+ *  - creates tables of the db_type
+ *  - creates info table
+ *  - opens transaction
+ * The db must be closed by cr_db_close_compressed() (cr_db_close()
+ * discards it). Note: The whole db is kept in memory, in a single buffer
+ * if the SQLite supports sqlite3_serialize(). Such db cannot grow over
+ * 2 GiB (inserts fail with CRE_DB, "database or disk is full"), use
+ * cr_db_open() with a file for larger dbs.
+ * @param db_type               Type of database (primary, filelists, other)
+ * @param err                   **GError
+ * @return                      Opened db or NULL on error
+ */
+cr_SqliteDb *cr_db_open_in_memory(cr_DatabaseType db_type, GError **err);
+
 /** Add package into the database.
  * @param sqlitedb              open db connection
  * @param pkg                   package object
@@ -172,6 +200,29 @@ int cr_db_dbinfo_update(cr_SqliteDb *sqlitedb,
  */
 int cr_db_close(cr_SqliteDb *sqlitedb, GError **err);
 
+/** Close db and write it into a (compressed) file.
+ *  - creates indexes on tables
+ *  - commits transaction
+ *  - writes the serialized image of the db (sqlite3_serialize())
+ *    into the file by cr_write(), if the image is not available
+ *    (old SQLite), the db is copied into a temporary file which is
+ *    compressed
+ *  - closes db (even if the indexing or the write failed)
+ * The file of a db opened by cr_db_open() is kept as it is.
+ * @param sqlitedb              open db connection
+ * @param path                  path to the target file
+ * @param comtype               compression of the target file
+ * @param stat                  cr_ContentStat filled by stats of the db
+ *                              and of the compressed file, or NULL
+ * @param err                   **GError
+ * @return                      cr_Error code
+ */
+int cr_db_close_compressed(cr_SqliteDb *sqlitedb,
+                           const char *path,
+                           cr_CompressionType comtype,
+                           cr_ContentStat *stat,
+                           GError **err);
+
 /** @} */
 
 #ifdef __cplusplus
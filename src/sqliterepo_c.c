@@ -0,0 +1,633 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2013  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "error.h"
+#include "version.h"
+#include "compression_wrapper.h"
+#include "misc.h"
+#include "package.h"
+#include "repomd.h"
+#include "sqlite.h"
+#include "xml_dump.h"
+#include "xml_parser.h"
+
+#define G_LOG_DOMAIN            ((gchar*) 0)
+
+typedef struct {
+
+    gboolean version;
+    gchar *compress_type;
+    gboolean xz;
+    gchar *checksum;
+    gboolean unique_md_filenames;
+    gboolean simple_md_filenames;
+    gboolean sqlite_in_memory;
+    gboolean verbose;
+
+} RawCmdOptions;
+
+// Generation of one database. Every database has its own thread which
+// parses the xml file and writes the packages into the database.
+typedef struct {
+    const char *xml_type;           // "primary", "filelists", "other"
+    const char *db_type;            // "primary_db", ...
+    cr_DatabaseType type;
+    cr_RepomdRecord *xml_rec;       // Record of the parsed xml file
+    gchar *xml_path;                // Path to the parsed xml file
+    gchar *db_path;                 // Uncompressed db (not in memory)
+    gchar *dst_path;                // Compressed db (in the temporary dir)
+    gchar *final_path;              // Compressed db in the repodata
+    gboolean moved;                 // Already moved to the final_path
+
+    cr_CompressionType compression;
+    cr_ChecksumType checksum_type;
+    gboolean unique_md_filenames;
+    gboolean in_memory;
+
+    cr_SqliteDb *db;
+    long packages;                  // Number of written packages
+    cr_RepomdRecord *db_rec;        // Record of the new compressed db
+    GError *err;
+    GThread *thread;
+} DbJob;
+
+static gboolean
+parse_arguments(int *argc, char ***argv, RawCmdOptions *options, GError **err)
+{
+    const GOptionEntry cmd_entries[] = {
+
+        { "version", 0, 0, G_OPTION_ARG_NONE, &(options->version),
+          "Show program's version number and exit.", NULL },
+        { "compress-type", 0, 0, G_OPTION_ARG_STRING, &(options->compress_type),
+          "Compression format to use. (default: bz2)", NULL },
+        { "xz", 0, 0, G_OPTION_ARG_NONE, &(options->xz),
+          "Use xz for the compression.", NULL },
+        { "checksum", 's', 0, G_OPTION_ARG_STRING, &(options->checksum),
+          "Specify the checksum type to use. (default: sha256)", "SUMTYPE" },
+        { "unique-md-filenames", 0, 0, G_OPTION_ARG_NONE,
+          &(options->unique_md_filenames),
+          "Include the file's checksum in the filename, helps with proxies. "
+          "(default)", NULL },
+        { "simple-md-filenames", 0, 0, G_OPTION_ARG_NONE,
+          &(options->simple_md_filenames),
+          "Do not include the file's checksum in the filename.", NULL },
+        { "sqlite-in-memory", 0, 0, G_OPTION_ARG_NONE,
+          &(options->sqlite_in_memory),
+          "Build the databases in memory and write them directly into "
+          "the compressed files. Needs enough memory for all the databases.",
+          NULL },
+        { "verbose", 0, 0, G_OPTION_ARG_NONE, &(options->verbose),
+          "Verbose output.", NULL},
+        { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
+
+    };
+
+    // Frstly, set default values
+    options->version = FALSE;
+    options->compress_type = NULL;
+    options->xz = FALSE;
+    options->checksum = NULL;
+    options->unique_md_filenames = TRUE;
+    options->simple_md_filenames = FALSE;
+    options->sqlite_in_memory = FALSE;
+    options->verbose = FALSE;
+
+    GOptionContext *context;
+    context = g_option_context_new(": Generate sqlite databases from "
+                                   "the xml metadata of a repository");
+    g_option_context_add_main_entries(context, cmd_entries, NULL);
+    gboolean ret = g_option_context_parse(context, argc, argv, err);
+    g_option_context_free(context);
+    return ret;
+}
+
+static gboolean
+check_arguments(RawCmdOptions *options, GError **err)
+{
+    // --compress-type
+    if (options->compress_type
+        && cr_compression_type(options->compress_type) == \
+           CR_CW_UNKNOWN_COMPRESSION)
+    {
+        g_set_error(err, CR_SQLITEREPO_ERROR, CRE_ERROR,
+                    "Unknown compression type \"%s\"", options->compress_type);
+        return FALSE;
+    }
+
+    // -s/--checksum
+    if (options->checksum
+        && cr_checksum_type(options->checksum) == CR_CHECKSUM_UNKNOWN)
+    {
+        g_set_error(err, CR_SQLITEREPO_ERROR, CRE_ERROR,
+                    "Unknown checksum type \"%s\"", options->checksum);
+        return FALSE;
+    }
+
+    // --unique_md_filenames && --simple_md_filenames
+    if (options->simple_md_filenames) {
+        options->unique_md_filenames = FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+print_usage(void)
+{
+    g_printerr("Usage: sqliterepo_c [options] <repo_directory>\n");
+}
+
+static int
+pkgcb(cr_Package *pkg, void *cbdata, GError **err)
+{
+    DbJob *job = cbdata;
+    int rc;
+
+    rc = cr_db_add_pkg(job->db, pkg, err);
+    cr_package_free(pkg);
+    if (rc != CRE_OK)
+        return CR_CB_RET_ERR;
+
+    job->packages++;
+    return CR_CB_RET_OK;
+}
+
+// Parse the xml file, fill the database and compress it
+static gboolean
+db_job_run(DbJob *job, GError **err)
+{
+    cr_ContentStat *stat;
+    GError *tmp_err = NULL;
+    int rc;
+
+    if (job->in_memory)
+        job->db = cr_db_open_in_memory(job->type, &tmp_err);
+    else
+        job->db = cr_db_open(job->db_path, job->type, &tmp_err);
+    if (!job->db) {
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "Cannot open %s database: ", job->xml_type);
+        return FALSE;
+    }
+
+    g_debug("%s: Parsing %s", __func__, job->xml_path);
+
+    switch (job->type) {
+        case CR_DB_PRIMARY:
+            rc = cr_xml_parse_primary(job->xml_path, NULL, NULL, pkgcb, job,
+                                      cr_warning_cb, "Primary XML parser",
+                                      1, &tmp_err);
+            break;
+        case CR_DB_FILELISTS:
+            rc = cr_xml_parse_filelists(job->xml_path, NULL, NULL, pkgcb, job,
+                                        cr_warning_cb, "Filelists XML parser",
+                                        &tmp_err);
+            break;
+        default:
+            rc = cr_xml_parse_other(job->xml_path, NULL, NULL, pkgcb, job,
+                                    cr_warning_cb, "Other XML parser",
+                                    &tmp_err);
+            break;
+    }
+
+    // The database contains checksum of its xml file
+    if (rc == CRE_OK)
+        cr_db_dbinfo_update(job->db, job->xml_rec->checksum, &tmp_err);
+
+    if (tmp_err) {
+        cr_db_close(job->db, NULL);
+        job->db = NULL;
+        if (!job->in_memory)
+            remove(job->db_path);
+        g_propagate_prefixed_error(err, tmp_err, "Cannot load %s: ",
+                                   job->xml_path);
+        return FALSE;
+    }
+
+    g_debug("%s: %ld packages written into the %s database",
+            __func__, job->packages, job->xml_type);
+
+    // Stats of the compressed file are computed while it is written,
+    // so cr_repomd_record_fill() doesn't read it again
+    stat = cr_contentstat_new(job->checksum_type, NULL);
+    stat->compressed_checksum_type = job->checksum_type;
+
+    if (job->in_memory) {
+        cr_db_close_compressed(job->db, job->dst_path, job->compression,
+                               stat, &tmp_err);
+    } else {
+        cr_db_close(job->db, &tmp_err);
+        if (!tmp_err)
+            cr_compress_file_with_stat(job->db_path, job->dst_path,
+                                       job->compression, stat, &tmp_err);
+        if (remove(job->db_path) == -1 && errno != ENOENT)
+            g_warning("Cannot remove \"%s\": %s",
+                      job->db_path, strerror(errno));
+    }
+    job->db = NULL;
+
+    if (tmp_err) {
+        cr_contentstat_free(stat, NULL);
+        g_propagate_prefixed_error(err, tmp_err, "Cannot write %s: ",
+                                   job->dst_path);
+        return FALSE;
+    }
+
+    job->db_rec = cr_repomd_record_new(job->db_type, job->dst_path);
+    cr_repomd_record_load_contentstat(job->db_rec, stat);
+    cr_contentstat_free(stat, NULL);
+
+    if (cr_repomd_record_fill(job->db_rec, job->checksum_type,
+                              &tmp_err) != CRE_OK)
+    {
+        g_propagate_prefixed_error(err, tmp_err, "Cannot process %s: ",
+                                   job->dst_path);
+        return FALSE;
+    }
+
+    if (job->unique_md_filenames) {
+        cr_repomd_record_rename_file(job->db_rec, NULL);
+        g_free(job->dst_path);
+        job->dst_path = g_strdup(job->db_rec->location_real);
+    }
+
+    return TRUE;
+}
+
+static gpointer
+db_job_thread(gpointer data)
+{
+    DbJob *job = data;
+    db_job_run(job, &job->err);
+    return NULL;
+}
+
+// Move the compressed database from the temporary dir into the repodata
+static gboolean
+db_job_move(DbJob *job, GError **err)
+{
+    if (g_rename(job->dst_path, job->final_path) == -1) {
+        g_set_error(err, CR_SQLITEREPO_ERROR, CRE_IO,
+                    "Cannot move %s to %s: %s", job->dst_path,
+                    job->final_path, g_strerror(errno));
+        return FALSE;
+    }
+
+    job->moved = TRUE;
+    return TRUE;
+}
+
+// Generate all the databases (each in its own thread) and replace
+// their records in the repomd.xml. The databases are written into
+// a temporary directory, files referenced by the current repomd.xml
+// are not touched until the new repomd.xml is written.
+static gboolean
+sqliterepo(const gchar *repopath, RawCmdOptions *options, GError **err)
+{
+    static const char *xml_types[3] = { "primary", "filelists", "other" };
+    static const char *db_types[3]  = { "primary_db", "filelists_db",
+                                        "other_db" };
+    static const cr_DatabaseType types[3] = { CR_DB_PRIMARY,
+                                              CR_DB_FILELISTS,
+                                              CR_DB_OTHER };
+    cr_CompressionType compression = CR_CW_BZ2_COMPRESSION;
+    cr_ChecksumType checksum_type = CR_CHECKSUM_SHA256;
+    DbJob jobs[3];
+    GSList *recordstoremove = NULL;
+    gchar *tmp_dir = NULL;
+    gboolean ret = TRUE;
+
+    assert(!err || *err == NULL);
+
+    if (options->compress_type)
+        compression = cr_compression_type(options->compress_type);
+    else if (options->xz)
+        compression = CR_CW_XZ_COMPRESSION;
+    if (options->checksum)
+        checksum_type = cr_checksum_type(options->checksum);
+
+    // Parse repomd.xml
+
+    gchar *repodata = g_build_filename(repopath, "repodata", NULL);
+    gchar *repomd_path = g_build_filename(repodata, "repomd.xml", NULL);
+    if (!g_file_test(repomd_path, G_FILE_TEST_IS_REGULAR)) {
+        g_set_error(err, CR_SQLITEREPO_ERROR, CRE_IO,
+                    "Regular file \"%s\" doesn't exists", repomd_path);
+        g_free(repomd_path);
+        g_free(repodata);
+        return FALSE;
+    }
+
+    cr_Repomd *repomd = cr_repomd_new();
+    int rc = cr_xml_parse_repomd(repomd_path, repomd, cr_warning_cb,
+                                  "Repomd XML parser", err);
+    if (rc != CRE_OK) {
+        g_debug("%s: Error while parsing repomd.xml", __func__);
+        cr_repomd_free(repomd);
+        g_free(repomd_path);
+        g_free(repodata);
+        return FALSE;
+    }
+
+    memset(jobs, 0, sizeof(jobs));
+
+    // Create the temporary dir (the same as createrepo_c uses, so the
+    // tools don't run on the same repo at once)
+
+    tmp_dir = g_build_filename(repopath, ".repodata", NULL);
+    if (g_mkdir(tmp_dir, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH)) {
+        if (errno == EEXIST)
+            g_set_error(err, CR_SQLITEREPO_ERROR, CRE_EXISTS,
+                        "Temporary repodata directory: %s already exists! "
+                        "(Another createrepo process is running?)", tmp_dir);
+        else
+            g_set_error(err, CR_SQLITEREPO_ERROR, CRE_IO,
+                        "Error while creating temporary repodata "
+                        "directory %s: %s", tmp_dir, g_strerror(errno));
+        g_free(tmp_dir);
+        tmp_dir = NULL;
+        ret = FALSE;
+        goto cleanup;
+    }
+
+    // Prepare the jobs
+
+    for (int x = 0; x < 3; x++) {
+        DbJob *job = &jobs[x];
+        cr_RepomdRecord *rec = cr_repomd_get_record(repomd, xml_types[x]);
+
+        if (!rec) {
+            g_set_error(err, CR_SQLITEREPO_ERROR, CRE_BADARG,
+                        "Record \"%s\" is missing in %s",
+                        xml_types[x], repomd_path);
+            ret = FALSE;
+            goto cleanup;
+        }
+
+        if (rec->location_base) {
+            g_set_error(err, CR_SQLITEREPO_ERROR, CRE_BADARG,
+                        "Record \"%s\" has a base location (%s), only local "
+                        "metadata are supported",
+                        xml_types[x], rec->location_base);
+            ret = FALSE;
+            goto cleanup;
+        }
+
+        job->xml_type       = xml_types[x];
+        job->db_type        = db_types[x];
+        job->type           = types[x];
+        job->xml_rec        = rec;
+        job->xml_path       = g_build_filename(repopath,
+                                               rec->location_href, NULL);
+        job->db_path        = g_strconcat(tmp_dir, "/", xml_types[x],
+                                          ".sqlite", NULL);
+        job->dst_path       = g_strconcat(tmp_dir, "/", xml_types[x],
+                                          ".sqlite",
+                                          cr_compression_suffix(compression),
+                                          NULL);
+        job->compression    = compression;
+        job->checksum_type  = checksum_type;
+        job->unique_md_filenames = options->unique_md_filenames;
+        job->in_memory      = options->sqlite_in_memory;
+    }
+
+    // Generate the databases
+
+    for (int x = 0; x < 3; x++) {
+        GError *tmp_err = NULL;
+
+        jobs[x].thread = g_thread_create(db_job_thread, &jobs[x],
+                                         TRUE, &tmp_err);
+        if (tmp_err) {
+            // Generate the database in this thread then
+            g_debug("%s: Cannot create thread: %s", __func__,
+                    tmp_err->message);
+            g_clear_error(&tmp_err);
+            db_job_run(&jobs[x], &jobs[x].err);
+        }
+    }
+
+    for (int x = 0; x < 3; x++) {
+        if (jobs[x].thread)
+            g_thread_join(jobs[x].thread);
+        if (jobs[x].err && ret) {
+            g_propagate_error(err, jobs[x].err);
+            jobs[x].err = NULL;
+            ret = FALSE;
+        }
+    }
+
+    if (!ret)
+        goto cleanup;
+
+    // Replace the records
+
+    for (int x = 0; x < 3; x++) {
+        cr_RepomdRecord *rec = cr_repomd_get_record(repomd, db_types[x]);
+        if (rec) {
+            g_debug("%s: Removing record \"%s\" from repomd.xml",
+                    __func__, db_types[x]);
+            recordstoremove = g_slist_prepend(recordstoremove, rec);
+            cr_repomd_detach_record(repomd, rec);
+        }
+        jobs[x].final_path = g_build_filename(repodata,
+                                              cr_get_filename(jobs[x].dst_path),
+                                              NULL);
+        cr_repomd_set_record(repomd, jobs[x].db_rec);
+        jobs[x].db_rec = NULL;
+    }
+
+    // Databases which don't replace any existing file are moved before
+    // the repomd.xml is written, so it never references a missing file
+
+    for (int x = 0; x < 3 && ret; x++)
+        if (!g_file_test(jobs[x].final_path, G_FILE_TEST_EXISTS))
+            ret = db_job_move(&jobs[x], err);
+
+    // Write repomd.xml (atomically, via the temporary dir)
+
+    if (ret) {
+        gchar *tmp_repomd_path = g_build_filename(tmp_dir, "repomd.xml", NULL);
+        gchar *repomd_xml = cr_xml_dump_repomd(repomd, NULL);
+
+        g_debug("%s: Writing modified %s", __func__, repomd_path);
+        ret = cr_write_to_file(err, tmp_repomd_path, "%s", repomd_xml);
+        if (ret && g_rename(tmp_repomd_path, repomd_path) == -1) {
+            g_set_error(err, CR_SQLITEREPO_ERROR, CRE_IO,
+                        "Cannot move %s to %s: %s", tmp_repomd_path,
+                        repomd_path, g_strerror(errno));
+            ret = FALSE;
+        }
+        g_free(repomd_xml);
+        g_free(tmp_repomd_path);
+    }
+
+    if (!ret) {
+        // The old repomd.xml is still valid - remove only the new files
+        for (int x = 0; x < 3; x++)
+            if (jobs[x].moved)
+                remove(jobs[x].final_path);
+        goto cleanup;
+    }
+
+    // Databases which replace files of the old repomd.xml
+    // (--simple-md-filenames) are moved after it is replaced
+
+    for (int x = 0; x < 3; x++) {
+        GError *tmp_err = NULL;
+
+        if (jobs[x].moved)
+            continue;
+        if (!db_job_move(&jobs[x], &tmp_err)) {
+            if (ret)
+                g_propagate_error(err, tmp_err);
+            else
+                g_error_free(tmp_err);
+            ret = FALSE;
+        }
+    }
+
+    // Delete files of removed records (unless the new records use them)
+    for (GSList *elem = recordstoremove; elem; elem = g_slist_next(elem)) {
+        cr_RepomdRecord *rec = elem->data;
+
+        if (rec->location_base)
+            continue;
+
+        gboolean remove_this = TRUE;
+        for (GSList *e = repomd->records; e; e = g_slist_next(e)) {
+            cr_RepomdRecord *lrec = e->data;
+            if (!g_strcmp0(rec->location_href, lrec->location_href)) {
+                remove_this = FALSE;
+                break;
+            }
+        }
+
+        if (!remove_this)
+            continue;
+
+        gchar *realpath = g_build_filename(repopath, rec->location_href, NULL);
+        g_debug("%s: Removing \"%s\"", __func__, realpath);
+        if (remove(realpath) == -1)
+            g_warning("Cannot remove \"%s\": %s", realpath, strerror(errno));
+        g_free(realpath);
+    }
+
+cleanup:
+    for (int x = 0; x < 3; x++) {
+        g_free(jobs[x].xml_path);
+        g_free(jobs[x].db_path);
+        g_free(jobs[x].dst_path);
+        g_free(jobs[x].final_path);
+        cr_repomd_record_free(jobs[x].db_rec);
+        if (jobs[x].err)
+            g_error_free(jobs[x].err);
+    }
+    g_slist_free_full(recordstoremove, (GDestroyNotify)cr_repomd_record_free);
+    if (tmp_dir) {
+        cr_remove_dir(tmp_dir, NULL);
+        g_free(tmp_dir);
+    }
+    cr_repomd_free(repomd);
+    g_free(repomd_path);
+    g_free(repodata);
+
+    return ret;
+}
+
+int
+main(int argc, char **argv)
+{
+    RawCmdOptions options;
+    GError *err = NULL;
+
+    // Parse arguments
+
+    parse_arguments(&argc, &argv, &options, &err);
+    if (err) {
+        g_printerr("%s\n", err->message);
+        print_usage();
+        g_error_free(err);
+        exit(EXIT_FAILURE);
+    }
+
+    // Set logging
+
+    g_log_set_default_handler(cr_log_fn, NULL);
+    if (options.verbose) {
+        // Verbose mode
+        GLogLevelFlags levels = G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG | G_LOG_LEVEL_WARNING;
+        g_log_set_handler(NULL, levels, cr_log_fn, NULL);
+        g_log_set_handler("C_CREATEREPOLIB", levels, cr_log_fn, NULL);
+    } else {
+        // Standard mode
+        GLogLevelFlags levels = G_LOG_LEVEL_DEBUG;
+        g_log_set_handler(NULL, levels, cr_null_log_fn, NULL);
+        g_log_set_handler("C_CREATEREPOLIB", levels, cr_null_log_fn, NULL);
+    }
+
+    // Print version if required
+
+    if (options.version) {
+        printf("Version: %d.%d.%d\n", CR_VERSION_MAJOR,
+                                      CR_VERSION_MINOR,
+                                      CR_VERSION_PATCH);
+        exit(EXIT_SUCCESS);
+    }
+
+    // Check arguments
+
+    check_arguments(&options, &err);
+    if (err) {
+        g_printerr("%s\n", err->message);
+        print_usage();
+        g_error_free(err);
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc != 2) {
+        print_usage();
+        exit(EXIT_FAILURE);
+    }
+
+    g_thread_init(NULL);
+    cr_xml_dump_init();
+
+    // Generate the databases
+
+    gboolean ret = sqliterepo(argv[1], &options, &err);
+
+    cr_xml_dump_cleanup();
+
+    if (!ret) {
+        g_printerr("%s\n", err->message);
+        g_error_free(err);
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
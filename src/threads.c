@@ -43,6 +43,7 @@ cr_compressiontask_new(const char *src,
     stat = cr_contentstat_new(checksum_type, err);
     if (!stat)
         return NULL;
+    stat->compressed_checksum_type = checksum_type;
 
     task = g_malloc0(sizeof(cr_CompressionTask));
     if (!task) {
@@ -154,3 +155,353 @@ cr_repomd_record_fill_thread(gpointer data, gpointer user_data)
         g_propagate_error(&task->err, tmp_err);
     }
 }
+
+/** Reorder Ring */
+
+#define REORDERRING_SPIN_COUNT  200
+
+typedef struct {
+    gpointer item;              // Published result
+    volatile gint seq;          // seq == id     - slot is free for the id
+                                // seq == id + 1 - result of the id is ready
+    volatile gint refs;         // Number of consumers which didn't release
+                                // the result yet
+} cr_ReorderRingSlot;
+
+struct _cr_ReorderRing {
+    cr_ReorderRingSlot *slots;  // Array of slots
+    guint capacity;             // Number of slots
+    guint consumers;            // Number of consumers
+    GMutex *mutex;              // Used only when somebody has to sleep
+    GCond *cond_published;      // Consumers sleep here
+    GCond *cond_released;       // Producers sleep here
+    volatile gint waiting_consumers;
+    volatile gint waiting_producers;
+};
+
+cr_ReorderRing *
+cr_reorderring_new(guint capacity, guint consumers)
+{
+    cr_ReorderRing *ring;
+
+    assert(capacity >= 2);
+    assert(consumers >= 1);
+
+    ring = g_malloc0(sizeof(cr_ReorderRing));
+    ring->slots = g_malloc0(sizeof(cr_ReorderRingSlot) * capacity);
+    ring->capacity  = capacity;
+    ring->consumers = consumers;
+    ring->mutex = g_mutex_new();
+    ring->cond_published = g_cond_new();
+    ring->cond_released  = g_cond_new();
+
+    for (guint x = 0; x < capacity; x++)
+        ring->slots[x].seq = (gint) x;
+
+    return ring;
+}
+
+/** Wait until the *seq has the expected value.
+ * Spin for a while first, then sleep on the cond.
+ * The waker always changes the seq before it checks the *waiting
+ * counter and the sleeper always increments the counter before it
+ * checks the seq for the last time, so no wakeup could be lost.
+ */
+static void
+reorderring_wait(cr_ReorderRing *ring,
+                 volatile gint *seq,
+                 gint expected,
+                 volatile gint *waiting,
+                 GCond *cond)
+{
+    for (int x = 0; x < REORDERRING_SPIN_COUNT; x++)
+        if (g_atomic_int_get(seq) == expected)
+            return;
+
+    g_mutex_lock(ring->mutex);
+    g_atomic_int_inc(waiting);
+    while (g_atomic_int_get(seq) != expected)
+        g_cond_wait(cond, ring->mutex);
+    g_atomic_int_add(waiting, -1);
+    g_mutex_unlock(ring->mutex);
+}
+
+static void
+reorderring_wake(cr_ReorderRing *ring, volatile gint *waiting, GCond *cond)
+{
+    if (!g_atomic_int_get(waiting))
+        return;
+
+    g_mutex_lock(ring->mutex);
+    g_cond_broadcast(cond);
+    g_mutex_unlock(ring->mutex);
+}
+
+void
+cr_reorderring_push(cr_ReorderRing *ring, long id, gpointer item)
+{
+    cr_ReorderRingSlot *slot;
+
+    assert(ring);
+    assert(id >= 0);
+
+    slot = &ring->slots[id % ring->capacity];
+
+    // Wait until all consumers release the result with id - capacity
+    reorderring_wait(ring, &slot->seq, (gint) id,
+                     &ring->waiting_producers, ring->cond_released);
+
+    slot->item = item;
+    g_atomic_int_set(&slot->refs, (gint) ring->consumers);
+    g_atomic_int_set(&slot->seq, (gint) id + 1);
+
+    reorderring_wake(ring, &ring->waiting_consumers, ring->cond_published);
+}
+
+gpointer
+cr_reorderring_get(cr_ReorderRing *ring, long id)
+{
+    cr_ReorderRingSlot *slot;
+
+    assert(ring);
+    assert(id >= 0);
+
+    slot = &ring->slots[id % ring->capacity];
+
+    reorderring_wait(ring, &slot->seq, (gint) id + 1,
+                     &ring->waiting_consumers, ring->cond_published);
+
+    return slot->item;
+}
+
+gboolean
+cr_reorderring_release(cr_ReorderRing *ring, long id)
+{
+    cr_ReorderRingSlot *slot;
+
+    assert(ring);
+    assert(id >= 0);
+
+    slot = &ring->slots[id % ring->capacity];
+
+    if (!g_atomic_int_dec_and_test(&slot->refs))
+        return FALSE;
+
+    // The last consumer - make the slot free for id + capacity
+    slot->item = NULL;
+    g_atomic_int_set(&slot->seq, (gint) (id + ring->capacity));
+
+    reorderring_wake(ring, &ring->waiting_producers, ring->cond_released);
+
+    return TRUE;
+}
+
+void
+cr_reorderring_free(cr_ReorderRing *ring)
+{
+    if (!ring)
+        return;
+
+    g_cond_free(ring->cond_published);
+    g_cond_free(ring->cond_released);
+    g_mutex_free(ring->mutex);
+    g_free(ring->slots);
+    g_free(ring);
+}
+
+/** Task DAG executor */
+
+struct _cr_DagTask {
+    gchar *name;
+    cr_DagTaskFunc func;
+    gpointer data;
+    GSList *dependents;         // Tasks which depend on this one
+    guint pending;              // Number of unfinished dependencies
+    gboolean skipped;           // A dependency failed
+    cr_TaskDag *dag;
+};
+
+struct _cr_TaskDag {
+    GPtrArray *tasks;           // All tasks (cr_DagTask *)
+    int threads;                // Max number of running tasks
+    GThreadPool *pool;
+    GMutex *mutex;              // Protects everything below and
+                                // the pending and skipped of tasks
+    GCond *cond;                // Signalized when all tasks are done
+    guint remaining;            // Tasks not finished nor skipped yet
+    GError *err;                // Error of the first failed task
+};
+
+cr_TaskDag *
+cr_taskdag_new(int threads)
+{
+    cr_TaskDag *dag = g_malloc0(sizeof(cr_TaskDag));
+
+    dag->tasks   = g_ptr_array_new();
+    dag->threads = threads > 0 ? threads : 1;
+    dag->mutex   = g_mutex_new();
+    dag->cond    = g_cond_new();
+
+    return dag;
+}
+
+cr_DagTask *
+cr_taskdag_add(cr_TaskDag *dag,
+               const char *name,
+               cr_DagTaskFunc func,
+               gpointer data)
+{
+    cr_DagTask *task;
+
+    assert(dag);
+    assert(func);
+    assert(!dag->pool);
+
+    task = g_malloc0(sizeof(cr_DagTask));
+    task->name = g_strdup(name);
+    task->func = func;
+    task->data = data;
+    task->dag  = dag;
+    g_ptr_array_add(dag->tasks, task);
+
+    return task;
+}
+
+void
+cr_taskdag_depends(cr_DagTask *task, cr_DagTask *dependency)
+{
+    assert(task);
+
+    if (!dependency)
+        return;
+
+    assert(task->dag == dependency->dag);
+    assert(task != dependency);
+    assert(!task->dag->pool);
+
+    dependency->dependents = g_slist_prepend(dependency->dependents, task);
+    task->pending++;
+}
+
+/** Skip all tasks which depend on the failed task.
+ * Called with the mutex locked.
+ */
+static void
+taskdag_skip_dependents(cr_TaskDag *dag, cr_DagTask *task)
+{
+    for (GSList *elem = task->dependents; elem; elem = g_slist_next(elem)) {
+        cr_DagTask *dependent = elem->data;
+
+        if (dependent->skipped)
+            continue;
+
+        g_debug("%s: Task %s skipped (%s failed)", __func__,
+                dependent->name, task->name);
+        dependent->skipped = TRUE;
+        dag->remaining--;
+        taskdag_skip_dependents(dag, dependent);
+    }
+}
+
+static void
+taskdag_worker(gpointer data, gpointer user_data)
+{
+    cr_DagTask *task = data;
+    cr_TaskDag *dag = user_data;
+    GError *tmp_err = NULL;
+    GTimer *timer = g_timer_new();
+
+    task->func(task->data, &tmp_err);
+
+    g_debug("%s: Task %s %s (%.3f s)", __func__, task->name,
+            tmp_err ? "failed" : "done", g_timer_elapsed(timer, NULL));
+    g_timer_destroy(timer);
+
+    g_mutex_lock(dag->mutex);
+
+    if (tmp_err) {
+        if (dag->err)
+            g_error_free(tmp_err);
+        else
+            dag->err = tmp_err;
+        taskdag_skip_dependents(dag, task);
+    } else {
+        for (GSList *elem = task->dependents; elem; elem = g_slist_next(elem)) {
+            cr_DagTask *dependent = elem->data;
+            if (--dependent->pending == 0 && !dependent->skipped)
+                g_thread_pool_push(dag->pool, dependent, NULL);
+        }
+    }
+
+    if (--dag->remaining == 0)
+        g_cond_signal(dag->cond);
+
+    g_mutex_unlock(dag->mutex);
+}
+
+int
+cr_taskdag_run(cr_TaskDag *dag, GError **err)
+{
+    GError *tmp_err = NULL;
+
+    assert(dag);
+    assert(!dag->pool);
+    assert(!err || *err == NULL);
+
+    if (!dag->tasks->len)
+        return CRE_OK;
+
+    dag->pool = g_thread_pool_new(taskdag_worker, dag, dag->threads,
+                                  FALSE, &tmp_err);
+    if (tmp_err) {
+        g_propagate_prefixed_error(err, tmp_err,
+                                   "Cannot create thread pool: ");
+        return CRE_ERROR;
+    }
+
+    g_mutex_lock(dag->mutex);
+
+    dag->remaining = dag->tasks->len;
+    for (guint x = 0; x < dag->tasks->len; x++) {
+        cr_DagTask *task = g_ptr_array_index(dag->tasks, x);
+        if (!task->pending)
+            g_thread_pool_push(dag->pool, task, NULL);
+    }
+
+    while (dag->remaining > 0)
+        g_cond_wait(dag->cond, dag->mutex);
+
+    g_mutex_unlock(dag->mutex);
+
+    g_thread_pool_free(dag->pool, FALSE, TRUE);
+
+    if (dag->err) {
+        int code = dag->err->code;
+        g_propagate_error(err, dag->err);
+        dag->err = NULL;
+        return code;
+    }
+
+    return CRE_OK;
+}
+
+void
+cr_taskdag_free(cr_TaskDag *dag)
+{
+    if (!dag)
+        return;
+
+    for (guint x = 0; x < dag->tasks->len; x++) {
+        cr_DagTask *task = g_ptr_array_index(dag->tasks, x);
+        g_slist_free(task->dependents);
+        g_free(task->name);
+        g_free(task);
+    }
+
+    if (dag->err)
+        g_error_free(dag->err);
+    g_ptr_array_free(dag->tasks, TRUE);
+    g_cond_free(dag->cond);
+    g_mutex_free(dag->mutex);
+    g_free(dag);
+}
@@ -92,7 +92,8 @@ typedef struct {
  *                          CR_CHECKSUM_UNKNOWN, then no checksum calculation
  *                          will be performed, only size would be calculated.
  *                          Don't be afraid, size calculation has almost
- *                          no overhead.
+ *                          no overhead. The same checksum of the compressed
+ *                          file is calculated too (during compression).
  * @param delsrc            Delete src after successuful compression.
  *                          0 = Do not delete, delete otherwise
  * @param err               GError **. Note: This is a GError for the
@@ -150,6 +151,160 @@ cr_repomdrecordfilltask_free(cr_RepomdRecordFillTask *task, GError **err);
 void
 cr_repomd_record_fill_thread(gpointer data, gpointer user_data);
 
+/** Reorder ring.
+ *
+ * Fixed-capacity ring which puts results of tasks processed in parallel
+ * back into their original order. Every result is identified by
+ * a sequence number (id) which starts from 0. Producers publish
+ * results in an arbitrary order without taking a lock, consumers
+ * (there can be more of them, every consumer sees every result) take
+ * the results in the order of their ids. The result is removed from
+ * the ring when the last consumer releases it.
+ * A producer blocks only if its id doesn't fit into the ring yet
+ * (the ring is full), a consumer blocks only if the result with the next
+ * id is not available yet. Nobody is woken up unless somebody waits.
+ *
+ * \code
+ * // Producer (e.g. a GThreadPool worker)
+ * cr_reorderring_push(ring, task->id, result);
+ *
+ * // Consumer (e.g. a dedicated writer thread)
+ * for (id = 0; id < count; id++) {
+ *     result = cr_reorderring_get(ring, id);
+ *     // Write the result
+ *     if (cr_reorderring_release(ring, id))
+ *         free_result(result);  // This was the last consumer
+ * }
+ * \endcode
+ */
+typedef struct _cr_ReorderRing cr_ReorderRing;
+
+/** Create a new reorder ring.
+ * @param capacity          Max number of results in the ring (at least 2).
+ * @param consumers         Number of consumers which must release
+ *                          every result.
+ * @return                  New cr_ReorderRing.
+ */
+cr_ReorderRing *
+cr_reorderring_new(guint capacity, guint consumers);
+
+/** Publish a result.
+ * Blocks until there is a free slot for the id in the ring.
+ * Every id from the sequence must be pushed exactly once.
+ * @param ring              cr_ReorderRing
+ * @param id                Sequence number of the result.
+ * @param item              The result (could be NULL).
+ */
+void
+cr_reorderring_push(cr_ReorderRing *ring, long id, gpointer item);
+
+/** Get a result with the specified id.
+ * Blocks until the result is published. Every consumer must get
+ * the results in the order of their ids.
+ * @param ring              cr_ReorderRing
+ * @param id                Sequence number of the result.
+ * @return                  The result.
+ */
+gpointer
+cr_reorderring_get(cr_ReorderRing *ring, long id);
+
+/** Release the result with the specified id. After release the consumer
+ * must not touch the result unless it was the last one.
+ * @param ring              cr_ReorderRing
+ * @param id                Sequence number of the result.
+ * @return                  TRUE if the caller was the last consumer
+ *                          of the result and it is responsible for
+ *                          freeing of the result.
+ */
+gboolean
+cr_reorderring_release(cr_ReorderRing *ring, long id);
+
+/** Free the reorder ring. Results remaining in the ring are not freed.
+ * @param ring              cr_ReorderRing
+ */
+void
+cr_reorderring_free(cr_ReorderRing *ring);
+
+/** Task DAG executor.
+ *
+ * Runs tasks on a pool of threads. A task is started as soon as all
+ * the tasks it depends on are finished, so independent chains of tasks
+ * overlap and the whole run takes about as long as its longest chain
+ * (critical path). If a task fails, the tasks which depend on it
+ * (directly or indirectly) are not run at all, other tasks are not
+ * affected.
+ *
+ * \code
+ * cr_TaskDag *dag = cr_taskdag_new(4);
+ * cr_DagTask *fill, *rename;
+ *
+ * fill   = cr_taskdag_add(dag, "fill", fill_func, record);
+ * rename = cr_taskdag_add(dag, "rename", rename_func, record);
+ * cr_taskdag_depends(rename, fill);
+ *
+ * if (cr_taskdag_run(dag, &err) != CRE_OK)
+ *     // err is the error of the first failed task
+ *
+ * cr_taskdag_free(dag);
+ * \endcode
+ */
+typedef struct _cr_TaskDag cr_TaskDag;
+
+/** Task of a cr_TaskDag. It's owned by its cr_TaskDag.
+ */
+typedef struct _cr_DagTask cr_DagTask;
+
+/** Function of a task.
+ * @param data              Data of the task.
+ * @param err               GError **
+ */
+typedef void (*cr_DagTaskFunc)(gpointer data, GError **err);
+
+/** Create a new task DAG executor.
+ * @param threads           Max number of tasks running at once.
+ * @return                  New cr_TaskDag.
+ */
+cr_TaskDag *
+cr_taskdag_new(int threads);
+
+/** Add a task.
+ * @param dag               cr_TaskDag
+ * @param name              Name of the task (used for debug messages,
+ *                          the string is copied).
+ * @param func              Function of the task.
+ * @param data              Data passed to the func.
+ * @return                  The new task.
+ */
+cr_DagTask *
+cr_taskdag_add(cr_TaskDag *dag,
+               const char *name,
+               cr_DagTaskFunc func,
+               gpointer data);
+
+/** The task cannot start until the dependency is finished.
+ * Dependencies must not form a cycle.
+ * @param task              cr_DagTask
+ * @param dependency        cr_DagTask of the same cr_TaskDag or NULL
+ *                          (then nothing is done).
+ */
+void
+cr_taskdag_depends(cr_DagTask *task, cr_DagTask *dependency);
+
+/** Run all tasks and wait until they are finished (or skipped because
+ * a task they depend on failed). Could be called only once.
+ * @param dag               cr_TaskDag
+ * @param err               GError ** (error of the first failed task)
+ * @return                  cr_Error code
+ */
+int
+cr_taskdag_run(cr_TaskDag *dag, GError **err);
+
+/** Free the task DAG executor and all its tasks.
+ * @param dag               cr_TaskDag
+ */
+void
+cr_taskdag_free(cr_TaskDag *dag);
+
 /** @} */
 
 #ifdef __cplusplus
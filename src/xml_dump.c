@@ -28,6 +28,7 @@
 #include "misc.h"
 #include "xml_dump.h"
 #include "xml_dump_internal.h"
+#include "xml_escape_internal.h"
 
 
 void
@@ -178,6 +179,181 @@ cr_xml_dump_files(xmlNodePtr node, cr_Package *package, int primary)
 }
 
 
+/** Per thread buffers of the streaming xml dump.
+ */
+typedef struct {
+    GString *xml;       /*!< buffer for the xml chunk */
+    GString *tmp;       /*!< buffer for iso-8859-1 to UTF-8 conversion */
+    GString *path;      /*!< buffer for a file path */
+} cr_XmlStreamBuffers;
+
+static GStaticPrivate xml_stream_buffers = G_STATIC_PRIVATE_INIT;
+
+static void
+cr_xml_stream_buffers_free(gpointer data)
+{
+    cr_XmlStreamBuffers *buffers = data;
+    g_string_free(buffers->xml, TRUE);
+    g_string_free(buffers->tmp, TRUE);
+    g_string_free(buffers->path, TRUE);
+    g_free(buffers);
+}
+
+static cr_XmlStreamBuffers *
+cr_xml_stream_buffers(void)
+{
+    cr_XmlStreamBuffers *buffers = g_static_private_get(&xml_stream_buffers);
+
+    if (!buffers) {
+        buffers = g_new(cr_XmlStreamBuffers, 1);
+        buffers->xml = g_string_sized_new(XML_STREAM_BUFFER_SIZE);
+        buffers->tmp = g_string_sized_new(XML_STREAM_BUFFER_SIZE);
+        buffers->path = g_string_sized_new(XML_STREAM_BUFFER_SIZE);
+        g_static_private_set(&xml_stream_buffers,
+                             buffers,
+                             cr_xml_stream_buffers_free);
+    }
+
+    return buffers;
+}
+
+GString *
+cr_xml_stream_buffer(void)
+{
+    GString *buf = cr_xml_stream_buffers()->xml;
+    g_string_truncate(buf, 0);
+    return buf;
+}
+
+char *
+cr_xml_stream_finish(GString *buf)
+{
+    char *result;
+
+    // Every chunk ends with a newline (the same as the libxml2 dump)
+    g_string_append_c(buf, '\n');
+    result = g_strndup(buf->str, buf->len);
+
+    // Do not keep too big buffers allocated
+    if (buf->allocated_len > XML_STREAM_BUFFER_MAX_SIZE) {
+        cr_XmlStreamBuffers *buffers = cr_xml_stream_buffers();
+        assert(buffers->xml == buf);
+        g_string_free(buf, TRUE);
+        buffers->xml = g_string_sized_new(XML_STREAM_BUFFER_SIZE);
+    }
+
+    return result;
+}
+
+/** Convert the string from iso-8859-1 into the tmp buffer.
+ * (The same conversion as cr_xmlNewTextChild() and cr_xmlNewProp() do
+ * for strings which are not valid UTF-8.)
+ */
+static const char *
+cr_xml_stream_latin1(const char *str)
+{
+    GString *tmp = cr_xml_stream_buffers()->tmp;
+    g_string_set_size(tmp, strlen(str) * 2);
+    cr_latin1_to_utf8((const unsigned char *) str, (unsigned char *) tmp->str);
+    return tmp->str;
+}
+
+void
+cr_xml_stream_text(GString *buf, const char *str)
+{
+    if (!str)
+        return;
+
+    if (!cr_xml_escape(buf, str, CR_XML_ESCAPE_TEXT))
+        cr_xml_escape(buf, cr_xml_stream_latin1(str),
+                      CR_XML_ESCAPE_TEXT | CR_XML_ESCAPE_NOCHECK);
+}
+
+void
+cr_xml_stream_text_element(GString *buf,
+                           int level,
+                           const char *name,
+                           const char *str)
+{
+    cr_xml_stream_indent(buf, level);
+    g_string_append_c(buf, '<');
+    g_string_append(buf, name);
+    g_string_append_c(buf, '>');
+    cr_xml_stream_text(buf, str);
+    g_string_append(buf, "</");
+    g_string_append(buf, name);
+    g_string_append(buf, ">\n");
+}
+
+static inline void
+cr_xml_stream_attr_start(GString *buf, const char *name)
+{
+    g_string_append_c(buf, ' ');
+    g_string_append(buf, name);
+    g_string_append(buf, "=\"");
+}
+
+void
+cr_xml_stream_attr(GString *buf, const char *name, const char *value)
+{
+    cr_xml_stream_attr_start(buf, name);
+    if (value && !cr_xml_escape(buf, value, CR_XML_ESCAPE_ATTR))
+        cr_xml_escape(buf, cr_xml_stream_latin1(value),
+                      CR_XML_ESCAPE_ATTR | CR_XML_ESCAPE_NOCHECK);
+    g_string_append_c(buf, '"');
+}
+
+void
+cr_xml_stream_attr_raw(GString *buf, const char *name, const char *value)
+{
+    cr_xml_stream_attr_start(buf, name);
+    if (value)
+        cr_xml_escape(buf, value, CR_XML_ESCAPE_ATTR | CR_XML_ESCAPE_NOCHECK);
+    g_string_append_c(buf, '"');
+}
+
+void
+cr_xml_stream_attr_int(GString *buf, const char *name, gint64 value)
+{
+    char str[DATESIZE_STR_MAX_LEN];
+    g_snprintf(str, DATESIZE_STR_MAX_LEN, "%"G_GINT64_FORMAT, value);
+    cr_xml_stream_attr_raw(buf, name, str);
+}
+
+void
+cr_xml_stream_files(GString *buf, int level, cr_Package *package, int primary)
+{
+    GString *fullname = cr_xml_stream_buffers()->path;
+
+    for (GSList *elem = package->files; elem; elem = g_slist_next(elem)) {
+        cr_PackageFile *entry = elem->data;
+
+        // File without name or path is suspicious => Skip it
+        if (!(entry->path) || !(entry->name))
+            continue;
+
+        // String concatenation (path + basename)
+        g_string_assign(fullname, entry->path);
+        g_string_append(fullname, entry->name);
+
+        // Skip a file if we want primary files and the file is not one
+        if (primary && !cr_is_primary(fullname->str))
+            continue;
+
+        cr_xml_stream_indent(buf, level);
+        g_string_append(buf, "<file");
+
+        // Write type (skip type if type value is empty of "file")
+        if (entry->type && entry->type[0] != '\0'
+            && strcmp(entry->type, "file"))
+            cr_xml_stream_attr(buf, "type", entry->type);
+
+        g_string_append_c(buf, '>');
+        cr_xml_stream_text(buf, fullname->str);
+        g_string_append(buf, "</file>\n");
+    }
+}
+
 struct cr_XmlStruct
 cr_xml_dump(cr_Package *pkg, GError **err)
 {
@@ -73,7 +73,7 @@ cr_xml_dump_filelists_items(xmlNodePtr root, cr_Package *package)
 
 
 char *
-cr_xml_dump_filelists(cr_Package *package, GError **err)
+cr_xml_dump_filelists_dom(cr_Package *package, GError **err)
 {
     xmlNodePtr root;
     char *result;
@@ -111,3 +111,38 @@ cr_xml_dump_filelists(cr_Package *package, GError **err)
 
     return result;
 }
+
+
+char *
+cr_xml_dump_filelists(cr_Package *package, GError **err)
+{
+    GString *buf;
+
+    assert(!err || *err == NULL);
+
+    if (!package)
+        return NULL;
+
+    buf = cr_xml_stream_buffer();
+
+    // Element: package
+    g_string_append(buf, "<package");
+    cr_xml_stream_attr(buf, "pkgid", package->pkgId);
+    cr_xml_stream_attr(buf, "name", package->name);
+    cr_xml_stream_attr(buf, "arch", package->arch);
+    g_string_append(buf, ">\n");
+
+    // Element: version
+    cr_xml_stream_indent(buf, 1);
+    g_string_append(buf, "<version");
+    cr_xml_stream_attr(buf, "epoch", package->epoch);
+    cr_xml_stream_attr(buf, "ver", package->version);
+    cr_xml_stream_attr(buf, "rel", package->release);
+    g_string_append(buf, "/>\n");
+
+    cr_xml_stream_files(buf, 1, package, 0);
+
+    g_string_append(buf, "</package>");
+
+    return cr_xml_stream_finish(buf);
+}
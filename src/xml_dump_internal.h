@@ -24,6 +24,8 @@
 extern "C" {
 #endif
 
+#include <glib.h>
+#include <assert.h>
 #include "package.h"
 #include <libxml/tree.h>
 
@@ -42,6 +44,10 @@ extern "C" {
 #define DATESIZE_STR_MAX_LEN    SIZE_STR_MAX_LEN
 #endif
 
+#define XML_STREAM_BUFFER_SIZE      16384
+#define XML_STREAM_BUFFER_MAX_SIZE  (4*1024*1024)
+#define XML_STREAM_MAX_INDENT       8
+
 /** Dump files from the package and append them to the node as childrens.
  * @param node          parent xml node
  * @param package       cr_Package
@@ -67,6 +73,90 @@ xmlAttrPtr cr_xmlNewProp(xmlNodePtr node,
                          const xmlChar *name,
                          const xmlChar *value);
 
+/* Streaming xml dump
+ * ==================
+ * Xml chunks are written directly into a per thread buffer without
+ * building of a libxml2 tree. The output is the same as the output of
+ * xmlNodeDump() with enabled formatting (two spaces indentation,
+ * elements with a text content are not indented inside).
+ */
+
+/** Get an empty per thread buffer for a xml chunk.
+ * @return              buffer (owned by the thread)
+ */
+GString *cr_xml_stream_buffer(void);
+
+/** Return a copy of the chunk in the buffer (a newline is appended).
+ * @param buf           buffer from cr_xml_stream_buffer()
+ * @return              mallocated xml chunk
+ */
+char *cr_xml_stream_finish(GString *buf);
+
+/** Append indentation for the specified level.
+ */
+static inline void
+cr_xml_stream_indent(GString *buf, int level)
+{
+    static const char spaces[2*XML_STREAM_MAX_INDENT+1] = "                ";
+    assert(level <= XML_STREAM_MAX_INDENT);
+    g_string_append_len(buf, spaces, 2*level);
+}
+
+/** Append escaped text content. It allows str to be NULL and non UTF-8
+ * (the same as cr_xmlNewTextChild()).
+ */
+void cr_xml_stream_text(GString *buf, const char *str);
+
+/** Append whole element with a text content (including indentation
+ * and newline). E.g. "  <name>foo</name>\n"
+ */
+void cr_xml_stream_text_element(GString *buf,
+                                int level,
+                                const char *name,
+                                const char *str);
+
+/** Append an attribute. It allows value to be NULL and non UTF-8
+ * (the same as cr_xmlNewProp()).
+ */
+void cr_xml_stream_attr(GString *buf, const char *name, const char *value);
+
+/** Append an attribute without UTF-8 check (the same as xmlNewProp()).
+ */
+void cr_xml_stream_attr_raw(GString *buf,
+                            const char *name,
+                            const char *value);
+
+/** Append an integer attribute.
+ */
+void cr_xml_stream_attr_int(GString *buf, const char *name, gint64 value);
+
+/** Append file elements (see cr_xml_dump_files()).
+ * @param buf           buffer
+ * @param level         indentation level of the file elements
+ * @param package       cr_Package
+ * @param primary       process only primary files
+ */
+void cr_xml_stream_files(GString *buf,
+                         int level,
+                         cr_Package *package,
+                         int primary);
+
+/** Generate primary xml chunk via the libxml2 tree.
+ * This is the former implementation of cr_xml_dump_primary(). It is kept
+ * as a reference for tests and benchmarks of the streaming dump.
+ */
+char *cr_xml_dump_primary_dom(cr_Package *package, GError **err);
+
+/** Generate filelists xml chunk via the libxml2 tree.
+ * See cr_xml_dump_primary_dom().
+ */
+char *cr_xml_dump_filelists_dom(cr_Package *package, GError **err);
+
+/** Generate other xml chunk via the libxml2 tree.
+ * See cr_xml_dump_primary_dom().
+ */
+char *cr_xml_dump_other_dom(cr_Package *package, GError **err);
+
 #ifdef __cplusplus
 }
 #endif
@@ -112,7 +112,7 @@ cr_xml_dump_other_items(xmlNodePtr root, cr_Package *package)
 
 
 char *
-cr_xml_dump_other(cr_Package *package, GError **err)
+cr_xml_dump_other_dom(cr_Package *package, GError **err)
 {
     xmlNodePtr root;
     char *result;
@@ -150,3 +150,51 @@ cr_xml_dump_other(cr_Package *package, GError **err)
 
     return result;
 }
+
+
+char *
+cr_xml_dump_other(cr_Package *package, GError **err)
+{
+    GString *buf;
+
+    assert(!err || *err == NULL);
+
+    if (!package)
+        return NULL;
+
+    buf = cr_xml_stream_buffer();
+
+    // Element: package
+    g_string_append(buf, "<package");
+    cr_xml_stream_attr(buf, "pkgid", package->pkgId);
+    cr_xml_stream_attr(buf, "name", package->name);
+    cr_xml_stream_attr(buf, "arch", package->arch);
+    g_string_append(buf, ">\n");
+
+    // Element: version
+    cr_xml_stream_indent(buf, 1);
+    g_string_append(buf, "<version");
+    cr_xml_stream_attr_raw(buf, "epoch", package->epoch);
+    cr_xml_stream_attr_raw(buf, "ver", package->version);
+    cr_xml_stream_attr_raw(buf, "rel", package->release);
+    g_string_append(buf, "/>\n");
+
+    // Element: changelog
+    for (GSList *elem = package->changelogs; elem; elem = g_slist_next(elem)) {
+        cr_ChangelogEntry *entry = elem->data;
+
+        assert(entry);
+
+        cr_xml_stream_indent(buf, 1);
+        g_string_append(buf, "<changelog");
+        cr_xml_stream_attr(buf, "author", entry->author);
+        cr_xml_stream_attr_int(buf, "date", entry->date);
+        g_string_append_c(buf, '>');
+        cr_xml_stream_text(buf, entry->changelog);
+        g_string_append(buf, "</changelog>\n");
+    }
+
+    g_string_append(buf, "</package>");
+
+    return cr_xml_stream_finish(buf);
+}
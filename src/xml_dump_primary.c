@@ -364,7 +364,7 @@ cr_xml_dump_primary_base_items(xmlNodePtr root, cr_Package *package)
 
 
 char *
-cr_xml_dump_primary(cr_Package *package, GError **err)
+cr_xml_dump_primary_dom(cr_Package *package, GError **err)
 {
     xmlNodePtr root;
     char *result;
@@ -403,3 +403,180 @@ cr_xml_dump_primary(cr_Package *package, GError **err)
     return result;
 
 }
+
+
+static void
+cr_xml_stream_primary_pco(GString *buf, cr_Package *package, int pcotype)
+{
+    const char *elem_name;
+    GSList *files = NULL;
+    gboolean empty = TRUE;
+
+    if (pcotype == PROVIDES) {
+        elem_name = "rpm:provides";
+        files = package->provides;
+    } else if (pcotype == CONFLICTS) {
+        elem_name = "rpm:conflicts";
+        files = package->conflicts;
+    } else if (pcotype == OBSOLETES) {
+        elem_name = "rpm:obsoletes";
+        files = package->obsoletes;
+    } else if (pcotype == REQUIRES) {
+        elem_name = "rpm:requires";
+        files = package->requires;
+    } else {
+        return;
+    }
+
+    if (!files)
+        return;
+
+    cr_xml_stream_indent(buf, 2);
+    g_string_append_c(buf, '<');
+    g_string_append(buf, elem_name);
+
+    for (GSList *element = files; element; element = element->next) {
+        cr_Dependency *entry = (cr_Dependency*) element->data;
+
+        assert(entry);
+
+        if (!entry->name || entry->name[0] == '\0')
+            continue;
+
+        if (empty) {
+            g_string_append(buf, ">\n");
+            empty = FALSE;
+        }
+
+        cr_xml_stream_indent(buf, 3);
+        g_string_append(buf, "<rpm:entry");
+        cr_xml_stream_attr(buf, "name", entry->name);
+
+        if (entry->flags && entry->flags[0] != '\0') {
+            cr_xml_stream_attr(buf, "flags", entry->flags);
+
+            if (entry->epoch && entry->epoch[0] != '\0')
+                cr_xml_stream_attr(buf, "epoch", entry->epoch);
+
+            if (entry->version && entry->version[0] != '\0')
+                cr_xml_stream_attr(buf, "ver", entry->version);
+
+            if (entry->release && entry->release[0] != '\0')
+                cr_xml_stream_attr(buf, "rel", entry->release);
+        }
+
+        if (pcotype == REQUIRES && entry->pre)
+            cr_xml_stream_attr_raw(buf, "pre", "1");
+
+        g_string_append(buf, "/>\n");
+    }
+
+    if (empty) {
+        // Element without any entry
+        g_string_append(buf, "/>\n");
+    } else {
+        cr_xml_stream_indent(buf, 2);
+        g_string_append(buf, "</");
+        g_string_append(buf, elem_name);
+        g_string_append(buf, ">\n");
+    }
+}
+
+
+char *
+cr_xml_dump_primary(cr_Package *package, GError **err)
+{
+    GString *buf;
+
+    assert(!err || *err == NULL);
+
+    if (!package)
+        return NULL;
+
+    buf = cr_xml_stream_buffer();
+
+    // Element: package
+    g_string_append(buf, "<package");
+    cr_xml_stream_attr_raw(buf, "type", "rpm");
+    g_string_append(buf, ">\n");
+
+    cr_xml_stream_text_element(buf, 1, "name", package->name);
+    cr_xml_stream_text_element(buf, 1, "arch", package->arch);
+
+    // Element: version
+    cr_xml_stream_indent(buf, 1);
+    g_string_append(buf, "<version");
+    cr_xml_stream_attr(buf, "epoch", package->epoch);
+    cr_xml_stream_attr(buf, "ver", package->version);
+    cr_xml_stream_attr(buf, "rel", package->release);
+    cr_xml_stream_attr(buf, "vcs", package->vcs);
+    g_string_append(buf, "/>\n");
+
+    // Element: checksum
+    cr_xml_stream_indent(buf, 1);
+    g_string_append(buf, "<checksum");
+    cr_xml_stream_attr(buf, "type", package->checksum_type);
+    cr_xml_stream_attr_raw(buf, "pkgid", "YES");
+    g_string_append_c(buf, '>');
+    cr_xml_stream_text(buf, package->pkgId);
+    g_string_append(buf, "</checksum>\n");
+
+    cr_xml_stream_text_element(buf, 1, "summary", package->summary);
+    cr_xml_stream_text_element(buf, 1, "description", package->description);
+    cr_xml_stream_text_element(buf, 1, "packager", package->rpm_packager);
+    cr_xml_stream_text_element(buf, 1, "url", package->url);
+
+    // Element: time
+    cr_xml_stream_indent(buf, 1);
+    g_string_append(buf, "<time");
+    cr_xml_stream_attr_int(buf, "file", package->time_file);
+    cr_xml_stream_attr_int(buf, "build", package->time_build);
+    g_string_append(buf, "/>\n");
+
+    // Element: size
+    cr_xml_stream_indent(buf, 1);
+    g_string_append(buf, "<size");
+    cr_xml_stream_attr_int(buf, "package", package->size_package);
+    cr_xml_stream_attr_int(buf, "installed", package->size_installed);
+    cr_xml_stream_attr_int(buf, "archive", package->size_archive);
+    g_string_append(buf, "/>\n");
+
+    // Element: location
+    cr_xml_stream_indent(buf, 1);
+    g_string_append(buf, "<location");
+    if (package->location_base && package->location_base[0] != '\0')
+        cr_xml_stream_attr(buf, "xml:base", package->location_base);
+    cr_xml_stream_attr(buf, "href", package->location_href);
+    g_string_append(buf, "/>\n");
+
+    // Element: format
+    cr_xml_stream_indent(buf, 1);
+    g_string_append(buf, "<format>\n");
+
+    cr_xml_stream_text_element(buf, 2, "rpm:license", package->rpm_license);
+    cr_xml_stream_text_element(buf, 2, "rpm:vendor", package->rpm_vendor);
+    cr_xml_stream_text_element(buf, 2, "rpm:group", package->rpm_group);
+    cr_xml_stream_text_element(buf, 2, "rpm:buildhost",
+                               package->rpm_buildhost);
+    cr_xml_stream_text_element(buf, 2, "rpm:sourcerpm",
+                               package->rpm_sourcerpm);
+
+    // Element: header-range
+    cr_xml_stream_indent(buf, 2);
+    g_string_append(buf, "<rpm:header-range");
+    cr_xml_stream_attr_int(buf, "start", package->rpm_header_start);
+    cr_xml_stream_attr_int(buf, "end", package->rpm_header_end);
+    g_string_append(buf, "/>\n");
+
+    cr_xml_stream_primary_pco(buf, package, PROVIDES);
+    cr_xml_stream_primary_pco(buf, package, REQUIRES);
+    cr_xml_stream_primary_pco(buf, package, CONFLICTS);
+    cr_xml_stream_primary_pco(buf, package, OBSOLETES);
+    cr_xml_stream_files(buf, 2, package, 1);
+
+    cr_xml_stream_indent(buf, 1);
+    g_string_append(buf, "</format>\n");
+    g_string_append(buf, "</package>");
+
+    return cr_xml_stream_finish(buf);
+}
@@ -0,0 +1,355 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <assert.h>
+#include <stdint.h>
+#include <libxml/chvalid.h>
+#include "xml_escape_internal.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define CR_XML_ESCAPE_X86
+#include <immintrin.h>
+#endif
+
+/* Classes of bytes. A byte with a class bit set stops the bulk copy
+ * for the given mode.
+ */
+#define STOP_TEXT   (1 << 0)
+#define STOP_ATTR   (1 << 1)
+#define STOP_BOTH   (STOP_TEXT | STOP_ATTR)
+
+static const unsigned char cr_xml_escape_class[256] = {
+    [0]             = STOP_BOTH,
+    ['\t']          = STOP_ATTR,
+    ['\n']          = STOP_ATTR,
+    ['\r']          = STOP_BOTH,
+    ['"']           = STOP_ATTR,
+    ['&']           = STOP_BOTH,
+    ['<']           = STOP_BOTH,
+    ['>']           = STOP_BOTH,
+    [0x80 ... 0xFF] = STOP_BOTH,
+};
+
+/** Return length of the initial part of the string which can be copied
+ * without any change. The byte at the returned offset is NUL, a non
+ * ASCII byte or a character which must be escaped.
+ */
+typedef size_t (*cr_XmlEscapeSpanFunc)(const unsigned char *str, int attr);
+
+static size_t
+cr_xml_escape_span_scalar(const unsigned char *str, int attr)
+{
+    const unsigned char *cur = str;
+    const unsigned char stop = attr ? STOP_ATTR : STOP_TEXT;
+
+    while (!(cr_xml_escape_class[*cur] & stop))
+        cur++;
+
+    return cur - str;
+}
+
+#ifdef CR_XML_ESCAPE_X86
+
+/* The SIMD implementations use aligned loads only. An aligned block never
+ * crosses a page boundary, so reading past the terminating NUL (inside
+ * the block) is safe.
+ */
+
+static inline unsigned int
+cr_xml_escape_mask_sse2(__m128i v, int attr)
+{
+    __m128i m;
+
+    m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                     _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    if (attr) {
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    }
+
+    // Non ASCII bytes have the highest bit set already
+    return (unsigned int) _mm_movemask_epi8(_mm_or_si128(m, v));
+}
+
+static size_t
+cr_xml_escape_span_sse2(const unsigned char *str, int attr)
+{
+    size_t misalign = (uintptr_t) str & 15;
+    const unsigned char *block = str - misalign;
+    unsigned int mask;
+
+    mask = cr_xml_escape_mask_sse2(_mm_load_si128((const __m128i *) block),
+                                   attr) >> misalign;
+    if (mask)
+        return __builtin_ctz(mask);
+
+    for (;;) {
+        block += 16;
+        mask = cr_xml_escape_mask_sse2(
+                        _mm_load_si128((const __m128i *) block), attr);
+        if (mask)
+            return (block - str) + __builtin_ctz(mask);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline unsigned int
+cr_xml_escape_mask_avx2(__m256i v, int attr)
+{
+    __m256i m;
+
+    m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()),
+                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    if (attr) {
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    }
+
+    return (unsigned int) _mm256_movemask_epi8(_mm256_or_si256(m, v));
+}
+
+__attribute__((target("avx2")))
+static size_t
+cr_xml_escape_span_avx2(const unsigned char *str, int attr)
+{
+    size_t misalign = (uintptr_t) str & 31;
+    const unsigned char *block = str - misalign;
+    unsigned int mask;
+
+    mask = cr_xml_escape_mask_avx2(
+                _mm256_load_si256((const __m256i *) block), attr) >> misalign;
+    if (mask)
+        return __builtin_ctz(mask);
+
+    for (;;) {
+        block += 32;
+        mask = cr_xml_escape_mask_avx2(
+                        _mm256_load_si256((const __m256i *) block), attr);
+        if (mask)
+            return (block - str) + __builtin_ctz(mask);
+    }
+}
+
+#endif /* CR_XML_ESCAPE_X86 */
+
+static cr_XmlEscapeSpanFunc cr_xml_escape_span = NULL;
+
+static cr_XmlEscapeSpanFunc
+cr_xml_escape_span_func(cr_XmlEscapeImpl impl)
+{
+    switch (impl) {
+        case CR_XML_ESCAPE_IMPL_AUTO:
+#ifdef CR_XML_ESCAPE_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return cr_xml_escape_span_avx2;
+            return cr_xml_escape_span_sse2;
+#else
+            return cr_xml_escape_span_scalar;
+#endif
+        case CR_XML_ESCAPE_IMPL_SCALAR:
+            return cr_xml_escape_span_scalar;
+#ifdef CR_XML_ESCAPE_X86
+        case CR_XML_ESCAPE_IMPL_SSE2:
+            return cr_xml_escape_span_sse2;
+        case CR_XML_ESCAPE_IMPL_AVX2:
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2"))
+                return cr_xml_escape_span_avx2;
+            return NULL;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+gboolean
+cr_xml_escape_set_impl(cr_XmlEscapeImpl impl)
+{
+    cr_XmlEscapeSpanFunc func = cr_xml_escape_span_func(impl);
+
+    if (!func)
+        return FALSE;
+
+    cr_xml_escape_span = func;
+    return TRUE;
+}
+
+/** Return length of the UTF-8 sequence at the str or 0 if the sequence
+ * is invalid. The same rules as xmlCheckUTF8() uses.
+ */
+static inline int
+cr_xml_escape_utf8_len(const unsigned char *str)
+{
+    if ((str[0] & 0xE0) == 0xC0) {
+        if ((str[1] & 0xC0) != 0x80)
+            return 0;
+        return 2;
+    } else if ((str[0] & 0xF0) == 0xE0) {
+        if ((str[1] & 0xC0) != 0x80 || (str[2] & 0xC0) != 0x80)
+            return 0;
+        return 3;
+    } else if ((str[0] & 0xF8) == 0xF0) {
+        if ((str[1] & 0xC0) != 0x80 || (str[2] & 0xC0) != 0x80
+            || (str[3] & 0xC0) != 0x80)
+            return 0;
+        return 4;
+    }
+
+    return 0;
+}
+
+/** Append a hexadecimal character reference (the same format as
+ * libxml2 uses, e.g. "&#xE9;").
+ */
+static void
+cr_xml_escape_hex_char_ref(GString *buf, int val)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    char tmp[16];
+    int pos = sizeof(tmp);
+
+    tmp[--pos] = ';';
+    do {
+        tmp[--pos] = hex[val & 0xF];
+        val >>= 4;
+    } while (val > 0);
+    tmp[--pos] = 'x';
+    tmp[--pos] = '#';
+    tmp[--pos] = '&';
+
+    g_string_append_len(buf, tmp + pos, sizeof(tmp) - pos);
+}
+
+/** Write a non ASCII character of an attribute value as a character
+ * reference. The same way as libxml2 does it for attributes of nodes
+ * without a document.
+ * @return          number of processed bytes
+ */
+static int
+cr_xml_escape_attr_char(GString *buf, const unsigned char *cur)
+{
+    int val = 0, l = 1;
+
+    if (*cur < 0xC0) {
+        l = 1;
+    } else if (*cur < 0xE0) {
+        val = (cur[0] & 0x1F) << 6 | (cur[1] & 0x3F);
+        l = 2;
+    } else if (*cur < 0xF0 && cur[2] != 0) {
+        val = (cur[0] & 0x0F) << 12 | (cur[1] & 0x3F) << 6
+              | (cur[2] & 0x3F);
+        l = 3;
+    } else if (*cur < 0xF8 && cur[2] != 0 && cur[3] != 0) {
+        val = (cur[0] & 0x07) << 18 | (cur[1] & 0x3F) << 12
+              | (cur[2] & 0x3F) << 6 | (cur[3] & 0x3F);
+        l = 4;
+    }
+
+    if (l == 1 || !xmlIsCharQ(val)) {
+        // Invalid character - write the byte as a char reference
+        cr_xml_escape_hex_char_ref(buf, *cur);
+        return 1;
+    }
+
+    cr_xml_escape_hex_char_ref(buf, val);
+    return l;
+}
+
+gboolean
+cr_xml_escape(GString *buf, const char *str, int flags)
+{
+    const unsigned char *base, *cur, *valid_end;
+    const char *entity;
+    gsize orig_len = buf->len;
+    int attr = flags & CR_XML_ESCAPE_ATTR;
+    int check = !(flags & CR_XML_ESCAPE_NOCHECK);
+    cr_XmlEscapeSpanFunc span = cr_xml_escape_span;
+
+    if (G_UNLIKELY(!span)) {
+        // Races are harmless, all threads select the same function
+        span = cr_xml_escape_span_func(CR_XML_ESCAPE_IMPL_AUTO);
+        cr_xml_escape_span = span;
+    }
+
+    base = cur = valid_end = (const unsigned char *) str;
+
+    for (;;) {
+        cur += span(cur, attr);
+
+        if (*cur == '\0')
+            break;
+
+        if (*cur >= 0x80) {
+            if (check && cur >= valid_end) {
+                int l = cr_xml_escape_utf8_len(cur);
+                if (!l) {
+                    g_string_truncate(buf, orig_len);
+                    return FALSE;
+                }
+                valid_end = cur + l;
+            }
+
+            if (!attr) {
+                // Text content keeps the UTF-8 as is
+                cur = check ? valid_end : cur + 1;
+                continue;
+            }
+
+            if (cur[1] == '\0') {
+                // libxml2 keeps the last byte as is
+                cur++;
+                continue;
+            }
+
+            g_string_append_len(buf, (const char *) base, cur - base);
+            cur += cr_xml_escape_attr_char(buf, cur);
+            base = cur;
+            continue;
+        }
+
+        switch (*cur) {
+            case '\t': entity = "&#9;";   break;
+            case '\n': entity = "&#10;";  break;
+            case '\r': entity = "&#13;";  break;
+            case '"':  entity = "&quot;"; break;
+            case '<':  entity = "&lt;";   break;
+            case '>':  entity = "&gt;";   break;
+            case '&':  entity = "&amp;";  break;
+            default:   assert(0); entity = ""; break;
+        }
+
+        g_string_append_len(buf, (const char *) base, cur - base);
+        g_string_append(buf, entity);
+        cur++;
+        base = cur;
+    }
+
+    g_string_append_len(buf, (const char *) base, cur - base);
+    return TRUE;
+}
@@ -0,0 +1,83 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#ifndef __C_CREATEREPOLIB_XML_ESCAPE_INTERNAL_H__
+#define __C_CREATEREPOLIB_XML_ESCAPE_INTERNAL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+/* Xml escaping kernel
+ * ===================
+ * UTF-8 validation and escaping of strings for the streaming xml dump
+ * in one pass. Runs of bytes which need no care are found 16 (SSE2) or
+ * 32 (AVX2) bytes at a time and copied in bulk, only special characters
+ * and non ASCII sequences are handled byte by byte. The implementation
+ * is selected at runtime according to the CPU, a scalar implementation
+ * is used on other architectures.
+ *
+ * The output is the same as the output of the libxml2 serializer.
+ */
+
+/** Escaping flags.
+ */
+typedef enum {
+    CR_XML_ESCAPE_TEXT      = 0,        /*!< escape text content */
+    CR_XML_ESCAPE_ATTR      = 1 << 0,   /*!< escape attribute value (non
+                                             ASCII chars are written as
+                                             character references) */
+    CR_XML_ESCAPE_NOCHECK   = 1 << 1,   /*!< do not validate UTF-8 */
+} cr_XmlEscapeFlags;
+
+/** Implementation of the kernel.
+ */
+typedef enum {
+    CR_XML_ESCAPE_IMPL_AUTO,    /*!< the best one supported by the CPU */
+    CR_XML_ESCAPE_IMPL_SCALAR,  /*!< byte by byte */
+    CR_XML_ESCAPE_IMPL_SSE2,    /*!< 16 bytes at a time */
+    CR_XML_ESCAPE_IMPL_AVX2,    /*!< 32 bytes at a time */
+} cr_XmlEscapeImpl;
+
+/** Escape the string and append it to the buffer.
+ * @param buf       output buffer
+ * @param str       string (must not be NULL)
+ * @param flags     cr_XmlEscapeFlags
+ * @return          FALSE if the string is not a valid UTF-8 (in the
+ *                  same sense as xmlCheckUTF8()), the buffer is left
+ *                  untouched in that case. Always TRUE with
+ *                  CR_XML_ESCAPE_NOCHECK.
+ */
+gboolean cr_xml_escape(GString *buf, const char *str, int flags);
+
+/** Select implementation of the kernel. Intended for tests and
+ * benchmarks; must not be called while other threads are escaping.
+ * @param impl      cr_XmlEscapeImpl
+ * @return          FALSE if the implementation is not supported by
+ *                  this CPU (the current one is kept)
+ */
+gboolean cr_xml_escape_set_impl(cr_XmlEscapeImpl impl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __C_CREATEREPOLIB_XML_ESCAPE_INTERNAL_H__ */
@@ -46,6 +46,17 @@ cr_xmlfile_sopen(const char *filename,
                  cr_CompressionType comtype,
                  cr_ContentStat *stat,
                  GError **err)
+{
+    return cr_xmlfile_sopen_mt(filename, type, comtype, stat, 1, err);
+}
+
+cr_XmlFile *
+cr_xmlfile_sopen_mt(const char *filename,
+                    cr_XmlFileType type,
+                    cr_CompressionType comtype,
+                    cr_ContentStat *stat,
+                    int threads,
+                    GError **err)
 {
     cr_XmlFile *f;
     GError *tmp_err = NULL;
@@ -61,11 +72,12 @@ cr_xmlfile_sopen(const char *filename,
         return NULL;
     }
 
-    CR_FILE *cr_f = cr_sopen(filename,
-                             CR_CW_MODE_WRITE,
-                             comtype,
-                             stat,
-                             &tmp_err);
+    CR_FILE *cr_f = cr_sopen_mt(filename,
+                                CR_CW_MODE_WRITE,
+                                comtype,
+                                stat,
+                                threads,
+                                &tmp_err);
     if (tmp_err) {
         g_propagate_prefixed_error(err, tmp_err, "Cannot open %s: ", filename);
         return NULL;
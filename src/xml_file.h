@@ -142,6 +142,25 @@ cr_XmlFile *cr_xmlfile_sopen(const char *filename,
                              cr_ContentStat *stat,
                              GError **err);
 
+/** Open a new XML file which is compressed by multiple threads.
+ * See cr_sopen_mt() for details.
+ * Note: Opened file must not exists! This function cannot
+ * open existing file!.
+ * @param filename      Filename.
+ * @param type          Type of XML file.
+ * @param comtype       Type of used compression.
+ * @param stat          pointer to cr_ContentStat or NULL
+ * @param threads       Number of compression threads (1 = no threads)
+ * @param err           **GError
+ * @return              Opened cr_XmlFile or NULL on error
+ */
+cr_XmlFile *cr_xmlfile_sopen_mt(const char *filename,
+                                cr_XmlFileType type,
+                                cr_CompressionType comtype,
+                                cr_ContentStat *stat,
+                                int threads,
+                                GError **err);
+
 /** Set total number of packages that will be in the file.
  * This number must be set before any write operation
  * (cr_xml_add_pkg, cr_xml_file_add_chunk, ..).
@@ -34,6 +34,7 @@ cr_xml_parser_data(unsigned int numstates)
     pd->acontent = CONTENT_REALLOC_STEP;
     pd->swtab = g_malloc0(sizeof(cr_StatesSwitch *) * numstates);
     pd->sbtab = g_malloc(sizeof(unsigned int) * numstates);
+    pd->raw_start = -1;
 
     return pd;
 }
@@ -44,6 +45,8 @@ cr_xml_parser_data_free(cr_ParserData *pd)
     g_free(pd->content);
     g_free(pd->swtab);
     g_free(pd->sbtab);
+    if (pd->raw)
+        g_string_free(pd->raw, TRUE);
     g_free(pd);
 }
 
@@ -138,6 +141,67 @@ cr_xml_parser_strtoll(cr_ParserData *pd,
     return val;
 }
 
+/** Drop raw data which are before the offset.
+ */
+static void
+cr_xml_parser_raw_drop(cr_ParserData *pd, gint64 offset)
+{
+    assert(offset >= pd->raw_offset);
+    assert(offset <= pd->raw_offset + (gint64) pd->raw->len);
+
+    g_string_erase(pd->raw, 0, offset - pd->raw_offset);
+    pd->raw_offset = offset;
+}
+
+void
+cr_xml_parser_raw_start(cr_ParserData *pd)
+{
+    gint64 start;
+
+    if (!pd->keep_raw)
+        return;
+
+    start = (gint64) XML_GetCurrentByteIndex(*pd->parser);
+
+    // Nothing before the element will be needed anymore
+    cr_xml_parser_raw_drop(pd, start);
+    pd->raw_start = start;
+}
+
+char *
+cr_xml_parser_raw_end(cr_ParserData *pd, GStringChunk *chunk)
+{
+    gint64 end;
+    gsize len;
+    char *xml, *tail, tail_char;
+
+    if (!pd->keep_raw || pd->raw_start < 0)
+        return NULL;
+
+    end = (gint64) XML_GetCurrentByteIndex(*pd->parser)
+          + XML_GetCurrentByteCount(*pd->parser);
+
+    assert(pd->raw_start == pd->raw_offset);
+    pd->raw_start = -1;
+
+    if (end <= pd->raw_offset)
+        return NULL;  // Should not happen
+
+    // Temporarily replace the byte after the element with a newline.
+    // If the element ends at the end of the data, the byte is the
+    // terminating '\0' of the GString.
+    len  = end - pd->raw_offset;
+    tail = pd->raw->str + len;
+    tail_char = *tail;
+    *tail = '\n';
+    xml = g_string_chunk_insert_len(chunk, pd->raw->str, len + 1);
+    *tail = tail_char;
+
+    cr_xml_parser_raw_drop(pd, end);
+
+    return xml;
+}
+
 int
 cr_newpkgcb(cr_Package **pkg,
             const char *pkgId,
@@ -202,6 +266,15 @@ cr_xml_parser_generic(XML_Parser parser,
             break;
         }
 
+        if (pd->keep_raw) {
+            // Keep a copy of the input for cr_xml_parser_raw_end().
+            // Expat may report an element which started in a previous
+            // buffer, so the data are dropped only by the raw functions.
+            if (!pd->raw)
+                pd->raw = g_string_sized_new(2 * XML_BUFFER_SIZE);
+            g_string_append_len(pd->raw, buf, len);
+        }
+
         if (!XML_ParseBuffer(parser, len, len == 0)) {
             ret = CRE_XMLPARSER;
             g_critical("%s: parsing error: %s\n",
@@ -120,6 +120,21 @@ int cr_xml_parse_primary(const char *path,
                          int do_files,
                          GError **err);
 
+/** Same as cr_xml_parse_primary() but the raw xml of every parsed package
+ * element (followed by a newline) is stored into the xml_primary member
+ * of the package (into the package string chunk).
+ * Such xml could be written as is into a new primary.xml.
+ */
+int cr_xml_parse_primary_raw(const char *path,
+                             cr_XmlParserNewPkgCb newpkgcb,
+                             void *newpkgcb_data,
+                             cr_XmlParserPkgCb pkgcb,
+                             void *pkgcb_data,
+                             cr_XmlParserWarningCb warningcb,
+                             void *warningcb_data,
+                             int do_files,
+                             GError **err);
+
 /** Parse filelists.xml. File could be compressed.
  * @param path           Path to filelists.xml
  * @param newpkgcb       Callback for new package (Called when new package
@@ -144,6 +159,20 @@ int cr_xml_parse_filelists(const char *path,
                            void *warningcb_data,
                            GError **err);
 
+/** Same as cr_xml_parse_filelists() but the raw xml of every parsed package
+ * element (followed by a newline) is stored into the xml_filelists member
+ * of the package (into the package string chunk).
+ * Such xml could be written as is into a new filelists.xml.
+ */
+int cr_xml_parse_filelists_raw(const char *path,
+                               cr_XmlParserNewPkgCb newpkgcb,
+                               void *newpkgcb_data,
+                               cr_XmlParserPkgCb pkgcb,
+                               void *pkgcb_data,
+                               cr_XmlParserWarningCb warningcb,
+                               void *warningcb_data,
+                               GError **err);
+
 /** Parse other.xml. File could be compressed.
  * @param path           Path to other.xml
  * @param newpkgcb       Callback for new package (Called when new package
@@ -168,6 +197,20 @@ int cr_xml_parse_other(const char *path,
                        void *warningcb_data,
                        GError **err);
 
+/** Same as cr_xml_parse_other() but the raw xml of every parsed package
+ * element (followed by a newline) is stored into the xml_other member
+ * of the package (into the package string chunk).
+ * Such xml could be written as is into a new other.xml.
+ */
+int cr_xml_parse_other_raw(const char *path,
+                           cr_XmlParserNewPkgCb newpkgcb,
+                           void *newpkgcb_data,
+                           cr_XmlParserPkgCb pkgcb,
+                           void *pkgcb_data,
+                           cr_XmlParserWarningCb warningcb,
+                           void *warningcb_data,
+                           GError **err);
+
 /** Parse repomd.xml. File could be compressed.
  * @param path           Path to repomd.xml
  * @param repomd         cr_Repomd object.
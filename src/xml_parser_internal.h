@@ -121,6 +121,20 @@ typedef struct _cr_ParserData {
     cr_ChangelogEntry *changelog; /*!<
         Changelog entry object for currently parsed element (entry) */
 
+    /* Raw xml related stuff */
+
+    int keep_raw; /*!<
+        If != 0 then raw xml of every package element is stored into
+        the package (xml_primary, xml_filelists or xml_other). */
+    GString *raw; /*!<
+        Input data which could belong to the currently parsed package
+        element. Only used if keep_raw is enabled. */
+    gint64 raw_offset; /*!<
+        Offset of the first byte of the raw in the input. */
+    gint64 raw_start; /*!<
+        Offset of the currently parsed package element in the input
+        or -1 if no package element is parsed. */
+
     /* Repomd related stuff */
 
     cr_Repomd *repomd; /*!<
@@ -185,6 +199,21 @@ int cr_newpkgcb(cr_Package **pkg,
                 void *cbdata,
                 GError **err);
 
+/** Mark the start of a package element. Must be called from the start
+ * element handler. Does nothing if the keep_raw is disabled.
+ */
+void cr_xml_parser_raw_start(cr_ParserData *pd);
+
+/** Get raw xml of the package element started by the last
+ * cr_xml_parser_raw_start() call. Must be called from the end element
+ * handler. The element is followed by a newline (the same format as
+ * cr_xml_dump() uses).
+ * @param pd        Parser data
+ * @param chunk     String chunk where the xml will be stored
+ * @return          The xml or NULL if the keep_raw is disabled
+ */
+char *cr_xml_parser_raw_end(cr_ParserData *pd, GStringChunk *chunk);
+
 /** Generic parser.
  */
 int
@@ -107,6 +107,8 @@ cr_start_handler(void *pdata, const char *element, const char **attr)
         break;
 
     case STATE_PACKAGE: {
+        cr_xml_parser_raw_start(pd);
+
         const char *pkgId = cr_find_attr("pkgid", attr);
         const char *name  = cr_find_attr("name", attr);
         const char *arch  = cr_find_attr("arch", attr);
@@ -243,6 +245,8 @@ cr_end_handler(void *pdata, const char *element)
         // Reverse list of changelogs
         pd->pkg->changelogs = g_slist_reverse(pd->pkg->changelogs);
 
+        pd->pkg->xml_other = cr_xml_parser_raw_end(pd, pd->pkg->chunk);
+
         if (pd->pkgcb && pd->pkgcb(pd->pkg, pd->pkgcb_data, &tmp_err)) {
             if (tmp_err)
                 g_propagate_prefixed_error(&pd->err,
@@ -278,15 +282,16 @@ cr_end_handler(void *pdata, const char *element)
     }
 }
 
-int
-cr_xml_parse_other(const char *path,
-                   cr_XmlParserNewPkgCb newpkgcb,
-                   void *newpkgcb_data,
-                   cr_XmlParserPkgCb pkgcb,
-                   void *pkgcb_data,
-                   cr_XmlParserWarningCb warningcb,
-                   void *warningcb_data,
-                   GError **err)
+static int
+xml_parse_other(const char *path,
+                cr_XmlParserNewPkgCb newpkgcb,
+                void *newpkgcb_data,
+                cr_XmlParserPkgCb pkgcb,
+                void *pkgcb_data,
+                cr_XmlParserWarningCb warningcb,
+                void *warningcb_data,
+                int keep_raw,
+                GError **err)
 {
     int ret = CRE_OK;
     cr_ParserData *pd;
@@ -315,6 +320,7 @@ cr_xml_parse_other(const char *path,
     pd->pkgcb = pkgcb;
     pd->warningcb = warningcb;
     pd->warningcb_data = warningcb_data;
+    pd->keep_raw = keep_raw;
     for (cr_StatesSwitch *sw = stateswitches; sw->from != NUMSTATES; sw++) {
         if (!pd->swtab[sw->from])
             pd->swtab[sw->from] = sw;
@@ -346,3 +352,31 @@ cr_xml_parse_other(const char *path,
 
     return ret;
 }
+
+int
+cr_xml_parse_other(const char *path,
+                   cr_XmlParserNewPkgCb newpkgcb,
+                   void *newpkgcb_data,
+                   cr_XmlParserPkgCb pkgcb,
+                   void *pkgcb_data,
+                   cr_XmlParserWarningCb warningcb,
+                   void *warningcb_data,
+                   GError **err)
+{
+    return xml_parse_other(path, newpkgcb, newpkgcb_data, pkgcb, pkgcb_data,
+                           warningcb, warningcb_data, 0, err);
+}
+
+int
+cr_xml_parse_other_raw(const char *path,
+                       cr_XmlParserNewPkgCb newpkgcb,
+                       void *newpkgcb_data,
+                       cr_XmlParserPkgCb pkgcb,
+                       void *pkgcb_data,
+                       cr_XmlParserWarningCb warningcb,
+                       void *warningcb_data,
+                       GError **err)
+{
+    return xml_parse_other(path, newpkgcb, newpkgcb_data, pkgcb, pkgcb_data,
+                           warningcb, warningcb_data, 1, err);
+}
@@ -159,6 +159,8 @@ cr_start_handler(void *pdata, const char *element, const char **attr)
     case STATE_PACKAGE:
         assert(!pd->pkg);
 
+        cr_xml_parser_raw_start(pd);
+
         val = cr_find_attr("type", attr);
 
         if (!val)
@@ -461,6 +463,8 @@ cr_end_handler(void *pdata, const char *element)
             // Reverse order of files
             pd->pkg->files = g_slist_reverse(pd->pkg->files);
 
+        pd->pkg->xml_primary = cr_xml_parser_raw_end(pd, pd->pkg->chunk);
+
         if (pd->pkgcb && pd->pkgcb(pd->pkg, pd->pkgcb_data, &tmp_err)) {
             if (tmp_err)
                 g_propagate_prefixed_error(&pd->err,
@@ -603,16 +607,17 @@ cr_end_handler(void *pdata, const char *element)
     }
 }
 
-int
-cr_xml_parse_primary(const char *path,
-                     cr_XmlParserNewPkgCb newpkgcb,
-                     void *newpkgcb_data,
-                     cr_XmlParserPkgCb pkgcb,
-                     void *pkgcb_data,
-                     cr_XmlParserWarningCb warningcb,
-                     void *warningcb_data,
-                     int do_files,
-                     GError **err)
+static int
+xml_parse_primary(const char *path,
+                  cr_XmlParserNewPkgCb newpkgcb,
+                  void *newpkgcb_data,
+                  cr_XmlParserPkgCb pkgcb,
+                  void *pkgcb_data,
+                  cr_XmlParserWarningCb warningcb,
+                  void *warningcb_data,
+                  int do_files,
+                  int keep_raw,
+                  GError **err)
 {
     int ret = CRE_OK;
     cr_ParserData *pd;
@@ -642,6 +647,7 @@ cr_xml_parse_primary(const char *path,
     pd->do_files = do_files;
     pd->warningcb = warningcb;
     pd->warningcb_data = warningcb_data;
+    pd->keep_raw = keep_raw;
     for (cr_StatesSwitch *sw = stateswitches; sw->from != NUMSTATES; sw++) {
         if (!pd->swtab[sw->from])
             pd->swtab[sw->from] = sw;
@@ -673,3 +679,33 @@ cr_xml_parse_primary(const char *path,
 
     return ret;
 }
+
+int
+cr_xml_parse_primary(const char *path,
+                     cr_XmlParserNewPkgCb newpkgcb,
+                     void *newpkgcb_data,
+                     cr_XmlParserPkgCb pkgcb,
+                     void *pkgcb_data,
+                     cr_XmlParserWarningCb warningcb,
+                     void *warningcb_data,
+                     int do_files,
+                     GError **err)
+{
+    return xml_parse_primary(path, newpkgcb, newpkgcb_data, pkgcb, pkgcb_data,
+                             warningcb, warningcb_data, do_files, 0, err);
+}
+
+int
+cr_xml_parse_primary_raw(const char *path,
+                         cr_XmlParserNewPkgCb newpkgcb,
+                         void *newpkgcb_data,
+                         cr_XmlParserPkgCb pkgcb,
+                         void *pkgcb_data,
+                         cr_XmlParserWarningCb warningcb,
+                         void *warningcb_data,
+                         int do_files,
+                         GError **err)
+{
+    return xml_parse_primary(path, newpkgcb, newpkgcb_data, pkgcb, pkgcb_data,
+                             warningcb, warningcb_data, do_files, 1, err);
+}
@@ -1,4 +1,5 @@
 import unittest
+import hashlib
 import shutil
 import tempfile
 import os.path
@@ -43,6 +44,30 @@ class TestCaseContentStat(unittest.TestCase):
         self.assertEqual(cs.checksum, "4eff31e3ee2cb389aaee7d2891104"\
                                       "6e8679440f9c5884e02a65b59e2fb0a2dc8")
 
+    def test_contentstat_compressed_checksum(self):
+        compressions = [cr.NO_COMPRESSION, cr.GZ_COMPRESSION,
+                        cr.BZ2_COMPRESSION, cr.XZ_COMPRESSION]
+        if hasattr(cr, "ZSTD_COMPRESSION"):
+            compressions.append(cr.ZSTD_COMPRESSION)
+        for compression in compressions:
+            cs = cr.ContentStat(cr.SHA256)
+            self.assertEqual(cs.compressed_size, 0)
+            self.assertEqual(cs.compressed_checksum_type, cr.UNKNOWN_CHECKSUM)
+            self.assertEqual(cs.compressed_checksum, None)
+            cs.compressed_checksum_type = cr.SHA256
+
+            path = os.path.join(self.tmpdir, "foofile")
+            f = cr.CrFile(path, cr.MODE_WRITE, compression, cs)
+            self.assertTrue(f)
+            f.write("foobar" * 1000)
+            f.close()
+
+            content = open(path, "rb").read()
+            self.assertEqual(cs.size, 6000)
+            self.assertEqual(cs.compressed_size, len(content))
+            self.assertEqual(cs.compressed_checksum,
+                             hashlib.sha256(content).hexdigest())
+
     def test_contentstat_ref_in_xmlfile(self):
         """Test if reference is saved properly"""
 
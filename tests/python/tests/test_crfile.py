@@ -104,3 +104,18 @@ class TestCaseCrFile(unittest.TestCase):
         p = subprocess.Popen(["unxz", "--stdout", path], stdout=subprocess.PIPE)
         content = p.stdout.read()
         self.assertEqual(content, "foobar")
+
+    @unittest.skipUnless(hasattr(cr, "ZSTD_COMPRESSION"),
+                         "built without libzstd")
+    def test_crfile_zstd_compression(self):
+        path = os.path.join(self.tmpdir, "foo.zst")
+        f = cr.CrFile(path, cr.MODE_WRITE, cr.ZSTD_COMPRESSION)
+        self.assertTrue(f)
+        self.assertTrue(os.path.isfile(path))
+        f.write("foobar")
+        f.close()
+
+        import subprocess
+        p = subprocess.Popen(["zstd", "-d", "--stdout", path], stdout=subprocess.PIPE)
+        content = p.stdout.read()
+        self.assertEqual(content, "foobar")
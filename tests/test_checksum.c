@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include "fixtures.h"
+#include "createrepo/error.h"
 #include "createrepo/checksum.h"
 
 static void
@@ -99,6 +100,80 @@ test_cr_checksum_file(void)
 }
 
 
+static void
+test_cr_checksum_file_multi(void)
+{
+    char **checksums;
+    cr_ChecksumMultiCtx *ctx;
+    GError *tmp_err = NULL;
+    const cr_ChecksumType types[] = { CR_CHECKSUM_SHA256, CR_CHECKSUM_MD5,
+                                      CR_CHECKSUM_SHA1, CR_CHECKSUM_UNKNOWN };
+    const cr_ChecksumType no_types[] = { CR_CHECKSUM_UNKNOWN };
+    const cr_ChecksumType bad_types[] = { CR_CHECKSUM_MD5, 244,
+                                          CR_CHECKSUM_UNKNOWN };
+
+    checksums = cr_checksum_file_multi(TEST_EMPTY_FILE, types, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(checksums);
+    g_assert_cmpstr(checksums[0], ==, "e3b0c44298fc1c149afbf4c8996fb92427ae"
+            "41e4649b934ca495991b7852b855");
+    g_assert_cmpstr(checksums[1], ==, "d41d8cd98f00b204e9800998ecf8427e");
+    g_assert_cmpstr(checksums[2], ==,
+                    "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    g_assert(!checksums[3]);
+    g_strfreev(checksums);
+
+    checksums = cr_checksum_file_multi(TEST_BINARY_FILE, types, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(checksums);
+    g_assert_cmpstr(checksums[0], ==, "bf68e32ad78cea8287be0f35b74fa3fecd0e"
+            "aa91770b48f1a7282b015d6d883e");
+    g_assert_cmpstr(checksums[1], ==, "4f8b033d7a402927a20c9328fc0e0f46");
+    g_assert_cmpstr(checksums[2], ==,
+                    "3539fb660a41846352ac4fa9076d168a3c77070b");
+    g_assert(!checksums[3]);
+    g_strfreev(checksums);
+
+    // Data fed by parts
+    ctx = cr_checksum_multi_new(types, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(ctx);
+    g_assert_cmpint(cr_checksum_multi_update(ctx, "foo", 3, NULL), ==,
+                    CRE_OK);
+    g_assert_cmpint(cr_checksum_multi_update(ctx, "", 0, NULL), ==, CRE_OK);
+    g_assert_cmpint(cr_checksum_multi_update(ctx, "bar", 3, NULL), ==,
+                    CRE_OK);
+    checksums = cr_checksum_multi_final(ctx, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpstr(checksums[0], ==, "c3ab8ff13720e8ad9047dd39466b3c8974e5"
+            "92c2fa383d4a3960714caef0c4f2");
+    g_assert_cmpstr(checksums[1], ==, "3858f62230ac3c915f300c664312c63f");
+    g_assert_cmpstr(checksums[2], ==,
+                    "8843d7f92416211de9ebb963ff4ce28125932878");
+    g_strfreev(checksums);
+
+    // Corner cases
+
+    checksums = cr_checksum_file_multi(TEST_BINARY_FILE, bad_types, &tmp_err);
+    g_assert(!checksums);
+    g_assert(tmp_err);
+    g_error_free(tmp_err);
+    tmp_err = NULL;
+
+    checksums = cr_checksum_file_multi(TEST_BINARY_FILE, no_types, &tmp_err);
+    g_assert(!checksums);
+    g_assert(tmp_err);
+    g_error_free(tmp_err);
+    tmp_err = NULL;
+
+    checksums = cr_checksum_file_multi(NON_EXIST_FILE, types, &tmp_err);
+    g_assert(!checksums);
+    g_assert(tmp_err);
+    g_error_free(tmp_err);
+    tmp_err = NULL;
+}
+
+
 static void
 test_cr_checksum_name_str(void)
 {
@@ -136,6 +211,8 @@ main(int argc, char *argv[])
 
     g_test_add_func("/checksum/test_cr_checksum_file",
             test_cr_checksum_file);
+    g_test_add_func("/checksum/test_cr_checksum_file_multi",
+            test_cr_checksum_file_multi);
     g_test_add_func("/checksum/test_cr_checksum_name_str",
             test_cr_checksum_name_str);
 
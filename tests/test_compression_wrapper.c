@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
 #include "fixtures.h"
 #include "createrepo/error.h"
 #include "createrepo/misc.h"
@@ -31,16 +33,21 @@
 
 #define COMPRESSED_BUFFER_LEN                   512
 
+#define PERF_CONTENT_SIZE                       (16 * 1024 * 1024)
+#define PERF_THREADS                            4
+
 #define FILE_COMPRESSED_0_CONTENT               ""
 #define FILE_COMPRESSED_0_CONTENT_LEN           0
 #define FILE_COMPRESSED_0_PLAIN                 TEST_COMPRESSED_FILES_PATH"/00_plain.txt"
 #define FILE_COMPRESSED_0_GZ                    TEST_COMPRESSED_FILES_PATH"/00_plain.txt.gz"
 #define FILE_COMPRESSED_0_BZ2                   TEST_COMPRESSED_FILES_PATH"/00_plain.txt.bz2"
 #define FILE_COMPRESSED_0_XZ                    TEST_COMPRESSED_FILES_PATH"/00_plain.txt.xz"
+#define FILE_COMPRESSED_0_ZSTD                  TEST_COMPRESSED_FILES_PATH"/00_plain.txt.zst"
 #define FILE_COMPRESSED_0_PLAIN_BAD_SUFFIX      TEST_COMPRESSED_FILES_PATH"/00_plain.foo0"
 #define FILE_COMPRESSED_0_GZ_BAD_SUFFIX         TEST_COMPRESSED_FILES_PATH"/00_plain.foo1"
 #define FILE_COMPRESSED_0_BZ2_BAD_SUFFIX        TEST_COMPRESSED_FILES_PATH"/00_plain.foo2"
 #define FILE_COMPRESSED_0_XZ_BAD_SUFFIX         TEST_COMPRESSED_FILES_PATH"/00_plain.foo3"
+#define FILE_COMPRESSED_0_ZSTD_BAD_SUFFIX       TEST_COMPRESSED_FILES_PATH"/00_plain.foo4"
 
 #define FILE_COMPRESSED_1_CONTENT               "foobar foobar foobar foobar test test\nfolkjsaflkjsadokf\n"
 #define FILE_COMPRESSED_1_CONTENT_LEN           56
@@ -48,10 +55,12 @@
 #define FILE_COMPRESSED_1_GZ                    TEST_COMPRESSED_FILES_PATH"/01_plain.txt.gz"
 #define FILE_COMPRESSED_1_BZ2                   TEST_COMPRESSED_FILES_PATH"/01_plain.txt.bz2"
 #define FILE_COMPRESSED_1_XZ                    TEST_COMPRESSED_FILES_PATH"/01_plain.txt.xz"
+#define FILE_COMPRESSED_1_ZSTD                  TEST_COMPRESSED_FILES_PATH"/01_plain.txt.zst"
 #define FILE_COMPRESSED_1_PLAIN_BAD_SUFFIX      TEST_COMPRESSED_FILES_PATH"/01_plain.foo0"
 #define FILE_COMPRESSED_1_GZ_BAD_SUFFIX         TEST_COMPRESSED_FILES_PATH"/01_plain.foo1"
 #define FILE_COMPRESSED_1_BZ2_BAD_SUFFIX        TEST_COMPRESSED_FILES_PATH"/01_plain.foo2"
 #define FILE_COMPRESSED_1_XZ_BAD_SUFFIX         TEST_COMPRESSED_FILES_PATH"/01_plain.foo3"
+#define FILE_COMPRESSED_1_ZSTD_BAD_SUFFIX       TEST_COMPRESSED_FILES_PATH"/01_plain.foo4"
 
 
 static void
@@ -97,6 +106,9 @@ test_cr_compression_suffix(void)
 
     suffix = cr_compression_suffix(CR_CW_XZ_COMPRESSION);
     g_assert_cmpstr(suffix, ==, ".xz");
+
+    suffix = cr_compression_suffix(CR_CW_ZSTD_COMPRESSION);
+    g_assert_cmpstr(suffix, ==, ".zst");
 }
 
 static void
@@ -133,6 +145,12 @@ test_cr_compression_type(void)
 
     type = cr_compression_type("xz");
     g_assert_cmpint(type, ==, CR_CW_XZ_COMPRESSION);
+
+    type = cr_compression_type("zstd");
+    g_assert_cmpint(type, ==, CR_CW_ZSTD_COMPRESSION);
+
+    type = cr_compression_type("zst");
+    g_assert_cmpint(type, ==, CR_CW_ZSTD_COMPRESSION);
 }
 
 static void
@@ -176,6 +194,15 @@ test_cr_detect_compression(void)
     ret = cr_detect_compression(FILE_COMPRESSED_1_XZ, &tmp_err);
     g_assert_cmpint(ret, ==, CR_CW_XZ_COMPRESSION);
     g_assert(!tmp_err);
+
+    // Zstd
+
+    ret = cr_detect_compression(FILE_COMPRESSED_0_ZSTD, &tmp_err);
+    g_assert_cmpint(ret, ==, CR_CW_ZSTD_COMPRESSION);
+    g_assert(!tmp_err);
+    ret = cr_detect_compression(FILE_COMPRESSED_1_ZSTD, &tmp_err);
+    g_assert_cmpint(ret, ==, CR_CW_ZSTD_COMPRESSION);
+    g_assert(!tmp_err);
 }
 
 
@@ -220,6 +247,15 @@ test_cr_detect_compression_bad_suffix(void)
     ret = cr_detect_compression(FILE_COMPRESSED_1_XZ_BAD_SUFFIX, &tmp_err);
     g_assert_cmpint(ret, ==, CR_CW_XZ_COMPRESSION);
     g_assert(!tmp_err);
+
+    // Zstd
+
+    ret = cr_detect_compression(FILE_COMPRESSED_0_ZSTD_BAD_SUFFIX, &tmp_err);
+    g_assert_cmpint(ret, ==, CR_CW_ZSTD_COMPRESSION);
+    g_assert(!tmp_err);
+    ret = cr_detect_compression(FILE_COMPRESSED_1_ZSTD_BAD_SUFFIX, &tmp_err);
+    g_assert_cmpint(ret, ==, CR_CW_ZSTD_COMPRESSION);
+    g_assert(!tmp_err);
 }
 
 
@@ -280,6 +316,15 @@ test_cr_read_with_autodetection(void)
             FILE_COMPRESSED_0_CONTENT, FILE_COMPRESSED_0_CONTENT_LEN);
     test_helper_cw_input(FILE_COMPRESSED_1_XZ, CR_CW_AUTO_DETECT_COMPRESSION,
             FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+
+#ifdef CR_WITH_ZSTD
+    // Zstd
+
+    test_helper_cw_input(FILE_COMPRESSED_0_ZSTD, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_0_CONTENT, FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_input(FILE_COMPRESSED_1_ZSTD, CR_CW_AUTO_DETECT_COMPRESSION,
+            FILE_COMPRESSED_1_CONTENT, FILE_COMPRESSED_1_CONTENT_LEN);
+#endif
 }
 
 
@@ -462,6 +507,32 @@ outputtest_cw_output(Outputtest *outputtest, gconstpointer test_data)
     test_helper_cw_output(OUTPUT_TYPE_PRINTF, outputtest->tmp_filename,
                           CR_CW_XZ_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
                           FILE_COMPRESSED_1_CONTENT_LEN);
+
+#ifdef CR_WITH_ZSTD
+    // Zstd
+
+    printf("Testing - zstd\nwrite()\n");
+    test_helper_cw_output(OUTPUT_TYPE_WRITE,  outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_0_CONTENT,
+                          FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_WRITE,  outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+    printf("puts()\n");
+    test_helper_cw_output(OUTPUT_TYPE_PUTS,   outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_0_CONTENT,
+                          FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PUTS,   outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+    printf("printf()\n");
+    test_helper_cw_output(OUTPUT_TYPE_PRINTF, outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_0_CONTENT,
+                          FILE_COMPRESSED_0_CONTENT_LEN);
+    test_helper_cw_output(OUTPUT_TYPE_PRINTF, outputtest->tmp_filename,
+                          CR_CW_ZSTD_COMPRESSION, FILE_COMPRESSED_1_CONTENT,
+                          FILE_COMPRESSED_1_CONTENT_LEN);
+#endif
 }
 
 
@@ -523,6 +594,13 @@ test_cr_error_handling(void)
     g_error_free(tmp_err);
     tmp_err = NULL;
 
+    f = cr_open("/", CR_CW_MODE_WRITE, CR_CW_ZSTD_COMPRESSION, &tmp_err);
+    g_assert(!f);
+    g_assert(tmp_err);
+    g_assert_cmpint(tmp_err->code, ==, CRE_ZSTD);
+    g_error_free(tmp_err);
+    tmp_err = NULL;
+
     // Opening plain text file as compressed
 
     char buf[256];
@@ -565,6 +643,30 @@ test_cr_error_handling(void)
     ret = cr_close(f, &tmp_err);
     g_assert_cmpint(ret, ==, CRE_OK);
     g_assert(!tmp_err);
+
+#ifdef CR_WITH_ZSTD
+    f = cr_open(FILE_COMPRESSED_1_PLAIN, CR_CW_MODE_READ,
+                CR_CW_ZSTD_COMPRESSION, &tmp_err);
+    g_assert(f);
+    ret = cr_read(f, buf, 256, &tmp_err);
+    g_assert_cmpint(ret, ==, -1);
+    g_assert(tmp_err);
+    g_assert_cmpint(tmp_err->code, ==, CRE_ZSTD);
+    g_error_free(tmp_err);
+    tmp_err = NULL;
+    ret = cr_close(f, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+#else
+    // Without libzstd, zstd files cannot be opened at all
+    f = cr_open(FILE_COMPRESSED_1_ZSTD, CR_CW_MODE_READ,
+                CR_CW_AUTO_DETECT_COMPRESSION, &tmp_err);
+    g_assert(!f);
+    g_assert(tmp_err);
+    g_assert_cmpint(tmp_err->code, ==, CRE_ZSTD);
+    g_error_free(tmp_err);
+    tmp_err = NULL;
+#endif
 }
 
 
@@ -686,6 +788,34 @@ test_contentstating_singlewrite(Outputtest *outputtest, gconstpointer test_data)
     g_assert_cmpstr(stat->checksum, ==, content_sha256);
     cr_contentstat_free(stat, &tmp_err);
     g_assert(!tmp_err);
+
+#ifdef CR_WITH_ZSTD
+    // Zstd compression
+
+    stat = cr_contentstat_new(CR_CHECKSUM_SHA256, &tmp_err);
+    g_assert(stat);
+    g_assert(!tmp_err);
+
+    f = cr_sopen(outputtest->tmp_filename,
+                 CR_CW_MODE_WRITE,
+                 CR_CW_ZSTD_COMPRESSION,
+                 stat,
+                 &tmp_err);
+    g_assert(f);
+    g_assert(!tmp_err);
+
+    ret = cr_write(f, content, content_len, &tmp_err);
+    g_assert_cmpint(ret, ==, content_len);
+    g_assert(!tmp_err);
+
+    cr_close(f, &tmp_err);
+    g_assert(!tmp_err);
+
+    g_assert_cmpint(stat->size, ==, content_len);
+    g_assert_cmpstr(stat->checksum, ==, content_sha256);
+    cr_contentstat_free(stat, &tmp_err);
+    g_assert(!tmp_err);
+#endif
 }
 
 static void
@@ -734,10 +864,311 @@ test_contentstating_multiwrite(Outputtest *outputtest, gconstpointer test_data)
     g_assert(!tmp_err);
 }
 
+static void
+test_contentstating_compressed(Outputtest *outputtest, gconstpointer test_data)
+{
+    CR_FILE *f;
+    int ret;
+    cr_ContentStat *cstat;
+    struct stat st;
+    gchar *checksum;
+    GError *tmp_err = NULL;
+    cr_CompressionType types[] = { CR_CW_NO_COMPRESSION,
+                                   CR_CW_GZ_COMPRESSION,
+                                   CR_CW_BZ2_COMPRESSION,
+                                   CR_CW_XZ_COMPRESSION,
+#ifdef CR_WITH_ZSTD
+                                   CR_CW_ZSTD_COMPRESSION,
+#endif
+                                 };
+
+    CR_UNUSED(test_data);
+
+    const char *content = "sdlkjowykjnhsadyhfsoaf\nasoiuyseahlndsf\n";
+    const int content_len = 39;
+    const char *content_sha256 = "c9d112f052ab86270bfb484817a513d6ce188133ddc0"
+                                 "7c0fc1ac32018b6da6c7";
+
+    for (size_t x = 0; x < G_N_ELEMENTS(types); x++) {
+        for (int threads = 1; threads <= 4; threads += 3) {
+            cstat = cr_contentstat_new(CR_CHECKSUM_SHA256, &tmp_err);
+            g_assert(cstat);
+            g_assert(!tmp_err);
+            g_assert_cmpint(cstat->compressed_checksum_type, ==,
+                            CR_CHECKSUM_UNKNOWN);
+            cstat->compressed_checksum_type = CR_CHECKSUM_SHA256;
+
+            f = cr_sopen_mt(outputtest->tmp_filename, CR_CW_MODE_WRITE,
+                            types[x], cstat, threads, &tmp_err);
+            g_assert(f);
+            g_assert(!tmp_err);
+
+            ret = cr_write(f, content, 10, &tmp_err);
+            g_assert_cmpint(ret, ==, 10);
+            g_assert(!tmp_err);
+
+            ret = cr_write(f, content+10, 29, &tmp_err);
+            g_assert_cmpint(ret, ==, 29);
+            g_assert(!tmp_err);
+
+            ret = cr_close(f, &tmp_err);
+            g_assert_cmpint(ret, ==, CRE_OK);
+            g_assert(!tmp_err);
+
+            // Stats of the compressed content are the stats of the file
+            checksum = cr_checksum_file(outputtest->tmp_filename,
+                                        CR_CHECKSUM_SHA256, &tmp_err);
+            g_assert(checksum);
+            g_assert(!tmp_err);
+            g_assert(!stat(outputtest->tmp_filename, &st));
+
+            g_assert_cmpint(cstat->size, ==, content_len);
+            g_assert_cmpstr(cstat->checksum, ==, content_sha256);
+            g_assert_cmpint(cstat->compressed_size, ==, st.st_size);
+            g_assert_cmpstr(cstat->compressed_checksum, ==, checksum);
+
+            g_free(checksum);
+            cr_contentstat_free(cstat, &tmp_err);
+            g_assert(!tmp_err);
+        }
+    }
+
+    // No checksum of compressed content by default
+    cstat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+    f = cr_sopen(outputtest->tmp_filename, CR_CW_MODE_WRITE,
+                 CR_CW_GZ_COMPRESSION, cstat, &tmp_err);
+    g_assert(f);
+    cr_write(f, content, content_len, NULL);
+    cr_close(f, NULL);
+    g_assert_cmpstr(cstat->checksum, ==, content_sha256);
+    g_assert(!cstat->compressed_checksum);
+    g_assert_cmpint(cstat->compressed_size, ==, 0);
+    cr_contentstat_free(cstat, NULL);
+
+    // A failed flush on close is reported and no checksum is published
+    if (g_file_test("/dev/full", G_FILE_TEST_EXISTS)) {
+        for (size_t x = 0; x < G_N_ELEMENTS(types); x++) {
+            cstat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+            cstat->compressed_checksum_type = CR_CHECKSUM_SHA256;
+            f = cr_sopen("/dev/full", CR_CW_MODE_WRITE, types[x], cstat,
+                         &tmp_err);
+            g_assert(f);
+            g_assert(!tmp_err);
+            cr_write(f, content, content_len, NULL);
+            ret = cr_close(f, &tmp_err);
+            g_assert_cmpint(ret, !=, CRE_OK);
+            g_assert(tmp_err);
+            g_assert(!cstat->compressed_checksum);
+            g_clear_error(&tmp_err);
+            cr_contentstat_free(cstat, NULL);
+        }
+    }
+}
+
+static void
+test_helper_cw_output_mt(const char *filename,
+                         cr_CompressionType comtype,
+                         int threads,
+                         const char *content,
+                         int content_len,
+                         cr_ContentStat *stat)
+{
+    CR_FILE *f;
+    int ret, chunk, written = 0;
+    char *buf;
+    GError *tmp_err = NULL;
+
+    f = cr_sopen_mt(filename, CR_CW_MODE_WRITE, comtype, stat, threads,
+                    &tmp_err);
+    g_assert(f);
+    g_assert(!tmp_err);
+
+    // Write in chunks of various sizes
+    for (chunk = 1; written < content_len; chunk = (chunk * 7) % 100003 + 1) {
+        int len = MIN(chunk, content_len - written);
+        ret = cr_write(f, content + written, len, &tmp_err);
+        g_assert_cmpint(ret, ==, len);
+        g_assert(!tmp_err);
+        written += len;
+    }
+
+    ret = cr_close(f, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    // Read it back
+    buf = g_malloc(content_len + 1);
+    f = cr_open(filename, CR_CW_MODE_READ, CR_CW_AUTO_DETECT_COMPRESSION,
+                &tmp_err);
+    g_assert(f);
+    g_assert(!tmp_err);
+    ret = cr_read(f, buf, content_len + 1, &tmp_err);
+    g_assert_cmpint(ret, ==, content_len);
+    g_assert(!tmp_err);
+    g_assert(!memcmp(buf, content, content_len));
+    cr_close(f, NULL);
+    g_free(buf);
+}
+
+static void
+test_cr_sopen_mt(Outputtest *outputtest, gconstpointer test_data)
+{
+    GString *content;
+    cr_ContentStat *stat_st, *stat_mt;
+    cr_CompressionType types[] = { CR_CW_GZ_COMPRESSION,
+                                   CR_CW_XZ_COMPRESSION,
+#ifdef CR_WITH_ZSTD
+                                   CR_CW_ZSTD_COMPRESSION,
+#endif
+                                   CR_CW_BZ2_COMPRESSION };
+
+    CR_UNUSED(test_data);
+
+    // Content long enough to be split into several blocks
+    content = g_string_new(NULL);
+    for (int x = 0; x < 40000; x++)
+        g_string_append_printf(content, "<file>/usr/share/doc/pkg-%d/%x</file>\n",
+                               x % 97, x * 2654435761U);
+
+    for (size_t x = 0; x < sizeof(types)/sizeof(types[0]); x++) {
+        stat_st = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+        stat_mt = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+
+        test_helper_cw_output_mt(outputtest->tmp_filename, types[x], 1,
+                                 content->str, content->len, stat_st);
+        test_helper_cw_output_mt(outputtest->tmp_filename, types[x], 4,
+                                 content->str, content->len, stat_mt);
+
+        // Stats of the open content don't depend on the number of threads
+        g_assert_cmpint(stat_mt->size, ==, content->len);
+        g_assert_cmpint(stat_mt->size, ==, stat_st->size);
+        g_assert_cmpstr(stat_mt->checksum, ==, stat_st->checksum);
+
+        cr_contentstat_free(stat_st, NULL);
+        cr_contentstat_free(stat_mt, NULL);
+    }
+
+    // Empty file
+    test_helper_cw_output_mt(outputtest->tmp_filename, CR_CW_GZ_COMPRESSION,
+                             4, "", 0, NULL);
+
+    g_string_free(content, TRUE);
+}
+
+
+static gchar *
+read_whole_file(const char *filename, gsize *len)
+{
+    GString *content = g_string_new(NULL);
+    char buf[4096];
+    CR_FILE *f;
+    int ret;
+
+    f = cr_open(filename, CR_CW_MODE_READ, CR_CW_AUTO_DETECT_COMPRESSION,
+                NULL);
+    g_assert(f);
+    while ((ret = cr_read(f, buf, sizeof(buf), NULL)) > 0)
+        g_string_append_len(content, buf, ret);
+    g_assert_cmpint(ret, ==, 0);
+    cr_close(f, NULL);
+
+    *len = content->len;
+    return g_string_free(content, FALSE);
+}
+
+static void
+test_cr_compression_perf(Outputtest *outputtest, gconstpointer test_data)
+{
+    const char *metadata[] = { TEST_REPO_02_PRIMARY,
+                               TEST_REPO_02_FILELISTS,
+                               TEST_REPO_02_OTHER };
+    cr_CompressionType types[] = { CR_CW_GZ_COMPRESSION,
+                                   CR_CW_BZ2_COMPRESSION,
+                                   CR_CW_XZ_COMPRESSION,
+#ifdef CR_WITH_ZSTD
+                                   CR_CW_ZSTD_COMPRESSION,
+#endif
+                                 };
+    GString *content;
+    GTimer *timer;
+    char *buf;
+
+    CR_UNUSED(test_data);
+
+    if (!g_test_perf())
+        return;
+
+    // Metadata of the test repo, every copy with different package
+    // names and files, so the content is not trivially repetitive
+    content = g_string_new(NULL);
+    for (int x = 0; content->len < PERF_CONTENT_SIZE; x++) {
+        for (size_t m = 0; m < G_N_ELEMENTS(metadata); m++) {
+            gsize len;
+            gchar *xml = read_whole_file(metadata[m], &len);
+            g_string_append_printf(content, "<package name=\"pkg-%d\">\n", x);
+            g_string_append_len(content, xml, len);
+            g_free(xml);
+        }
+        for (int y = 0; y < 64; y++)
+            g_string_append_printf(content, "<file>/usr/share/pkg-%d/%x</file>\n",
+                                   x, (x * 64 + y) * 2654435761U);
+    }
+
+    buf = g_malloc(content->len);
+    timer = g_timer_new();
+
+    for (size_t x = 0; x < G_N_ELEMENTS(types); x++) {
+        for (int threads = 1; threads <= PERF_THREADS; threads += PERF_THREADS - 1) {
+            gdouble c_elapsed, d_elapsed;
+            struct stat st;
+            CR_FILE *f;
+            int ret;
+
+            g_timer_start(timer);
+            f = cr_sopen_mt(outputtest->tmp_filename, CR_CW_MODE_WRITE,
+                            types[x], NULL, threads, NULL);
+            g_assert(f);
+            for (gsize off = 0; off < content->len; off += 8192) {
+                int len = MIN(8192, content->len - off);
+                g_assert_cmpint(cr_write(f, content->str + off, len, NULL),
+                                ==, len);
+            }
+            g_assert_cmpint(cr_close(f, NULL), ==, CRE_OK);
+            c_elapsed = g_timer_elapsed(timer, NULL);
+
+            g_timer_start(timer);
+            f = cr_open(outputtest->tmp_filename, CR_CW_MODE_READ,
+                        types[x], NULL);
+            g_assert(f);
+            ret = cr_read(f, buf, content->len, NULL);
+            g_assert_cmpint(ret, ==, (int) content->len);
+            cr_close(f, NULL);
+            d_elapsed = g_timer_elapsed(timer, NULL);
+            g_assert(!memcmp(buf, content->str, content->len));
+
+            g_assert(!stat(outputtest->tmp_filename, &st));
+            g_test_message("%s (%d threads): ratio %.2f%%, compression "
+                           "%.1f MB/s, decompression %.1f MB/s",
+                           cr_compression_suffix(types[x]), threads,
+                           100.0 * st.st_size / content->len,
+                           content->len / c_elapsed / (1024 * 1024),
+                           content->len / d_elapsed / (1024 * 1024));
+            g_test_minimized_result(c_elapsed, "%s (%d threads) compression: "
+                                    "%.3fs", cr_compression_suffix(types[x]),
+                                    threads, c_elapsed);
+        }
+    }
+
+    g_timer_destroy(timer);
+    g_free(buf);
+    g_string_free(content, TRUE);
+}
+
 
 int
 main(int argc, char *argv[])
 {
+    g_thread_init(NULL);
     g_test_init(&argc, &argv, NULL);
 
     g_test_add_func("/compression_wrapper/test_cr_contentstat",
@@ -762,6 +1193,15 @@ main(int argc, char *argv[])
     g_test_add("/compression_wrapper/test_contentstating_multiwrite",
             Outputtest, NULL, outputtest_setup,
             test_contentstating_multiwrite, outputtest_teardown);
+    g_test_add("/compression_wrapper/test_contentstating_compressed",
+            Outputtest, NULL, outputtest_setup,
+            test_contentstating_compressed, outputtest_teardown);
+    g_test_add("/compression_wrapper/test_cr_sopen_mt",
+            Outputtest, NULL, outputtest_setup,
+            test_cr_sopen_mt, outputtest_teardown);
+    g_test_add("/compression_wrapper/test_cr_compression_perf",
+            Outputtest, NULL, outputtest_setup,
+            test_cr_compression_perf, outputtest_teardown);
 
     return g_test_run();
 }
@@ -0,0 +1,230 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/package.h"
+#include "createrepo/delta_manifest.h"
+
+
+static gchar *
+write_manifest(const char *content)
+{
+    gchar *dir = g_strdup(TMPDIR_TEMPLATE);
+    gchar *path;
+
+    g_assert(mkdtemp(dir));
+    path = g_strconcat(dir, "/manifest", NULL);
+    g_free(dir);
+    g_assert(g_file_set_contents(path, content, -1, NULL));
+    return path;
+}
+
+
+static void
+remove_manifest(gchar *path)
+{
+    gchar *dir = g_path_get_dirname(path);
+    cr_remove_dir(dir, NULL);
+    g_free(dir);
+    g_free(path);
+}
+
+
+static gboolean
+list_contains(GSList *list, const char *str)
+{
+    for (GSList *elem = list; elem; elem = g_slist_next(elem))
+        if (!strcmp(elem->data, str))
+            return TRUE;
+    return FALSE;
+}
+
+
+static void
+test_cr_delta_manifest_parse(void)
+{
+    GSList *changed = NULL, *removed = NULL;
+    GError *err = NULL;
+    gchar *path;
+
+    path = write_manifest("# comment\n"
+                          "\n"
+                          "A a/foo.rpm\n"
+                          "M  /b/foo.rpm  \n"
+                          "\tR sub/foo.rpm\n"
+                          "A bar.rpm");
+
+    g_assert(cr_delta_manifest_parse(path, &changed, &removed, &err));
+    g_assert(!err);
+    g_assert_cmpint(g_slist_length(changed), ==, 3);
+    g_assert(list_contains(changed, "a/foo.rpm"));
+    g_assert(list_contains(changed, "b/foo.rpm"));
+    g_assert(list_contains(changed, "bar.rpm"));
+    g_assert_cmpint(g_slist_length(removed), ==, 1);
+    g_assert(list_contains(removed, "sub/foo.rpm"));
+
+    cr_slist_free_full(changed, g_free);
+    cr_slist_free_full(removed, g_free);
+    remove_manifest(path);
+}
+
+
+static void
+test_cr_delta_manifest_parse_bad(void)
+{
+    const char *bad[] = { "X foo.rpm\n", "Afoo.rpm\n", "A\n", "R /\n",
+                          "A foo.rpm\nfoo.rpm\n", NULL };
+    GSList *changed = NULL, *removed = NULL;
+    GError *err = NULL;
+    gchar *path;
+
+    for (int x = 0; bad[x]; x++) {
+        path = write_manifest(bad[x]);
+        g_assert(!cr_delta_manifest_parse(path, &changed, &removed, &err));
+        g_assert(err);
+        g_assert(err->domain == CR_DELTA_MANIFEST_ERROR);
+        g_assert_cmpint(err->code, ==, CRE_BADARG);
+        g_clear_error(&err);
+        cr_slist_free_full(changed, g_free);
+        cr_slist_free_full(removed, g_free);
+        changed = removed = NULL;
+        remove_manifest(path);
+    }
+
+    // Missing file
+    g_assert(!cr_delta_manifest_parse(TMPDIR_TEMPLATE "/nonexistent",
+                                      &changed, &removed, &err));
+    g_assert(err);
+    g_assert_cmpint(err->code, ==, CRE_IO);
+    g_clear_error(&err);
+}
+
+
+// Old metadata: hashtable of packages with location_href as a key
+static GHashTable *
+old_packages(const char **hrefs)
+{
+    GHashTable *ht = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                           (GDestroyNotify) cr_package_free);
+
+    for (int x = 0; hrefs[x]; x++) {
+        cr_Package *pkg = cr_package_new();
+        pkg->location_href = g_string_chunk_insert(pkg->chunk, hrefs[x]);
+        g_hash_table_insert(ht, pkg->location_href, pkg);
+    }
+
+    return ht;
+}
+
+
+static void
+test_cr_delta_manifest_apply(void)
+{
+    const char *hrefs[] = { "a/foo.rpm", "b/foo.rpm", "sub/foo.rpm",
+                            "bar.rpm", NULL };
+    GHashTable *ht = old_packages(hrefs);
+    GSList *changed = NULL, *removed = NULL, *to_read;
+
+    // Packages with the same filename in different directories are
+    // different packages
+    g_assert_cmpint(g_hash_table_size(ht), ==, 4);
+
+    removed = g_slist_prepend(removed, "sub/foo.rpm");
+    changed = g_slist_prepend(changed, "b/foo.rpm");  // Modified
+    changed = g_slist_prepend(changed, "c/foo.rpm");  // Added
+
+    to_read = cr_delta_manifest_apply(ht, changed, removed, NULL);
+
+    // Unchanged packages
+    g_assert_cmpint(g_hash_table_size(ht), ==, 2);
+    g_assert(g_hash_table_lookup(ht, "a/foo.rpm"));
+    g_assert(g_hash_table_lookup(ht, "bar.rpm"));
+    g_assert(!g_hash_table_lookup(ht, "b/foo.rpm"));
+    g_assert(!g_hash_table_lookup(ht, "sub/foo.rpm"));
+
+    // Added and modified packages
+    g_assert_cmpint(g_slist_length(to_read), ==, 2);
+    g_assert(list_contains(to_read, "b/foo.rpm"));
+    g_assert(list_contains(to_read, "c/foo.rpm"));
+
+    g_slist_free(to_read);
+    g_slist_free(changed);
+    g_slist_free(removed);
+    g_hash_table_destroy(ht);
+}
+
+
+static void
+test_cr_delta_manifest_apply_excludes(void)
+{
+    const char *hrefs[] = { "a/foo.rpm", "debug/foo-debuginfo.rpm",
+                            "bar.rpm", NULL };
+    char *globs[] = { "debug/*", "*/baz*", NULL };
+    GHashTable *ht = old_packages(hrefs);
+    GSList *changed = NULL, *to_read;
+    cr_ExcludeMatcher *excludes = cr_exclude_matcher_new(globs, NULL);
+
+    g_assert(excludes);
+
+    changed = g_slist_prepend(changed, "a/baz.rpm");    // Excluded
+    changed = g_slist_prepend(changed, "baz.rpm");      // Not excluded
+    changed = g_slist_prepend(changed, "a/foo.rpm");    // Modified
+
+    to_read = cr_delta_manifest_apply(ht, changed, NULL, excludes);
+
+    // The masks are matched against the paths relative to the repo
+    // (as in the directory walk), both for the carried over and for
+    // the added packages
+    g_assert_cmpint(g_hash_table_size(ht), ==, 1);
+    g_assert(g_hash_table_lookup(ht, "bar.rpm"));
+
+    g_assert_cmpint(g_slist_length(to_read), ==, 2);
+    g_assert(list_contains(to_read, "a/foo.rpm"));
+    g_assert(list_contains(to_read, "baz.rpm"));
+
+    g_slist_free(to_read);
+    g_slist_free(changed);
+    cr_exclude_matcher_free(excludes);
+    g_hash_table_destroy(ht);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/delta_manifest/test_cr_delta_manifest_parse",
+            test_cr_delta_manifest_parse);
+    g_test_add_func("/delta_manifest/test_cr_delta_manifest_parse_bad",
+            test_cr_delta_manifest_parse_bad);
+    g_test_add_func("/delta_manifest/test_cr_delta_manifest_apply",
+            test_cr_delta_manifest_apply);
+    g_test_add_func("/delta_manifest/test_cr_delta_manifest_apply_excludes",
+            test_cr_delta_manifest_apply_excludes);
+
+    return g_test_run();
+}
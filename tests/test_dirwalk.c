@@ -0,0 +1,273 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/dirwalk.h"
+
+typedef struct {
+    gchar *tmp_dir;
+} Dirwalktest;
+
+// Files of the test tree (relative to the tmp dir)
+static const char *TREE_DIRS[] = {
+    "a", "a/b", "a/b/c", "d", "d/sub.rpm.d", NULL
+};
+
+static const char *TREE_FILES[] = {
+    "top.rpm",
+    "a/foo-1.0.rpm",
+    "a/readme.txt",
+    "a/b/bar-debuginfo-1.0.rpm",
+    "a/b/c/baz.rpm",
+    "d/qux.rpm",
+    "d/sub.rpm.d/quux.rpm",
+    NULL
+};
+
+
+static void
+dirwalktest_setup(Dirwalktest *dirwalktest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    dirwalktest->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    mkdtemp(dirwalktest->tmp_dir);
+
+    for (int x = 0; TREE_DIRS[x]; x++) {
+        gchar *path = g_strconcat(dirwalktest->tmp_dir, "/", TREE_DIRS[x], NULL);
+        g_assert_cmpint(mkdir(path, 0755), ==, 0);
+        g_free(path);
+    }
+
+    for (int x = 0; TREE_FILES[x]; x++) {
+        gchar *path = g_strconcat(dirwalktest->tmp_dir, "/", TREE_FILES[x], NULL);
+        g_assert(g_file_set_contents(path, "", 0, NULL));
+        g_free(path);
+    }
+
+    // Symlink to a package and symlink to a directory
+    gchar *path = g_strconcat(dirwalktest->tmp_dir, "/link.rpm", NULL);
+    g_assert_cmpint(symlink("top.rpm", path), ==, 0);
+    g_free(path);
+    path = g_strconcat(dirwalktest->tmp_dir, "/dirlink", NULL);
+    g_assert_cmpint(symlink("a/b/c", path), ==, 0);
+    g_free(path);
+}
+
+
+static void
+dirwalktest_teardown(Dirwalktest *dirwalktest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    cr_remove_dir(dirwalktest->tmp_dir, NULL);
+    g_free(dirwalktest->tmp_dir);
+}
+
+
+typedef struct {
+    const char *root;
+    GPtrArray *found;   // Paths relative to the root
+} WalkResult;
+
+
+static void
+walk_cb(const char *full_path,
+        const char *dirname,
+        const char *filename,
+        void *cbdata)
+{
+    WalkResult *result = cbdata;
+    size_t root_len = strlen(result->root);
+
+    g_assert(g_str_has_prefix(full_path, result->root));
+    g_assert(g_str_has_prefix(full_path, dirname));
+    g_assert(g_str_has_suffix(full_path, filename));
+    g_assert_cmpint(strlen(dirname) + 1 + strlen(filename), ==,
+                    strlen(full_path));
+    g_ptr_array_add(result->found, g_strdup(full_path + root_len + 1));
+}
+
+
+static int
+strcmp_cb(gconstpointer a, gconstpointer b)
+{
+    return strcmp(*((char **) a), *((char **) b));
+}
+
+
+static gchar *
+walk(const char *root,
+     cr_ExcludeMatcher *excludes,
+     int flags,
+     int threads)
+{
+    WalkResult result;
+    GString *joined = g_string_new(NULL);
+
+    result.root = root;
+    result.found = g_ptr_array_new_with_free_func(g_free);
+
+    cr_dirwalk(root, ".rpm", excludes, flags, threads, walk_cb, &result);
+
+    g_ptr_array_sort(result.found, strcmp_cb);
+    for (guint x = 0; x < result.found->len; x++) {
+        if (x)
+            g_string_append_c(joined, ' ');
+        g_string_append(joined, g_ptr_array_index(result.found, x));
+    }
+
+    g_ptr_array_free(result.found, TRUE);
+    return g_string_free(joined, FALSE);
+}
+
+
+static void
+test_cr_dirwalk(Dirwalktest *dirwalktest, gconstpointer test_data)
+{
+    gchar *found;
+
+    CR_UNUSED(test_data);
+
+    for (int threads = 1; threads <= 4; threads++) {
+        found = walk(dirwalktest->tmp_dir, NULL, CR_DIRWALK_DEFAULT, threads);
+        g_assert_cmpstr(found, ==, "a/b/bar-debuginfo-1.0.rpm "
+                                   "a/b/c/baz.rpm "
+                                   "a/foo-1.0.rpm "
+                                   "d/qux.rpm "
+                                   "d/sub.rpm.d/quux.rpm "
+                                   "dirlink/baz.rpm "
+                                   "link.rpm "
+                                   "top.rpm");
+        g_free(found);
+    }
+}
+
+
+static void
+test_cr_dirwalk_skip_symlinks(Dirwalktest *dirwalktest,
+                              gconstpointer test_data)
+{
+    gchar *found;
+
+    CR_UNUSED(test_data);
+
+    // Symlinked dirs are still searched (only files are skipped)
+    found = walk(dirwalktest->tmp_dir, NULL, CR_DIRWALK_SKIP_SYMLINKS, 2);
+    g_assert_cmpstr(found, ==, "a/b/bar-debuginfo-1.0.rpm "
+                               "a/b/c/baz.rpm "
+                               "a/foo-1.0.rpm "
+                               "d/qux.rpm "
+                               "d/sub.rpm.d/quux.rpm "
+                               "dirlink/baz.rpm "
+                               "top.rpm");
+    g_free(found);
+}
+
+
+static void
+test_cr_dirwalk_excludes(Dirwalktest *dirwalktest, gconstpointer test_data)
+{
+    gchar *found;
+    char *globs[] = { "*debuginfo*", "d/*", "?op.rpm", NULL };
+    cr_ExcludeMatcher *excludes;
+
+    CR_UNUSED(test_data);
+
+    excludes = cr_exclude_matcher_new(globs, NULL);
+    g_assert(excludes);
+
+    found = walk(dirwalktest->tmp_dir, excludes, CR_DIRWALK_DEFAULT, 3);
+    g_assert_cmpstr(found, ==, "a/b/c/baz.rpm "
+                               "a/foo-1.0.rpm "
+                               "dirlink/baz.rpm "
+                               "link.rpm");
+    g_free(found);
+
+    cr_exclude_matcher_free(excludes);
+}
+
+
+static void
+test_cr_exclude_matcher(void)
+{
+    char *globs[] = { "*.src.rpm", "foo?bar", "a*b*c", "x[1].rpm",
+                      "dot.rpm", "caf?", NULL };
+    const char *strings[] = {
+        "foo.src.rpm", "foo.rpm", ".src.rpm", "foo/bar.src.rpm",
+        "foo-bar", "foobar", "foo--bar", "foo\xc3\xa9" "bar",
+        "abc", "aXbYc", "ac", "abcX", "x[1].rpm", "x1.rpm", "dot.rpm",
+        "dotXrpm", "caf\xc3\xa9", "cafe", "caf\xe2\x82\xac",
+        "", NULL
+    };
+    cr_ExcludeMatcher *matcher;
+
+    matcher = cr_exclude_matcher_new(globs, NULL);
+    g_assert(matcher);
+
+    // The result must be the same as the result of GPatternSpec
+    for (int x = 0; strings[x]; x++) {
+        gboolean expected = FALSE;
+
+        for (int y = 0; globs[y]; y++) {
+            GPatternSpec *spec = g_pattern_spec_new(globs[y]);
+            expected |= g_pattern_match_string(spec, strings[x]);
+            g_pattern_spec_free(spec);
+        }
+
+        g_assert_cmpint(cr_exclude_matcher_match(matcher, strings[x]),
+                        ==, expected);
+    }
+
+    cr_exclude_matcher_free(matcher);
+
+    // No masks
+    matcher = cr_exclude_matcher_new(NULL, NULL);
+    g_assert(matcher);
+    g_assert(!cr_exclude_matcher_match(matcher, "foo.rpm"));
+    cr_exclude_matcher_free(matcher);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_thread_init(NULL);
+
+    g_test_add("/dirwalk/test_cr_dirwalk",
+            Dirwalktest, NULL, dirwalktest_setup,
+            test_cr_dirwalk, dirwalktest_teardown);
+    g_test_add("/dirwalk/test_cr_dirwalk_skip_symlinks",
+            Dirwalktest, NULL, dirwalktest_setup,
+            test_cr_dirwalk_skip_symlinks, dirwalktest_teardown);
+    g_test_add("/dirwalk/test_cr_dirwalk_excludes",
+            Dirwalktest, NULL, dirwalktest_setup,
+            test_cr_dirwalk_excludes, dirwalktest_teardown);
+    g_test_add_func("/dirwalk/test_cr_exclude_matcher",
+            test_cr_exclude_matcher);
+
+    return g_test_run();
+}
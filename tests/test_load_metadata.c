@@ -93,14 +93,18 @@ static void test_cr_metadata_locate_and_load_xml(void)
     test_helper_check_keys(TEST_REPO_00, CR_HT_KEY_HASH, REPO_SIZE_00, REPO_HASH_KEYS_00);
     test_helper_check_keys(TEST_REPO_00, CR_HT_KEY_NAME, REPO_SIZE_00, REPO_NAME_KEYS_00);
     test_helper_check_keys(TEST_REPO_00, CR_HT_KEY_FILENAME, REPO_SIZE_00, REPO_FILENAME_KEYS_00);
+    // Packages of the test repos are in their top directories
+    test_helper_check_keys(TEST_REPO_00, CR_HT_KEY_LOCATION_HREF, REPO_SIZE_00, REPO_FILENAME_KEYS_00);
 
     test_helper_check_keys(TEST_REPO_01, CR_HT_KEY_HASH, REPO_SIZE_01, REPO_HASH_KEYS_01);
     test_helper_check_keys(TEST_REPO_01, CR_HT_KEY_NAME, REPO_SIZE_01, REPO_NAME_KEYS_01);
     test_helper_check_keys(TEST_REPO_01, CR_HT_KEY_FILENAME, REPO_SIZE_01, REPO_FILENAME_KEYS_01);
+    test_helper_check_keys(TEST_REPO_01, CR_HT_KEY_LOCATION_HREF, REPO_SIZE_01, REPO_FILENAME_KEYS_01);
 
     test_helper_check_keys(TEST_REPO_02, CR_HT_KEY_HASH, REPO_SIZE_02, REPO_HASH_KEYS_02);
     test_helper_check_keys(TEST_REPO_02, CR_HT_KEY_NAME, REPO_SIZE_02, REPO_NAME_KEYS_02);
     test_helper_check_keys(TEST_REPO_02, CR_HT_KEY_FILENAME, REPO_SIZE_02, REPO_FILENAME_KEYS_02);
+    test_helper_check_keys(TEST_REPO_02, CR_HT_KEY_LOCATION_HREF, REPO_SIZE_02, REPO_FILENAME_KEYS_02);
 }
 
 
@@ -151,13 +155,173 @@ static void test_cr_metadata_locate_and_load_xml_detailed(void)
 }
 
 
+static void
+test_helper_check_files_and_changelogs(int use_single_chunk, GSList *pkglist)
+{
+    int ret;
+    cr_Package *pkg;
+    cr_PackageFile *file;
+    cr_ChangelogEntry *changelog;
+    cr_Metadata *metadata;
+
+    metadata = cr_metadata_new(CR_HT_KEY_NAME, use_single_chunk, pkglist);
+    g_assert(metadata);
+    ret = cr_metadata_locate_and_load_xml(metadata, TEST_REPO_02, NULL);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert_cmpuint(g_hash_table_size(cr_metadata_hashtable(metadata)), ==,
+                     pkglist ? 1 : REPO_SIZE_02);
+
+    pkg = g_hash_table_lookup(cr_metadata_hashtable(metadata), "fake_bash");
+    if (pkglist) {
+        g_assert(!pkg);
+    } else {
+        g_assert(pkg);
+        g_assert_cmpuint(g_slist_length(pkg->files), ==, 1);
+        g_assert_cmpuint(g_slist_length(pkg->changelogs), ==, 1);
+    }
+
+    pkg = g_hash_table_lookup(cr_metadata_hashtable(metadata), "super_kernel");
+    g_assert(pkg);
+
+    g_assert_cmpuint(g_slist_length(pkg->files), ==, 2);
+    file = pkg->files->data;
+    g_assert_cmpstr(file->path, ==, "/usr/bin/");
+    g_assert_cmpstr(file->name, ==, "super_kernel");
+    file = pkg->files->next->data;
+    g_assert_cmpstr(file->path, ==, "/usr/share/man/");
+    g_assert_cmpstr(file->name, ==, "super_kernel.8.gz");
+
+    g_assert_cmpuint(g_slist_length(pkg->changelogs), ==, 2);
+    changelog = pkg->changelogs->data;
+    g_assert_cmpstr(changelog->author, ==,
+                    "Tomas Mlcoch <tmlcoch@redhat.com> - 6.0.1-1");
+    g_assert_cmpint(changelog->date, ==, 1334664000);
+    g_assert_cmpstr(changelog->changelog, ==, "- First release");
+    changelog = pkg->changelogs->next->data;
+    g_assert_cmpstr(changelog->changelog, ==, "- Second release");
+
+    cr_metadata_free(metadata);
+}
+
+
+static void test_cr_metadata_load_xml_files_and_changelogs(void)
+{
+    GSList *pkglist = g_slist_prepend(NULL, "super_kernel-6.0.1-2.x86_64.rpm");
+
+    test_helper_check_files_and_changelogs(0, NULL);
+    test_helper_check_files_and_changelogs(1, NULL);
+    test_helper_check_files_and_changelogs(0, pkglist);
+    test_helper_check_files_and_changelogs(1, pkglist);
+
+    g_slist_free(pkglist);
+}
+
+
+static void test_cr_metadata_load_xml_raw(void)
+{
+    int ret;
+    cr_Package *pkg;
+    cr_Metadata *metadata;
+
+    metadata = cr_metadata_new(CR_HT_KEY_FILENAME, 0, NULL);
+    cr_metadata_set_keep_raw_xml(metadata, TRUE);
+    ret = cr_metadata_locate_and_load_xml(metadata, TEST_REPO_01, NULL);
+    g_assert_cmpint(ret, ==, CRE_OK);
+
+    pkg = g_hash_table_lookup(cr_metadata_hashtable(metadata),
+                              "super_kernel-6.0.1-2.x86_64.rpm");
+    g_assert(pkg);
+
+    // The package elements exactly as they are in the files
+    g_assert_cmpstr(pkg->xml_primary, ==,
+        "<package type=\"rpm\">\n"
+        "  <name>super_kernel</name>\n"
+        "  <arch>x86_64</arch>\n"
+        "  <version epoch=\"0\" ver=\"6.0.1\" rel=\"2\"/>\n"
+        "  <checksum type=\"sha256\" pkgid=\"YES\">152824bff2aa6d54f429d43e87a3ff3a0286505c6d93ec87692b5e3a9e3b97bf</checksum>\n"
+        "  <summary>Test package</summary>\n"
+        "  <description>This package has provides, requires, obsoletes, conflicts options.</description>\n"
+        "  <packager></packager>\n"
+        "  <url>http://so_super_kernel.com/it_is_awesome/yep_it_really_is</url>\n"
+        "  <time file=\"1334667003\" build=\"1334667003\"/>\n"
+        "  <size package=\"2845\" installed=\"0\" archive=\"404\"/>\n"
+        "<location href=\"super_kernel-6.0.1-2.x86_64.rpm\"/>\n"
+        "  <format>\n"
+        "    <rpm:license>LGPLv2</rpm:license>\n"
+        "    <rpm:vendor/>\n"
+        "    <rpm:group>Applications/System</rpm:group>\n"
+        "    <rpm:buildhost>localhost.localdomain</rpm:buildhost>\n"
+        "    <rpm:sourcerpm>super_kernel-6.0.1-2.src.rpm</rpm:sourcerpm>\n"
+        "    <rpm:header-range start=\"280\" end=\"2637\"/>\n"
+        "    <rpm:provides>\n"
+        "      <rpm:entry name=\"not_so_super_kernel\" flags=\"LT\" epoch=\"0\" ver=\"5.8.0\"/>\n"
+        "      <rpm:entry name=\"super_kernel\" flags=\"EQ\" epoch=\"0\" ver=\"6.0.0\"/>\n"
+        "      <rpm:entry name=\"super_kernel\" flags=\"EQ\" epoch=\"0\" ver=\"6.0.1\" rel=\"2\"/>\n"
+        "      <rpm:entry name=\"super_kernel(x86-64)\" flags=\"EQ\" epoch=\"0\" ver=\"6.0.1\" rel=\"2\"/>\n"
+        "    </rpm:provides>\n"
+        "    <rpm:requires>\n"
+        "      <rpm:entry name=\"bzip2\" flags=\"GE\" epoch=\"0\" ver=\"1.0.0\" pre=\"1\"/>\n"
+        "      <rpm:entry name=\"expat\" pre=\"1\"/>\n"
+        "      <rpm:entry name=\"glib\" flags=\"GE\" epoch=\"0\" ver=\"2.26.0\"/>\n"
+        "      <rpm:entry name=\"zlib\"/>\n"
+        "    </rpm:requires>\n"
+        "    <rpm:conflicts>\n"
+        "      <rpm:entry name=\"kernel\"/>\n"
+        "      <rpm:entry name=\"super_kernel\" flags=\"EQ\" epoch=\"0\" ver=\"5.0.0\"/>\n"
+        "      <rpm:entry name=\"super_kernel\" flags=\"LT\" epoch=\"0\" ver=\"4.0.0\"/>\n"
+        "    </rpm:conflicts>\n"
+        "    <rpm:obsoletes>\n"
+        "      <rpm:entry name=\"kernel\"/>\n"
+        "      <rpm:entry name=\"super_kernel\" flags=\"EQ\" epoch=\"0\" ver=\"5.9.0\"/>\n"
+        "    </rpm:obsoletes>\n"
+        "    <file>/usr/bin/super_kernel</file>\n"
+        "  </format>\n"
+        "</package>\n");
+
+    g_assert_cmpstr(pkg->xml_filelists, ==,
+        "<package pkgid=\"152824bff2aa6d54f429d43e87a3ff3a0286505c6d93ec87692b5e3a9e3b97bf\" name=\"super_kernel\" arch=\"x86_64\">\n"
+        "    <version epoch=\"0\" ver=\"6.0.1\" rel=\"2\"/>\n"
+        "\n"
+        "    <file>/usr/bin/super_kernel</file>\n"
+        "    <file>/usr/share/man/super_kernel.8.gz</file>\n"
+        "</package>\n");
+
+    // Entities are kept escaped
+    g_assert_cmpstr(pkg->xml_other, ==,
+        "<package pkgid=\"152824bff2aa6d54f429d43e87a3ff3a0286505c6d93ec87692b5e3a9e3b97bf\" name=\"super_kernel\" arch=\"x86_64\">\n"
+        "    <version epoch=\"0\" ver=\"6.0.1\" rel=\"2\"/>\n"
+        "\n"
+        "<changelog author=\"Tomas Mlcoch &lt;tmlcoch@redhat.com&gt; - 6.0.1-1\" date=\"1334664000\">- First release</changelog>\n"
+        "<changelog author=\"Tomas Mlcoch &lt;tmlcoch@redhat.com&gt; - 6.0.1-2\" date=\"1334664001\">- Second release</changelog>\n"
+        "\n"
+        "</package>\n");
+
+    cr_metadata_free(metadata);
+
+    // Without keep_raw_xml nothing is kept
+    metadata = cr_metadata_new(CR_HT_KEY_FILENAME, 0, NULL);
+    ret = cr_metadata_locate_and_load_xml(metadata, TEST_REPO_01, NULL);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    pkg = g_hash_table_lookup(cr_metadata_hashtable(metadata),
+                              "super_kernel-6.0.1-2.x86_64.rpm");
+    g_assert(pkg);
+    g_assert(!pkg->xml_primary);
+    g_assert(!pkg->xml_filelists);
+    g_assert(!pkg->xml_other);
+    cr_metadata_free(metadata);
+}
+
+
 int main(int argc, char *argv[])
 {
+    g_thread_init(NULL);
     g_test_init(&argc, &argv, NULL);
 
     g_test_add_func("/load_metadata/test_cr_metadata_new", test_cr_metadata_new);
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_xml", test_cr_metadata_locate_and_load_xml);
     g_test_add_func("/load_metadata/test_cr_metadata_locate_and_load_xml_detailed", test_cr_metadata_locate_and_load_xml_detailed);
+    g_test_add_func("/load_metadata/test_cr_metadata_load_xml_files_and_changelogs", test_cr_metadata_load_xml_files_and_changelogs);
+    g_test_add_func("/load_metadata/test_cr_metadata_load_xml_raw", test_cr_metadata_load_xml_raw);
 
     return g_test_run();
 }
@@ -377,6 +377,41 @@ test_cr_get_header_byte_range(void)
 }
 
 
+static void
+test_cr_get_header_byte_range_from_buffer(void)
+{
+    struct cr_HeaderRangeStruct hdr_range;
+    GError *tmp_err = NULL;
+    gchar *content;
+    gsize length;
+
+    g_assert(g_file_get_contents(PACKAGE_01, &content, &length, NULL));
+    hdr_range = cr_get_header_byte_range_from_buffer((unsigned char *) content,
+                                                     length, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpuint(hdr_range.start, ==, PACKAGE_01_HEADER_START);
+    g_assert_cmpuint(hdr_range.end, ==, PACKAGE_01_HEADER_END);
+
+    // Too short buffer
+    hdr_range = cr_get_header_byte_range_from_buffer((unsigned char *) content,
+                                                     100, &tmp_err);
+    g_assert(tmp_err);
+    g_error_free(tmp_err);
+    tmp_err = NULL;
+    g_assert_cmpuint(hdr_range.start, ==, 0);
+    g_assert_cmpuint(hdr_range.end, ==, 0);
+    g_free(content);
+
+    g_assert(g_file_get_contents(PACKAGE_02, &content, &length, NULL));
+    hdr_range = cr_get_header_byte_range_from_buffer((unsigned char *) content,
+                                                     length, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpuint(hdr_range.start, ==, PACKAGE_02_HEADER_START);
+    g_assert_cmpuint(hdr_range.end, ==, PACKAGE_02_HEADER_END);
+    g_free(content);
+}
+
+
 static void
 test_cr_get_filename(void)
 {
@@ -1045,6 +1080,8 @@ main(int argc, char *argv[])
             test_cr_is_primary);
     g_test_add_func("/misc/test_cr_get_header_byte_range",
             test_cr_get_header_byte_range);
+    g_test_add_func("/misc/test_cr_get_header_byte_range_from_buffer",
+            test_cr_get_header_byte_range_from_buffer);
     g_test_add_func("/misc/test_cr_get_filename",
             test_cr_get_filename);
     g_test_add("/misc/copyfiletest_test_empty_file",
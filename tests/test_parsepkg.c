@@ -0,0 +1,338 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/xattr.h>
+#endif
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/checksum.h"
+#include "createrepo/misc.h"
+#include "createrepo/package.h"
+#include "createrepo/parsepkg.h"
+
+#define TEST_PKG                TEST_PACKAGES_PATH"fake_bash-1.1.1-1.x86_64.rpm"
+#define CACHE_XATTR             "user.createrepo.sha256"
+
+#ifdef __linux__
+
+typedef struct {
+    gchar *tmp_dir;
+    gchar *pkg_path;        // Copy of the TEST_PKG
+    gchar *checksum;        // Real checksum of the package
+    gboolean xattrs;        // User xattrs are supported
+} Parsepkgtest;
+
+
+static void
+parsepkgtest_setup(Parsepkgtest *parsepkgtest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    gchar *content;
+    gsize len;
+
+    parsepkgtest->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    mkdtemp(parsepkgtest->tmp_dir);
+    parsepkgtest->pkg_path = g_strconcat(parsepkgtest->tmp_dir,
+                                         "/pkg.rpm", NULL);
+
+    g_assert(g_file_get_contents(TEST_PKG, &content, &len, NULL));
+    g_assert(g_file_set_contents(parsepkgtest->pkg_path, content, len, NULL));
+    g_free(content);
+
+    parsepkgtest->checksum = cr_checksum_file(parsepkgtest->pkg_path,
+                                              CR_CHECKSUM_SHA256, NULL);
+    g_assert(parsepkgtest->checksum);
+
+    parsepkgtest->xattrs = (setxattr(parsepkgtest->pkg_path,
+                                     "user.createrepo.test", "1", 1, 0) == 0);
+    if (!parsepkgtest->xattrs)
+        g_test_message("User extended attributes are not supported (%s), "
+                       "checksum cache tests are skipped", strerror(errno));
+
+    cr_package_parser_init();
+    cr_package_parser_set_checksum_cache(CR_CHECKSUM_CACHE_XATTR);
+}
+
+
+static void
+parsepkgtest_teardown(Parsepkgtest *parsepkgtest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    cr_package_parser_set_checksum_cache(CR_CHECKSUM_CACHE_NONE);
+    cr_package_parser_set_mmap(TRUE);
+    cr_package_parser_cleanup();
+    cr_remove_dir(parsepkgtest->tmp_dir, NULL);
+    g_free(parsepkgtest->tmp_dir);
+    g_free(parsepkgtest->pkg_path);
+    g_free(parsepkgtest->checksum);
+}
+
+
+// Parse the package and return its checksum
+static gchar *
+parse_checksum(Parsepkgtest *parsepkgtest)
+{
+    GError *err = NULL;
+    cr_Package *pkg;
+    gchar *checksum;
+
+    pkg = cr_package_from_rpm(parsepkgtest->pkg_path, CR_CHECKSUM_SHA256,
+                              "pkg.rpm", NULL, 5, NULL, &err);
+    g_assert(!err);
+    g_assert(pkg);
+    checksum = g_strdup(pkg->pkgId);
+    cr_package_free(pkg);
+    return checksum;
+}
+
+
+static gchar *
+get_cache(Parsepkgtest *parsepkgtest)
+{
+    char value[257];
+    ssize_t len;
+
+    len = getxattr(parsepkgtest->pkg_path, CACHE_XATTR, value, 256);
+    if (len < 0)
+        return NULL;
+    value[len] = '\0';
+    return g_strdup(value);
+}
+
+
+// Store a cache entry with the current stat of the package, the stat
+// values could be shifted by the deltas
+static void
+set_cache(Parsepkgtest *parsepkgtest,
+          long long mtime_delta,
+          long long size_delta,
+          long long ino_delta,
+          long long start,
+          long long end,
+          const char *checksum)
+{
+    struct stat st;
+    gchar *value;
+
+    g_assert_cmpint(stat(parsepkgtest->pkg_path, &st), ==, 0);
+    value = g_strdup_printf("1 %lld.%09ld %lld %llu %lld %lld %s",
+                            (long long) st.st_mtim.tv_sec + mtime_delta,
+                            (long) st.st_mtim.tv_nsec,
+                            (long long) st.st_size + size_delta,
+                            (unsigned long long) st.st_ino + ino_delta,
+                            start, end, checksum);
+    g_assert_cmpint(setxattr(parsepkgtest->pkg_path, CACHE_XATTR,
+                             value, strlen(value), 0), ==, 0);
+    g_free(value);
+}
+
+
+static void
+test_checksum_cache_set(Parsepkgtest *parsepkgtest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    gchar *checksum, *cache;
+
+    if (!parsepkgtest->xattrs)
+        return;
+
+    g_assert(!get_cache(parsepkgtest));
+
+    checksum = parse_checksum(parsepkgtest);
+    g_assert_cmpstr(checksum, ==, parsepkgtest->checksum);
+    g_free(checksum);
+
+    // The computed checksum is stored
+    cache = get_cache(parsepkgtest);
+    g_assert(cache);
+    g_assert(g_str_has_prefix(cache, "1 "));
+    g_assert(g_str_has_suffix(cache, parsepkgtest->checksum));
+    g_free(cache);
+}
+
+
+static void
+test_checksum_cache_get(Parsepkgtest *parsepkgtest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    gchar *checksum, *cache, *fake;
+    long long start, end;
+
+    if (!parsepkgtest->xattrs)
+        return;
+
+    // Get the header range stored by the parser
+    g_free(parse_checksum(parsepkgtest));
+    cache = get_cache(parsepkgtest);
+    g_assert(cache);
+    g_assert_cmpint(sscanf(cache, "1 %*s %*s %*s %lld %lld", &start, &end),
+                    ==, 2);
+    g_free(cache);
+
+    // A valid cached checksum is used as it is (without reading the file)
+    fake = g_strnfill(64, 'a');
+    set_cache(parsepkgtest, 0, 0, 0, start, end, fake);
+    checksum = parse_checksum(parsepkgtest);
+    g_assert_cmpstr(checksum, ==, fake);
+    g_free(checksum);
+    g_free(fake);
+}
+
+
+// Cache entries which must not be used
+typedef struct {
+    const char *desc;
+    long long mtime_delta;
+    long long size_delta;
+    long long ino_delta;
+    long long start_delta;
+    long long end_delta;    // Added to the file size if end_from_size
+    gboolean end_from_size;
+    size_t checksum_len;
+} BadCache;
+
+static const BadCache BAD_CACHES[] = {
+    { "mtime",              1, 0, 0, 0,        0,        FALSE, 64 },
+    { "size",               0, 1, 0, 0,        0,        FALSE, 64 },
+    { "inode",              0, 0, 1, 0,        0,        FALSE, 64 },
+    { "header end",         0, 0, 0, 0,        1,        TRUE,  64 },
+    { "header end",         0, 0, 0, 0,        -1000000, FALSE, 64 },
+    { "header start",       0, 0, 0, -1000000, 0,        FALSE, 64 },
+    { "checksum length",    0, 0, 0, 0,        0,        FALSE, 63 },
+    { "checksum length",    0, 0, 0, 0,        0,        FALSE, 128 },
+    { NULL,                 0, 0, 0, 0,        0,        FALSE, 0 },
+};
+
+
+static void
+test_checksum_cache_invalid(Parsepkgtest *parsepkgtest,
+                            gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    struct stat st;
+    gchar *cache;
+    long long start, end;
+
+    if (!parsepkgtest->xattrs)
+        return;
+
+    g_free(parse_checksum(parsepkgtest));
+    cache = get_cache(parsepkgtest);
+    g_assert(cache);
+    g_assert_cmpint(sscanf(cache, "1 %*s %*s %*s %lld %lld", &start, &end),
+                    ==, 2);
+    g_free(cache);
+    g_assert_cmpint(stat(parsepkgtest->pkg_path, &st), ==, 0);
+
+    for (int x = 0; BAD_CACHES[x].desc; x++) {
+        const BadCache *bad = &BAD_CACHES[x];
+        gchar *fake = g_strnfill(bad->checksum_len, 'a');
+        gchar *checksum;
+
+        set_cache(parsepkgtest,
+                  bad->mtime_delta, bad->size_delta, bad->ino_delta,
+                  start + bad->start_delta,
+                  (bad->end_from_size ? st.st_size : end) + bad->end_delta,
+                  fake);
+
+        // The checksum is computed again (and the cache is fixed)
+        g_test_message("Cache entry with bad %s", bad->desc);
+        checksum = parse_checksum(parsepkgtest);
+        g_assert_cmpstr(checksum, ==, parsepkgtest->checksum);
+        g_free(checksum);
+
+        cache = get_cache(parsepkgtest);
+        g_assert(g_str_has_suffix(cache, parsepkgtest->checksum));
+        g_free(cache);
+        g_free(fake);
+    }
+
+    // A changed mtime of the file itself invalidates the cache as well
+    {
+        gchar *fake = g_strnfill(64, 'a');
+        gchar *checksum;
+        struct timespec times[2] = { { 0, UTIME_OMIT }, { 1000, 0 } };
+
+        set_cache(parsepkgtest, 0, 0, 0, start, end, fake);
+        g_assert_cmpint(utimensat(AT_FDCWD, parsepkgtest->pkg_path, times, 0),
+                        ==, 0);
+        checksum = parse_checksum(parsepkgtest);
+        g_assert_cmpstr(checksum, ==, parsepkgtest->checksum);
+        g_free(checksum);
+        g_free(fake);
+    }
+}
+
+
+static void
+test_read_without_mmap(Parsepkgtest *parsepkgtest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    GError *err = NULL;
+    cr_Package *pkg;
+
+    cr_package_parser_set_checksum_cache(CR_CHECKSUM_CACHE_NONE);
+    cr_package_parser_set_mmap(FALSE);
+
+    // The checksum and the header are the same as with the mmaped file
+    pkg = cr_package_from_rpm(parsepkgtest->pkg_path, CR_CHECKSUM_SHA256,
+                              "pkg.rpm", NULL, 5, NULL, &err);
+    g_assert(!err);
+    g_assert(pkg);
+    g_assert_cmpstr(pkg->pkgId, ==, parsepkgtest->checksum);
+    g_assert_cmpstr(pkg->name, ==, "fake_bash");
+    g_assert_cmpint(pkg->rpm_header_start, >, 0);
+    g_assert_cmpint(pkg->rpm_header_end, >, pkg->rpm_header_start);
+    cr_package_free(pkg);
+}
+
+#endif /* __linux__ */
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+#ifdef __linux__    // The checksum cache uses extended attributes
+    g_test_add("/parsepkg/test_checksum_cache_set",
+            Parsepkgtest, NULL, parsepkgtest_setup,
+            test_checksum_cache_set, parsepkgtest_teardown);
+    g_test_add("/parsepkg/test_checksum_cache_get",
+            Parsepkgtest, NULL, parsepkgtest_setup,
+            test_checksum_cache_get, parsepkgtest_teardown);
+    g_test_add("/parsepkg/test_checksum_cache_invalid",
+            Parsepkgtest, NULL, parsepkgtest_setup,
+            test_checksum_cache_invalid, parsepkgtest_teardown);
+    g_test_add("/parsepkg/test_read_without_mmap",
+            Parsepkgtest, NULL, parsepkgtest_setup,
+            test_read_without_mmap, parsepkgtest_teardown);
+#endif
+
+    return g_test_run();
+}
@@ -0,0 +1,314 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/package.h"
+#include "createrepo/pkgcache.h"
+
+#define CACHE_FILE      "cache"
+
+typedef struct {
+    gchar *tmp_dir;
+    gchar *cache_file;
+    cr_Package *pkg;
+    struct stat stat_buf;
+} Pkgcachetest;
+
+
+static cr_Package *
+get_package(void)
+{
+    cr_Package *pkg;
+    cr_Dependency *dep;
+    cr_PackageFile *file;
+    cr_ChangelogEntry *entry;
+
+    pkg = cr_package_new();
+    pkg->pkgId = "123456";
+    pkg->name = "foo";
+    pkg->arch = "x86_64";
+    pkg->version = "1.2.3";
+    pkg->epoch = "0";
+    pkg->release = "2";
+    pkg->summary = "Foo package";
+    pkg->description = "Description of the foo package";
+    pkg->url = "http://foo.bar";
+    pkg->time_file = 1234;
+    pkg->time_build = 4321;
+    pkg->rpm_license = "GPL";
+    pkg->rpm_sourcerpm = "foo-1.2.3-2.src.rpm";
+    pkg->rpm_header_start = 280;
+    pkg->rpm_header_end = 2000;
+    pkg->size_package = 4000;
+    pkg->size_installed = 8000;
+    pkg->size_archive = 9000;
+    pkg->location_href = "packages/foo-1.2.3-2.x86_64.rpm";
+    pkg->checksum_type = "sha256";
+
+    dep = cr_dependency_new();
+    dep->name = "bar";
+    dep->flags = "GE";
+    dep->version = "1.0";
+    dep->pre = 1;
+    pkg->requires = g_slist_prepend(pkg->requires, dep);
+
+    dep = cr_dependency_new();
+    dep->name = "foo";
+    pkg->provides = g_slist_prepend(pkg->provides, dep);
+
+    file = cr_package_file_new();
+    file->type = "dir";
+    file->path = "/usr/share/";
+    file->name = "foo";
+    pkg->files = g_slist_prepend(pkg->files, file);
+
+    file = cr_package_file_new();
+    file->path = "/usr/bin/";
+    file->name = "foo";
+    pkg->files = g_slist_prepend(pkg->files, file);
+
+    entry = cr_changelog_entry_new();
+    entry->author = "Foo Bar <foo@bar.org> - 1.2.3-2";
+    entry->date = 1234567;
+    entry->changelog = "- Rebuild";
+    pkg->changelogs = g_slist_prepend(pkg->changelogs, entry);
+
+    return pkg;
+}
+
+
+static void
+pkgcachetest_setup(Pkgcachetest *pkgcachetest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    pkgcachetest->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    mkdtemp(pkgcachetest->tmp_dir);
+    pkgcachetest->cache_file = g_strconcat(pkgcachetest->tmp_dir, "/",
+                                           CACHE_FILE, NULL);
+    pkgcachetest->pkg = get_package();
+    memset(&pkgcachetest->stat_buf, 0, sizeof(struct stat));
+    pkgcachetest->stat_buf.st_size = 4000;
+    pkgcachetest->stat_buf.st_mtime = 1234;
+    pkgcachetest->stat_buf.st_ino = 42;
+}
+
+
+static void
+pkgcachetest_teardown(Pkgcachetest *pkgcachetest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    remove(pkgcachetest->cache_file);
+    rmdir(pkgcachetest->tmp_dir);
+    g_free(pkgcachetest->tmp_dir);
+    g_free(pkgcachetest->cache_file);
+    cr_package_free(pkgcachetest->pkg);
+}
+
+
+static void
+write_cache(Pkgcachetest *pkgcachetest)
+{
+    int ret;
+    GError *tmp_err = NULL;
+    cr_PkgCacheWriter *writer;
+
+    writer = cr_pkgcache_writer_new(pkgcachetest->cache_file,
+                                    CR_CHECKSUM_SHA256, 10, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(writer);
+
+    ret = cr_pkgcache_writer_add(writer, pkgcachetest->pkg,
+                                 &pkgcachetest->stat_buf, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+
+    ret = cr_pkgcache_writer_close(writer, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+}
+
+
+static void
+test_cr_pkgcache_write_and_read(Pkgcachetest *pkgcachetest,
+                                gconstpointer test_data)
+{
+    GError *tmp_err = NULL;
+    cr_PkgCache *cache;
+    cr_Package *pkg;
+    cr_Dependency *dep;
+    cr_PackageFile *file;
+    cr_ChangelogEntry *entry;
+
+    CR_UNUSED(test_data);
+
+    write_cache(pkgcachetest);
+
+    cache = cr_pkgcache_open(pkgcachetest->cache_file, CR_CHECKSUM_SHA256,
+                             10, &tmp_err);
+    g_assert(!tmp_err);
+    g_assert(cache);
+    g_assert_cmpint(cr_pkgcache_size(cache), ==, 1);
+
+    pkg = cr_pkgcache_get(cache, "packages/foo-1.2.3-2.x86_64.rpm",
+                          &pkgcachetest->stat_buf);
+    g_assert(pkg);
+    g_assert_cmpstr(pkg->pkgId, ==, "123456");
+    g_assert_cmpstr(pkg->name, ==, "foo");
+    g_assert_cmpstr(pkg->arch, ==, "x86_64");
+    g_assert_cmpstr(pkg->version, ==, "1.2.3");
+    g_assert_cmpstr(pkg->epoch, ==, "0");
+    g_assert_cmpstr(pkg->release, ==, "2");
+    g_assert_cmpstr(pkg->summary, ==, "Foo package");
+    g_assert_cmpstr(pkg->url, ==, "http://foo.bar");
+    g_assert_cmpstr(pkg->rpm_vendor, ==, NULL);
+    g_assert_cmpstr(pkg->rpm_sourcerpm, ==, "foo-1.2.3-2.src.rpm");
+    g_assert_cmpstr(pkg->location_href, ==, "packages/foo-1.2.3-2.x86_64.rpm");
+    g_assert_cmpstr(pkg->checksum_type, ==, "sha256");
+    g_assert_cmpint(pkg->time_file, ==, 1234);
+    g_assert_cmpint(pkg->time_build, ==, 4321);
+    g_assert_cmpint(pkg->rpm_header_start, ==, 280);
+    g_assert_cmpint(pkg->rpm_header_end, ==, 2000);
+    g_assert_cmpint(pkg->size_package, ==, 4000);
+    g_assert_cmpint(pkg->size_installed, ==, 8000);
+    g_assert_cmpint(pkg->size_archive, ==, 9000);
+
+    g_assert_cmpint(g_slist_length(pkg->requires), ==, 1);
+    dep = pkg->requires->data;
+    g_assert_cmpstr(dep->name, ==, "bar");
+    g_assert_cmpstr(dep->flags, ==, "GE");
+    g_assert_cmpstr(dep->epoch, ==, NULL);
+    g_assert_cmpstr(dep->version, ==, "1.0");
+    g_assert_cmpint(dep->pre, ==, 1);
+    g_assert_cmpint(g_slist_length(pkg->provides), ==, 1);
+    g_assert_cmpint(g_slist_length(pkg->conflicts), ==, 0);
+    g_assert_cmpint(g_slist_length(pkg->obsoletes), ==, 0);
+
+    g_assert_cmpint(g_slist_length(pkg->files), ==, 2);
+    file = pkg->files->data;
+    g_assert_cmpstr(file->type, ==, NULL);
+    g_assert_cmpstr(file->path, ==, "/usr/bin/");
+    g_assert_cmpstr(file->name, ==, "foo");
+    file = pkg->files->next->data;
+    g_assert_cmpstr(file->type, ==, "dir");
+    g_assert_cmpstr(file->path, ==, "/usr/share/");
+
+    g_assert_cmpint(g_slist_length(pkg->changelogs), ==, 1);
+    entry = pkg->changelogs->data;
+    g_assert_cmpstr(entry->author, ==, "Foo Bar <foo@bar.org> - 1.2.3-2");
+    g_assert_cmpint(entry->date, ==, 1234567);
+    g_assert_cmpstr(entry->changelog, ==, "- Rebuild");
+
+    cr_package_free(pkg);
+
+    // Unknown package
+    pkg = cr_pkgcache_get(cache, "packages/bar.rpm", &pkgcachetest->stat_buf);
+    g_assert(!pkg);
+
+    cr_pkgcache_close(cache);
+}
+
+
+static void
+test_cr_pkgcache_changed_file(Pkgcachetest *pkgcachetest,
+                              gconstpointer test_data)
+{
+    cr_PkgCache *cache;
+    cr_Package *pkg;
+
+    CR_UNUSED(test_data);
+
+    write_cache(pkgcachetest);
+
+    cache = cr_pkgcache_open(pkgcachetest->cache_file, CR_CHECKSUM_SHA256,
+                             10, NULL);
+    g_assert(cache);
+
+    pkgcachetest->stat_buf.st_mtime = 1235;
+    pkg = cr_pkgcache_get(cache, "packages/foo-1.2.3-2.x86_64.rpm",
+                          &pkgcachetest->stat_buf);
+    g_assert(!pkg);
+
+    pkgcachetest->stat_buf.st_mtime = 1234;
+    pkgcachetest->stat_buf.st_size = 4001;
+    pkg = cr_pkgcache_get(cache, "packages/foo-1.2.3-2.x86_64.rpm",
+                          &pkgcachetest->stat_buf);
+    g_assert(!pkg);
+
+    cr_pkgcache_close(cache);
+}
+
+
+static void
+test_cr_pkgcache_incompatible(Pkgcachetest *pkgcachetest,
+                              gconstpointer test_data)
+{
+    cr_PkgCache *cache;
+
+    CR_UNUSED(test_data);
+
+    write_cache(pkgcachetest);
+
+    cache = cr_pkgcache_open(pkgcachetest->cache_file, CR_CHECKSUM_SHA1,
+                             10, NULL);
+    g_assert(!cache);
+
+    cache = cr_pkgcache_open(pkgcachetest->cache_file, CR_CHECKSUM_SHA256,
+                             5, NULL);
+    g_assert(!cache);
+}
+
+
+static void
+test_cr_pkgcache_open_nonexistent(void)
+{
+    cr_PkgCache *cache;
+
+    cache = cr_pkgcache_open(NON_EXIST_FILE, CR_CHECKSUM_SHA256, 10, NULL);
+    g_assert(!cache);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_thread_init(NULL);
+
+    g_test_add("/pkgcache/test_cr_pkgcache_write_and_read",
+            Pkgcachetest, NULL, pkgcachetest_setup,
+            test_cr_pkgcache_write_and_read, pkgcachetest_teardown);
+    g_test_add("/pkgcache/test_cr_pkgcache_changed_file",
+            Pkgcachetest, NULL, pkgcachetest_setup,
+            test_cr_pkgcache_changed_file, pkgcachetest_teardown);
+    g_test_add("/pkgcache/test_cr_pkgcache_incompatible",
+            Pkgcachetest, NULL, pkgcachetest_setup,
+            test_cr_pkgcache_incompatible, pkgcachetest_teardown);
+    g_test_add_func("/pkgcache/test_cr_pkgcache_open_nonexistent",
+            test_cr_pkgcache_open_nonexistent);
+
+    return g_test_run();
+}
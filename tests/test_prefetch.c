@@ -0,0 +1,188 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/prefetch.h"
+
+#define FILES           32
+#define FILE_SIZE       (64*1024)
+#define MISSING_FILE    5               // Index of a removed file
+
+typedef struct {
+    gchar *tmp_dir;
+    gchar *paths[FILES];
+} Prefetchtest;
+
+
+static void
+prefetchtest_setup(Prefetchtest *test, gconstpointer test_data)
+{
+    gchar *content = g_malloc0(FILE_SIZE);
+
+    CR_UNUSED(test_data);
+    test->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    mkdtemp(test->tmp_dir);
+
+    for (int x = 0; x < FILES; x++) {
+        test->paths[x] = g_strdup_printf("%s/file_%02d", test->tmp_dir, x);
+        if (x != MISSING_FILE)
+            g_assert(g_file_set_contents(test->paths[x], content,
+                                         FILE_SIZE, NULL));
+    }
+
+    g_free(content);
+}
+
+
+static void
+prefetchtest_teardown(Prefetchtest *test, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    for (int x = 0; x < FILES; x++)
+        g_free(test->paths[x]);
+    cr_remove_dir(test->tmp_dir, NULL);
+    g_free(test->tmp_dir);
+}
+
+
+static void
+consume_all(Prefetchtest *test, guint window, gsize memory, gboolean drop)
+{
+    GError *tmp_err = NULL;
+    cr_Prefetcher *prefetcher;
+
+    prefetcher = cr_prefetcher_new(window, memory, drop, &tmp_err);
+    g_assert(prefetcher);
+    g_assert(!tmp_err);
+
+    for (long x = 0; x < FILES; x++)
+        g_assert_cmpint(cr_prefetcher_add(prefetcher, test->paths[x]), ==, x);
+    cr_prefetcher_finish(prefetcher);
+
+    // Every fourth file is skipped (e.g. found in a cache)
+    for (long x = 0; x < FILES; x++) {
+        if (x % 4 == 0)
+            cr_prefetcher_skip(prefetcher, x);
+        else
+            cr_prefetcher_done(prefetcher, x);
+    }
+
+    // Files must stay untouched
+    for (long x = 0; x < FILES; x++) {
+        gchar *content;
+        gsize size;
+
+        if (x == MISSING_FILE) {
+            g_assert(!g_file_test(test->paths[x], G_FILE_TEST_EXISTS));
+            continue;
+        }
+        g_assert(g_file_get_contents(test->paths[x], &content, &size, NULL));
+        g_assert_cmpint(size, ==, FILE_SIZE);
+        g_free(content);
+    }
+
+    cr_prefetcher_free(prefetcher);
+}
+
+
+static void
+test_cr_prefetcher_window(Prefetchtest *test, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    consume_all(test, 1, 0, FALSE);
+    consume_all(test, 8, 0, FALSE);
+    consume_all(test, 64, 0, TRUE);
+}
+
+
+static void
+test_cr_prefetcher_memory(Prefetchtest *test, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    // Only a few files fit into the memory limit
+    consume_all(test, 64, 3 * FILE_SIZE, TRUE);
+    // No file fits, but the prefetcher never stalls completely
+    consume_all(test, 64, 1, FALSE);
+}
+
+
+static void
+test_cr_prefetcher_drop_only(Prefetchtest *test, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    // Without the thread, files are only dropped from the page cache
+    consume_all(test, 0, 0, TRUE);
+    consume_all(test, 0, 0, FALSE);
+}
+
+
+static void
+test_cr_prefetcher_free_unconsumed(Prefetchtest *test,
+                                   gconstpointer test_data)
+{
+    cr_Prefetcher *prefetcher;
+
+    CR_UNUSED(test_data);
+
+    // Files which were prefetched but never consumed are closed
+    // together with the prefetcher
+    prefetcher = cr_prefetcher_new(16, 0, TRUE, NULL);
+    g_assert(prefetcher);
+    for (long x = 0; x < FILES; x++)
+        cr_prefetcher_add(prefetcher, test->paths[x]);
+    g_usleep(G_USEC_PER_SEC / 100);
+    cr_prefetcher_done(prefetcher, 0);
+    cr_prefetcher_free(prefetcher);
+
+    // Prefetcher without files
+    prefetcher = cr_prefetcher_new(16, 0, FALSE, NULL);
+    g_assert(prefetcher);
+    cr_prefetcher_finish(prefetcher);
+    cr_prefetcher_free(prefetcher);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_thread_init(NULL);
+
+    g_test_add("/prefetch/test_cr_prefetcher_window",
+            Prefetchtest, NULL, prefetchtest_setup,
+            test_cr_prefetcher_window, prefetchtest_teardown);
+    g_test_add("/prefetch/test_cr_prefetcher_memory",
+            Prefetchtest, NULL, prefetchtest_setup,
+            test_cr_prefetcher_memory, prefetchtest_teardown);
+    g_test_add("/prefetch/test_cr_prefetcher_drop_only",
+            Prefetchtest, NULL, prefetchtest_setup,
+            test_cr_prefetcher_drop_only, prefetchtest_teardown);
+    g_test_add("/prefetch/test_cr_prefetcher_free_unconsumed",
+            Prefetchtest, NULL, prefetchtest_setup,
+            test_cr_prefetcher_free_unconsumed, prefetchtest_teardown);
+
+    return g_test_run();
+}
@@ -0,0 +1,286 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/readengine.h"
+
+#define FILES           48
+#define MEMORY_LIMIT    (1024*1024)     // Files over 256 KiB are not read
+#define MISSING_FILE    7               // Index of a removed file
+#define EMPTY_FILE      11              // Index of an empty file
+#define LARGE_FILE      13              // Index of a file over the limit
+
+typedef struct {
+    gchar *tmp_dir;
+    gchar *paths[FILES];
+} Readenginetest;
+
+
+static gsize
+file_size(int x)
+{
+    if (x == EMPTY_FILE)
+        return 0;
+    if (x == LARGE_FILE)
+        return MEMORY_LIMIT / 2;
+    return (x * 77731) % (MEMORY_LIMIT / 4) + 1;
+}
+
+
+static void
+readenginetest_setup(Readenginetest *test, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    test->tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    mkdtemp(test->tmp_dir);
+
+    for (int x = 0; x < FILES; x++) {
+        gsize size = file_size(x);
+        gchar *content = g_malloc(size + 1);
+
+        for (gsize y = 0; y < size; y++)
+            content[y] = (gchar) (x + y * 31);
+
+        test->paths[x] = g_strdup_printf("%s/file_%02d", test->tmp_dir, x);
+        if (x != MISSING_FILE)
+            g_assert(g_file_set_contents(test->paths[x], content, size, NULL));
+        g_free(content);
+    }
+}
+
+
+static void
+readenginetest_teardown(Readenginetest *test, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    for (int x = 0; x < FILES; x++)
+        g_free(test->paths[x]);
+    cr_remove_dir(test->tmp_dir, NULL);
+    g_free(test->tmp_dir);
+}
+
+
+static void
+check_buffer(Readenginetest *test, cr_ReadBuffer *buf, long id)
+{
+    gchar *content;
+    gsize size;
+
+    g_assert(buf);
+    g_assert_cmpint(buf->id, ==, id);
+    g_assert_cmpstr(buf->filename, ==, test->paths[id]);
+    g_assert_cmpint(buf->fd, >=, 0);
+    g_assert_cmpint((gsize) buf->stat.st_size, ==, buf->size);
+    g_assert(g_file_get_contents(test->paths[id], &content, &size, NULL));
+    g_assert_cmpint(buf->size, ==, size);
+    g_assert(!memcmp(buf->data, content, size));
+    g_free(content);
+}
+
+
+static void
+read_all(Readenginetest *test, cr_ReadEngineBackend backend, int depth)
+{
+    GError *tmp_err = NULL;
+    cr_ReadEngine *engine;
+    int read_ahead = 0;
+
+    engine = cr_readengine_new(backend, depth, MEMORY_LIMIT, &tmp_err);
+    g_assert(engine);
+    g_assert(!tmp_err);
+
+    for (long x = 0; x < FILES; x++)
+        g_assert_cmpint(cr_readengine_add(engine, test->paths[x]), ==, x);
+    cr_readengine_finish(engine);
+
+    // Give the engine some time to read the files ahead
+    g_usleep(G_USEC_PER_SEC / 10);
+
+    // Files which cannot be read ahead are left to the consumer
+    for (long x = 0; x < FILES; x++) {
+        cr_ReadBuffer *buf = cr_readengine_get(engine, x);
+        if (x == MISSING_FILE || x == EMPTY_FILE || x == LARGE_FILE) {
+            g_assert(!buf);
+            continue;
+        }
+        // Other files could be left to the consumer only if the
+        // engine didn't start to read them yet
+        if (buf) {
+            check_buffer(test, buf, x);
+            read_ahead++;
+        }
+        cr_readengine_release(engine, buf);
+    }
+
+    g_assert_cmpint(read_ahead, >, 0);
+    cr_readengine_free(engine);
+}
+
+
+static void
+test_cr_readengine_pread(Readenginetest *test, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    read_all(test, CR_READENGINE_PREAD, 0);
+    read_all(test, CR_READENGINE_PREAD, 1);
+}
+
+
+static void
+test_cr_readengine_io_uring(Readenginetest *test, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    // Falls back to pread if io_uring is not available
+    read_all(test, CR_READENGINE_IO_URING, 0);
+    read_all(test, CR_READENGINE_IO_URING, 2);
+}
+
+
+typedef struct {
+    Readenginetest *test;
+    cr_ReadEngine *engine;
+    GMutex *mutex;
+    long next;
+} Consumers;
+
+
+static gpointer
+consumer_thread(gpointer data)
+{
+    Consumers *consumers = data;
+
+    while (1) {
+        long id;
+
+        g_mutex_lock(consumers->mutex);
+        id = consumers->next++;
+        g_mutex_unlock(consumers->mutex);
+        if (id >= FILES)
+            break;
+
+        // Every third file is skipped (e.g. found in a cache)
+        if (id % 3 == 0) {
+            cr_readengine_skip(consumers->engine, id);
+            continue;
+        }
+
+        cr_ReadBuffer *buf = cr_readengine_get(consumers->engine, id);
+        if (buf)
+            check_buffer(consumers->test, buf, id);
+        cr_readengine_release(consumers->engine, buf);
+    }
+
+    return NULL;
+}
+
+
+static void
+test_cr_readengine_consumers(Readenginetest *test, gconstpointer test_data)
+{
+    cr_ReadEngineBackend backends[] = { CR_READENGINE_PREAD,
+                                        CR_READENGINE_AUTO };
+
+    CR_UNUSED(test_data);
+
+    for (int b = 0; b < 2; b++) {
+        for (int threads = 1; threads <= 4; threads++) {
+            Consumers consumers;
+            GThread *thread_list[4];
+
+            // Small memory limit - the engine waits for the consumers
+            consumers.test = test;
+            consumers.engine = cr_readengine_new(backends[b], 4,
+                                                 MEMORY_LIMIT, NULL);
+            consumers.mutex = g_mutex_new();
+            consumers.next = 0;
+            g_assert(consumers.engine);
+
+            for (long x = 0; x < FILES; x++)
+                cr_readengine_add(consumers.engine, test->paths[x]);
+
+            for (int x = 0; x < threads; x++)
+                thread_list[x] = g_thread_create(consumer_thread, &consumers,
+                                                 TRUE, NULL);
+
+            cr_readengine_finish(consumers.engine);
+
+            for (int x = 0; x < threads; x++)
+                g_thread_join(thread_list[x]);
+
+            cr_readengine_free(consumers.engine);
+            g_mutex_free(consumers.mutex);
+        }
+    }
+}
+
+
+static void
+test_cr_readengine_free_unconsumed(Readenginetest *test,
+                                   gconstpointer test_data)
+{
+    cr_ReadEngine *engine;
+
+    CR_UNUSED(test_data);
+
+    // Files which were read (or are being read) but never consumed
+    // are freed together with the engine
+    engine = cr_readengine_new(CR_READENGINE_AUTO, 0, MEMORY_LIMIT, NULL);
+    g_assert(engine);
+    for (long x = 0; x < FILES; x++)
+        cr_readengine_add(engine, test->paths[x]);
+    cr_readengine_free(engine);
+
+    // Engine without files
+    engine = cr_readengine_new(CR_READENGINE_PREAD, 0, 0, NULL);
+    g_assert(engine);
+    g_assert(cr_readengine_backend_name(engine));
+    cr_readengine_finish(engine);
+    cr_readengine_free(engine);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_thread_init(NULL);
+
+    g_test_add("/readengine/test_cr_readengine_pread",
+            Readenginetest, NULL, readenginetest_setup,
+            test_cr_readengine_pread, readenginetest_teardown);
+    g_test_add("/readengine/test_cr_readengine_io_uring",
+            Readenginetest, NULL, readenginetest_setup,
+            test_cr_readengine_io_uring, readenginetest_teardown);
+    g_test_add("/readengine/test_cr_readengine_consumers",
+            Readenginetest, NULL, readenginetest_setup,
+            test_cr_readengine_consumers, readenginetest_teardown);
+    g_test_add("/readengine/test_cr_readengine_free_unconsumed",
+            Readenginetest, NULL, readenginetest_setup,
+            test_cr_readengine_free_unconsumed, readenginetest_teardown);
+
+    return g_test_run();
+}
@@ -0,0 +1,239 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/repowatch.h"
+
+typedef struct {
+    gchar *tmp_dir;     // Watched dir (with trailing '/')
+} Repowatchtest;
+
+
+static void
+repowatchtest_setup(Repowatchtest *repowatchtest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    gchar *tmp_dir = g_strdup(TMPDIR_TEMPLATE);
+    mkdtemp(tmp_dir);
+    repowatchtest->tmp_dir = g_strconcat(tmp_dir, "/", NULL);
+    g_free(tmp_dir);
+}
+
+
+static void
+repowatchtest_teardown(Repowatchtest *repowatchtest, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+    cr_remove_dir(repowatchtest->tmp_dir, NULL);
+    g_free(repowatchtest->tmp_dir);
+}
+
+
+static void
+write_file(Repowatchtest *repowatchtest, const char *name)
+{
+    gchar *path = g_strconcat(repowatchtest->tmp_dir, name, NULL);
+    g_assert(g_file_set_contents(path, "x", -1, NULL));
+    g_free(path);
+}
+
+
+static void
+make_dir(Repowatchtest *repowatchtest, const char *name)
+{
+    gchar *path = g_strconcat(repowatchtest->tmp_dir, name, NULL);
+    g_assert_cmpint(mkdir(path, 0755), ==, 0);
+    g_free(path);
+}
+
+
+static void
+make_symlink(Repowatchtest *repowatchtest, const char *target,
+             const char *name)
+{
+    gchar *path = g_strconcat(repowatchtest->tmp_dir, name, NULL);
+    g_assert_cmpint(symlink(target, path), ==, 0);
+    g_free(path);
+}
+
+
+static void
+remove_file(Repowatchtest *repowatchtest, const char *name)
+{
+    gchar *path = g_strconcat(repowatchtest->tmp_dir, name, NULL);
+    g_assert_cmpint(unlink(path), ==, 0);
+    g_free(path);
+}
+
+
+static void
+remove_dir(Repowatchtest *repowatchtest, const char *name)
+{
+    gchar *path = g_strconcat(repowatchtest->tmp_dir, name, NULL);
+    g_assert_cmpint(rmdir(path), ==, 0);
+    g_free(path);
+}
+
+
+// Sorted list joined by spaces (e.g. "a.rpm sub/b.rpm")
+static gchar *
+list_str(GSList *list)
+{
+    GString *str = g_string_new(NULL);
+
+    list = g_slist_sort(list, (GCompareFunc) strcmp);
+    for (GSList *elem = list; elem; elem = g_slist_next(elem)) {
+        if (str->len)
+            g_string_append_c(str, ' ');
+        g_string_append(str, elem->data);
+    }
+    cr_slist_free_full(list, g_free);
+
+    return g_string_free(str, FALSE);
+}
+
+
+// All events are already queued, so with zero delay the changes are
+// returned right after the queued events are read
+static void
+check_wait(struct RepoWatch *watch,
+           const char *exp_changed,
+           const char *exp_removed)
+{
+    GSList *changed = NULL, *removed = NULL;
+    GError *err = NULL;
+    gchar *str;
+
+    g_assert(repowatch_wait(watch, 0, &changed, &removed, &err));
+    g_assert(!err);
+
+    str = list_str(changed);
+    g_assert_cmpstr(str, ==, exp_changed);
+    g_free(str);
+    str = list_str(removed);
+    g_assert_cmpstr(str, ==, exp_removed);
+    g_free(str);
+}
+
+
+static void
+test_repowatch_changes(Repowatchtest *repowatchtest, gconstpointer test_data)
+{
+    struct RepoWatch *watch;
+    GError *err = NULL;
+
+    CR_UNUSED(test_data);
+
+    write_file(repowatchtest, "old.rpm");
+    write_file(repowatchtest, "kept.rpm");
+    make_dir(repowatchtest, "repodata");
+
+    watch = repowatch_new(repowatchtest->tmp_dir, ".rpm", FALSE, &err);
+    g_assert(watch);
+    g_assert(!err);
+
+    // A file written several times is reported once, a file added and
+    // removed again is not reported at all, only known files are
+    // reported as removed
+    write_file(repowatchtest, "new.rpm");
+    write_file(repowatchtest, "new.rpm");
+    write_file(repowatchtest, "new.rpm");
+    write_file(repowatchtest, "tmp.rpm");
+    remove_file(repowatchtest, "tmp.rpm");
+    remove_file(repowatchtest, "old.rpm");
+    write_file(repowatchtest, "readme.txt");
+    write_file(repowatchtest, "repodata/ignored.rpm");
+
+    check_wait(watch, "new.rpm", "old.rpm");
+
+    // Files of new subdirectories are reported with their path
+    make_dir(repowatchtest, "sub");
+    write_file(repowatchtest, "sub/a.rpm");
+    write_file(repowatchtest, "kept.rpm");
+
+    check_wait(watch, "kept.rpm sub/a.rpm", "");
+
+    // A removed directory removes its files, a file modified and then
+    // removed is reported only as removed
+    write_file(repowatchtest, "new.rpm");
+    remove_file(repowatchtest, "new.rpm");
+    remove_file(repowatchtest, "sub/a.rpm");
+    remove_dir(repowatchtest, "sub");
+
+    check_wait(watch, "", "new.rpm sub/a.rpm");
+
+    repowatch_free(watch);
+}
+
+
+static void
+test_repowatch_symlinks(Repowatchtest *repowatchtest, gconstpointer test_data)
+{
+    gboolean skip_symlinks = GPOINTER_TO_INT(test_data);
+    struct RepoWatch *watch;
+    GError *err = NULL;
+
+    write_file(repowatchtest, "real.rpm");
+    make_symlink(repowatchtest, "real.rpm", "old-link.rpm");
+
+    watch = repowatch_new(repowatchtest->tmp_dir, ".rpm", skip_symlinks,
+                          &err);
+    g_assert(watch);
+    g_assert(!err);
+
+    make_symlink(repowatchtest, "real.rpm", "new-link.rpm");
+    remove_file(repowatchtest, "old-link.rpm");
+    write_file(repowatchtest, "other.rpm");
+
+    if (skip_symlinks)
+        check_wait(watch, "other.rpm", "");
+    else
+        check_wait(watch, "new-link.rpm other.rpm", "old-link.rpm");
+
+    repowatch_free(watch);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+#ifdef __linux__    // inotify is needed
+    g_test_add("/repowatch/test_repowatch_changes",
+            Repowatchtest, NULL, repowatchtest_setup,
+            test_repowatch_changes, repowatchtest_teardown);
+    g_test_add("/repowatch/test_repowatch_symlinks",
+            Repowatchtest, GINT_TO_POINTER(FALSE), repowatchtest_setup,
+            test_repowatch_symlinks, repowatchtest_teardown);
+    g_test_add("/repowatch/test_repowatch_skip_symlinks",
+            Repowatchtest, GINT_TO_POINTER(TRUE), repowatchtest_setup,
+            test_repowatch_symlinks, repowatchtest_teardown);
+#endif
+
+    return g_test_run();
+}
@@ -27,6 +27,9 @@
 #include "createrepo/misc.h"
 #include "createrepo/package.h"
 #include "createrepo/sqlite.h"
+#include "createrepo/error.h"
+#include "createrepo/checksum.h"
+#include "createrepo/compression_wrapper.h"
 #include "createrepo/parsepkg.h"
 #include "createrepo/constants.h"
 
@@ -38,6 +41,8 @@
 #define EMPTY_PKG               TEST_PACKAGES_PATH"empty-0-0.x86_64.rpm"
 #define EMPTY_PKG_SRC           TEST_PACKAGES_PATH"empty-0-0.src.rpm"
 
+#define PERF_PACKAGES           20000
+
 
 typedef struct {
     gchar *tmp_dir;
@@ -351,6 +356,377 @@ test_all(TestData *testdata, gconstpointer test_data)
 
 
 
+// Decompress the file into a db file and check its content
+static void
+check_compressed_db(const char *path,
+                    cr_CompressionType comtype,
+                    const char *db_path,
+                    cr_ContentStat *stat)
+{
+    GError *err = NULL;
+    CR_FILE *f;
+    FILE *out;
+    char buf[4096];
+    int len;
+    gint64 size = 0;
+    gchar *checksum;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+
+    // Stats of the compressed file
+
+    checksum = cr_checksum_file(path, CR_CHECKSUM_SHA256, &err);
+    g_assert(!err);
+    g_assert_cmpstr(stat->compressed_checksum, ==, checksum);
+    g_free(checksum);
+
+    // Decompress
+
+    f = cr_sopen(path, CR_CW_MODE_READ, comtype, NULL, &err);
+    g_assert(f);
+    g_assert(!err);
+    out = fopen(db_path, "wb");
+    g_assert(out);
+    while ((len = cr_read(f, buf, sizeof(buf), &err)) > 0) {
+        g_assert_cmpint(fwrite(buf, 1, len, out), ==, len);
+        size += len;
+    }
+    g_assert(!err);
+    fclose(out);
+    cr_close(f, NULL);
+
+    // Stats of the db
+
+    g_assert_cmpint(stat->size, ==, size);
+    checksum = cr_checksum_file(db_path, CR_CHECKSUM_SHA256, &err);
+    g_assert(!err);
+    g_assert_cmpstr(stat->checksum, ==, checksum);
+    g_free(checksum);
+
+    // Content of the db
+
+    g_assert_cmpint(sqlite3_open(db_path, &db), ==, SQLITE_OK);
+    g_assert_cmpint(sqlite3_prepare_v2(db,
+                        "SELECT name FROM packages", -1, &stmt, NULL),
+                    ==, SQLITE_OK);
+    g_assert_cmpint(sqlite3_step(stmt), ==, SQLITE_ROW);
+    g_assert_cmpstr((const char *) sqlite3_column_text(stmt, 0), ==, "foo");
+    g_assert_cmpint(sqlite3_step(stmt), ==, SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    g_assert_cmpint(sqlite3_prepare_v2(db,
+                        "SELECT checksum FROM db_info", -1, &stmt, NULL),
+                    ==, SQLITE_OK);
+    g_assert_cmpint(sqlite3_step(stmt), ==, SQLITE_ROW);
+    g_assert_cmpstr((const char *) sqlite3_column_text(stmt, 0), ==,
+                    "foochecksum");
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+}
+
+
+static void
+test_cr_db_close_compressed(TestData *testdata, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+
+    cr_CompressionType types[] = { CR_CW_NO_COMPRESSION,
+                                   CR_CW_GZ_COMPRESSION,
+                                   CR_CW_BZ2_COMPRESSION };
+
+    for (int x = 0; x < 3; x++) {
+        GError *err = NULL;
+        gchar *path, *db_path, *file_db_path;
+        cr_SqliteDb *db;
+        cr_Package *pkg;
+        cr_ContentStat *stat;
+
+        path = g_strconcat(testdata->tmp_dir, "/", TMP_PRIMARY_NAME,
+                           cr_compression_suffix(types[x]), NULL);
+        db_path = g_strconcat(testdata->tmp_dir, "/decompressed.sqlite", NULL);
+        file_db_path = g_strconcat(testdata->tmp_dir, "/", TMP_PRIMARY_NAME,
+                                   NULL);
+
+        // In-memory db, nothing is written until it is closed
+
+        db = cr_db_open_in_memory(CR_DB_PRIMARY, &err);
+        g_assert(db);
+        g_assert(!err);
+#ifdef SQLITE_FCNTL_SIZE_LIMIT
+        {
+            // The memdb may grow over its default limit (1 GiB)
+            sqlite3_int64 limit = -1;
+            if (sqlite3_file_control(db->db, "main", SQLITE_FCNTL_SIZE_LIMIT,
+                                     &limit) == SQLITE_OK)
+                g_assert_cmpint(limit, >, 1024*1024*1024);
+        }
+#endif
+        pkg = get_package();
+        cr_db_add_pkg(db, pkg, &err);
+        g_assert(!err);
+        cr_db_dbinfo_update(db, "foochecksum", &err);
+        g_assert(!err);
+        g_assert(!g_file_test(path, G_FILE_TEST_EXISTS));
+
+        stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+        stat->compressed_checksum_type = CR_CHECKSUM_SHA256;
+        g_assert_cmpint(cr_db_close_compressed(db, path, types[x], stat, &err),
+                        ==, CRE_OK);
+        g_assert(!err);
+        check_compressed_db(path, types[x], db_path, stat);
+        cr_contentstat_free(stat, NULL);
+        remove(path);
+        remove(db_path);
+
+        // Db file, the file is kept
+
+        db = cr_db_open_primary(file_db_path, &err);
+        g_assert(db);
+        g_assert(!err);
+        cr_db_add_pkg(db, pkg, &err);
+        g_assert(!err);
+        cr_db_dbinfo_update(db, "foochecksum", &err);
+        g_assert(!err);
+
+        stat = cr_contentstat_new(CR_CHECKSUM_SHA256, NULL);
+        stat->compressed_checksum_type = CR_CHECKSUM_SHA256;
+        cr_db_close_compressed(db, path, types[x], stat, &err);
+        g_assert(!err);
+        g_assert(g_file_test(file_db_path, G_FILE_TEST_EXISTS));
+        check_compressed_db(path, types[x], db_path, stat);
+        cr_contentstat_free(stat, NULL);
+        remove(path);
+        remove(db_path);
+        remove(file_db_path);
+
+        // Indexing fails, the db is closed anyway
+
+        db = cr_db_open_in_memory(CR_DB_PRIMARY, &err);
+        g_assert(db);
+        g_assert(!err);
+        g_assert_cmpint(sqlite3_exec(db->db, "DROP TABLE packages",
+                                     NULL, NULL, NULL), ==, SQLITE_OK);
+        g_assert_cmpint(cr_db_close_compressed(db, path, types[x], NULL, &err),
+                        !=, CRE_OK);
+        g_assert(err);
+        g_clear_error(&err);
+        g_assert(!g_file_test(path, G_FILE_TEST_EXISTS));
+
+        cr_package_free(pkg);
+        g_free(path);
+        g_free(db_path);
+        g_free(file_db_path);
+    }
+}
+
+
+
+// Package with the given number of provides, requires, files
+// and changelogs (each of them is a separate row in the database)
+static cr_Package *
+get_package_with_rows(int rows)
+{
+    cr_Package *p = get_package();
+
+    g_slist_foreach(p->requires, (GFunc) g_free, NULL);
+    g_slist_free(p->requires);
+    g_slist_foreach(p->files, (GFunc) g_free, NULL);
+    g_slist_free(p->files);
+    p->requires = NULL;
+    p->files = NULL;
+
+    for (int x = rows - 1; x >= 0; x--) {
+        cr_Dependency *dep;
+        cr_PackageFile *file;
+        cr_ChangelogEntry *entry;
+        gchar *name = g_strdup_printf("name_%d", x);
+
+        dep = cr_dependency_new();
+        dep->name = g_string_chunk_insert(p->chunk, name);
+        dep->flags = "EQ";
+        dep->version = "1.0";
+        p->provides = g_slist_prepend(p->provides, dep);
+
+        dep = cr_dependency_new();
+        dep->name = g_string_chunk_insert(p->chunk, name);
+        dep->pre = x % 2;
+        p->requires = g_slist_prepend(p->requires, dep);
+
+        file = cr_package_file_new();
+        file->type = (x % 3) ? "" : "dir";
+        file->path = (x % 2) ? "/etc/" : "/usr/bin/";
+        file->name = g_string_chunk_insert(p->chunk, name);
+        p->files = g_slist_prepend(p->files, file);
+
+        entry = cr_changelog_entry_new();
+        entry->author = "foo";
+        entry->date = x;
+        entry->changelog = g_string_chunk_insert(p->chunk, name);
+        p->changelogs = g_slist_prepend(p->changelogs, entry);
+
+        g_free(name);
+    }
+
+    return p;
+}
+
+
+static gint64
+query_int(sqlite3 *db, const char *query)
+{
+    sqlite3_stmt *stmt;
+    gint64 value;
+
+    g_assert_cmpint(sqlite3_prepare_v2(db, query, -1, &stmt, NULL),
+                    ==, SQLITE_OK);
+    g_assert_cmpint(sqlite3_step(stmt), ==, SQLITE_ROW);
+    value = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+
+static void
+test_cr_db_add_pkg_rows(TestData *testdata, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+
+    // Rows are inserted by statements with 32, 16, ... 1 rows
+    int rows_list[] = { 0, 1, 31, 32, 63, 100 };
+
+    for (int r = 0; r < 6; r++) {
+        GError *err = NULL;
+        int rows = rows_list[r];
+        gchar *paths[3];
+        cr_SqliteDb *dbs[3];
+        cr_Package *pkg = get_package_with_rows(rows);
+        gchar *query;
+        sqlite3 *db;
+
+        paths[0] = g_strconcat(testdata->tmp_dir, "/", TMP_PRIMARY_NAME, NULL);
+        paths[1] = g_strconcat(testdata->tmp_dir, "/", TMP_FILELISTS_NAME, NULL);
+        paths[2] = g_strconcat(testdata->tmp_dir, "/", TMP_OTHER_NAME, NULL);
+
+        for (int x = 0; x < 3; x++) {
+            dbs[x] = cr_db_open(paths[x], x, &err);
+            g_assert(dbs[x]);
+            g_assert(!err);
+            // Two packages, pkgKey of the rows must differ
+            cr_db_add_pkg(dbs[x], pkg, &err);
+            g_assert(!err);
+            cr_db_add_pkg(dbs[x], pkg, &err);
+            g_assert(!err);
+            cr_db_close(dbs[x], &err);
+            g_assert(!err);
+        }
+
+        // Primary
+
+        g_assert_cmpint(sqlite3_open(paths[0], &db), ==, SQLITE_OK);
+        g_assert_cmpint(query_int(db, "SELECT COUNT(*) FROM provides"),
+                        ==, 2 * rows);
+        g_assert_cmpint(query_int(db, "SELECT COUNT(*) FROM requires"),
+                        ==, 2 * rows);
+        g_assert_cmpint(query_int(db, "SELECT COUNT(*) FROM requires "
+                                      "WHERE pre = 'TRUE'"), ==, rows / 2 * 2);
+        // Unversioned dependencies and missing parts of versions are NULL
+        g_assert_cmpint(query_int(db, "SELECT COUNT(*) FROM requires "
+                                      "WHERE flags IS NULL "
+                                      "AND version IS NULL "
+                                      "AND epoch IS NULL "
+                                      "AND release IS NULL"), ==, 2 * rows);
+        g_assert_cmpint(query_int(db, "SELECT COUNT(*) FROM provides "
+                                      "WHERE epoch IS NULL "
+                                      "AND release IS NULL"), ==, 2 * rows);
+        // Only files from /etc/ and */bin/* are primary
+        g_assert_cmpint(query_int(db, "SELECT COUNT(*) FROM files"),
+                        ==, 2 * rows);
+        g_assert_cmpint(query_int(db, "SELECT COUNT(*) FROM files "
+                                      "WHERE type = 'dir'"),
+                        ==, 2 * ((rows + 2) / 3));
+        for (int x = 0; x < rows; x++) {
+            query = g_strdup_printf("SELECT COUNT(*) FROM provides "
+                                    "WHERE name = 'name_%d' AND flags = 'EQ' "
+                                    "AND version = '1.0' "
+                                    "AND pkgKey IN (1, 2)", x);
+            g_assert_cmpint(query_int(db, query), ==, 2);
+            g_free(query);
+        }
+        sqlite3_close(db);
+
+        // Filelists
+
+        g_assert_cmpint(sqlite3_open(paths[1], &db), ==, SQLITE_OK);
+        g_assert_cmpint(query_int(db, "SELECT COUNT(*) FROM filelist"),
+                        ==, 2 * MIN(rows, 2));
+        g_assert_cmpint(query_int(db, "SELECT SUM(LENGTH(filetypes)) "
+                                      "FROM filelist"), ==, 2 * rows);
+        sqlite3_close(db);
+
+        // Other
+
+        g_assert_cmpint(sqlite3_open(paths[2], &db), ==, SQLITE_OK);
+        g_assert_cmpint(query_int(db, "SELECT COUNT(*) FROM changelog"),
+                        ==, 2 * rows);
+        g_assert_cmpint(query_int(db, "SELECT COUNT(DISTINCT date) "
+                                      "FROM changelog WHERE pkgKey = 2"),
+                        ==, rows);
+        sqlite3_close(db);
+
+        for (int x = 0; x < 3; x++) {
+            remove(paths[x]);
+            g_free(paths[x]);
+        }
+        cr_package_free(pkg);
+    }
+}
+
+
+static void
+test_cr_db_add_pkg_perf(TestData *testdata, gconstpointer test_data)
+{
+    CR_UNUSED(test_data);
+
+    const char *names[3] = { TMP_PRIMARY_NAME,
+                             TMP_FILELISTS_NAME,
+                             TMP_OTHER_NAME };
+    GTimer *timer;
+    cr_Package *pkg;
+
+    if (!g_test_perf())
+        return;
+
+    pkg = get_package_with_rows(20);
+    timer = g_timer_new();
+
+    for (int x = 0; x < 3; x++) {
+        GError *err = NULL;
+        gchar *path = g_strconcat(testdata->tmp_dir, "/", names[x], NULL);
+        cr_SqliteDb *db;
+        gdouble elapsed;
+
+        g_timer_start(timer);
+        db = cr_db_open(path, x, &err);
+        g_assert(db);
+        for (int y = 0; y < PERF_PACKAGES; y++)
+            cr_db_add_pkg(db, pkg, NULL);
+        cr_db_close(db, &err);
+        g_assert(!err);
+        elapsed = g_timer_elapsed(timer, NULL);
+
+        g_test_message("%s: %d packages in %.3fs, %.0f packages/sec",
+                       names[x], PERF_PACKAGES, elapsed,
+                       PERF_PACKAGES / elapsed);
+        g_test_maximized_result(PERF_PACKAGES / elapsed,
+                                "%s: %.0f packages/sec",
+                                names[x], PERF_PACKAGES / elapsed);
+        g_free(path);
+    }
+
+    g_timer_destroy(timer);
+    cr_package_free(pkg);
+}
+
+
 int
 main(int argc, char *argv[])
 {
@@ -360,6 +736,9 @@ main(int argc, char *argv[])
     g_test_add("/sqlite/test_cr_db_add_primary_pkg", TestData, NULL, testdata_setup, test_cr_db_add_primary_pkg, testdata_teardown);
     g_test_add("/sqlite/test_cr_db_dbinfo_update", TestData, NULL, testdata_setup, test_cr_db_dbinfo_update, testdata_teardown);
     g_test_add("/sqlite/test_all", TestData, NULL, testdata_setup, test_all, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_add_pkg_rows", TestData, NULL, testdata_setup, test_cr_db_add_pkg_rows, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_add_pkg_perf", TestData, NULL, testdata_setup, test_cr_db_add_pkg_perf, testdata_teardown);
+    g_test_add("/sqlite/test_cr_db_close_compressed", TestData, NULL, testdata_setup, test_cr_db_close_compressed, testdata_teardown);
 
     return g_test_run();
 }
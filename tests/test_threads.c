@@ -0,0 +1,348 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2013  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/misc.h"
+#include "createrepo/threads.h"
+
+#define RING_ITEMS          5000
+#define RING_CAPACITY       8
+#define RING_PRODUCERS      6
+#define RING_CONSUMERS      3
+
+#define DAG_CHAINS          6
+#define DAG_CHAIN_LEN       4
+
+typedef struct {
+    cr_ReorderRing *ring;
+    long *items;                // Array of RING_ITEMS items
+    volatile gint freed;        // Number of items freed by consumers
+    volatile gint out_of_order; // Number of items got out of order
+} RingTestData;
+
+static void
+ring_producer(gpointer data, gpointer user_data)
+{
+    long *item = data;
+    RingTestData *test_data = user_data;
+
+    // Make the order of pushes random
+    if (g_random_int_range(0, 10) == 0)
+        g_usleep(g_random_int_range(0, 200));
+
+    cr_reorderring_push(test_data->ring, *item, item);
+}
+
+static gpointer
+ring_consumer(gpointer data)
+{
+    RingTestData *test_data = data;
+
+    for (long id = 0; id < RING_ITEMS; id++) {
+        long *item = cr_reorderring_get(test_data->ring, id);
+        if (*item != id)
+            g_atomic_int_inc(&test_data->out_of_order);
+        if (cr_reorderring_release(test_data->ring, id))
+            g_atomic_int_inc(&test_data->freed);
+    }
+
+    return NULL;
+}
+
+static void
+test_cr_reorderring(void)
+{
+    GThreadPool *pool;
+    GThread *consumers[RING_CONSUMERS];
+    RingTestData test_data;
+
+    test_data.ring = cr_reorderring_new(RING_CAPACITY, RING_CONSUMERS);
+    test_data.items = g_malloc(sizeof(long) * RING_ITEMS);
+    test_data.freed = 0;
+    test_data.out_of_order = 0;
+    g_assert(test_data.ring);
+
+    for (int x = 0; x < RING_CONSUMERS; x++)
+        consumers[x] = g_thread_create(ring_consumer, &test_data, TRUE, NULL);
+
+    pool = g_thread_pool_new(ring_producer, &test_data, RING_PRODUCERS,
+                             FALSE, NULL);
+    for (long id = 0; id < RING_ITEMS; id++) {
+        test_data.items[id] = id;
+        g_thread_pool_push(pool, &test_data.items[id], NULL);
+    }
+    g_thread_pool_free(pool, FALSE, TRUE);
+
+    for (int x = 0; x < RING_CONSUMERS; x++)
+        g_thread_join(consumers[x]);
+
+    g_assert_cmpint(test_data.out_of_order, ==, 0);
+    g_assert_cmpint(test_data.freed, ==, RING_ITEMS);
+
+    cr_reorderring_free(test_data.ring);
+    g_free(test_data.items);
+}
+
+static void
+test_cr_reorderring_null_items(void)
+{
+    cr_ReorderRing *ring = cr_reorderring_new(2, 1);
+
+    // Single thread, items pushed in order and never more than capacity
+    cr_reorderring_push(ring, 0, NULL);
+    cr_reorderring_push(ring, 1, GINT_TO_POINTER(1));
+    g_assert(cr_reorderring_get(ring, 0) == NULL);
+    g_assert(cr_reorderring_release(ring, 0));
+    cr_reorderring_push(ring, 2, GINT_TO_POINTER(2));
+    g_assert(cr_reorderring_get(ring, 1) == GINT_TO_POINTER(1));
+    g_assert(cr_reorderring_release(ring, 1));
+    g_assert(cr_reorderring_get(ring, 2) == GINT_TO_POINTER(2));
+    g_assert(cr_reorderring_release(ring, 2));
+
+    cr_reorderring_free(ring);
+}
+
+typedef struct _DagTestTask DagTestTask;
+
+struct _DagTestTask {
+    DagTestTask *dep;           // Task which must be done before this one
+    gulong sleep;               // Time to sleep in microseconds
+    gboolean fail;              // Fail instead of sleep
+    volatile gint done;         // Number of runs of the task
+    volatile gint dep_not_done; // Run before its dependency was done
+};
+
+static void
+dag_test_func(gpointer data, GError **err)
+{
+    DagTestTask *task = data;
+
+    if (task->dep && !g_atomic_int_get(&task->dep->done))
+        g_atomic_int_inc(&task->dep_not_done);
+
+    if (task->fail) {
+        g_set_error(err, CR_THREADS_ERROR, CRE_IO, "Task failed");
+        return;
+    }
+
+    g_usleep(task->sleep);
+    g_atomic_int_inc(&task->done);
+}
+
+static void
+test_cr_taskdag(void)
+{
+    DagTestTask tasks[DAG_CHAINS][DAG_CHAIN_LEN];
+    DagTestTask sink;
+    cr_DagTask *dag_tasks[DAG_CHAINS][DAG_CHAIN_LEN];
+    cr_DagTask *dag_sink;
+    cr_TaskDag *dag;
+    GError *tmp_err = NULL;
+    int ret;
+
+    memset(tasks, 0, sizeof(tasks));
+    memset(&sink, 0, sizeof(sink));
+
+    dag = cr_taskdag_new(3);
+
+    // Independent chains, the sink depends on all of them
+    dag_sink = cr_taskdag_add(dag, "sink", dag_test_func, &sink);
+    for (int c = 0; c < DAG_CHAINS; c++) {
+        for (int x = 0; x < DAG_CHAIN_LEN; x++) {
+            tasks[c][x].sleep = g_random_int_range(0, 2000);
+            if (x > 0)
+                tasks[c][x].dep = &tasks[c][x-1];
+            dag_tasks[c][x] = cr_taskdag_add(dag, "task", dag_test_func,
+                                             &tasks[c][x]);
+            cr_taskdag_depends(dag_tasks[c][x], x ? dag_tasks[c][x-1] : NULL);
+        }
+        cr_taskdag_depends(dag_sink, dag_tasks[c][DAG_CHAIN_LEN-1]);
+    }
+
+    ret = cr_taskdag_run(dag, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert(!tmp_err);
+
+    for (int c = 0; c < DAG_CHAINS; c++) {
+        for (int x = 0; x < DAG_CHAIN_LEN; x++) {
+            g_assert_cmpint(tasks[c][x].done, ==, 1);
+            g_assert_cmpint(tasks[c][x].dep_not_done, ==, 0);
+        }
+    }
+    g_assert_cmpint(sink.done, ==, 1);
+
+    cr_taskdag_free(dag);
+
+    // Empty DAG
+    dag = cr_taskdag_new(1);
+    g_assert_cmpint(cr_taskdag_run(dag, NULL), ==, CRE_OK);
+    cr_taskdag_free(dag);
+}
+
+static void
+test_cr_taskdag_error(void)
+{
+    DagTestTask tasks[DAG_CHAINS][DAG_CHAIN_LEN];
+    DagTestTask sink;
+    cr_DagTask *dag_tasks[DAG_CHAINS][DAG_CHAIN_LEN];
+    cr_DagTask *dag_sink;
+    cr_TaskDag *dag;
+    GError *tmp_err = NULL;
+    int ret;
+
+    memset(tasks, 0, sizeof(tasks));
+    memset(&sink, 0, sizeof(sink));
+
+    dag = cr_taskdag_new(2);
+
+    dag_sink = cr_taskdag_add(dag, "sink", dag_test_func, &sink);
+    for (int c = 0; c < DAG_CHAINS; c++) {
+        for (int x = 0; x < DAG_CHAIN_LEN; x++) {
+            dag_tasks[c][x] = cr_taskdag_add(dag, "task", dag_test_func,
+                                             &tasks[c][x]);
+            cr_taskdag_depends(dag_tasks[c][x], x ? dag_tasks[c][x-1] : NULL);
+        }
+        cr_taskdag_depends(dag_sink, dag_tasks[c][DAG_CHAIN_LEN-1]);
+    }
+
+    // The second task of the first chain fails
+    tasks[0][1].fail = TRUE;
+
+    ret = cr_taskdag_run(dag, &tmp_err);
+    g_assert_cmpint(ret, ==, CRE_IO);
+    g_assert(tmp_err);
+    g_assert_cmpint(tmp_err->code, ==, CRE_IO);
+    g_error_free(tmp_err);
+
+    // Its dependents (and the sink) were skipped, other chains are done
+    g_assert_cmpint(tasks[0][0].done, ==, 1);
+    for (int x = 1; x < DAG_CHAIN_LEN; x++)
+        g_assert_cmpint(tasks[0][x].done, ==, 0);
+    for (int c = 1; c < DAG_CHAINS; c++)
+        for (int x = 0; x < DAG_CHAIN_LEN; x++)
+            g_assert_cmpint(tasks[c][x].done, ==, 1);
+    g_assert_cmpint(sink.done, ==, 0);
+
+    cr_taskdag_free(dag);
+}
+
+typedef struct {
+    GMutex *mutex;
+    GCond *cond;
+    gboolean started;           // The waited task has started
+    gboolean overlapped;        // ... while the waiting task was running
+} DagOverlap;
+
+// Max time to wait for the other task (only to not hang if the tasks
+// cannot overlap)
+#define DAG_OVERLAP_TIMEOUT     10
+
+static void
+dag_overlap_wait(gpointer data, GError **err)
+{
+    DagOverlap *overlap = data;
+    GTimeVal end;
+
+    CR_UNUSED(err);
+
+    g_get_current_time(&end);
+    g_time_val_add(&end, DAG_OVERLAP_TIMEOUT * G_USEC_PER_SEC);
+
+    g_mutex_lock(overlap->mutex);
+    while (!overlap->started)
+        if (!g_cond_timed_wait(overlap->cond, overlap->mutex, &end))
+            break;
+    overlap->overlapped = overlap->started;
+    g_mutex_unlock(overlap->mutex);
+}
+
+static void
+dag_overlap_signal(gpointer data, GError **err)
+{
+    DagOverlap *overlap = data;
+
+    CR_UNUSED(err);
+
+    g_mutex_lock(overlap->mutex);
+    overlap->started = TRUE;
+    g_cond_signal(overlap->cond);
+    g_mutex_unlock(overlap->mutex);
+}
+
+static void
+test_cr_taskdag_overlap(void)
+{
+    DagTestTask tasks[2];
+    DagOverlap overlap;
+    cr_DagTask *first[2], *second[2];
+    cr_TaskDag *dag;
+
+    memset(tasks, 0, sizeof(tasks));
+    memset(&overlap, 0, sizeof(overlap));
+    overlap.mutex = g_mutex_new();
+    overlap.cond = g_cond_new();
+
+    // Two chains of two tasks. The first task of the first chain doesn't
+    // finish until the second task of the other chain starts, which is
+    // possible only if the chains overlap (phases separated by barriers
+    // would wait for the first task).
+    dag = cr_taskdag_new(2);
+    first[0] = cr_taskdag_add(dag, "wait", dag_overlap_wait, &overlap);
+    second[0] = cr_taskdag_add(dag, "task", dag_test_func, &tasks[0]);
+    first[1] = cr_taskdag_add(dag, "task", dag_test_func, &tasks[1]);
+    second[1] = cr_taskdag_add(dag, "signal", dag_overlap_signal, &overlap);
+    for (int c = 0; c < 2; c++)
+        cr_taskdag_depends(second[c], first[c]);
+
+    g_assert_cmpint(cr_taskdag_run(dag, NULL), ==, CRE_OK);
+
+    g_assert(overlap.started);
+    g_assert(overlap.overlapped);
+    g_assert_cmpint(tasks[0].done, ==, 1);
+    g_assert_cmpint(tasks[1].done, ==, 1);
+
+    cr_taskdag_free(dag);
+    g_cond_free(overlap.cond);
+    g_mutex_free(overlap.mutex);
+}
+
+int
+main(int argc, char *argv[])
+{
+    g_thread_init(NULL);
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/threads/test_cr_reorderring",
+            test_cr_reorderring);
+    g_test_add_func("/threads/test_cr_reorderring_null_items",
+            test_cr_reorderring_null_items);
+    g_test_add_func("/threads/test_cr_taskdag",
+            test_cr_taskdag);
+    g_test_add_func("/threads/test_cr_taskdag_error",
+            test_cr_taskdag_error);
+    g_test_add_func("/threads/test_cr_taskdag_overlap",
+            test_cr_taskdag_overlap);
+
+    return g_test_run();
+}
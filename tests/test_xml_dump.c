@@ -0,0 +1,247 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "fixtures.h"
+#include "createrepo/error.h"
+#include "createrepo/package.h"
+#include "createrepo/misc.h"
+#include "createrepo/load_metadata.h"
+#include "createrepo/xml_dump.h"
+#include "createrepo/xml_dump_internal.h"
+
+#define PERF_ITERATIONS     20000
+
+
+static cr_Package *
+get_package(void)
+{
+    cr_Package *pkg;
+    cr_Dependency *dep;
+    cr_PackageFile *file;
+    cr_ChangelogEntry *entry;
+
+    pkg = cr_package_new();
+    pkg->pkgId = "123456";
+    pkg->name = "foo&<bar>\"'\r\n\t";
+    pkg->arch = "x86_64";
+    pkg->version = "1.2.3";
+    pkg->epoch = NULL;
+    pkg->release = "2\xe9";
+    pkg->summary = "Foo \xc3\xa9 & <package> \r\n\"quoted\"";
+    pkg->description = "";
+    pkg->url = NULL;
+    pkg->time_file = 1234;
+    pkg->time_build = 4321;
+    pkg->rpm_license = "GPL";
+    pkg->rpm_vendor = "Vendor \xff\xfe";
+    pkg->rpm_packager = "Packager \xe2\x82\xac";
+    pkg->rpm_sourcerpm = "foo-1.2.3-2.src.rpm";
+    pkg->rpm_header_start = 280;
+    pkg->rpm_header_end = 2000;
+    pkg->size_package = 4000;
+    pkg->size_installed = 8000;
+    pkg->size_archive = 9000;
+    pkg->location_href = "packages/foo&bar-\xc3\xa9.rpm";
+    pkg->location_base = "file:///\"base\"";
+    pkg->checksum_type = "sha256";
+
+    dep = cr_dependency_new();
+    dep->name = "bar<&>";
+    dep->flags = "GE";
+    dep->epoch = "0";
+    dep->version = "1.0\xc3\xa9";
+    dep->release = "1\"";
+    dep->pre = 1;
+    pkg->requires = g_slist_prepend(pkg->requires, dep);
+
+    dep = cr_dependency_new();
+    dep->name = "";
+    pkg->requires = g_slist_prepend(pkg->requires, dep);
+
+    dep = cr_dependency_new();
+    dep->name = "foo\t\n";
+    dep->flags = "EQ";
+    dep->version = "1.2.3";
+    pkg->provides = g_slist_prepend(pkg->provides, dep);
+
+    file = cr_package_file_new();
+    file->type = "ghost";
+    file->path = "/var/lib/";
+    file->name = "foo\r";
+    pkg->files = g_slist_prepend(pkg->files, file);
+
+    file = cr_package_file_new();
+    file->type = "dir";
+    file->path = "/etc/";
+    file->name = "foo\xe9";
+    pkg->files = g_slist_prepend(pkg->files, file);
+
+    file = cr_package_file_new();
+    file->path = "/usr/bin/";
+    file->name = "foo&bar";
+    pkg->files = g_slist_prepend(pkg->files, file);
+
+    entry = cr_changelog_entry_new();
+    entry->author = NULL;
+    entry->date = 0;
+    entry->changelog = NULL;
+    pkg->changelogs = g_slist_prepend(pkg->changelogs, entry);
+
+    entry = cr_changelog_entry_new();
+    entry->author = "Foo Bar <foo@bar.org> \xe9 - 1.2.3-2";
+    entry->date = 1234567;
+    entry->changelog = "- Rebuild & <fix>\r\n\xff";
+    pkg->changelogs = g_slist_prepend(pkg->changelogs, entry);
+
+    return pkg;
+}
+
+
+static void
+compare_with_dom(cr_Package *pkg)
+{
+    char *stream, *dom;
+
+    stream = cr_xml_dump_primary(pkg, NULL);
+    dom = cr_xml_dump_primary_dom(pkg, NULL);
+    g_assert_cmpstr(stream, ==, dom);
+    g_free(stream);
+    g_free(dom);
+
+    stream = cr_xml_dump_filelists(pkg, NULL);
+    dom = cr_xml_dump_filelists_dom(pkg, NULL);
+    g_assert_cmpstr(stream, ==, dom);
+    g_free(stream);
+    g_free(dom);
+
+    stream = cr_xml_dump_other(pkg, NULL);
+    dom = cr_xml_dump_other_dom(pkg, NULL);
+    g_assert_cmpstr(stream, ==, dom);
+    g_free(stream);
+    g_free(dom);
+}
+
+
+static void
+test_cr_xml_dump_empty_package(void)
+{
+    cr_Package *pkg = cr_package_new();
+    compare_with_dom(pkg);
+    cr_package_free(pkg);
+}
+
+
+static void
+test_cr_xml_dump_special_chars(void)
+{
+    cr_Package *pkg = get_package();
+    compare_with_dom(pkg);
+
+    // Header range end 0 and obsoletes/conflicts
+    pkg->rpm_header_end = 0;
+    pkg->obsoletes = pkg->provides;
+    pkg->conflicts = pkg->requires;
+    compare_with_dom(pkg);
+    pkg->obsoletes = NULL;
+    pkg->conflicts = NULL;
+
+    cr_package_free(pkg);
+}
+
+
+static void
+test_cr_xml_dump_repo_02(void)
+{
+    int ret;
+    GHashTableIter iter;
+    gpointer key, value;
+    cr_Metadata *md;
+
+    md = cr_metadata_new(CR_HT_KEY_HASH, 0, NULL);
+    ret = cr_metadata_locate_and_load_xml(md, TEST_REPO_02, NULL);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert_cmpint(g_hash_table_size(cr_metadata_hashtable(md)), ==, 2);
+
+    g_hash_table_iter_init(&iter, cr_metadata_hashtable(md));
+    while (g_hash_table_iter_next(&iter, &key, &value))
+        compare_with_dom((cr_Package *) value);
+
+    cr_metadata_free(md);
+}
+
+
+static void
+test_cr_xml_dump_perf(void)
+{
+    GTimer *timer;
+    gdouble stream_time, dom_time;
+    cr_Package *pkg = get_package();
+
+    if (!g_test_perf())
+        return;
+
+    timer = g_timer_new();
+    for (int x = 0; x < PERF_ITERATIONS; x++) {
+        g_free(cr_xml_dump_primary_dom(pkg, NULL));
+        g_free(cr_xml_dump_filelists_dom(pkg, NULL));
+        g_free(cr_xml_dump_other_dom(pkg, NULL));
+    }
+    dom_time = g_timer_elapsed(timer, NULL);
+
+    g_timer_start(timer);
+    for (int x = 0; x < PERF_ITERATIONS; x++) {
+        g_free(cr_xml_dump_primary(pkg, NULL));
+        g_free(cr_xml_dump_filelists(pkg, NULL));
+        g_free(cr_xml_dump_other(pkg, NULL));
+    }
+    stream_time = g_timer_elapsed(timer, NULL);
+
+    g_test_message("%d packages: libxml2 tree %.3fs, stream %.3fs",
+                   PERF_ITERATIONS, dom_time, stream_time);
+    g_test_minimized_result(stream_time, "Stream dump of %d packages: %.3fs",
+                            PERF_ITERATIONS, stream_time);
+
+    g_timer_destroy(timer);
+    cr_package_free(pkg);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+    g_thread_init(NULL);
+    cr_xml_dump_init();
+
+    g_test_add_func("/xml_dump/test_cr_xml_dump_empty_package",
+            test_cr_xml_dump_empty_package);
+    g_test_add_func("/xml_dump/test_cr_xml_dump_special_chars",
+            test_cr_xml_dump_special_chars);
+    g_test_add_func("/xml_dump/test_cr_xml_dump_repo_02",
+            test_cr_xml_dump_repo_02);
+    g_test_add_func("/xml_dump/test_cr_xml_dump_perf",
+            test_cr_xml_dump_perf);
+
+    int ret = g_test_run();
+    cr_xml_dump_cleanup();
+    return ret;
+}
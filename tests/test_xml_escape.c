@@ -0,0 +1,228 @@
+/* createrepo_c - Library of routines for manipulation with repodata
+ * Copyright (C) 2012  Tomas Mlcoch
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+ * USA.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "createrepo/xml_escape_internal.h"
+
+#define PERF_ITERATIONS     200000
+
+static const cr_XmlEscapeImpl IMPLS[] = {
+    CR_XML_ESCAPE_IMPL_SCALAR,
+    CR_XML_ESCAPE_IMPL_SSE2,
+    CR_XML_ESCAPE_IMPL_AVX2,
+};
+
+static const char *IMPL_NAMES[] = { "scalar", "sse2", "avx2" };
+
+typedef struct {
+    const char *in;
+    int flags;
+    gboolean valid;
+    const char *out;
+} EscapeTest;
+
+static const EscapeTest ESCAPE_TESTS[] = {
+    { "", CR_XML_ESCAPE_TEXT, TRUE, "" },
+    { "foo", CR_XML_ESCAPE_TEXT, TRUE, "foo" },
+    { "a<b>&c\r\n\t\"", CR_XML_ESCAPE_TEXT, TRUE,
+      "a&lt;b&gt;&amp;c&#13;\n\t\"" },
+    { "a<b>&c\r\n\t\"", CR_XML_ESCAPE_ATTR, TRUE,
+      "a&lt;b&gt;&amp;c&#13;&#10;&#9;&quot;" },
+    { "caf\xc3\xa9 \xe2\x82\xac", CR_XML_ESCAPE_TEXT, TRUE,
+      "caf\xc3\xa9 \xe2\x82\xac" },
+    { "caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80", CR_XML_ESCAPE_ATTR, TRUE,
+      "caf&#xE9; &#x20AC; &#x1F600;" },
+    { "caf\xe9", CR_XML_ESCAPE_TEXT, FALSE, NULL },
+    { "caf\xe9", CR_XML_ESCAPE_ATTR, FALSE, NULL },
+    { "\xc3", CR_XML_ESCAPE_TEXT, FALSE, NULL },
+    { "caf\xe9", CR_XML_ESCAPE_TEXT | CR_XML_ESCAPE_NOCHECK, TRUE,
+      "caf\xe9" },
+    // libxml2 keeps the last byte of an attribute as is
+    { "caf\xe9", CR_XML_ESCAPE_ATTR | CR_XML_ESCAPE_NOCHECK, TRUE,
+      "caf\xe9" },
+    { "\xff<", CR_XML_ESCAPE_ATTR | CR_XML_ESCAPE_NOCHECK, TRUE,
+      "&#xFF;&lt;" },
+    // Not allowed characters are written byte by byte
+    { "\xef\xbf\xbe.", CR_XML_ESCAPE_ATTR, TRUE, "&#xEF;&#xBF;&#xBE;." },
+};
+
+
+static void
+check_escape_tests(void)
+{
+    GString *buf = g_string_new(NULL);
+    char *str = g_malloc(256);
+
+    for (size_t x = 0; x < G_N_ELEMENTS(ESCAPE_TESTS); x++) {
+        const EscapeTest *test = &ESCAPE_TESTS[x];
+
+        // Every alignment of the string and special chars at positions
+        // around the SIMD block boundaries
+        for (int offset = 0; offset < 64; offset++) {
+            gboolean ret;
+            char *prefix = g_strnfill(offset, 'x');
+
+            strcpy(str, prefix);
+            strcat(str, test->in);
+
+            g_string_assign(buf, "prev");
+            ret = cr_xml_escape(buf, str + (offset % 32), test->flags);
+            g_assert_cmpint(ret, ==, test->valid);
+            if (test->valid) {
+                g_assert(g_str_has_prefix(buf->str, "prev"));
+                g_assert(g_str_has_prefix(buf->str + 4,
+                                          prefix + (offset % 32)));
+                g_assert_cmpstr(buf->str + 4 + offset - (offset % 32),
+                                ==, test->out);
+            } else {
+                // Buffer is untouched
+                g_assert_cmpstr(buf->str, ==, "prev");
+            }
+
+            g_free(prefix);
+        }
+    }
+
+    g_free(str);
+    g_string_free(buf, TRUE);
+}
+
+
+static void
+test_cr_xml_escape(void)
+{
+    for (size_t x = 0; x < G_N_ELEMENTS(IMPLS); x++) {
+        if (!cr_xml_escape_set_impl(IMPLS[x])) {
+            g_test_message("%s is not supported", IMPL_NAMES[x]);
+            continue;
+        }
+        check_escape_tests();
+    }
+
+    cr_xml_escape_set_impl(CR_XML_ESCAPE_IMPL_AUTO);
+}
+
+
+static void
+test_cr_xml_escape_random(void)
+{
+    static const char alphabet[] = "ab<>&\"\r\n\t \x80\xc3\xa9\xe2\x82\xac"
+                                   "\xf0\x9f\x98\x80\xff";
+    GRand *rand = g_rand_new_with_seed(42);
+    GString *expected = g_string_new(NULL);
+    GString *buf = g_string_new(NULL);
+    char str[128];
+
+    for (int x = 0; x < 10000; x++) {
+        int len = g_rand_int_range(rand, 0, sizeof(str));
+        int flags = g_rand_int_range(rand, 0, 4);
+        gboolean valid;
+
+        for (int y = 0; y < len - 1; y++)
+            str[y] = g_rand_int_range(rand, 0, 3)
+                        ? g_rand_int_range(rand, 'a', 'z')
+                        : alphabet[g_rand_int_range(rand, 0,
+                                                    sizeof(alphabet) - 1)];
+        str[MAX(len - 1, 0)] = '\0';
+
+        cr_xml_escape_set_impl(CR_XML_ESCAPE_IMPL_SCALAR);
+        g_string_truncate(expected, 0);
+        valid = cr_xml_escape(expected, str, flags);
+
+        for (size_t i = 1; i < G_N_ELEMENTS(IMPLS); i++) {
+            if (!cr_xml_escape_set_impl(IMPLS[i]))
+                continue;
+            g_string_truncate(buf, 0);
+            g_assert_cmpint(cr_xml_escape(buf, str, flags), ==, valid);
+            g_assert_cmpstr(buf->str, ==, expected->str);
+        }
+    }
+
+    cr_xml_escape_set_impl(CR_XML_ESCAPE_IMPL_AUTO);
+    g_string_free(expected, TRUE);
+    g_string_free(buf, TRUE);
+    g_rand_free(rand);
+}
+
+
+static void
+test_cr_xml_escape_perf(void)
+{
+    GString *text = g_string_new(NULL);
+    GString *buf = g_string_new(NULL);
+    GTimer *timer;
+
+    if (!g_test_perf())
+        return;
+
+    // Description like text with a few special chars
+    for (int x = 0; x < 8; x++)
+        g_string_append(text, "This package contains a library for "
+                        "manipulation with the <repodata> & its files. "
+                        "It is used by createrepo_c and mergerepo_c.\n");
+
+    timer = g_timer_new();
+    for (size_t x = 0; x < G_N_ELEMENTS(IMPLS); x++) {
+        gdouble elapsed;
+
+        if (!cr_xml_escape_set_impl(IMPLS[x]))
+            continue;
+
+        for (int flags = CR_XML_ESCAPE_TEXT; flags <= CR_XML_ESCAPE_ATTR;
+             flags++) {
+            g_timer_start(timer);
+            for (int y = 0; y < PERF_ITERATIONS; y++) {
+                g_string_truncate(buf, 0);
+                cr_xml_escape(buf, text->str, flags);
+            }
+            elapsed = g_timer_elapsed(timer, NULL);
+
+            g_test_message("%s %s: %.1f MB/s", IMPL_NAMES[x],
+                           flags ? "attr" : "text",
+                           text->len * (gdouble) PERF_ITERATIONS
+                           / elapsed / (1024 * 1024));
+            g_test_minimized_result(elapsed, "%s %s: %.3fs", IMPL_NAMES[x],
+                                    flags ? "attr" : "text", elapsed);
+        }
+    }
+
+    cr_xml_escape_set_impl(CR_XML_ESCAPE_IMPL_AUTO);
+    g_timer_destroy(timer);
+    g_string_free(text, TRUE);
+    g_string_free(buf, TRUE);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/xml_escape/test_cr_xml_escape",
+            test_cr_xml_escape);
+    g_test_add_func("/xml_escape/test_cr_xml_escape_random",
+            test_cr_xml_escape_random);
+    g_test_add_func("/xml_escape/test_cr_xml_escape_perf",
+            test_cr_xml_escape_perf);
+
+    return g_test_run();
+}
@@ -38,6 +38,23 @@ pkgcb(cr_Package *pkg, void *cbdata, GError **err)
     return CR_CB_RET_OK;
 }
 
+static int
+pkgcb_raw(cr_Package *pkg, void *cbdata, GError **err)
+{
+    g_assert(pkg);
+    g_assert(!err || *err == NULL);
+    g_assert_cmpstr(pkg->xml_filelists, ==,
+        "<package pkgid=\"152824bff2aa6d54f429d43e87a3ff3a0286505c6d93ec87692b5e3a9e3b97bf\" name=\"super_kernel\" arch=\"x86_64\">\n"
+        "    <version epoch=\"0\" ver=\"6.0.1\" rel=\"2\"/>\n"
+        "\n"
+        "    <file>/usr/bin/super_kernel</file>\n"
+        "    <file>/usr/share/man/super_kernel.8.gz</file>\n"
+        "</package>\n");
+    if (cbdata) *((int *)cbdata) += 1;
+    cr_package_free(pkg);
+    return CR_CB_RET_OK;
+}
+
 static int
 pkgcb_interrupt(cr_Package *pkg, void *cbdata, GError **err)
 {
@@ -157,6 +174,19 @@ test_cr_xml_parse_filelists_01(void)
     g_assert_cmpint(parsed, ==, 1);
 }
 
+static void
+test_cr_xml_parse_filelists_raw(void)
+{
+    int parsed = 0;
+    GError *tmp_err = NULL;
+    int ret = cr_xml_parse_filelists_raw(TEST_REPO_01_FILELISTS, NULL, NULL,
+                                         pkgcb_raw, &parsed, NULL, NULL,
+                                         &tmp_err);
+    g_assert(tmp_err == NULL);
+    g_assert_cmpint(ret, ==, CRE_OK);
+    g_assert_cmpint(parsed, ==, 1);
+}
+
 static void
 test_cr_xml_parse_filelists_02(void)
 {
@@ -333,6 +363,8 @@ main(int argc, char *argv[])
                     test_cr_xml_parse_filelists_unknown_element_01);
     g_test_add_func("/xml_parser_filelists/test_cr_xml_parse_filelists_unknown_element_02",
                     test_cr_xml_parse_filelists_unknown_element_02);
+    g_test_add_func("/xml_parser_filelists/test_cr_xml_parse_filelists_raw",
+            test_cr_xml_parse_filelists_raw);
     g_test_add_func("/xml_parser_filelists/test_cr_xml_parse_filelists_no_pgkid",
                     test_cr_xml_parse_filelists_no_pkgid);
     g_test_add_func("/xml_parser_filelists/test_cr_xml_parse_filelists_skip_fake_bash_00",
@@ -30,18 +30,6 @@ if [ $# -eq "2" ]; then
     fi
 fi
 
-if $CLEAR_CACHE; then
-    if [ `id --user` != "0" ]; then
-        echo "Note:"
-        echo "You are not root!"
-        echo "For cleaning disk caches you have to have a root permissions."
-        echo "You will be asked for sudo password."
-        echo "(Maybe even several times)"
-        sudo bash -c "echo \"OK\""
-        echo
-    fi
-fi
-
 REPO=$1
 
 if [ ! -d "$REPO" ]; then
@@ -53,16 +41,22 @@ fi
 
 function clear_cache {
     # Clear cache if CLEAR_CACHE is true
+    # Only packages of the repo are dropped from the page cache
+    # (POSIX_FADV_DONTNEED), so root permissions are not needed
 
     if ! $CLEAR_CACHE; then
         return
     fi
 
-    if [ `id --user` != "0" ]; then
-        sudo bash -c "echo 3 > /proc/sys/vm/drop_caches"
-    else
-        echo 3 > /proc/sys/vm/drop_caches
-    fi
+    find "$REPO" -name "*.rpm" -type f -print0 | \
+        xargs -0 -r -n 64 sh -c \
+        'for f; do dd if="$f" iflag=nocache count=0 status=none; done' sh
+}
+
+function warm_cache {
+    # Read all packages of the repo into the page cache
+
+    find "$REPO" -name "*.rpm" -type f -print0 | xargs -0 -r cat > /dev/null
 }
 
 function run {
@@ -142,6 +136,41 @@ echo "+ Without sqlite DB"
 echo "+----------------------+"
 dirty_run "--update --no-database"
 
+echo "Case-3: createrepo_c with cold and warm page cache"
+echo "+---------------------------------------------------------------+"
+for OPTS in "" "--prefetch 64" "--prefetch 64 --drop-pkgs-cache" \
+            "--read-engine auto"
+do
+    for CACHE in cold warm; do
+        rm -rf "$REPO"/.repodata
+        rm -rf "$REPO"/repodata
+        echo -e "\n\$ createrepo_c $OPTS $REPO ($CACHE cache)"
+        if [ "$CACHE" == "cold" ]; then
+            clear_cache
+        else
+            warm_cache
+        fi
+        (time createrepo_c --no-database $OPTS "$REPO") 2>&1
+    done
+done
+echo
+
+echo "Case-4: createrepo_c packages/sec with and without sqlite DB (warm cache)"
+echo "+---------------------------------------------------------------+"
+PACKAGES=`find "$REPO" -name "*.rpm" -type f | wc -l`
+for OPTS in "--no-database" "--database" "--database --sqlite-in-memory"; do
+    rm -rf "$REPO"/.repodata
+    rm -rf "$REPO"/repodata
+    warm_cache
+    START=`date +%s.%N`
+    createrepo_c --quiet $OPTS "$REPO"
+    END=`date +%s.%N`
+    awk -v opts="$OPTS" -v start="$START" -v end="$END" -v pkgs="$PACKAGES" \
+        'BEGIN { printf "%-30s %8.2f s %10.1f packages/sec\n",
+                 opts, end - start, pkgs / (end - start) }'
+done
+echo
+
 # Final clean up
 
 rm -rf "$REPO"/repodata